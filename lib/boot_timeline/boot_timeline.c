@@ -0,0 +1,140 @@
+#include <stdio.h>
+#include <string.h>
+#include "boot_timeline.h"
+#include "../mesh_tx/mesh_tx.h"
+#include "../mesh_dispatch/mesh_dispatch.h"
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "freertos/semphr.h"
+
+#define FIRST_MILESTONE BOOT_PHASE_PARENT_CONNECTED
+
+_Static_assert(sizeof(BootReport_t) <= MESH_TX_MTU - WIRE_MAX_OVERHEAD, "BOOT_REPORT fits one packet");
+
+static const char *TAG = "boot_timeline";
+
+static const char *const s_names[BOOT_PHASE_COUNT] = {
+    [BOOT_PHASE_DELAY] = "delay",
+    [BOOT_PHASE_CONFIG] = "config",
+    [BOOT_PHASE_FINGERPRINT] = "fingerprint",
+    [BOOT_PHASE_NETIF] = "netif",
+    [BOOT_PHASE_BATTERY] = "battery",
+    [BOOT_PHASE_MESH_TX] = "mesh_tx",
+    [BOOT_PHASE_SERIAL] = "serial",
+    [BOOT_PHASE_ANTENNA] = "antenna",
+    [BOOT_PHASE_WIFI] = "wifi",
+    [BOOT_PHASE_MESH_CONFIG] = "mesh_config",
+    [BOOT_PHASE_OTA] = "ota",
+    [BOOT_PHASE_MESH_START] = "mesh_start",
+    [BOOT_PHASE_PARENT_CONNECTED] = "parent",
+    [BOOT_PHASE_GOT_IP] = "ip",
+    [BOOT_PHASE_FIRST_CORRECTION] = "correction",
+};
+
+// Milliseconds since the app started, 0: not marked
+static uint32_t s_start_ms[BOOT_PHASE_COUNT];
+static uint32_t s_end_ms[BOOT_PHASE_COUNT];
+static uint8_t s_flags;
+static uint8_t s_reset_reason;
+
+static SemaphoreHandle_t s_mutex;   // s_root, between the mesh event task and the milestone callers
+static mesh_addr_t s_root;
+static bool s_have_root;
+
+static uint32_t now_ms(void) {
+    uint32_t ms = (uint32_t)(esp_timer_get_time() / 1000);
+    return ms ? ms : 1;
+}
+
+// Keep the first mark only
+static bool mark(uint32_t *slot) {
+    if (__atomic_load_n(slot, __ATOMIC_RELAXED) != 0) {
+        return false;
+    }
+    uint32_t unset = 0;
+    return __atomic_compare_exchange_n(slot, &unset, now_ms(), false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
+static void log_report(const char *who, const BootReport_t *r) {
+    char line[320];
+    int len = 0;
+    for (int i = 0; i < FIRST_MILESTONE && len < (int)sizeof(line); i++) {
+        if (r->end_ms[i] != 0) {
+            len += snprintf(line + len, sizeof(line) - len, " %s %lu+%lu", s_names[i], r->start_ms[i],
+                            r->end_ms[i] - r->start_ms[i]);
+        }
+    }
+    ESP_LOGI(TAG, "%s boot, reset reason:%u%s, phases (ms):%s", who, r->reset_reason,
+             (r->flags & BOOT_FLAG_FAST) ? " fast" : "", len ? line : " none");
+    len = 0;
+    for (int i = FIRST_MILESTONE; i < BOOT_PHASE_COUNT && len < (int)sizeof(line); i++) {
+        if (r->end_ms[i] != 0) {
+            len += snprintf(line + len, sizeof(line) - len, " %s %lu", s_names[i], r->end_ms[i]);
+        }
+    }
+    ESP_LOGI(TAG, "%s milestones (ms):%s", who, len ? line : " none");
+}
+
+static void publish(void) {
+    static BootReport_t report;     // Published from several tasks; always rebuilt in full under s_mutex
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    if (!s_have_root) {
+        xSemaphoreGive(s_mutex);
+        return;
+    }
+    report = (BootReport_t){ .reset_reason = s_reset_reason, .flags = s_flags };
+    for (int i = 0; i < BOOT_PHASE_COUNT; i++) {
+        report.start_ms[i] = __atomic_load_n(&s_start_ms[i], __ATOMIC_RELAXED);
+        report.end_ms[i] = __atomic_load_n(&s_end_ms[i], __ATOMIC_RELAXED);
+    }
+    if (esp_mesh_is_root()) {
+        log_report("This node", &report);
+    } else {
+        // Copied into the TX queue before the mutex is released
+        esp_err_t err = mesh_tx_send(MESH_TX_CONTROL, &s_root, MESH_DATA_P2P, BOOT_REPORT, &report, sizeof(report));
+        if (err != ESP_OK) {
+            ESP_LOGW(TAG, "Failed to send BOOT_REPORT: 0x%x", err);
+        }
+    }
+    xSemaphoreGive(s_mutex);
+}
+
+void boot_timeline_start(bool fast) {
+    s_mutex = xSemaphoreCreateMutex();
+    s_flags = fast ? BOOT_FLAG_FAST : 0;
+    s_reset_reason = (uint8_t)esp_reset_reason();
+}
+
+void boot_timeline_begin(boot_phase_t phase) {
+    mark(&s_start_ms[phase]);
+}
+
+void boot_timeline_end(boot_phase_t phase) {
+    if (mark(&s_end_ms[phase]) && phase >= FIRST_MILESTONE) {
+        publish();
+    }
+}
+
+void boot_timeline_set_root(const mesh_addr_t *root) {
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    s_root = *root;
+    s_have_root = true;
+    xSemaphoreGive(s_mutex);
+    publish();
+}
+
+static void handle_report(const mesh_addr_t *from, const void *payload, size_t payload_len, pkt_buf_t *buf,
+                          void *arg) {
+    BootReport_t report;
+    memcpy(&report, payload, sizeof(report));
+    char who[24];
+    snprintf(who, sizeof(who), "Node "MACSTR, MAC2STR(from->addr));
+    log_report(who, &report);
+}
+
+esp_err_t boot_timeline_register(void) {
+    return mesh_dispatch_register(BOOT_REPORT, "BOOT_REPORT", sizeof(BootReport_t), sizeof(BootReport_t),
+                                  handle_report, NULL);
+}
@@ -0,0 +1,53 @@
+#ifndef BOOT_TIMELINE_H
+#define BOOT_TIMELINE_H
+
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_mesh.h"
+#include "../protocol/protocol.h"
+
+/*
+Boot timeline: when each init phase of app_main began and ended, and when the node reached the
+milestones that follow (boot_phase_t), in esp_timer milliseconds since the app started.
+
+app_main brackets every phase with boot_timeline_begin()/boot_timeline_end(); the milestones are
+marked with boot_timeline_end() alone, from wherever they happen (mesh and IP event handlers, the
+correction paths). Only the first mark of each entry is kept, so a milestone reached again after a
+reconnect keeps its boot time, and marking costs an atomic load once an entry is set.
+
+Once the node knows the root (boot_timeline_set_root()) and again at each milestone after that, the
+timeline is published: a non-root node sends it to the root as a BOOT_REPORT (BootReport_t), and
+the root logs it, its own and every report it receives, which the base also ships to the log server
+once it has an IP. One line lists the phases as "name start+duration", the next the milestones.
+*/
+
+/**
+ * @brief Start the timeline. Call first thing in app_main.
+ *
+ * @param fast Fast boot: the phases overlap (BOOT_FLAG_FAST in the report).
+ */
+void boot_timeline_start(bool fast);
+
+/**
+ * @brief Mark the start of an init phase. Safe from any task.
+ */
+void boot_timeline_begin(boot_phase_t phase);
+
+/**
+ * @brief Mark the end of an init phase, or a milestone as reached. Safe from any task.
+ *
+ * Reaching a milestone for the first time publishes the timeline.
+ */
+void boot_timeline_end(boot_phase_t phase);
+
+/**
+ * @brief The root is known (MESH_EVENT_ROOT_ADDRESS): publish the timeline to it.
+ */
+void boot_timeline_set_root(const mesh_addr_t *root);
+
+/**
+ * @brief Register the BOOT_REPORT handler, which logs the reports of other nodes on the root.
+ */
+esp_err_t boot_timeline_register(void);
+
+#endif // BOOT_TIMELINE_H
@@ -0,0 +1,227 @@
+#include <math.h>
+#include <stdlib.h>
+#include "enu_frame.h"
+#include "../seqlock/seqlock.h"
+
+// WGS84
+#define WGS84_A     6378137.0
+#define WGS84_F     (1.0 / 298.257223563)
+#define WGS84_E2    (WGS84_F * (2.0 - WGS84_F))
+
+#define Q62_ONE     (1LL << 62)
+#define Q8          256.0           // Internal length unit: 1/256 of 0.1 mm
+#define M_TO_Q8     (1e4 * Q8)
+
+// Current frame: written by the task that receives the reference, read lock-free from anywhere
+static seqlock_t s_lock = SEQLOCK_INIT;
+static enu_frame_t s_bufs[2];
+static bool s_have_ref;
+static int64_t s_ref[3];
+
+// (a * b) >> shift, rounded half away from zero, for 1 <= shift <= 63. The 128 bit product is built
+// from 32 bit halves (no __int128 on RV32); the result must fit in 63 bits.
+static int64_t mul_shift(int64_t a, int64_t b, unsigned shift) {
+    bool neg = (a < 0) != (b < 0);
+    uint64_t ua = a < 0 ? -(uint64_t)a : (uint64_t)a;
+    uint64_t ub = b < 0 ? -(uint64_t)b : (uint64_t)b;
+    uint64_t a_lo = (uint32_t)ua, a_hi = ua >> 32;
+    uint64_t b_lo = (uint32_t)ub, b_hi = ub >> 32;
+
+    uint64_t ll = a_lo * b_lo;
+    uint64_t lh = a_lo * b_hi;
+    uint64_t hl = a_hi * b_lo;
+    uint64_t mid = (ll >> 32) + (uint32_t)lh + (uint32_t)hl;
+    uint64_t lo = (mid << 32) | (uint32_t)ll;
+    uint64_t hi = a_hi * b_hi + (lh >> 32) + (hl >> 32) + (mid >> 32);
+
+    uint64_t half = 1ULL << (shift - 1);
+    lo += half;
+    if (lo < half) {
+        hi++;
+    }
+    uint64_t r = (hi << (64 - shift)) | (lo >> shift);
+    return neg ? -(int64_t)r : (int64_t)r;
+}
+
+static inline int64_t mul_q62(int64_t a, int64_t b) {
+    return mul_shift(a, b, 62);
+}
+
+// Small-angle sine and cosine, Q62 in and out. Good to the last bit for |x| < 0.02 rad
+// (1.15 deg: half of ENU_FRAME_MAX_DELTA_E9 is less).
+static int64_t sin_q62(int64_t x) {
+    int64_t x2 = mul_q62(x, x);
+    int64_t t = Q62_ONE - mul_q62(x2, Q62_ONE / 72);
+    t = Q62_ONE - mul_q62(x2, t) / 42;
+    t = Q62_ONE - mul_q62(x2, t) / 20;
+    t = Q62_ONE - mul_q62(x2, t) / 6;
+    return mul_q62(x, t);
+}
+
+static int64_t cos_q62(int64_t x) {
+    int64_t x2 = mul_q62(x, x);
+    int64_t t = Q62_ONE - mul_q62(x2, Q62_ONE / 56);
+    t = Q62_ONE - mul_q62(x2, t) / 30;
+    t = Q62_ONE - mul_q62(x2, t) / 12;
+    return Q62_ONE - mul_q62(x2, t) / 2;
+}
+
+static int64_t to_q62(double v) {
+    return llround(ldexp(v, 62));
+}
+
+// 1/256 0.1 mm to 0.1 mm, rounded
+static int32_t round_q8(int64_t v) {
+    return (int32_t)((v + 128) >> 8);
+}
+
+static bool in_range(int64_t v) {
+    return v >= -ENU_FRAME_MAX_RANGE && v <= ENU_FRAME_MAX_RANGE;
+}
+
+void enu_frame_init(enu_frame_t *frame, int64_t x, int64_t y, int64_t z) {
+    *frame = (enu_frame_t){ .ref_x = x, .ref_y = y, .ref_z = z };
+    double X = x * 1e-4, Y = y * 1e-4, Z = z * 1e-4;
+
+    // Geodetic latitude by fixed-point iteration (converges to well below 1e-9 deg in a few rounds)
+    double p = hypot(X, Y);
+    double lat = atan2(Z, p * (1.0 - WGS84_E2));
+    double h = 0.0;
+    for (int i = 0; i < 8; i++) {
+        double s = sin(lat);
+        double n = WGS84_A / sqrt(1.0 - WGS84_E2 * s * s);
+        h = p * cos(lat) + Z * s - WGS84_A * WGS84_A / n;
+        lat = atan2(Z, p * (1.0 - WGS84_E2 * n / (n + h)));
+    }
+    double lon = atan2(Y, X);
+
+    // Expand around the nearest grid point of the LLH messages, so latitude/longitude differences are exact integers
+    frame->lat0_e9 = llround(lat * 180.0 / M_PI * 1e9);
+    frame->lon0_e9 = llround(lon * 180.0 / M_PI * 1e9);
+    int64_t h0 = llround(h * 1e4);
+    frame->h0_q8 = h0 * 256;
+    double lat0 = frame->lat0_e9 * 1e-9 * M_PI / 180.0;
+    double lon0 = frame->lon0_e9 * 1e-9 * M_PI / 180.0;
+    double h0_m = h0 * 1e-4;
+
+    double sl = sin(lat0), cl = cos(lat0), so = sin(lon0), co = cos(lon0);
+    double n0 = WGS84_A / sqrt(1.0 - WGS84_E2 * sl * sl);
+    const double rot[3][3] = {
+        { -so,       co,       0.0 },
+        { -sl * co,  -sl * so, cl  },
+        { cl * co,   cl * so,  sl  },
+    };
+    for (int r = 0; r < 3; r++) {
+        for (int c = 0; c < 3; c++) {
+            frame->rot[r][c] = to_q62(rot[r][c]);
+        }
+    }
+    frame->sin_lat = to_q62(sl);
+    frame->cos_lat = to_q62(cl);
+    frame->sin_lon = to_q62(so);
+    frame->cos_lon = to_q62(co);
+    frame->one_minus_e2 = to_q62(1.0 - WGS84_E2);
+    frame->w_scale = to_q62(2.0 * WGS84_E2 / (1.0 - WGS84_E2 * sl * sl));
+    frame->rad_per_e9_q94 = llround(ldexp(M_PI / 180e9, 94));
+    frame->n0_q8 = llround(n0 * M_TO_Q8);
+
+    // Where the expansion point is in the frame (under 0.1 mm horizontally, 0.05 mm vertically)
+    double d[3] = {
+        (n0 + h0_m) * cl * co - X,
+        (n0 + h0_m) * cl * so - Y,
+        (n0 * (1.0 - WGS84_E2) + h0_m) * sl - Z,
+    };
+    frame->grid_e_q8 = llround((rot[0][0] * d[0] + rot[0][1] * d[1] + rot[0][2] * d[2]) * M_TO_Q8);
+    frame->grid_n_q8 = llround((rot[1][0] * d[0] + rot[1][1] * d[1] + rot[1][2] * d[2]) * M_TO_Q8);
+    frame->grid_u_q8 = llround((rot[2][0] * d[0] + rot[2][1] * d[1] + rot[2][2] * d[2]) * M_TO_Q8);
+}
+
+bool enu_from_ecef(const enu_frame_t *frame, int64_t x, int64_t y, int64_t z, enu_pos_t *pos) {
+    int64_t d[3] = { x - frame->ref_x, y - frame->ref_y, z - frame->ref_z };
+    if (!in_range(d[0]) || !in_range(d[1]) || !in_range(d[2])) {
+        return false;
+    }
+    int32_t out[3];
+    for (int r = 0; r < 3; r++) {
+        int64_t sum = 0;
+        for (int c = 0; c < 3; c++) {
+            sum += mul_q62(d[c] * 256, frame->rot[r][c]);
+        }
+        out[r] = round_q8(sum);
+    }
+    pos->e = out[0];
+    pos->n = out[1];
+    pos->u = out[2];
+    return true;
+}
+
+bool enu_from_llh(const enu_frame_t *frame, int64_t lat_e9, int64_t lon_e9, int64_t height_mm10, enu_pos_t *pos) {
+    int64_t dlat = lat_e9 - frame->lat0_e9;
+    int64_t dlon = lon_e9 - frame->lon0_e9;
+    if (dlon > 180000000000LL) {
+        dlon -= 360000000000LL;
+    } else if (dlon < -180000000000LL) {
+        dlon += 360000000000LL;
+    }
+    int64_t dh = height_mm10 * 256 - frame->h0_q8;
+    if (llabs(dlat) > ENU_FRAME_MAX_DELTA_E9 || llabs(dlon) > ENU_FRAME_MAX_DELTA_E9 ||
+        !in_range(dh / 256)) {
+        return false;
+    }
+    const int64_t s0 = frame->sin_lat, c0 = frame->cos_lat;
+
+    // Half angles in radians (Q62): 1e-9 deg in Q94 >> 33 is Q62 halved
+    int64_t half_lat = mul_shift(dlat, frame->rad_per_e9_q94, 33);
+    int64_t half_lon = mul_shift(dlon, frame->rad_per_e9_q94, 33);
+    int64_t hs = sin_q62(half_lat), hc = cos_q62(half_lat);
+    int64_t ls = sin_q62(half_lon), lc = cos_q62(half_lon);
+
+    // sin(lat) - sin(lat0) and cos(lat) - cos(lat0) from the half-angle identities
+    int64_t ds = 2 * mul_q62(hs, mul_q62(c0, hc) - mul_q62(s0, hs));
+    int64_t dc = -2 * mul_q62(hs, mul_q62(s0, hc) + mul_q62(c0, hs));
+    int64_t s = s0 + ds, c = c0 + dc;
+
+    // N(lat) = N0 (1 - w)^-1/2 with w = e^2 (sin^2 lat - sin^2 lat0) / (1 - e^2 sin^2 lat0)
+    int64_t w = mul_q62(frame->w_scale, mul_q62(ds, s0 / 2 + s / 2));
+    int64_t w2 = mul_q62(w, w);
+    int64_t w3 = mul_q62(w2, w);
+    int64_t dn = mul_q62(frame->n0_q8, w / 2 + w2 / 8 * 3 + w3 / 16 * 5);
+    int64_t nh = frame->n0_q8 + dn + frame->h0_q8 + dh;
+
+    // ECEF difference in the reference meridian plane (x: where it crosses the equator, y: east, z: north pole)
+    int64_t nhc = mul_q62(nh, c);
+    int64_t e = mul_q62(nhc, 2 * mul_q62(ls, lc));                    // sin(dlon) = 2 sin cos of the half angle
+    int64_t dx = -mul_q62(nhc, 2 * mul_q62(ls, ls))                   // cos(dlon) - 1 = -2 sin^2 of the half angle
+                 + mul_q62(nh, dc) + mul_q62(dn + dh, c0);
+    int64_t dz = mul_q62(mul_q62(frame->n0_q8 + dn, frame->one_minus_e2) + frame->h0_q8 + dh, ds)
+                 + mul_q62(mul_q62(dn, frame->one_minus_e2) + dh, s0);
+
+    int64_t n = mul_q62(c0, dz) - mul_q62(s0, dx) + frame->grid_n_q8;
+    int64_t u = mul_q62(c0, dx) + mul_q62(s0, dz) + frame->grid_u_q8;
+    e += frame->grid_e_q8;
+    if (!in_range(e / 256) || !in_range(n / 256) || !in_range(u / 256)) {
+        return false;
+    }
+    pos->e = round_q8(e);
+    pos->n = round_q8(n);
+    pos->u = round_q8(u);
+    return true;
+}
+
+bool enu_frame_set_reference(int64_t x, int64_t y, int64_t z) {
+    if (s_have_ref && s_ref[0] == x && s_ref[1] == y && s_ref[2] == z) {
+        return false;
+    }
+    enu_frame_t *frame = seqlock_write_begin(&s_lock, s_bufs, sizeof(s_bufs[0]));
+    enu_frame_init(frame, x, y, z);
+    seqlock_write_end(&s_lock);
+    s_ref[0] = x;
+    s_ref[1] = y;
+    s_ref[2] = z;
+    s_have_ref = true;
+    return true;
+}
+
+bool enu_frame_get(enu_frame_t *frame) {
+    return seqlock_read(&s_lock, s_bufs, sizeof(s_bufs[0]), frame);
+}
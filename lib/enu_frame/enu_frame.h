@@ -0,0 +1,100 @@
+#ifndef ENU_FRAME_H
+#define ENU_FRAME_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+Local east/north/up frame around the survey-in base position, for the path planner.
+
+The reference is the base's ECEF antenna position: NAV-SVIN mean (base) or RTCM 1005 (robots, from
+the correction stream). Everything that depends on it only (latitude/longitude of the reference,
+the ECEF to ENU rotation, the ellipsoid radius) is worked out once per reference by
+enu_frame_init(), the only place that uses floating point. The per-fix conversions are integer only
+(the C6 has no FPU): Q62 fractions, lengths in 1/256 of 0.1 mm, 64x64 bit products built from 32 bit
+halves.
+
+- enu_from_ecef(): ECEF (NAV-HPPOSECEF) to ENU, a plain rotation of the baseline.
+- enu_from_llh(): latitude/longitude/height (NAV-HPPOSLLH, NAV-PVT) to ENU. Geodetic to ECEF is
+  expanded around the reference with half-angle identities, so only differences to the reference
+  are ever multiplied and nothing cancels.
+
+Both stay well below 0.1 mm of a double-precision conversion within ENU_FRAME_MAX_RANGE; output is
+in 0.1 mm (the resolution of the receiver's high-precision messages).
+
+No ESP-IDF dependencies: the kernel can be checked on a host against a double-precision reference.
+*/
+
+#define ENU_FRAME_MAX_RANGE     1000000000LL    // 0.1 mm: 100 km per axis from the reference
+#define ENU_FRAME_MAX_DELTA_E9  2000000000LL    // 1e-9 deg: latitude/longitude at most 2 deg from the reference
+
+typedef struct {
+    int64_t ref_x, ref_y, ref_z;    // Reference ECEF, 0.1 mm
+    // Expansion point for enu_from_llh(): the reference on the 1e-9 deg / 0.1 mm grid of NAV-HPPOSLLH
+    int64_t lat0_e9, lon0_e9;       // 1e-9 deg
+    int64_t h0_q8;                  // Ellipsoid height, 1/256 0.1 mm
+    int64_t grid_e_q8, grid_n_q8, grid_u_q8;   // ENU of the expansion point (it is not exactly on the reference)
+    // Q62 fractions
+    int64_t sin_lat, cos_lat, sin_lon, cos_lon;
+    int64_t rot[3][3];              // ECEF to ENU rotation
+    int64_t one_minus_e2;           // 1 - e^2
+    int64_t w_scale;                // 2 e^2 / (1 - e^2 sin^2 lat0)
+    int64_t rad_per_e9_q94;         // 1e-9 deg in radians, Q94
+    int64_t n0_q8;                  // Prime vertical radius of curvature at lat0, 1/256 0.1 mm
+} enu_frame_t;
+
+typedef struct {
+    int32_t e;                      // 0.1 mm
+    int32_t n;
+    int32_t u;
+} enu_pos_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Precompute a frame around a reference. Uses double math: call once per reference, not per fix.
+ *
+ * @param x, y, z Reference ECEF (WGS84) in 0.1 mm.
+ */
+void enu_frame_init(enu_frame_t *frame, int64_t x, int64_t y, int64_t z);
+
+/**
+ * @brief ECEF to ENU (integer only).
+ *
+ * @param x, y, z ECEF in 0.1 mm (e.g. NAV-HPPOSECEF ecefX * 100 + ecefXHp).
+ * @return false if the point is further than ENU_FRAME_MAX_RANGE from the reference on any axis.
+ */
+bool enu_from_ecef(const enu_frame_t *frame, int64_t x, int64_t y, int64_t z, enu_pos_t *pos);
+
+/**
+ * @brief Geodetic (WGS84) to ENU (integer only).
+ *
+ * @param lat_e9, lon_e9 1e-9 deg (NAV-HPPOSLLH lat * 100 + latHp, NAV-PVT lat * 100).
+ * @param height_mm10    Ellipsoid height in 0.1 mm (NAV-HPPOSLLH height * 10 + heightHp, NAV-PVT height * 10).
+ * @return false if the point is out of range (ENU_FRAME_MAX_DELTA_E9, ENU_FRAME_MAX_RANGE).
+ */
+bool enu_from_llh(const enu_frame_t *frame, int64_t lat_e9, int64_t lon_e9, int64_t height_mm10, enu_pos_t *pos);
+
+/**
+ * @brief Set the reference used by enu_frame_get(). The frame is only recomputed when the position changed.
+ *
+ * Single writer: the serial task on the base (NAV-SVIN) or the mesh RX task on robots (RTCM 1005).
+ *
+ * @return true if the reference changed.
+ */
+bool enu_frame_set_reference(int64_t x, int64_t y, int64_t z);
+
+/**
+ * @brief Get a consistent copy of the current frame without locking (safe from any task).
+ *
+ * @return false if no reference has been set yet.
+ */
+bool enu_frame_get(enu_frame_t *frame);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ENU_FRAME_H
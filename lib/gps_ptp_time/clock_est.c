@@ -0,0 +1,96 @@
+#include <stdlib.h>
+#include "clock_est.h"
+
+#define PPB 1000000000LL
+
+// Offset change over `dt_us` for a drift in 1/256 ppb, in 1/256 us
+static int64_t drift_step_q8(int64_t drift_q8, int64_t dt_us) {
+    return drift_q8 * dt_us / PPB;
+}
+
+void clock_est_init(clock_est_t *est, uint32_t max_drift_ppb) {
+    *est = (clock_est_t){ 0 };
+    est->max_drift_ppb = max_drift_ppb;
+    est->drift_unc_ppb = max_drift_ppb;
+}
+
+// First sample of a fit: offset from the sample, drift unknown
+static void restart(clock_est_t *est, int64_t local_us, int64_t gps_us) {
+    est->k = 1;
+    est->ref_local_us = local_us;
+    est->offset_q8 = (gps_us - local_us) * 256;
+    est->drift_q8 = 0;
+    est->mad_us = 0;
+    est->outlier = false;
+    est->drift_unc_ppb = est->max_drift_ppb;
+}
+
+int32_t clock_est_update(clock_est_t *est, int64_t local_us, uint64_t gps_us, uint32_t acc_us) {
+    int64_t gps = (int64_t)gps_us + est->week_base_us;
+    if (est->k > 0 && gps + GPS_WEEK_US / 2 < est->last_gps_us) {
+        est->week_base_us += GPS_WEEK_US; // Week rollover
+        gps += GPS_WEEK_US;
+    }
+    est->last_gps_us = gps;
+    est->sample_acc_us = acc_us;
+
+    int64_t dt_us = local_us - est->ref_local_us;
+    if (est->k == 0 || dt_us <= 0) {
+        restart(est, local_us, gps);
+        return 0;
+    }
+    int64_t predicted_q8 = est->offset_q8 + drift_step_q8(est->drift_q8, dt_us);
+    int64_t residual_q8 = (gps - local_us) * 256 - predicted_q8;
+    int64_t residual_us = residual_q8 / 256;
+    if (llabs(residual_us) > CLOCK_EST_RESET_US) {
+        // A single late timestamp is skipped; two in a row mean the time really jumped
+        if (est->outlier) {
+            est->resets++;
+            restart(est, local_us, gps);
+        } else {
+            est->outlier = true;
+            est->outliers++;
+        }
+        return (int32_t)residual_us;
+    }
+    est->outlier = false;
+
+    // Least-squares gain schedule for the k-th sample (k >= 2), fixed once k reaches CLOCK_EST_MAX_K
+    uint32_t k = est->k + 1 < CLOCK_EST_MAX_K ? est->k + 1 : CLOCK_EST_MAX_K;
+    int64_t alpha_q16 = ((int64_t)2 * (2 * k - 1) << 16) / (k * (k + 1));
+    int64_t beta_q16 = ((int64_t)6 << 16) / (k * (k + 1));
+
+    est->offset_q8 = predicted_q8 + ((residual_q8 * alpha_q16) >> 16);
+    // residual / dt as a rate in 1/256 ppb, then scaled by beta
+    est->drift_q8 += ((residual_q8 * PPB / dt_us) * beta_q16) >> 16;
+    est->ref_local_us = local_us;
+    est->k = k;
+
+    uint32_t abs_res = (uint32_t)llabs(residual_us);
+    est->mad_us = k == 2 ? abs_res : est->mad_us + ((int32_t)abs_res - (int32_t)est->mad_us) / 8;
+    if (k >= 3) {
+        // Two jitters' worth of error spread over one sample interval
+        int64_t unc = (int64_t)(2 * est->mad_us + 1) * PPB / dt_us;
+        if (unc < CLOCK_EST_MIN_DRIFT_UNC) unc = CLOCK_EST_MIN_DRIFT_UNC;
+        if (unc > est->max_drift_ppb) unc = est->max_drift_ppb;
+        est->drift_unc_ppb = (uint32_t)unc;
+    }
+    return (int32_t)residual_us;
+}
+
+bool clock_est_predict(const clock_est_t *est, int64_t local_us, uint64_t *gps_us, uint32_t *err_us) {
+    if (est->k == 0) {
+        return false;
+    }
+    int64_t age_us = local_us - est->ref_local_us;
+    int64_t offset_q8 = est->offset_q8 + drift_step_q8(est->drift_q8, age_us);
+    int64_t gps = local_us + offset_q8 / 256 - est->week_base_us;
+    gps %= GPS_WEEK_US;
+    if (gps < 0) gps += GPS_WEEK_US;
+    *gps_us = (uint64_t)gps;
+    if (err_us) {
+        uint64_t drift_err = (uint64_t)llabs(age_us) * est->drift_unc_ppb / PPB;
+        *err_us = (uint32_t)(est->sample_acc_us + 3 * est->mad_us + drift_err);
+    }
+    return true;
+}
@@ -0,0 +1,75 @@
+#ifndef CLOCK_EST_H
+#define CLOCK_EST_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+Offset and drift estimator for the local clock against GPS time (integer only, the C6 has no FPU).
+
+Each (local esp_timer, GPS time of week) sample from NAV-PVT feeds an alpha-beta filter on
+offset = GPS - local. The gains follow the least-squares schedule alpha = 2(2k-1)/(k(k+1)),
+beta = 6/(k(k+1)), so the first samples are an exact line fit; from CLOCK_EST_MAX_K samples on
+the gains stay fixed and older samples are forgotten, which lets the drift follow temperature.
+
+Fixed point: offsets in 1/256 us, drift in 1/256 ppb, gains in Q16. GPS time of week is unwrapped
+across week rollovers internally and wrapped again on output.
+
+No ESP-IDF dependencies: can be driven from a host simulation.
+*/
+
+#define CLOCK_EST_MAX_K         16          // Gain schedule stops here (memory of ~16 samples)
+#define CLOCK_EST_RESET_US      5000        // Residuals above this are outliers; two in a row restart the fit
+#define CLOCK_EST_MIN_DRIFT_UNC 50          // ppb: floor of the drift uncertainty (temperature changes)
+#define GPS_WEEK_US             (7LL * 24 * 3600 * 1000000)
+
+typedef struct {
+    uint32_t k;                 // Samples in the current fit (0 = empty)
+    int64_t ref_local_us;       // Local time of the last sample: the model is anchored there
+    int64_t offset_q8;          // GPS - local at ref_local_us, 1/256 us (GPS time unwrapped)
+    int64_t drift_q8;           // d(offset)/d(local), 1/256 ppb
+    int64_t week_base_us;       // Added to GPS time of week to unwrap it
+    int64_t last_gps_us;        // Last unwrapped GPS time
+    uint32_t mad_us;            // Mean absolute residual (timestamp jitter)
+    uint32_t sample_acc_us;     // Receiver accuracy (tAcc) of the last sample
+    uint32_t drift_unc_ppb;     // Uncertainty of drift_q8
+    uint32_t max_drift_ppb;     // Uncertainty used until the drift is known
+    bool outlier;               // Last sample was skipped as an outlier
+    uint32_t outliers;          // Samples skipped
+    uint32_t resets;            // Fits restarted after a time jump
+} clock_est_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Start with an empty fit.
+ *
+ * @param max_drift_ppb Oscillator tolerance, used as the drift uncertainty until two samples are in.
+ */
+void clock_est_init(clock_est_t *est, uint32_t max_drift_ppb);
+
+/**
+ * @brief Add a sample.
+ *
+ * @param local_us  esp_timer time the sample was taken.
+ * @param gps_us    GPS time of week at that instant (us).
+ * @param acc_us    Receiver time accuracy (tAcc).
+ * @return The residual against the prediction (us), 0 for the first sample of a fit.
+ */
+int32_t clock_est_update(clock_est_t *est, int64_t local_us, uint64_t gps_us, uint32_t acc_us);
+
+/**
+ * @brief GPS time of week at a local instant, interpolated or extrapolated with the estimated drift.
+ *
+ * @param err_us  Optional: error bound (receiver accuracy + 3x mean timestamp jitter + drift uncertainty over the age).
+ * @return false if no sample has been added yet.
+ */
+bool clock_est_predict(const clock_est_t *est, int64_t local_us, uint64_t *gps_us, uint32_t *err_us);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CLOCK_EST_H
@@ -1,6 +1,84 @@
 #include "gps_ptp_time.h"
+#include "esp_timer.h"
+#include "../seqlock/seqlock.h"
+#include "clock_est.h"
 
-// Global instance and mutex for thread-safe access
-gps_ptp_time_t g_gps_ptp_time = {0};
-SemaphoreHandle_t g_gps_ptp_time_mutex;
+// Latest GPS time sample, published by the serial task and read lock-free from anywhere
+static seqlock_t s_time_lock = SEQLOCK_INIT;
+static gps_ptp_time_t s_time_bufs[2];
 
+// Offset/drift fit over the NAV-PVT samples: updated by the serial task, snapshots read lock-free
+static clock_est_t s_est;
+static bool s_est_ready;
+static seqlock_t s_est_lock = SEQLOCK_INIT;
+static clock_est_t s_est_bufs[2];
+
+// Mesh clock, published by the mesh RX task
+static seqlock_t s_mesh_lock = SEQLOCK_INIT;
+static gps_ptp_mesh_clock_t s_mesh_bufs[2];
+
+void gps_ptp_time_publish(const gps_ptp_time_t *time) {
+    seqlock_publish(&s_time_lock, s_time_bufs, sizeof(s_time_bufs[0]), time);
+    if (!s_est_ready) {
+        clock_est_init(&s_est, CONFIG_GPS_PTP_DRIFT_PPM * 1000);
+        s_est_ready = true;
+    }
+    clock_est_update(&s_est, (int64_t)time->updated_us, time->gps_iTOW_us, time->tAcc_us);
+    seqlock_publish(&s_est_lock, s_est_bufs, sizeof(s_est_bufs[0]), &s_est);
+}
+
+bool gps_ptp_time_get(gps_ptp_time_t *time) {
+    return seqlock_read(&s_time_lock, s_time_bufs, sizeof(s_time_bufs[0]), time);
+}
+
+void gps_ptp_mesh_publish(const gps_ptp_mesh_clock_t *clock) {
+    seqlock_publish(&s_mesh_lock, s_mesh_bufs, sizeof(s_mesh_bufs[0]), clock);
+}
+
+bool gps_ptp_mesh_get(gps_ptp_mesh_clock_t *clock) {
+    return seqlock_read(&s_mesh_lock, s_mesh_bufs, sizeof(s_mesh_bufs[0]), clock);
+}
+
+// Error added by the local oscillator over `age_us` (either direction)
+static uint32_t drift_bound_us(int64_t age_us) {
+    if (age_us < 0) {
+        age_us = -age_us;
+    }
+    return (uint32_t)(age_us * CONFIG_GPS_PTP_DRIFT_PPM / 1000000);
+}
+
+gps_ptp_source_t gps_ptp_from_local(int64_t local_us, uint64_t *gps_us, uint32_t *accuracy_us) {
+    const int64_t max_age_us = CONFIG_GPS_PTP_MAX_AGE_MS * 1000LL;
+    int64_t now_us = esp_timer_get_time();
+
+    clock_est_t est;
+    if (seqlock_read(&s_est_lock, s_est_bufs, sizeof(s_est_bufs[0]), &est) &&
+        now_us - est.ref_local_us < max_age_us &&
+        clock_est_predict(&est, local_us, gps_us, accuracy_us)) {
+        return GPS_PTP_SOURCE_GNSS;
+    }
+    gps_ptp_mesh_clock_t clock;
+    if (gps_ptp_mesh_get(&clock) && now_us - clock.updated_us < max_age_us) {
+        int64_t age_us = local_us - clock.updated_us;
+        int64_t gps = local_us + clock.offset_us + age_us * clock.drift_ppb / 1000000000;
+        *gps_us = (uint64_t)(((gps % GPS_WEEK_US) + GPS_WEEK_US) % GPS_WEEK_US);
+        if (accuracy_us) {
+            *accuracy_us = clock.accuracy_us + drift_bound_us(age_us);
+        }
+        return GPS_PTP_SOURCE_MESH;
+    }
+    return GPS_PTP_SOURCE_NONE;
+}
+
+uint64_t gps_ptp_now_us(void) {
+    uint64_t gps_us = 0;
+    gps_ptp_from_local(esp_timer_get_time(), &gps_us, NULL);
+    return gps_us;
+}
+
+uint32_t gps_ptp_accuracy_us(void) {
+    uint64_t gps_us;
+    uint32_t accuracy_us = GPS_PTP_ACCURACY_UNKNOWN;
+    gps_ptp_from_local(esp_timer_get_time(), &gps_us, &accuracy_us);
+    return accuracy_us;
+}
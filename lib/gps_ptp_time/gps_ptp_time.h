@@ -3,8 +3,29 @@
 
 #include <stdint.h>
 #include <stdbool.h>
-#include <freertos/FreeRTOS.h>
-#include <freertos/semphr.h>
+
+/*
+GPS time on every node.
+
+Nodes with a GNSS receiver (BASE, ROBOT) take GPS time from their own NAV-PVT. Every other node,
+and a robot whose receiver has no valid time, uses the mesh clock disciplined by mesh_ptp.h, which
+carries the base's GPS time down the tree one hop at a time. gps_ptp_now_us() picks the best
+source and gps_ptp_accuracy_us() says how far off it may be, including drift since the last update.
+
+NAV-PVT only arrives every few seconds, so local receiver time comes from an offset/drift fit over
+the samples (clock_est.h) rather than the last sample alone: between updates the time is
+interpolated with the measured oscillator drift, and the error bound grows with the drift's
+uncertainty instead of the worst-case CONFIG_GPS_PTP_DRIFT_PPM.
+*/
+
+#ifndef CONFIG_GPS_PTP_MAX_AGE_MS
+#define CONFIG_GPS_PTP_MAX_AGE_MS 15000
+#endif
+#ifndef CONFIG_GPS_PTP_DRIFT_PPM
+#define CONFIG_GPS_PTP_DRIFT_PPM 40
+#endif
+
+#define GPS_PTP_ACCURACY_UNKNOWN UINT32_MAX
 
 /**
  * @brief Structure to hold GPS time information for PTP-like synchronization.
@@ -18,7 +39,70 @@ typedef struct gps_ptp_time_t{
     uint32_t tAcc_us;       // Time accuracy in microseconds (from NAV-PVT, rounded)
 } gps_ptp_time_t;
 
-extern gps_ptp_time_t g_gps_ptp_time;
-extern SemaphoreHandle_t g_gps_ptp_time_mutex;
+/**
+ * @brief Mesh clock: offset of GPS time from the local esp_timer, as measured against the parent.
+ */
+typedef struct {
+    int64_t offset_us;      // GPS time of week (us) minus esp_timer time
+    int64_t updated_us;     // esp_timer time of the measurement
+    int32_t drift_ppb;      // Rate of change of offset_us (local oscillator error against GPS)
+    uint32_t accuracy_us;   // Parent's accuracy plus this hop's measurement error
+    uint8_t steps_removed;  // Hops from the GNSS clock (1 = child of the base)
+} gps_ptp_mesh_clock_t;
+
+typedef enum {
+    GPS_PTP_SOURCE_NONE,
+    GPS_PTP_SOURCE_GNSS,    // Local receiver (NAV-PVT)
+    GPS_PTP_SOURCE_MESH,    // Synchronised to the parent over PTP_DATA
+} gps_ptp_source_t;
+
+/**
+ * @brief Publish a new GPS time sample and add it to the drift fit. Only the serial task (NAV-PVT decoder) may call this.
+ */
+void gps_ptp_time_publish(const gps_ptp_time_t *time);
+
+/**
+ * @brief Get a consistent copy of the latest GPS time sample without locking.
+ *
+ * Safe from any task; never blocks behind the writer.
+ *
+ * @return false if no valid NAV-PVT time has been received yet.
+ */
+bool gps_ptp_time_get(gps_ptp_time_t *time);
+
+/**
+ * @brief Publish a new mesh clock measurement. Only the mesh RX task (mesh_ptp) may call this.
+ */
+void gps_ptp_mesh_publish(const gps_ptp_mesh_clock_t *clock);
+
+/**
+ * @brief Get a consistent copy of the mesh clock without locking.
+ *
+ * @return false if this node has never been synchronised over the mesh.
+ */
+bool gps_ptp_mesh_get(gps_ptp_mesh_clock_t *clock);
+
+/**
+ * @brief Convert an esp_timer timestamp (e.g. when a sensor sample was taken) to GPS time.
+ *
+ * Uses the local receiver if its last valid time is younger than CONFIG_GPS_PTP_MAX_AGE_MS,
+ * otherwise the mesh clock under the same age limit.
+ *
+ * @param local_us     esp_timer time to convert.
+ * @param gps_us       GPS time of week in us.
+ * @param accuracy_us  Optional: error bound in us, including drift uncertainty since the last update.
+ * @return The source used; GPS_PTP_SOURCE_NONE (outputs untouched) if no source is fresh enough.
+ */
+gps_ptp_source_t gps_ptp_from_local(int64_t local_us, uint64_t *gps_us, uint32_t *accuracy_us);
+
+/**
+ * @brief Current GPS time of week in us, or 0 if this node has no usable time source.
+ */
+uint64_t gps_ptp_now_us(void);
+
+/**
+ * @brief Error bound of gps_ptp_now_us() in us, or GPS_PTP_ACCURACY_UNKNOWN.
+ */
+uint32_t gps_ptp_accuracy_us(void);
 
 #endif // GPS_PTP_TIME_H
@@ -0,0 +1,310 @@
+#include <stdlib.h>
+#include "mesh_ptp.h"
+#include "../mesh_dispatch/mesh_dispatch.h"
+#include "../protocol/wire.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define MIN_DELAY_WINDOW_US (60 * 1000 * 1000LL)   // Forget the fastest exchange after this long
+#define DELAY_SLACK_US      500                     // Accept exchanges up to min delay + this
+#define MAX_DRIFT_PPB       200000                  // Clamp the frequency estimate to +-200 ppm
+#define STATS_INTERVAL_US   (60 * 1000 * 1000LL)
+
+static const char *TAG = "mesh_ptp";
+
+// Child side: the parent link and the node sending us SYNC over it (mesh RX task only)
+static struct {
+    mesh_addr_t bssid;          // Parent softAP
+    mesh_addr_t master;         // Its mesh address, once heard
+    mesh_addr_t previous;       // Master of the link before
+    bool have_master;
+    bool have_previous;
+} s_link;
+
+// Child side: exchange in progress with the parent (mesh RX task only)
+static struct {
+    uint16_t seq;
+    bool have_sync;
+    bool req_sent;
+    int64_t t2_us;          // SYNC received (local)
+    uint64_t t1_us;         // SYNC sent (parent GPS time)
+    int64_t t3_us;          // DELAY_REQ sent (local)
+    uint32_t parent_accuracy_us;
+    uint8_t parent_steps;
+} s_ex;
+
+// Child side: servo state
+static bool s_locked;
+static int64_t s_offset_us;
+static int64_t s_offset_at_us;  // Local time the offset refers to
+static int32_t s_drift_ppb;
+static uint32_t s_jitter_us;
+static uint32_t s_min_delay_us;
+static int64_t s_min_delay_at_us;
+
+static uint16_t s_sync_seq;
+static mesh_ptp_stats_t s_stats;
+
+static esp_err_t send_msg(const mesh_addr_t *to, const PTPData_t *msg) {
+    uint8_t pkt[WIRE_TX_OVERHEAD + sizeof(PTPData_t)];
+    memcpy(pkt + WIRE_TX_HDR_SIZE, msg, sizeof(PTPData_t));
+
+    mesh_data_t data;
+    data.data = pkt;
+    data.size = wire_encode(pkt, PTP_DATA, sizeof(PTPData_t));
+    data.proto = MESH_PROTO_BIN;
+    data.tos = MESH_TOS_P2P;
+    esp_err_t err = esp_mesh_send(to, &data, MESH_DATA_P2P | MESH_DATA_NONBLOCK, NULL, 0);
+    if (err != ESP_OK) {
+        s_stats.send_errors++;
+    }
+    return err;
+}
+
+// Hops of our own clock from the GNSS clock, as advertised to children
+static uint8_t own_steps_removed(gps_ptp_source_t source) {
+    gps_ptp_mesh_clock_t clock;
+    if (source == GPS_PTP_SOURCE_MESH && gps_ptp_mesh_get(&clock)) {
+        return clock.steps_removed;
+    }
+    return 0;
+}
+
+// Master: one SYNC + FOLLOW_UP to every child on our softAP
+static void sync_children(void) {
+    wifi_sta_list_t children;
+    if (esp_wifi_ap_get_sta_list(&children) != ESP_OK || children.num == 0) {
+        return;
+    }
+    uint64_t gps_us;
+    uint32_t accuracy_us;
+    gps_ptp_source_t source = gps_ptp_from_local(esp_timer_get_time(), &gps_us, &accuracy_us);
+    if (source == GPS_PTP_SOURCE_NONE) {
+        return; // Nothing to distribute yet
+    }
+    uint8_t steps = own_steps_removed(source);
+    s_sync_seq++;
+
+    for (int i = 0; i < children.num; i++) {
+        mesh_addr_t child;
+        memcpy(child.addr, children.sta[i].mac, sizeof(child.addr));
+
+        PTPData_t msg = { .msg = PTP_MSG_SYNC, .steps_removed = steps, .seq = s_sync_seq };
+        int64_t t1_local = esp_timer_get_time();
+        if (send_msg(&child, &msg) != ESP_OK) {
+            continue; // Non-mesh station or queue full; try again next interval
+        }
+        gps_ptp_from_local(t1_local, &msg.timestamp_us, &msg.accuracy_us);
+        msg.msg = PTP_MSG_FOLLOW_UP;
+        if (send_msg(&child, &msg) == ESP_OK) {
+            s_stats.syncs_sent++;
+        }
+    }
+}
+
+static void mesh_ptp_task(void *arg) {
+    int64_t last_stats_us = esp_timer_get_time();
+    while (true) {
+        vTaskDelay(pdMS_TO_TICKS(CONFIG_MESH_PTP_INTERVAL_MS));
+        sync_children();
+        if (esp_timer_get_time() - last_stats_us > STATS_INTERVAL_US) {
+            mesh_ptp_log_stats();
+            last_stats_us = esp_timer_get_time();
+        }
+    }
+}
+
+static void handle_packet(const mesh_addr_t *from, const void *payload, size_t payload_len, pkt_buf_t *buf,
+                          void *arg);
+
+esp_err_t mesh_ptp_start(void) {
+    static bool started = false;
+    if (started) {
+        return ESP_OK;
+    }
+    esp_err_t err = mesh_dispatch_register(PTP_DATA, "PTP_DATA", sizeof(PTPData_t), sizeof(PTPData_t),
+                                           handle_packet, NULL);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (xTaskCreate(mesh_ptp_task, "MeshPTP", 3072, NULL, 5, NULL) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create PTP task");
+        return ESP_ERR_NO_MEM;
+    }
+    started = true;
+    return ESP_OK;
+}
+
+// Child: compute offset and delay of a complete exchange and steer the mesh clock
+static void update_clock(uint64_t t4_us) {
+    int64_t ms_us = (int64_t)s_ex.t1_us - s_ex.t2_us;  // offset - delay
+    int64_t sm_us = (int64_t)t4_us - s_ex.t3_us;       // offset + delay
+    int64_t offset_us = (ms_us + sm_us) / 2;
+    int64_t delay_us = (sm_us - ms_us) / 2;
+
+    s_stats.exchanges++;
+    if (delay_us < 0) {
+        s_stats.rejected++; // Parent clock stepped during the exchange
+        return;
+    }
+    s_stats.last_delay_us = (uint32_t)delay_us;
+
+    // Queueing only ever adds delay, and rarely symmetrically: keep exchanges close to the fastest recent one.
+    // Extra delay x1 + x2 over the minimum can bias the offset by at most (x1 - x2) / 2, i.e. the slack.
+    if (s_min_delay_us == 0 || delay_us < s_min_delay_us || s_ex.t2_us - s_min_delay_at_us > MIN_DELAY_WINDOW_US) {
+        s_min_delay_us = (uint32_t)delay_us;
+        s_min_delay_at_us = s_ex.t2_us;
+    }
+    s_stats.min_delay_us = s_min_delay_us;
+    if (delay_us > (int64_t)s_min_delay_us + DELAY_SLACK_US) {
+        s_stats.rejected++;
+        return;
+    }
+
+    int64_t dt_us = s_ex.t2_us - s_offset_at_us;
+    int64_t predicted_us = s_offset_us + dt_us * s_drift_ppb / 1000000000;
+    int64_t err_us = offset_us - predicted_us;
+    s_stats.last_offset_err_us = (int32_t)err_us;
+
+    if (!s_locked || llabs(err_us) > CONFIG_MESH_PTP_STEP_US) {
+        // First exchange, new parent or a parent that stepped: jump, and assume the worst asymmetry until jitter is known
+        s_offset_us = offset_us;
+        s_jitter_us = (uint32_t)delay_us / 2;
+        s_locked = true;
+        s_stats.steps++;
+    } else {
+        // PI servo: correct a quarter of the offset error now, and a small share of it into the frequency estimate
+        s_offset_us = predicted_us + err_us / 4;
+        if (dt_us > 0) {
+            int64_t drift = s_drift_ppb + err_us * 1000000000 / dt_us / 64;
+            s_drift_ppb = (int32_t)(drift > MAX_DRIFT_PPB ? MAX_DRIFT_PPB : drift < -MAX_DRIFT_PPB ? -MAX_DRIFT_PPB : drift);
+        }
+        s_jitter_us += ((int32_t)llabs(err_us) - (int32_t)s_jitter_us) / 8;
+    }
+    s_offset_at_us = s_ex.t2_us;
+
+    gps_ptp_mesh_clock_t clock = {
+        .offset_us = s_offset_us,
+        .updated_us = s_offset_at_us,
+        .drift_ppb = s_drift_ppb,
+        .accuracy_us = s_ex.parent_accuracy_us + 2 * s_jitter_us,
+        .steps_removed = s_ex.parent_steps + 1,
+    };
+    gps_ptp_mesh_publish(&clock);
+    ESP_LOGD(TAG, "offset err:%lldus delay:%lldus drift:%ldppb acc:%luus", err_us, delay_us, s_drift_ppb, clock.accuracy_us);
+}
+
+static bool same_addr(const mesh_addr_t *a, const mesh_addr_t *b) {
+    return memcmp(a->addr, b->addr, sizeof(a->addr)) == 0;
+}
+
+// Child: whether a SYNC comes from our parent. Masters only send SYNC to the stations on their softAP,
+// but a former parent keeps listing us until the association expires there, and its SYNC then reaches
+// us routed through the mesh, over more than one hop. The parent's mesh address is not its BSSID, so
+// the first master heard after joining a parent is taken for as long as that link lasts, except the
+// master of the link before. The root has no mesh parent.
+static bool sync_from_parent(const mesh_addr_t *from) {
+    mesh_addr_t bssid;
+    if (esp_mesh_is_root() || esp_mesh_get_parent_bssid(&bssid) != ESP_OK) {
+        return false;
+    }
+    if (!same_addr(&bssid, &s_link.bssid)) {
+        s_link.bssid = bssid;
+        s_link.previous = s_link.master;
+        s_link.have_previous = s_link.have_master;
+        s_link.have_master = false;
+    }
+    if (s_link.have_master) {
+        return same_addr(from, &s_link.master);
+    }
+    if (s_link.have_previous && same_addr(from, &s_link.previous)) {
+        return false;
+    }
+    s_link.master = *from;
+    s_link.have_master = true;
+    // Another path to the GNSS clock: step to it, and find the fastest exchange on this link afresh
+    s_locked = false;
+    s_min_delay_us = 0;
+    return true;
+}
+
+// PTP_DATA from the mesh (both master and child messages), length checked by the dispatcher
+static void handle_packet(const mesh_addr_t *from, const void *payload, size_t payload_len, pkt_buf_t *buf,
+                          void *arg) {
+    int64_t rx_us = esp_timer_get_time();
+    PTPData_t msg;
+    memcpy(&msg, payload, sizeof(msg));
+    bool from_parent = s_link.have_master && same_addr(from, &s_link.master);
+
+    switch (msg.msg) {
+        case PTP_MSG_SYNC:
+            if (!sync_from_parent(from)) {
+                s_stats.foreign_syncs++;
+                break;
+            }
+            s_ex.seq = msg.seq;
+            s_ex.t2_us = rx_us;
+            s_ex.have_sync = true;
+            s_ex.req_sent = false;
+            break;
+        case PTP_MSG_FOLLOW_UP: {
+            if (!s_ex.have_sync || !from_parent || msg.seq != s_ex.seq) {
+                s_stats.unmatched++;
+                break;
+            }
+            s_ex.have_sync = false;
+            s_ex.t1_us = msg.timestamp_us;
+            s_ex.parent_accuracy_us = msg.accuracy_us;
+            s_ex.parent_steps = msg.steps_removed;
+            PTPData_t req = { .msg = PTP_MSG_DELAY_REQ, .seq = msg.seq };
+            s_ex.t3_us = esp_timer_get_time();
+            s_ex.req_sent = send_msg(from, &req) == ESP_OK;
+            break;
+        }
+        case PTP_MSG_DELAY_REQ: {
+            // Master: stamp the arrival with our own GPS time
+            PTPData_t resp = { .msg = PTP_MSG_DELAY_RESP, .seq = msg.seq };
+            gps_ptp_source_t source = gps_ptp_from_local(rx_us, &resp.timestamp_us, &resp.accuracy_us);
+            if (source == GPS_PTP_SOURCE_NONE) {
+                break;
+            }
+            resp.steps_removed = own_steps_removed(source);
+            if (send_msg(from, &resp) == ESP_OK) {
+                s_stats.delay_resps_sent++;
+            }
+            break;
+        }
+        case PTP_MSG_DELAY_RESP:
+            if (!s_ex.req_sent || !from_parent || msg.seq != s_ex.seq) {
+                s_stats.unmatched++;
+                break;
+            }
+            s_ex.req_sent = false;
+            update_clock(msg.timestamp_us);
+            break;
+        default:
+            ESP_LOGW(TAG, "Unknown PTP message: %u", msg.msg);
+            break;
+    }
+}
+
+void mesh_ptp_get_stats(mesh_ptp_stats_t *stats) {
+    *stats = s_stats;
+}
+
+void mesh_ptp_log_stats(void) {
+    uint64_t gps_us = 0;
+    uint32_t accuracy_us = GPS_PTP_ACCURACY_UNKNOWN;
+    gps_ptp_source_t source = gps_ptp_from_local(esp_timer_get_time(), &gps_us, &accuracy_us);
+    ESP_LOGI(TAG, "Time source:%s gps:%lluus acc:%luus drift:%ldppb",
+             source == GPS_PTP_SOURCE_GNSS ? "gnss" : source == GPS_PTP_SOURCE_MESH ? "mesh" : "none",
+             gps_us, accuracy_us, s_drift_ppb);
+    ESP_LOGI(TAG, "Master syncs:%lu delay resps:%lu | child exchanges:%lu rejected:%lu steps:%lu unmatched:%lu "
+             "foreign syncs:%lu send errors:%lu last err:%ldus delay last/min:%lu/%luus",
+             s_stats.syncs_sent, s_stats.delay_resps_sent, s_stats.exchanges, s_stats.rejected, s_stats.steps,
+             s_stats.unmatched, s_stats.foreign_syncs, s_stats.send_errors, s_stats.last_offset_err_us,
+             s_stats.last_delay_us, s_stats.min_delay_us);
+}
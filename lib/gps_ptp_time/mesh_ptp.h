@@ -0,0 +1,67 @@
+#ifndef MESH_PTP_H
+#define MESH_PTP_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "esp_mesh.h"
+#include "../protocol/protocol.h"
+#include "gps_ptp_time.h"
+
+/*
+Mesh time distribution over PTP_DATA.
+
+Every node with a time source acts as master for its direct children (the stations on its mesh
+softAP) and runs a two-step PTP exchange with each of them once per CONFIG_MESH_PTP_INTERVAL_MS:
+
+    parent                         child
+    SYNC            ------------>  t2 = local receive time
+    FOLLOW_UP(t1)   ------------>  t1 = parent GPS time when SYNC was sent
+                    <------------  DELAY_REQ, t3 = local send time
+    DELAY_RESP(t4)  ------------>  t4 = parent GPS time when DELAY_REQ arrived
+
+    offset = ((t1 - t2) + (t4 - t3)) / 2     (GPS time - local esp_timer)
+    delay  = ((t4 - t3) - (t1 - t2)) / 2     (one-way, assumed symmetric)
+
+Synchronising hop by hop keeps each exchange to one radio link, so the cost is four small packets
+per link per interval whatever the depth of the tree, and queueing on a link only affects that
+link's exchange. SYNC is only taken from the parent: a former parent can still list this node as
+a station for a while, and reach it over several hops. Exchanges much slower than the fastest
+recent one are discarded (mesh queueing is one-sided), and a PI servo tracks offset and frequency
+between exchanges. A node's accuracy is its parent's plus twice its own measurement jitter;
+timestamps are taken in software around esp_mesh_send()/esp_mesh_recv().
+*/
+
+#ifndef CONFIG_MESH_PTP_INTERVAL_MS
+#define CONFIG_MESH_PTP_INTERVAL_MS 1000
+#endif
+#ifndef CONFIG_MESH_PTP_STEP_US
+#define CONFIG_MESH_PTP_STEP_US 5000
+#endif
+
+typedef struct {
+    // Master side
+    uint32_t syncs_sent;        // SYNC + FOLLOW_UP pairs sent to children
+    uint32_t delay_resps_sent;
+    // Child side
+    uint32_t exchanges;         // Complete exchanges with the parent
+    uint32_t rejected;          // Exchanges discarded by the delay filter
+    uint32_t steps;             // Offset stepped instead of slewed
+    uint32_t unmatched;         // Messages not matching the exchange in progress (lost or reordered)
+    uint32_t foreign_syncs;     // SYNC ignored: not from the parent (a former one), or this node is the root
+    uint32_t send_errors;
+    int32_t last_offset_err_us; // Measured minus predicted offset at the last accepted exchange
+    uint32_t last_delay_us;
+    uint32_t min_delay_us;      // Fastest recent exchange, the reference of the delay filter
+} mesh_ptp_stats_t;
+
+/**
+ * @brief Register the PTP_DATA handler and start the task that sends SYNC to this node's children.
+ * Safe to call more than once.
+ */
+esp_err_t mesh_ptp_start(void);
+
+void mesh_ptp_get_stats(mesh_ptp_stats_t *stats);
+void mesh_ptp_log_stats(void);
+
+#endif // MESH_PTP_H
@@ -0,0 +1,246 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netdb.h>
+#include <arpa/inet.h>
+#include "log_ship.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define STATS_INTERVAL_US   (60 * 1000 * 1000LL)
+#define RING_MASK           (CONFIG_LOG_SHIP_BUF_SIZE - 1)
+
+// Record header
+#define REC_HEADER          4
+#define REC_LEN_MASK        0xFFFFu
+#define REC_PAD             (1u << 30)  // Filler up to the end of the ring, no text
+#define REC_COMMITTED       (1u << 31)  // Text complete: the sender may take it
+#define REC_SPAN(len)       (REC_HEADER + (((len) + 1 + 3) & ~3u))     // Text, NUL, padding to 4 bytes
+
+static const char *TAG = "log_ship";
+
+// Zero wherever no record is reserved, so a header still being written reads as uncommitted
+static uint8_t s_ring[CONFIG_LOG_SHIP_BUF_SIZE] __attribute__((aligned(4)));
+static uint32_t s_reserve;          // Producers: position of the next record (free running)
+static uint32_t s_read;             // Sender: position of the oldest record not yet freed
+
+static vprintf_like_t s_original_vprintf;
+static struct sockaddr_in s_server;
+static bool s_connect_now;          // Set by log_ship_connect(), taken by the sender
+static log_ship_stats_t s_stats;
+
+static inline void count(uint32_t *counter, uint32_t n) {
+    __atomic_fetch_add(counter, n, __ATOMIC_RELAXED);
+}
+
+static inline uint32_t *header_at(uint32_t off) {
+    return (uint32_t *)&s_ring[off];
+}
+
+// Claim `span` contiguous bytes, after a PAD record if they would wrap. Never waits.
+static bool reserve(uint32_t span, uint32_t *off) {
+    uint32_t pos = __atomic_load_n(&s_reserve, __ATOMIC_RELAXED);
+    uint32_t total;
+    do {
+        uint32_t at = pos & RING_MASK;
+        total = span + (at + span > CONFIG_LOG_SHIP_BUF_SIZE ? CONFIG_LOG_SHIP_BUF_SIZE - at : 0);
+        if (pos + total - __atomic_load_n(&s_read, __ATOMIC_ACQUIRE) > CONFIG_LOG_SHIP_BUF_SIZE) {
+            return false;
+        }
+    } while (!__atomic_compare_exchange_n(&s_reserve, &pos, pos + total, true, __ATOMIC_ACQ_REL,
+                                          __ATOMIC_RELAXED));
+    uint32_t at = pos & RING_MASK;
+    if (total != span) {
+        __atomic_store_n(header_at(at), REC_COMMITTED | REC_PAD | (CONFIG_LOG_SHIP_BUF_SIZE - at - REC_HEADER),
+                         __ATOMIC_RELEASE);
+        at = 0;
+    }
+    *off = at;
+    return true;
+}
+
+static void enqueue(const char *format, va_list args) {
+    va_list measure;
+    va_copy(measure, args);
+    int len = vsnprintf(NULL, 0, format, measure);
+    va_end(measure);
+    if (len <= 0) {
+        return;
+    }
+    bool cut = len > CONFIG_LOG_SHIP_LINE_MAX;
+    if (cut) {
+        len = CONFIG_LOG_SHIP_LINE_MAX;
+    }
+    uint32_t off;
+    if (!reserve(REC_SPAN(len), &off)) {
+        count(&s_stats.dropped, 1);
+        count(&s_stats.dropped_bytes, len);
+        return;
+    }
+    char *text = (char *)&s_ring[off + REC_HEADER];
+    vsnprintf(text, len + 1, format, args);
+    if (cut) {
+        text[len - 1] = '\n';     // Cut lines still end theirs
+        count(&s_stats.truncated, 1);
+    }
+    __atomic_store_n(header_at(off), REC_COMMITTED | len, __ATOMIC_RELEASE);
+    count(&s_stats.lines, 1);
+}
+
+// esp_log hook: console first, then the ring. Each consumer gets its own copy of the arguments.
+static int log_ship_vprintf(const char *format, va_list args) {
+    va_list ship;
+    va_copy(ship, args);
+    int written = s_original_vprintf ? s_original_vprintf(format, args) : 0;
+    enqueue(format, ship);
+    va_end(ship);
+    return written;
+}
+
+// Move whole committed lines, oldest first, into `out` and free their records
+static size_t drain(char *out, size_t cap) {
+    size_t n = 0;
+    uint32_t pos = s_read;
+    while (pos != __atomic_load_n(&s_reserve, __ATOMIC_ACQUIRE)) {
+        uint32_t off = pos & RING_MASK;
+        uint32_t hdr = __atomic_load_n(header_at(off), __ATOMIC_ACQUIRE);
+        if (!(hdr & REC_COMMITTED)) {
+            break;      // Still being written
+        }
+        uint32_t len = hdr & REC_LEN_MASK;
+        uint32_t span = (hdr & REC_PAD) ? REC_HEADER + len : REC_SPAN(len);
+        if (!(hdr & REC_PAD)) {
+            if (n + len > cap) {
+                break;
+            }
+            memcpy(out + n, &s_ring[off + REC_HEADER], len);
+            n += len;
+        }
+        memset(&s_ring[off], 0, span);
+        pos += span;
+        __atomic_store_n(&s_read, pos, __ATOMIC_RELEASE);
+    }
+    return n;
+}
+
+static int connect_server(void) {
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0) {
+        return -1;
+    }
+    struct timeval timeout = {
+        .tv_sec = LOG_SHIP_SEND_TIMEOUT_MS / 1000,
+        .tv_usec = (LOG_SHIP_SEND_TIMEOUT_MS % 1000) * 1000,
+    };
+    setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    if (connect(sock, (struct sockaddr *)&s_server, sizeof(s_server)) != 0) {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+static bool send_all(int sock, const char *data, size_t len) {
+    while (len > 0) {
+        int n = send(sock, data, len, 0);
+        if (n <= 0) {
+            return false;
+        }
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+static void sender_task(void *arg) {
+    static char batch[LOG_SHIP_BATCH];
+    int sock = -1;
+    bool online = false;
+    uint32_t backoff_ms = LOG_SHIP_RETRY_MIN_MS;
+    int64_t retry_us = 0;
+    int64_t last_stats_us = esp_timer_get_time();
+
+    while (true) {
+        vTaskDelay(pdMS_TO_TICKS(CONFIG_LOG_SHIP_FLUSH_MS));
+        int64_t now_us = esp_timer_get_time();
+
+        if (now_us - last_stats_us > STATS_INTERVAL_US) {
+            log_ship_log_stats();
+            last_stats_us = now_us;
+        }
+        if (__atomic_exchange_n(&s_connect_now, false, __ATOMIC_RELAXED)) {
+            online = true;
+            retry_us = now_us;
+            backoff_ms = LOG_SHIP_RETRY_MIN_MS;
+        }
+        if (sock < 0) {
+            // Lines wait in the ring meanwhile, dropped only once it is full
+            if (!online || now_us < retry_us) {
+                continue;
+            }
+            sock = connect_server();
+            if (sock < 0) {
+                s_stats.connect_failures++;
+                ESP_LOGW(TAG, "Failed to connect to log server at %s:%d, retry in %lu ms", CONFIG_DATASERVER_ADDRESS,
+                         CONFIG_DATASERVER_PORT, backoff_ms);
+                retry_us = now_us + backoff_ms * 1000LL;
+                backoff_ms = backoff_ms * 2 < LOG_SHIP_RETRY_MAX_MS ? backoff_ms * 2 : LOG_SHIP_RETRY_MAX_MS;
+                continue;
+            }
+            s_stats.connects++;
+            backoff_ms = LOG_SHIP_RETRY_MIN_MS;
+            ESP_LOGI(TAG, "Connected to log server at %s:%d", CONFIG_DATASERVER_ADDRESS, CONFIG_DATASERVER_PORT);
+        }
+
+        size_t n;
+        while ((n = drain(batch, sizeof(batch))) > 0) {
+            if (!send_all(sock, batch, n)) {
+                s_stats.send_errors++;
+                s_stats.lost_bytes += n;
+                close(sock);
+                sock = -1;
+                retry_us = esp_timer_get_time() + backoff_ms * 1000LL;
+                ESP_LOGW(TAG, "Log server connection lost, %u bytes dropped, reconnecting", (unsigned)n);
+                break;
+            }
+            s_stats.batches++;
+            s_stats.bytes_sent += n;
+        }
+    }
+}
+
+void log_ship_init(void) {
+    s_server.sin_family = AF_INET;
+    s_server.sin_port = htons(CONFIG_DATASERVER_PORT);
+    // Only IPv4 addresses, no name resolution
+    if (inet_pton(AF_INET, CONFIG_DATASERVER_ADDRESS, &s_server.sin_addr) != 1) {
+        ESP_LOGE(TAG, "Log server address %s is not an IPv4 address, not shipping logs", CONFIG_DATASERVER_ADDRESS);
+        return;
+    }
+    if (xTaskCreate(sender_task, "LogShip", 3072, NULL, 1, NULL) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create log sender task");
+        return;
+    }
+    s_original_vprintf = esp_log_set_vprintf(log_ship_vprintf);
+}
+
+void log_ship_connect(void) {
+    __atomic_store_n(&s_connect_now, true, __ATOMIC_RELAXED);
+}
+
+void log_ship_get_stats(log_ship_stats_t *stats) {
+    *stats = s_stats;
+}
+
+void log_ship_log_stats(void) {
+    log_ship_stats_t st;
+    log_ship_get_stats(&st);
+    ESP_LOGI(TAG, "lines:%lu dropped:%lu (%lu bytes) truncated:%lu sent:%lu bytes in %lu batches", st.lines,
+             st.dropped, st.dropped_bytes, st.truncated, st.bytes_sent, st.batches);
+    ESP_LOGI(TAG, "send errors:%lu (%lu bytes lost) connects:%lu failed:%lu", st.send_errors, st.lost_bytes,
+             st.connects, st.connect_failures);
+}
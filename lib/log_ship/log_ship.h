@@ -0,0 +1,82 @@
+#ifndef LOG_SHIP_H
+#define LOG_SHIP_H
+
+#include <stdint.h>
+
+/*
+Log lines shipped to the TCP log server (CONFIG_DATASERVER_ADDRESS:CONFIG_DATASERVER_PORT) without
+ever blocking the task that logs.
+
+log_ship_init() hooks esp_log's vprintf: every line still goes to the console first, then is
+formatted straight into a lock-free multi-producer ring of CONFIG_LOG_SHIP_BUF_SIZE bytes. A
+producer claims its record with one compare-and-swap on the reserve position, writes the text and
+publishes the record by setting the commit bit in its header:
+
+    header (u32): length | PAD | COMMITTED    text, NUL, padding to 4 bytes
+
+Records never wrap: one that would is preceded by a PAD record filling the end of the ring. When
+the ring is full the line is dropped and counted, never waited for. Lines longer than
+CONFIG_LOG_SHIP_LINE_MAX are cut there and counted.
+
+A sender task at the lowest priority wakes every CONFIG_LOG_SHIP_FLUSH_MS and drains the committed
+records in order into batches of up to one TCP segment, one send() each; it stops at a record
+still being written, which its producer finishes without waiting for anything. The connection is
+opened once log_ship_connect() reports the network up; until then lines build up in the ring, so
+the boot log reaches the server too. A failed send drops its batch (counted) and closes the
+socket, and connecting is retried with exponential backoff from LOG_SHIP_RETRY_MIN_MS to
+LOG_SHIP_RETRY_MAX_MS. Sends time out after LOG_SHIP_SEND_TIMEOUT_MS, so a stalled server only
+ever holds up the sender task.
+*/
+
+#ifndef CONFIG_DATASERVER_ADDRESS
+#define CONFIG_DATASERVER_ADDRESS "machine.local"
+#endif
+#ifndef CONFIG_DATASERVER_PORT
+#define CONFIG_DATASERVER_PORT 9000
+#endif
+#ifndef CONFIG_LOG_SHIP_BUF_SIZE
+#define CONFIG_LOG_SHIP_BUF_SIZE 8192
+#endif
+#ifndef CONFIG_LOG_SHIP_LINE_MAX
+#define CONFIG_LOG_SHIP_LINE_MAX 512
+#endif
+#ifndef CONFIG_LOG_SHIP_FLUSH_MS
+#define CONFIG_LOG_SHIP_FLUSH_MS 100
+#endif
+
+#define LOG_SHIP_BATCH              1460    // Bytes per send(): one TCP segment on Ethernet-sized MTUs
+#define LOG_SHIP_RETRY_MIN_MS       1000
+#define LOG_SHIP_RETRY_MAX_MS       30000
+#define LOG_SHIP_SEND_TIMEOUT_MS    2000
+
+_Static_assert((CONFIG_LOG_SHIP_BUF_SIZE & (CONFIG_LOG_SHIP_BUF_SIZE - 1)) == 0, "ring size is a power of 2");
+_Static_assert(CONFIG_LOG_SHIP_LINE_MAX <= LOG_SHIP_BATCH, "a line fits one batch");
+_Static_assert(CONFIG_LOG_SHIP_BUF_SIZE >= 2 * (CONFIG_LOG_SHIP_LINE_MAX + 8), "the ring holds two lines");
+
+typedef struct {
+    uint32_t lines;             // Queued for the server
+    uint32_t dropped;           // Lines not queued: ring full (server slow, or not connected yet)
+    uint32_t dropped_bytes;
+    uint32_t truncated;         // Lines cut to CONFIG_LOG_SHIP_LINE_MAX
+    uint32_t bytes_sent;
+    uint32_t batches;           // send() calls
+    uint32_t send_errors;       // Connection lost or send timed out: batch dropped, reconnecting
+    uint32_t lost_bytes;        // Bytes of the batches dropped that way
+    uint32_t connects;
+    uint32_t connect_failures;
+} log_ship_stats_t;
+
+/**
+ * @brief Hook esp_log and start the sender task. Lines are kept from here on, sent once connected.
+ */
+void log_ship_init(void);
+
+/**
+ * @brief The network is up (IP_EVENT_STA_GOT_IP): connect now, and again whenever the connection drops.
+ */
+void log_ship_connect(void);
+
+void log_ship_get_stats(log_ship_stats_t *stats);
+void log_ship_log_stats(void);
+
+#endif // LOG_SHIP_H
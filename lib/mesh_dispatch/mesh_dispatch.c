@@ -0,0 +1,458 @@
+#include <string.h>
+#include "mesh_dispatch.h"
+#include "esp_cpu.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "../mesh_tx/mesh_tx.h"
+#include "../mesh_frag/mesh_frag.h"
+
+#define STATS_INTERVAL_US   (60 * 1000 * 1000LL)
+#define SEQ_PEERS           16      // Senders tracked, least recently heard replaced
+#define SEQ_REORDER_WINDOW  256     // Further back than this: the sender restarted, resync
+#define SEQ_MAX_GAP         4096    // Further ahead than this: resync rather than count a gap
+
+_Static_assert(sizeof(RxStatsReport_t) <= MESH_TX_MTU - WIRE_MAX_OVERHEAD, "RX_STATS_REPORT fits one packet");
+
+static const char *TAG = "mesh_dispatch";
+
+struct mesh_worker {
+    const char *name;
+    QueueHandle_t queue;
+    mesh_worker_stats_t stats;
+};
+
+typedef struct {
+    mesh_addr_t from;
+    pkt_buf_t *buf;             // Reference owned by the job
+    int64_t queued_us;
+    uint16_t type;
+    uint16_t offset;            // Payload in buf->data
+    uint16_t len;
+} rx_job_t;
+
+typedef struct {
+    mesh_rx_handler_t handler;  // NULL: not registered
+    void *arg;
+    mesh_worker_t *worker;      // NULL: run on the RX task
+    const char *name;
+    uint16_t min_len;
+    uint16_t max_len;
+    mesh_dispatch_stats_t stats;
+} rx_type_t;
+
+// Last v2 sequence number per sender and type
+typedef struct {
+    uint8_t mac[6];
+    uint16_t seen;              // Bit per type: seq[] valid
+    uint32_t last_heard;        // s_seq_clock when last used, 0: free
+    uint16_t seq[MESH_DISPATCH_MAX_TYPES];
+} seq_peer_t;
+
+// Written by mesh_dispatch_register() from any task, stats only by the RX task
+static rx_type_t s_types[MESH_DISPATCH_MAX_TYPES];
+static mesh_dispatch_totals_t s_totals;
+static seq_peer_t s_seq_peers[SEQ_PEERS];
+static uint32_t s_seq_clock;
+static int64_t s_last_stats_us;
+static mesh_worker_t s_workers[MESH_DISPATCH_MAX_WORKERS];
+static int s_num_workers;
+
+// 0 below 1k cycles, then one bucket per factor of 4
+static inline int hist_bucket(uint32_t cycles) {
+    if (cycles < 1024) {
+        return 0;
+    }
+    int bucket = (31 - __builtin_clz(cycles) - 10) / 2 + 1;
+    return bucket < MESH_DISPATCH_HIST_BUCKETS ? bucket : MESH_DISPATCH_HIST_BUCKETS - 1;
+}
+
+esp_err_t mesh_dispatch_register_worker(mesh_worker_t *worker, ProtocolType type, const char *name, size_t min_len,
+                                        size_t max_len, mesh_rx_handler_t handler, void *arg) {
+    if (type >= MESH_DISPATCH_MAX_TYPES || handler == NULL || min_len > max_len ||
+        max_len > CONFIG_MESH_FRAG_MAX_MSG) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    rx_type_t *t = &s_types[type];
+    __atomic_store_n(&t->handler, NULL, __ATOMIC_RELEASE);
+    t->arg = arg;
+    t->worker = worker;
+    t->name = name;
+    t->min_len = min_len;
+    t->max_len = max_len;
+    // The RX task only looks at the rest once it sees the handler
+    __atomic_store_n(&t->handler, handler, __ATOMIC_RELEASE);
+    return ESP_OK;
+}
+
+esp_err_t mesh_dispatch_register(ProtocolType type, const char *name, size_t min_len, size_t max_len,
+                                 mesh_rx_handler_t handler, void *arg) {
+    return mesh_dispatch_register_worker(NULL, type, name, min_len, max_len, handler, arg);
+}
+
+static void run_handler(rx_type_t *t, mesh_rx_handler_t handler, const mesh_addr_t *from, pkt_buf_t *buf,
+                        const uint8_t *payload, size_t payload_len) {
+    uint32_t start = esp_cpu_get_cycle_count();
+    handler(from, payload, payload_len, buf, t->arg);
+    uint32_t cycles = esp_cpu_get_cycle_count() - start;
+
+    t->stats.packets++;
+    t->stats.bytes += payload_len;
+    t->stats.sum_cycles += cycles;
+    t->stats.hist[hist_bucket(cycles)]++;
+    if (cycles > t->stats.max_cycles) {
+        t->stats.max_cycles = cycles;
+    }
+}
+
+static void worker_task(void *arg) {
+    mesh_worker_t *w = arg;
+    rx_job_t job;
+    while (true) {
+        if (!xQueueReceive(w->queue, &job, portMAX_DELAY)) {
+            continue;
+        }
+        uint32_t wait_us = (uint32_t)(esp_timer_get_time() - job.queued_us);
+        w->stats.jobs++;
+        w->stats.wait_last_us = wait_us;
+        if (wait_us > w->stats.wait_max_us) {
+            w->stats.wait_max_us = wait_us;
+        }
+        rx_type_t *t = &s_types[job.type];
+        run_handler(t, __atomic_load_n(&t->handler, __ATOMIC_ACQUIRE), &job.from, job.buf,
+                    job.buf->data + job.offset, job.len);
+        pkt_buf_release(job.buf);
+    }
+}
+
+mesh_worker_t *mesh_worker_create(const char *name, uint8_t queue_len, uint32_t stack_size, UBaseType_t priority) {
+    if (s_num_workers >= MESH_DISPATCH_MAX_WORKERS) {
+        return NULL;
+    }
+    mesh_worker_t *w = &s_workers[s_num_workers];
+    w->name = name;
+    w->queue = xQueueCreate(queue_len, sizeof(rx_job_t));
+    if (w->queue == NULL) {
+        ESP_LOGE(TAG, "Failed to create %s queue", name);
+        return NULL;
+    }
+    if (xTaskCreate(worker_task, name, stack_size, w, priority, NULL) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create %s task", name);
+        vQueueDelete(w->queue);
+        w->queue = NULL;
+        return NULL;
+    }
+    s_num_workers++;
+    return w;
+}
+
+// Hand a packet to its worker without ever blocking the RX task
+static void queue_job(rx_type_t *t, const mesh_addr_t *from, pkt_buf_t *buf, size_t offset, const wire_hdr_t *hdr) {
+    rx_job_t job = {
+        .from = *from,
+        .buf = buf,
+        .queued_us = esp_timer_get_time(),
+        .type = hdr->type,
+        .offset = offset,
+        .len = hdr->length,
+    };
+    pkt_buf_ref(buf);
+    if (!xQueueSend(t->worker->queue, &job, 0)) {
+        pkt_buf_release(buf);
+        t->stats.queue_full++;
+        ESP_LOGD(TAG, "%s queue full, %s dropped", t->worker->name, t->name);
+        return;
+    }
+    uint32_t depth = uxQueueMessagesWaiting(t->worker->queue);
+    if (depth > t->worker->stats.max_depth) {
+        t->worker->stats.max_depth = depth;
+    }
+}
+
+static seq_peer_t *seq_peer(const mesh_addr_t *from) {
+    seq_peer_t *oldest = &s_seq_peers[0];
+    s_seq_clock++;
+    for (int i = 0; i < SEQ_PEERS; i++) {
+        seq_peer_t *p = &s_seq_peers[i];
+        if (p->last_heard != 0 && memcmp(p->mac, from->addr, sizeof(p->mac)) == 0) {
+            p->last_heard = s_seq_clock;
+            return p;
+        }
+        if (p->last_heard < oldest->last_heard) {
+            oldest = p;
+        }
+    }
+    memcpy(oldest->mac, from->addr, sizeof(oldest->mac));
+    oldest->seen = 0;
+    oldest->last_heard = s_seq_clock;
+    return oldest;
+}
+
+static void track_seq(rx_type_t *t, const mesh_addr_t *from, const wire_hdr_t *hdr) {
+    seq_peer_t *p = seq_peer(from);
+    uint16_t bit = 1 << hdr->type;
+    if (p->seen & bit) {
+        int16_t ahead = (int16_t)(hdr->seq - p->seq[hdr->type]);
+        if (ahead <= 0 && ahead > -SEQ_REORDER_WINDOW) {
+            t->stats.out_of_order++;
+            return;
+        }
+        if (ahead > 1 && ahead <= SEQ_MAX_GAP) {
+            t->stats.seq_gaps += ahead - 1;
+        }
+    }
+    p->seen |= bit;
+    p->seq[hdr->type] = hdr->seq;
+}
+
+static void track_latency(rx_type_t *t, const wire_hdr_t *hdr) {
+    uint32_t latency_us;
+    if (!wire_latency_us(hdr, &latency_us)) {
+        return;
+    }
+    t->stats.latency_last_us = latency_us;
+    t->stats.latency_sum_us += latency_us;
+    t->stats.latency_samples++;
+    if (latency_us > t->stats.latency_max_us) {
+        t->stats.latency_max_us = latency_us;
+    }
+}
+
+static void log_bad_header(const mesh_addr_t *from, const uint8_t *pkt, size_t size, wire_err_t err) {
+    ESP_LOGW(TAG, "Bad header from "MACSTR": error %d, %u bytes", MAC2STR(from->addr), err, (unsigned)size);
+    if (size >= WIRE_HEADER_V2_SIZE && pkt[1] >> 5 == WIRE_VERSION_2) {
+        PROTOCOL_LOG_BASE64(ESP_LOG_WARN, DATATAG, pkt, WIRE_HEADER_V2_SIZE, WIRE_HEADER_V2_NAME,
+                            WIRE_HEADER_V2_FORMAT);
+    } else if (size >= WIRE_HEADER_V1_SIZE) {
+        PROTOCOL_LOG_BASE64(ESP_LOG_WARN, DATATAG, pkt, WIRE_HEADER_V1_SIZE, WIRE_HEADER_V1_NAME,
+                            WIRE_HEADER_V1_FORMAT);
+    }
+}
+
+// Dispatch the packet at buf->data[offset..offset + size): the whole buffer, or a record of an AGGREGATE frame
+static void dispatch(const mesh_addr_t *from, pkt_buf_t *buf, size_t offset, size_t size) {
+    const uint8_t *pkt = buf->data + offset;
+    wire_hdr_t hdr;
+    wire_err_t err = wire_decode(pkt, size, &hdr);
+    if (err == WIRE_ERR_SHORT) {
+        s_totals.unknown++;
+        ESP_LOGW(TAG, "Packet from "MACSTR" too small for its header", MAC2STR(from->addr));
+        return;
+    }
+    if (err == WIRE_ERR_VERSION || err == WIRE_ERR_CRC) {
+        s_totals.bad_header++;
+        log_bad_header(from, pkt, size, err);
+        return;
+    }
+    if (hdr.version == WIRE_VERSION_2) {
+        s_totals.v2_packets++;
+    } else {
+        s_totals.v1_packets++;
+    }
+
+    rx_type_t *t = NULL;
+    mesh_rx_handler_t handler = NULL;
+    if (hdr.type < MESH_DISPATCH_MAX_TYPES) {
+        t = &s_types[hdr.type];
+        handler = __atomic_load_n(&t->handler, __ATOMIC_ACQUIRE);
+    }
+    if (handler == NULL) {
+        s_totals.unknown++;
+        ESP_LOGW(TAG, "Unknown ProtocolType: %u from "MACSTR, hdr.type, MAC2STR(from->addr));
+        return;
+    }
+    if (err != WIRE_OK || hdr.length < t->min_len || hdr.length > t->max_len) {
+        t->stats.malformed++;
+        ESP_LOGW(TAG, "%s from "MACSTR": %u bytes, header says %u", t->name, MAC2STR(from->addr),
+                 (unsigned)(size - hdr.hdr_size), hdr.length);
+        return;
+    }
+    if (hdr.version == WIRE_VERSION_2) {
+        track_seq(t, from, &hdr);
+        track_latency(t, &hdr);
+    }
+    if (t->worker != NULL) {
+        queue_job(t, from, buf, offset + hdr.hdr_size, &hdr);
+    } else {
+        run_handler(t, handler, from, buf, pkt + hdr.hdr_size, hdr.length);
+    }
+}
+
+void mesh_dispatch_packet(const mesh_addr_t *from, pkt_buf_t *buf) {
+    dispatch(from, buf, 0, buf->len);
+
+    int64_t now_us = esp_timer_get_time();
+    if (now_us - s_last_stats_us > STATS_INTERVAL_US) {
+        if (s_last_stats_us != 0) {
+            mesh_dispatch_log_stats();
+        }
+        s_last_stats_us = now_us;
+    }
+}
+
+void mesh_dispatch_message(const mesh_addr_t *from, ProtocolType type, const void *payload, size_t len) {
+    rx_type_t *t = NULL;
+    mesh_rx_handler_t handler = NULL;
+    if (type < MESH_DISPATCH_MAX_TYPES) {
+        t = &s_types[type];
+        handler = __atomic_load_n(&t->handler, __ATOMIC_ACQUIRE);
+    }
+    if (handler == NULL) {
+        s_totals.unknown++;
+        ESP_LOGW(TAG, "Unknown ProtocolType: %u from "MACSTR" (reassembled)", type, MAC2STR(from->addr));
+        return;
+    }
+    // No packet buffer to hand to a worker, or to a handler that unpacks the packet it came in
+    if (t->worker != NULL || mesh_dispatch_packet_only(type) || len < t->min_len || len > t->max_len) {
+        t->stats.malformed++;
+        ESP_LOGW(TAG, "%s from "MACSTR": reassembled message of %u bytes not accepted", t->name,
+                 MAC2STR(from->addr), (unsigned)len);
+        return;
+    }
+    run_handler(t, handler, from, NULL, payload, len);
+}
+
+static void handle_query(const mesh_addr_t *from, const void *payload, size_t payload_len, pkt_buf_t *buf,
+                         void *arg) {
+    static RxStatsReport_t report;     // Too big for the RX task stack
+    report = (RxStatsReport_t){
+        .unknown = s_totals.unknown,
+        .bad_header = s_totals.bad_header,
+        .v1_packets = s_totals.v1_packets,
+        .v2_packets = s_totals.v2_packets,
+        .cpu_mhz = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ,
+    };
+    for (int i = 0; i < MESH_DISPATCH_MAX_TYPES && report.count < RX_STATS_REPORT_ENTRIES; i++) {
+        const rx_type_t *t = &s_types[i];
+        if (__atomic_load_n(&t->handler, __ATOMIC_ACQUIRE) == NULL) {
+            continue;
+        }
+        RxStatsEntry_t *e = &report.entries[report.count++];
+        e->type = i;
+        e->packets = t->stats.packets;
+        e->bytes = t->stats.bytes;
+        e->malformed = t->stats.malformed;
+        e->queue_full = t->stats.queue_full;
+        e->avg_cycles = t->stats.packets ? (uint32_t)(t->stats.sum_cycles / t->stats.packets) : 0;
+        e->max_cycles = t->stats.max_cycles;
+        memcpy(e->hist, t->stats.hist, sizeof(e->hist));
+        e->seq_gaps = t->stats.seq_gaps;
+        e->out_of_order = t->stats.out_of_order;
+        e->latency_avg_us = t->stats.latency_samples ?
+                            (uint32_t)(t->stats.latency_sum_us / t->stats.latency_samples) : 0;
+        e->latency_max_us = t->stats.latency_max_us;
+    }
+    uint16_t len = offsetof(RxStatsReport_t, entries) + report.count * sizeof(RxStatsEntry_t);
+    esp_err_t err = mesh_tx_send(MESH_TX_CONTROL, from, MESH_DATA_P2P, RX_STATS_REPORT, &report, len);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to send RX_STATS_REPORT: 0x%x", err);
+    }
+}
+
+static void handle_report(const mesh_addr_t *from, const void *payload, size_t payload_len, pkt_buf_t *buf,
+                          void *arg) {
+    static RxStatsReport_t report;
+    report = (RxStatsReport_t){ 0 };
+    memcpy(&report, payload, payload_len);
+    size_t count = (payload_len - offsetof(RxStatsReport_t, entries)) / sizeof(RxStatsEntry_t);
+    if (report.count < count) {
+        count = report.count;
+    }
+    uint32_t mhz = report.cpu_mhz ? report.cpu_mhz : 1;
+    ESP_LOGI(TAG, "Node "MACSTR" RX stats, unknown type:%lu bad header:%lu v1/v2: %lu/%lu", MAC2STR(from->addr),
+             report.unknown, report.bad_header, report.v1_packets, report.v2_packets);
+    for (size_t i = 0; i < count; i++) {
+        const RxStatsEntry_t *e = &report.entries[i];
+        ESP_LOGI(TAG, "  type %u packets:%lu bytes:%lu malformed:%lu queue full:%lu handler avg/max: %lu/%lu us "
+                 "hist:%lu/%lu/%lu/%lu/%lu/%lu/%lu/%lu",
+                 e->type, e->packets, e->bytes, e->malformed, e->queue_full, e->avg_cycles / mhz, e->max_cycles / mhz,
+                 e->hist[0], e->hist[1], e->hist[2], e->hist[3], e->hist[4], e->hist[5], e->hist[6], e->hist[7]);
+        if (e->seq_gaps || e->out_of_order || e->latency_max_us) {
+            ESP_LOGI(TAG, "  type %u seq gaps:%lu out of order:%lu latency avg/max: %lu/%lu us",
+                     e->type, e->seq_gaps, e->out_of_order, e->latency_avg_us, e->latency_max_us);
+        }
+    }
+}
+
+// Unpack an AGGREGATE frame (mesh_tx.h): whole packets back to back, each dispatched as if received alone
+static void handle_aggregate(const mesh_addr_t *from, const void *payload, size_t payload_len, pkt_buf_t *buf,
+                             void *arg) {
+    size_t start = (const uint8_t *)payload - buf->data;
+    size_t end = start + payload_len;
+    for (size_t offset = start; offset < end; ) {
+        size_t size = wire_packet_size(buf->data + offset, end - offset);
+        // Byte 0 is the type in both header versions; frames are never nested
+        if (size == 0 || buf->data[offset] == AGGREGATE) {
+            s_types[AGGREGATE].stats.malformed++;
+            ESP_LOGW(TAG, "AGGREGATE from "MACSTR": bad record at %u of %u bytes", MAC2STR(from->addr),
+                     (unsigned)(offset - start), (unsigned)payload_len);
+            return;
+        }
+        dispatch(from, buf, offset, size);
+        offset += size;
+    }
+}
+
+esp_err_t mesh_dispatch_init(void) {
+    esp_err_t err = mesh_dispatch_register(RX_STATS_QUERY, "RX_STATS_QUERY", 0, 0, handle_query, NULL);
+    if (err == ESP_OK) {
+        err = mesh_dispatch_register(RX_STATS_REPORT, "RX_STATS_REPORT", offsetof(RxStatsReport_t, entries),
+                                     sizeof(RxStatsReport_t), handle_report, NULL);
+    }
+    if (err == ESP_OK) {
+        err = mesh_dispatch_register(AGGREGATE, "AGGREGATE", WIRE_HEADER_V1_SIZE,
+                                     PKT_POOL_BUF_SIZE - WIRE_HEADER_V1_SIZE, handle_aggregate, NULL);
+    }
+    return err;
+}
+
+esp_err_t mesh_dispatch_query(const mesh_addr_t *to) {
+    return mesh_tx_send(MESH_TX_CONTROL, to, MESH_DATA_P2P, RX_STATS_QUERY, NULL, 0);
+}
+
+bool mesh_dispatch_get_stats(ProtocolType type, mesh_dispatch_stats_t *stats) {
+    if (type >= MESH_DISPATCH_MAX_TYPES || __atomic_load_n(&s_types[type].handler, __ATOMIC_ACQUIRE) == NULL) {
+        *stats = (mesh_dispatch_stats_t){ 0 };
+        return false;
+    }
+    *stats = s_types[type].stats;
+    return true;
+}
+
+void mesh_dispatch_get_totals(mesh_dispatch_totals_t *totals) {
+    *totals = s_totals;
+}
+
+void mesh_worker_get_stats(const mesh_worker_t *worker, mesh_worker_stats_t *stats) {
+    *stats = worker->stats;
+}
+
+void mesh_dispatch_log_stats(void) {
+    ESP_LOGI(TAG, "Packets v1/v2: %lu/%lu unknown type:%lu bad header:%lu", s_totals.v1_packets,
+             s_totals.v2_packets, s_totals.unknown, s_totals.bad_header);
+    for (int i = 0; i < MESH_DISPATCH_MAX_TYPES; i++) {
+        mesh_dispatch_stats_t st;
+        if (!mesh_dispatch_get_stats(i, &st) || (st.packets == 0 && st.malformed == 0 && st.queue_full == 0)) {
+            continue;
+        }
+        ESP_LOGI(TAG, "%s packets:%lu bytes:%lu malformed:%lu queue full:%lu handler avg/max: %lu/%lu us "
+                 "hist:%lu/%lu/%lu/%lu/%lu/%lu/%lu/%lu",
+                 s_types[i].name, st.packets, st.bytes, st.malformed, st.queue_full,
+                 st.packets ? (uint32_t)(st.sum_cycles / st.packets / CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ) : 0,
+                 st.max_cycles / CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ,
+                 st.hist[0], st.hist[1], st.hist[2], st.hist[3], st.hist[4], st.hist[5], st.hist[6], st.hist[7]);
+        if (st.seq_gaps || st.out_of_order || st.latency_samples) {
+            ESP_LOGI(TAG, "%s seq gaps:%lu out of order:%lu latency last/avg/max: %lu/%lu/%lu us", s_types[i].name,
+                     st.seq_gaps, st.out_of_order, st.latency_last_us,
+                     st.latency_samples ? (uint32_t)(st.latency_sum_us / st.latency_samples) : 0, st.latency_max_us);
+        }
+    }
+    for (int i = 0; i < s_num_workers; i++) {
+        const mesh_worker_t *w = &s_workers[i];
+        if (w->stats.jobs) {
+            ESP_LOGI(TAG, "%s worker jobs:%lu max depth:%lu wait last/max: %lu/%lu us", w->name, w->stats.jobs,
+                     w->stats.max_depth, w->stats.wait_last_us, w->stats.wait_max_us);
+        }
+    }
+}
@@ -0,0 +1,172 @@
+#ifndef MESH_DISPATCH_H
+#define MESH_DISPATCH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "esp_mesh.h"
+#include "freertos/FreeRTOS.h"
+#include "../protocol/protocol.h"
+#include "../pkt_pool/pkt_pool.h"
+#include "../protocol/wire.h"
+
+/*
+Mesh receive dispatcher.
+
+Each module registers a handler for the ProtocolType values it understands, with the payload length
+range it accepts. The mesh RX task hands every packet to mesh_dispatch_packet(), which decodes the
+header (v1 or v2, wire.h) and checks the received size against its length and the registered range
+before calling the handler; packets that fail are counted as malformed and never reach it.
+
+AGGREGATE frames (small packets packed together by mesh_tx.h) are unpacked here: each packet in the
+frame goes through the same checks and handlers as a packet received on its own. Messages larger
+than one packet are reassembled by mesh_frag.h and come in through mesh_dispatch_message().
+
+For v2 packets the dispatcher also tracks the sequence number per sender and type (gaps, and
+duplicates or late arrivals) and the one-way latency from the header timestamp when both ends
+have GPS time.
+
+Handlers that block (flash erase/write for OTA) are registered on a worker instead: the RX task
+only takes a reference on the packet buffer and queues it, and the worker task runs the handler.
+Worker queues are bounded; when one is full the packet is dropped and counted (queue_full) rather
+than stalling the RX task, so RTK_DATA and PTP_DATA keep their receive latency while a worker is
+busy. A full queue holds its packet buffers, which also bounds the pool share one slow type can take.
+
+Per type the dispatcher counts packets, bytes and malformed drops, and times every handler call
+in CPU cycles into a histogram with buckets of 4x:
+
+    bucket   0      1       2        3         4          5         6        7
+    cycles   <1k    <4k     <16k     <64k      <256k      <1M       <4M      >=4M
+
+The counters are logged every 60 s and can be queried from any node with RX_STATS_QUERY; the reply
+(RX_STATS_REPORT) is logged by the node that asked.
+*/
+
+#define MESH_DISPATCH_MAX_TYPES     RX_STATS_MAX_TYPES  // ProtocolType values below this can be registered
+#define MESH_DISPATCH_HIST_BUCKETS  RX_STATS_HIST_BUCKETS
+
+#define MESH_DISPATCH_MAX_WORKERS   2
+
+#ifndef CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ
+#define CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ 160
+#endif
+
+/**
+ * @brief Handle one received packet, header already checked.
+ *
+ * Runs on the mesh RX task, or on the worker it was registered on: anything slow on the RX task holds
+ * up every other packet type. The packet lives in `buf` until the handler returns; to keep it longer
+ * take a reference with pkt_buf_ref(). `buf` is NULL for a message reassembled from fragments.
+ *
+ * @param payload     Payload after the header.
+ * @param payload_len Within the range given at registration.
+ * @param arg         As passed to mesh_dispatch_register().
+ */
+typedef void (*mesh_rx_handler_t)(const mesh_addr_t *from, const void *payload, size_t payload_len,
+                                  pkt_buf_t *buf, void *arg);
+
+typedef struct mesh_worker mesh_worker_t;
+
+typedef struct {
+    uint32_t jobs;
+    uint32_t max_depth;         // Queue high-water mark
+    uint32_t wait_last_us;      // Queued to handler start
+    uint32_t wait_max_us;
+} mesh_worker_stats_t;
+
+typedef struct {
+    uint32_t packets;
+    uint32_t bytes;             // Payload bytes handed to the handler
+    uint32_t malformed;         // Size not matching the header, or payload length out of range
+    uint32_t queue_full;        // Dropped: the worker queue was full
+    uint32_t max_cycles;        // Slowest handler call
+    uint64_t sum_cycles;
+    uint32_t hist[MESH_DISPATCH_HIST_BUCKETS];
+    // v2 header only
+    uint32_t seq_gaps;          // Sequence numbers skipped
+    uint32_t out_of_order;      // Duplicate or older sequence number (still dispatched)
+    uint32_t latency_last_us;   // Sender to dispatcher
+    uint32_t latency_max_us;
+    uint32_t latency_samples;
+    uint64_t latency_sum_us;
+} mesh_dispatch_stats_t;
+
+typedef struct {
+    uint32_t unknown;           // No handler for the type, or too short for a header
+    uint32_t bad_header;        // Unknown version or CRC error
+    uint32_t v1_packets;
+    uint32_t v2_packets;
+} mesh_dispatch_totals_t;
+
+/**
+ * @brief Register the handler of a packet type (replaces any earlier one). Safe from any task.
+ *
+ * @param name    For the logs.
+ * @param min_len Smallest payload accepted.
+ * @param max_len Largest payload accepted: up to one packet, or CONFIG_MESH_FRAG_MAX_MSG for types sent
+ *                with mesh_frag_send() (handler on the RX task only).
+ * @return ESP_ERR_INVALID_ARG if `type` is not below MESH_DISPATCH_MAX_TYPES or the range is empty.
+ */
+esp_err_t mesh_dispatch_register(ProtocolType type, const char *name, size_t min_len, size_t max_len,
+                                 mesh_rx_handler_t handler, void *arg);
+
+/**
+ * @brief Create a worker task with its own bounded queue. Call at init, before registering on it.
+ *
+ * @return NULL if the MESH_DISPATCH_MAX_WORKERS workers exist already or out of memory.
+ */
+mesh_worker_t *mesh_worker_create(const char *name, uint8_t queue_len, uint32_t stack_size, UBaseType_t priority);
+
+/**
+ * @brief As mesh_dispatch_register(), with the handler run on `worker` instead of the RX task.
+ */
+esp_err_t mesh_dispatch_register_worker(mesh_worker_t *worker, ProtocolType type, const char *name, size_t min_len,
+                                        size_t max_len, mesh_rx_handler_t handler, void *arg);
+
+/**
+ * @brief Register the RX_STATS_QUERY/RX_STATS_REPORT and AGGREGATE handlers. Call once before the RX task starts.
+ */
+esp_err_t mesh_dispatch_init(void);
+
+/**
+ * @brief Validate and dispatch a received packet (buf->data[0..buf->len), as received).
+ *
+ * The caller keeps its reference to `buf`.
+ */
+void mesh_dispatch_packet(const mesh_addr_t *from, pkt_buf_t *buf);
+
+/**
+ * @brief Types whose handlers work on the packet buffer itself (AGGREGATE, FRAGMENT, FRAG_NACK):
+ * only ever dispatched as packets, never as a reassembled message.
+ */
+static inline bool mesh_dispatch_packet_only(ProtocolType type) {
+    return type == AGGREGATE || type == FRAGMENT || type == FRAG_NACK;
+}
+
+/**
+ * @brief Dispatch a message reassembled from fragments, on the calling task with a NULL packet buffer.
+ *
+ * Counted against its type like a packet; dropped as malformed if the type is registered on a worker,
+ * is a packet-only type (mesh_dispatch_packet_only()) or the length is out of its range. Called by
+ * mesh_frag on the RX task.
+ */
+void mesh_dispatch_message(const mesh_addr_t *from, ProtocolType type, const void *payload, size_t len);
+
+/**
+ * @brief Ask a node for its dispatcher counters; its RX_STATS_REPORT is logged when it arrives.
+ */
+esp_err_t mesh_dispatch_query(const mesh_addr_t *to);
+
+/**
+ * @return false if nothing is registered for `type` (stats zeroed).
+ */
+bool mesh_dispatch_get_stats(ProtocolType type, mesh_dispatch_stats_t *stats);
+
+void mesh_dispatch_get_totals(mesh_dispatch_totals_t *totals);
+
+void mesh_worker_get_stats(const mesh_worker_t *worker, mesh_worker_stats_t *stats);
+
+void mesh_dispatch_log_stats(void);
+
+#endif // MESH_DISPATCH_H
@@ -0,0 +1,364 @@
+#include <string.h>
+#include "mesh_frag.h"
+#include "../mesh_dispatch/mesh_dispatch.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#define STATS_INTERVAL_US   (60 * 1000 * 1000LL)
+#define NACK_US             (CONFIG_MESH_FRAG_NACK_MS * 1000LL)
+#define TIMEOUT_US          (CONFIG_MESH_FRAG_TIMEOUT_MS * 1000LL)
+
+static const char *TAG = "mesh_frag";
+
+// Sender: fragments of a recent message, kept for retransmission
+typedef struct {
+    pkt_buf_t *bufs[MESH_FRAG_MAX_FRAGMENTS];   // References owned by the history, NULL: free entry
+    int64_t resent_us[MESH_FRAG_MAX_FRAGMENTS]; // Last queued
+    int64_t sent_us;
+    mesh_addr_t to;
+    int flag;
+    uint8_t cls;            // mesh_tx_class_t
+    uint8_t count;
+    uint16_t msg_id;
+} tx_msg_t;
+
+typedef enum {
+    SLOT_FREE,
+    SLOT_RECEIVING,
+    SLOT_DONE,              // Delivered; kept until the timeout to recognise late fragments
+} slot_state_t;
+
+// Receiver: message being reassembled. Data written and delivered by the RX task only.
+typedef struct {
+    uint8_t state;          // slot_state_t
+    uint8_t type;
+    uint8_t count;
+    uint8_t nacks;
+    mesh_addr_t from;
+    uint16_t msg_id;
+    uint16_t total_len;
+    uint32_t received;      // Bit per fragment
+    int64_t first_us;
+    int64_t last_us;        // Last progress, or last NACK
+    uint8_t data[CONFIG_MESH_FRAG_MAX_MSG];
+} rx_slot_t;
+
+static tx_msg_t s_history[CONFIG_MESH_FRAG_TX_HISTORY];
+static rx_slot_t s_slots[CONFIG_MESH_FRAG_RX_SLOTS];
+static SemaphoreHandle_t s_mutex;
+static uint16_t s_msg_id;
+static mesh_frag_stats_t s_stats;
+
+static inline uint32_t all_fragments(uint8_t count) {
+    return count >= 32 ? UINT32_MAX : (1u << count) - 1;
+}
+
+// Drop the history entry's buffers (mutex held)
+static void release_msg(tx_msg_t *m) {
+    for (int i = 0; i < m->count; i++) {
+        pkt_buf_release(m->bufs[i]);
+        m->bufs[i] = NULL;
+    }
+    m->count = 0;
+}
+
+esp_err_t mesh_frag_send(mesh_tx_class_t cls, const mesh_addr_t *to, int flag, ProtocolType type,
+                         const void *payload, size_t len) {
+    if (len <= MESH_TX_MTU - WIRE_TX_OVERHEAD) {
+        return mesh_tx_send(cls, to, flag, type, payload, len);
+    }
+    if (len > CONFIG_MESH_FRAG_MAX_MSG || type > UINT8_MAX) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (mesh_dispatch_packet_only(type)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    uint8_t count = (len + MESH_FRAG_DATA_MAX - 1) / MESH_FRAG_DATA_MAX;
+
+    // Every buffer first: a message that cannot go out whole is not started
+    pkt_buf_t *bufs[MESH_FRAG_MAX_FRAGMENTS];
+    for (int i = 0; i < count; i++) {
+        bufs[i] = pkt_pool_alloc();
+        if (bufs[i] == NULL) {
+            while (--i >= 0) {
+                pkt_buf_release(bufs[i]);
+            }
+            __atomic_fetch_add(&s_stats.no_buffer, 1, __ATOMIC_RELAXED);
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    uint16_t msg_id = __atomic_fetch_add(&s_msg_id, 1, __ATOMIC_RELAXED);
+    for (int i = 0; i < count; i++) {
+        uint16_t offset = i * MESH_FRAG_DATA_MAX;
+        uint16_t n = len - offset < MESH_FRAG_DATA_MAX ? len - offset : MESH_FRAG_DATA_MAX;
+        FragHeader_t h = {
+            .msg_id = msg_id,
+            .total_len = len,
+            .offset = offset,
+            .type = type,
+            .index = i,
+            .count = count,
+        };
+        uint8_t *p = bufs[i]->data + WIRE_TX_HDR_SIZE;
+        memcpy(p, &h, sizeof(h));
+        memcpy(p + sizeof(h), (const uint8_t *)payload + offset, n);
+        bufs[i]->len = wire_encode(bufs[i]->data, FRAGMENT, sizeof(h) + n);
+    }
+
+    // The history takes the allocation references; each send below takes one of its own
+    int64_t now_us = esp_timer_get_time();
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    tx_msg_t *m = &s_history[0];
+    for (int i = 1; i < CONFIG_MESH_FRAG_TX_HISTORY && m->count != 0; i++) {
+        if (s_history[i].count == 0 || s_history[i].sent_us < m->sent_us) {
+            m = &s_history[i];
+        }
+    }
+    release_msg(m);
+    *m = (tx_msg_t){ .sent_us = now_us, .to = *to, .flag = flag, .cls = cls, .count = count, .msg_id = msg_id };
+    for (int i = 0; i < count; i++) {
+        m->bufs[i] = bufs[i];
+        m->resent_us[i] = now_us;
+        pkt_buf_ref(bufs[i]);
+    }
+    xSemaphoreGive(s_mutex);
+
+    // Not under the mutex: a bulk send can wait for room in its queue
+    esp_err_t result = ESP_OK;
+    for (int i = 0; i < count; i++) {
+        esp_err_t err = mesh_tx_send_buf(cls, to, flag, bufs[i]);
+        if (err != ESP_OK && result == ESP_OK) {
+            result = err;   // Lost fragments can still be asked for
+        }
+    }
+    __atomic_fetch_add(&s_stats.messages_sent, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&s_stats.fragments_sent, count, __ATOMIC_RELAXED);
+    return result;
+}
+
+static void handle_nack(const mesh_addr_t *from, const void *payload, size_t payload_len, pkt_buf_t *buf,
+                        void *arg) {
+    FragNack_t nack;
+    memcpy(&nack, payload, sizeof(nack));
+    s_stats.nacks_received++;
+
+    pkt_buf_t *resend[MESH_FRAG_MAX_FRAGMENTS];
+    int n = 0;
+    tx_msg_t m = { 0 };
+    int64_t now_us = esp_timer_get_time();
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    for (int i = 0; i < CONFIG_MESH_FRAG_TX_HISTORY; i++) {
+        tx_msg_t *h = &s_history[i];
+        if (h->count == 0 || h->msg_id != nack.msg_id) {
+            continue;
+        }
+        m = *h;
+        for (int f = 0; f < h->count; f++) {
+            // A fragment asked for again within the NACK interval is likely still on its way
+            if ((nack.missing & (1u << f)) && now_us - h->resent_us[f] >= NACK_US) {
+                h->resent_us[f] = now_us;
+                pkt_buf_ref(h->bufs[f]);
+                resend[n++] = h->bufs[f];
+            }
+        }
+        break;
+    }
+    xSemaphoreGive(s_mutex);
+
+    if (m.count == 0) {
+        ESP_LOGD(TAG, "FRAG_NACK from "MACSTR" for expired message %u", MAC2STR(from->addr), nack.msg_id);
+        return;
+    }
+    for (int i = 0; i < n; i++) {
+        mesh_tx_send_buf(m.cls, &m.to, m.flag, resend[i]);
+    }
+    s_stats.retransmits += n;
+}
+
+// Slot for a new message: a free one, else the one done or started longest ago (mutex held)
+static rx_slot_t *take_slot(void) {
+    rx_slot_t *best = &s_slots[0];
+    for (int i = 0; i < CONFIG_MESH_FRAG_RX_SLOTS; i++) {
+        rx_slot_t *s = &s_slots[i];
+        if (s->state == SLOT_FREE) {
+            return s;
+        }
+        if ((s->state == SLOT_DONE && best->state != SLOT_DONE) ||
+            (s->state == best->state && s->first_us < best->first_us)) {
+            best = s;
+        }
+    }
+    if (best->state == SLOT_RECEIVING) {
+        s_stats.evicted++;
+        ESP_LOGW(TAG, "Message %u from "MACSTR" dropped for a newer one, %d of %u fragments",
+                 best->msg_id, MAC2STR(best->from.addr), __builtin_popcount(best->received), best->count);
+    }
+    return best;
+}
+
+static void handle_fragment(const mesh_addr_t *from, const void *payload, size_t payload_len, pkt_buf_t *buf,
+                            void *arg) {
+    FragHeader_t h;
+    memcpy(&h, payload, sizeof(h));
+    const uint8_t *data = (const uint8_t *)payload + sizeof(h);
+    size_t n = payload_len - sizeof(h);
+    s_stats.fragments_received++;
+    // Packet-only types (AGGREGATE, FRAGMENT, FRAG_NACK) are never reassembled: their handlers need the buffer.
+    // The layout follows from total_len alone, so a fragment can only ever write its own part of the slot.
+    bool last = h.index == h.count - 1;
+    if (h.count < 2 || h.count > MESH_FRAG_MAX_FRAGMENTS || h.index >= h.count || mesh_dispatch_packet_only(h.type) ||
+        h.total_len > CONFIG_MESH_FRAG_MAX_MSG ||
+        h.count != (h.total_len + MESH_FRAG_DATA_MAX - 1) / MESH_FRAG_DATA_MAX ||
+        h.offset != h.index * MESH_FRAG_DATA_MAX || n == 0 ||
+        (last ? h.offset + n != h.total_len : n != MESH_FRAG_DATA_MAX)) {
+        s_stats.malformed++;
+        ESP_LOGW(TAG, "Bad fragment from "MACSTR": %u/%u at %u+%u of %u", MAC2STR(from->addr), h.index, h.count,
+                 h.offset, (unsigned)n, h.total_len);
+        return;
+    }
+
+    int64_t now_us = esp_timer_get_time();
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    rx_slot_t *s = NULL;
+    for (int i = 0; i < CONFIG_MESH_FRAG_RX_SLOTS; i++) {
+        if (s_slots[i].state != SLOT_FREE && s_slots[i].msg_id == h.msg_id &&
+            memcmp(s_slots[i].from.addr, from->addr, sizeof(from->addr)) == 0) {
+            s = &s_slots[i];
+            break;
+        }
+    }
+    if (s == NULL) {
+        s = take_slot();
+        s->state = SLOT_RECEIVING;
+        s->type = h.type;
+        s->count = h.count;
+        s->nacks = 0;
+        s->from = *from;
+        s->msg_id = h.msg_id;
+        s->total_len = h.total_len;
+        s->received = 0;
+        s->first_us = now_us;
+    } else if (s->type != h.type || s->count != h.count || s->total_len != h.total_len) {
+        s_stats.malformed++;
+        xSemaphoreGive(s_mutex);
+        return;
+    }
+    uint32_t bit = 1u << h.index;
+    if (s->state == SLOT_DONE || (s->received & bit)) {
+        s_stats.duplicates++;
+        xSemaphoreGive(s_mutex);
+        return;
+    }
+    memcpy(s->data + h.offset, data, n);
+    s->received |= bit;
+    s->last_us = now_us;
+    bool complete = s->received == all_fragments(s->count);
+    if (complete) {
+        s->state = SLOT_DONE;
+    }
+    xSemaphoreGive(s_mutex);
+
+    // The data stays put: only this task reuses slots
+    if (complete) {
+        s_stats.messages_received++;
+        mesh_dispatch_message(from, s->type, s->data, s->total_len);
+    }
+}
+
+// NACK stalled messages, expire old ones and release the history past the timeout
+static void mesh_frag_task(void *arg) {
+    int64_t last_stats_us = esp_timer_get_time();
+    while (true) {
+        vTaskDelay(pdMS_TO_TICKS(CONFIG_MESH_FRAG_NACK_MS));
+
+        struct {
+            mesh_addr_t to;
+            FragNack_t nack;
+        } nacks[CONFIG_MESH_FRAG_RX_SLOTS];
+        int n = 0;
+        int64_t now_us = esp_timer_get_time();
+        xSemaphoreTake(s_mutex, portMAX_DELAY);
+        for (int i = 0; i < CONFIG_MESH_FRAG_RX_SLOTS; i++) {
+            rx_slot_t *s = &s_slots[i];
+            if (s->state == SLOT_FREE) {
+                continue;
+            }
+            if (now_us - s->first_us > TIMEOUT_US) {
+                if (s->state == SLOT_RECEIVING) {
+                    s_stats.timeouts++;
+                    ESP_LOGW(TAG, "Message %u from "MACSTR" timed out, %d of %u fragments", s->msg_id,
+                             MAC2STR(s->from.addr), __builtin_popcount(s->received), s->count);
+                }
+                s->state = SLOT_FREE;
+            } else if (s->state == SLOT_RECEIVING && now_us - s->last_us >= NACK_US &&
+                       s->nacks < MESH_FRAG_MAX_NACKS) {
+                s->nacks++;
+                s->last_us = now_us;
+                nacks[n].to = s->from;
+                nacks[n].nack = (FragNack_t){
+                    .msg_id = s->msg_id,
+                    .missing = all_fragments(s->count) & ~s->received,
+                };
+                n++;
+            }
+        }
+        for (int i = 0; i < CONFIG_MESH_FRAG_TX_HISTORY; i++) {
+            if (s_history[i].count != 0 && now_us - s_history[i].sent_us > TIMEOUT_US) {
+                release_msg(&s_history[i]);
+            }
+        }
+        xSemaphoreGive(s_mutex);
+
+        for (int i = 0; i < n; i++) {
+            esp_err_t err = mesh_tx_send(MESH_TX_CONTROL, &nacks[i].to, MESH_DATA_P2P, FRAG_NACK, &nacks[i].nack,
+                                         sizeof(FragNack_t));
+            if (err == ESP_OK) {
+                s_stats.nacks_sent++;
+            }
+        }
+
+        if (now_us - last_stats_us > STATS_INTERVAL_US) {
+            if (s_stats.fragments_sent || s_stats.fragments_received) {
+                mesh_frag_log_stats();
+            }
+            last_stats_us = now_us;
+        }
+    }
+}
+
+esp_err_t mesh_frag_init(void) {
+    s_mutex = xSemaphoreCreateMutex();
+    if (s_mutex == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    esp_err_t err = mesh_dispatch_register(FRAGMENT, "FRAGMENT", sizeof(FragHeader_t) + 1,
+                                           MESH_TX_MTU - WIRE_HEADER_V1_SIZE, handle_fragment, NULL);
+    if (err == ESP_OK) {
+        err = mesh_dispatch_register(FRAG_NACK, "FRAG_NACK", sizeof(FragNack_t), sizeof(FragNack_t), handle_nack,
+                                     NULL);
+    }
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (xTaskCreate(mesh_frag_task, "MeshFrag", 3072, NULL, 5, NULL) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create fragmentation task");
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+void mesh_frag_get_stats(mesh_frag_stats_t *stats) {
+    *stats = s_stats;
+}
+
+void mesh_frag_log_stats(void) {
+    mesh_frag_stats_t st;
+    mesh_frag_get_stats(&st);
+    ESP_LOGI(TAG, "sent messages:%lu fragments:%lu no buffer:%lu NACKs received:%lu retransmits:%lu",
+             st.messages_sent, st.fragments_sent, st.no_buffer, st.nacks_received, st.retransmits);
+    ESP_LOGI(TAG, "received messages:%lu fragments:%lu duplicates:%lu NACKs sent:%lu timeouts:%lu evicted:%lu "
+             "malformed:%lu", st.messages_received, st.fragments_received, st.duplicates, st.nacks_sent,
+             st.timeouts, st.evicted, st.malformed);
+}
@@ -0,0 +1,105 @@
+#ifndef MESH_FRAG_H
+#define MESH_FRAG_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "esp_mesh.h"
+#include "../protocol/protocol.h"
+#include "../protocol/wire.h"
+#include "../mesh_tx/mesh_tx.h"
+
+/*
+Messages larger than one mesh packet, with selective retransmission.
+
+mesh_frag_send() sends a payload that fits one packet as a plain packet of its type, so small
+messages pay nothing. Anything larger, up to CONFIG_MESH_FRAG_MAX_MSG, goes out as FRAGMENT packets
+of exactly MESH_FRAG_DATA_MAX bytes each, the last one holding the rest:
+
+    wire header | FragHeader_t: msg_id, total_len, offset, type, index, count | message bytes
+
+MESH_FRAG_DATA_MAX leaves room for the largest wire header, so nodes with and without
+CONFIG_MESH_WIRE_V2_TX cut messages the same way, and a fragment whose offset, size or count does
+not follow from its index and total_len is dropped as malformed.
+
+The receiver reassembles each message in one of CONFIG_MESH_FRAG_RX_SLOTS static buffers of
+CONFIG_MESH_FRAG_MAX_MSG bytes, keyed by sender and msg_id, and passes the complete message to the
+handler registered for its type (mesh_dispatch_message()). A message that makes no progress for
+CONFIG_MESH_FRAG_NACK_MS is answered with a FRAG_NACK carrying a bitmap of the fragments still
+missing, up to MESH_FRAG_MAX_NACKS times. The sender keeps the fragment buffers of its last
+CONFIG_MESH_FRAG_TX_HISTORY messages (references into the packet pool, no copies) for
+CONFIG_MESH_FRAG_TIMEOUT_MS and queues only the missing fragments again, to the original
+destination: for a group message one resend serves every receiver that lost it, and each fragment
+is resent at most once per CONFIG_MESH_FRAG_NACK_MS whoever asks.
+
+A message still incomplete after CONFIG_MESH_FRAG_TIMEOUT_MS is dropped. When every slot is busy a
+new message takes the slot of the oldest, so stale messages never block fresh ones. Completed
+messages are remembered until the timeout as well, so late duplicate fragments are ignored rather
+than starting the message again.
+
+Reassembled messages are handed over on the mesh RX task with a NULL packet buffer: their types
+must be registered on the RX task, not on a worker, with a max_len up to CONFIG_MESH_FRAG_MAX_MSG.
+AGGREGATE, FRAGMENT and FRAG_NACK are never fragmented: fragments carrying them are malformed.
+*/
+
+#ifndef CONFIG_MESH_FRAG_MAX_MSG
+#define CONFIG_MESH_FRAG_MAX_MSG 4096
+#endif
+#ifndef CONFIG_MESH_FRAG_RX_SLOTS
+#define CONFIG_MESH_FRAG_RX_SLOTS 2
+#endif
+#ifndef CONFIG_MESH_FRAG_TX_HISTORY
+#define CONFIG_MESH_FRAG_TX_HISTORY 2
+#endif
+#ifndef CONFIG_MESH_FRAG_NACK_MS
+#define CONFIG_MESH_FRAG_NACK_MS 30
+#endif
+#ifndef CONFIG_MESH_FRAG_TIMEOUT_MS
+#define CONFIG_MESH_FRAG_TIMEOUT_MS 500
+#endif
+
+#define MESH_FRAG_DATA_MAX  (MESH_TX_MTU - WIRE_MAX_OVERHEAD - FRAG_HEADER_SIZE)     // Message bytes per fragment
+#define MESH_FRAG_MAX_NACKS 3       // Per message and receiver
+
+_Static_assert(CONFIG_MESH_FRAG_MAX_MSG >= MESH_TX_MTU, "messages up to one packet are sent unfragmented");
+_Static_assert(CONFIG_MESH_FRAG_MAX_MSG <= MESH_FRAG_MAX_FRAGMENTS * MESH_FRAG_DATA_MAX,
+               "the largest message fits MESH_FRAG_MAX_FRAGMENTS fragments");
+_Static_assert(CONFIG_MESH_FRAG_MAX_MSG <= UINT16_MAX, "FragHeader_t.total_len is 16 bits");
+
+typedef struct {
+    // Sender
+    uint32_t messages_sent;     // Fragmented messages; smaller ones are plain packets and not counted
+    uint32_t fragments_sent;
+    uint32_t no_buffer;         // Message not sent: the pool could not hold all its fragments
+    uint32_t nacks_received;
+    uint32_t retransmits;       // Fragments queued again for a FRAG_NACK
+    // Receiver
+    uint32_t messages_received; // Reassembled and dispatched
+    uint32_t fragments_received;
+    uint32_t duplicates;        // Fragment already received (retransmitted for another receiver, or late)
+    uint32_t nacks_sent;
+    uint32_t timeouts;          // Incomplete after CONFIG_MESH_FRAG_TIMEOUT_MS
+    uint32_t evicted;           // Incomplete, slot taken by a newer message
+    uint32_t malformed;         // Header inconsistent with itself or the rest of its message
+} mesh_frag_stats_t;
+
+/**
+ * @brief Register the FRAGMENT/FRAG_NACK handlers and start the task that sends NACKs and expires
+ * messages. Call once after mesh_dispatch_init(), before the RX task starts.
+ */
+esp_err_t mesh_frag_init(void);
+
+/**
+ * @brief Send a message of any size up to CONFIG_MESH_FRAG_MAX_MSG. Safe from any task.
+ *
+ * Arguments and return as mesh_tx_send(); the payload is copied before this returns. A fragmented
+ * message is queued whole or not at all: ESP_ERR_NO_MEM if the pool cannot hold every fragment,
+ * ESP_ERR_INVALID_ARG for a packet-only type (mesh_dispatch_packet_only()).
+ */
+esp_err_t mesh_frag_send(mesh_tx_class_t cls, const mesh_addr_t *to, int flag, ProtocolType type,
+                         const void *payload, size_t len);
+
+void mesh_frag_get_stats(mesh_frag_stats_t *stats);
+void mesh_frag_log_stats(void);
+
+#endif // MESH_FRAG_H
@@ -0,0 +1,351 @@
+#include <string.h>
+#include "mesh_tx.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#define STATS_INTERVAL_US   (60 * 1000 * 1000LL)
+#define AGG_FLUSH_US        (CONFIG_MESH_TX_AGGREGATE_FLUSH_MS * 1000LL)
+
+static const char *TAG = "mesh_tx";
+
+typedef enum {
+    FULL_DROP_OLDEST,
+    FULL_DROP_NEW,
+    FULL_WAIT,
+} full_policy_t;
+
+typedef struct {
+    mesh_addr_t to;
+    int flag;
+    int64_t queued_us;
+    pkt_buf_t *buf;         // Reference owned by the queue
+    uint8_t records;        // Packets in buf: more than 1 for an AGGREGATE frame
+    bool open;              // Frame still taking packets; header not written yet
+} tx_entry_t;
+
+typedef struct {
+    const char *name;
+    tx_entry_t *ring;
+    uint8_t depth;
+    uint8_t policy;         // full_policy_t
+    uint32_t max_age_us;    // 0: no limit
+    bool aggregate;         // Small packets can share a frame (CONFIG_MESH_TX_AGGREGATE)
+    uint8_t head;
+    uint8_t count;
+    bool in_flight;         // The TX task is sending the head entry
+    mesh_tx_stats_t stats;
+} tx_class_t;
+
+static tx_entry_t s_corr_ring[CONFIG_MESH_TX_CORR_QUEUE_LEN];
+static tx_entry_t s_control_ring[CONFIG_MESH_TX_CONTROL_QUEUE_LEN];
+static tx_entry_t s_telem_ring[CONFIG_MESH_TX_TELEM_QUEUE_LEN];
+static tx_entry_t s_bulk_ring[CONFIG_MESH_TX_BULK_QUEUE_LEN];
+
+static tx_class_t s_classes[MESH_TX_NUM_CLASSES] = {
+    [MESH_TX_CORRECTIONS] = { "corrections", s_corr_ring, CONFIG_MESH_TX_CORR_QUEUE_LEN, FULL_DROP_OLDEST,
+                              CONFIG_MESH_TX_CORR_MAX_AGE_MS * 1000 },
+    [MESH_TX_CONTROL]     = { "control", s_control_ring, CONFIG_MESH_TX_CONTROL_QUEUE_LEN, FULL_DROP_NEW, 0, true },
+    [MESH_TX_TELEMETRY]   = { "telemetry", s_telem_ring, CONFIG_MESH_TX_TELEM_QUEUE_LEN, FULL_DROP_OLDEST, 0, true },
+    [MESH_TX_BULK]        = { "bulk", s_bulk_ring, CONFIG_MESH_TX_BULK_QUEUE_LEN, FULL_WAIT, 0 },
+};
+
+static SemaphoreHandle_t s_mutex;
+static TaskHandle_t s_task;
+
+static inline tx_entry_t *entry_at(tx_class_t *c, uint8_t pos) {
+    return &c->ring[(c->head + pos) % c->depth];
+}
+
+// Remove the packet at position `pos` of the send order and drop the queue's reference (mutex held)
+static void remove_at(tx_class_t *c, uint8_t pos) {
+    pkt_buf_release(entry_at(c, pos)->buf);
+    for (uint8_t i = pos; i + 1 < c->count; i++) {
+        *entry_at(c, i) = *entry_at(c, i + 1);
+    }
+    c->count--;
+}
+
+static void remove_head(tx_class_t *c) {
+    pkt_buf_release(c->ring[c->head].buf);
+    c->head = (c->head + 1) % c->depth;
+    c->count--;
+}
+
+// Make room in a full class according to its policy (mutex held). Returns false if the new packet has to go.
+static bool make_room(tx_class_t *c) {
+    if (c->policy != FULL_DROP_OLDEST) {
+        return false;
+    }
+    // The oldest packet not being sent right now
+    uint8_t pos = c->in_flight ? 1 : 0;
+    if (pos >= c->count) {
+        return false;
+    }
+    c->stats.dropped_full += entry_at(c, pos)->records;
+    remove_at(c, pos);
+    return true;
+}
+
+// Turn an open frame into the packet to send (mutex held); a single record goes out as itself
+static void close_frame(tx_entry_t *e) {
+    pkt_buf_t *f = e->buf;
+    uint16_t records_len = f->len - WIRE_TX_HDR_SIZE;
+    if (e->records == 1) {
+        memmove(f->data, f->data + WIRE_TX_HDR_SIZE, records_len);
+        f->len = records_len;
+    } else {
+        f->len = wire_encode(f->data, AGGREGATE, records_len);
+    }
+    e->open = false;
+}
+
+#ifdef CONFIG_MESH_TX_AGGREGATE
+// Append a packet to the open frame for its destination (mutex held). Returns false if there is none
+// or it is full (then closed, to go out as soon as it reaches the head).
+static bool append_to_frame(tx_class_t *c, const mesh_addr_t *to, int flag, pkt_buf_t *buf) {
+    for (uint8_t pos = 0; pos < c->count; pos++) {
+        tx_entry_t *e = entry_at(c, pos);
+        if (!e->open || e->flag != flag || memcmp(e->to.addr, to->addr, sizeof(to->addr)) != 0) {
+            continue;
+        }
+        pkt_buf_t *f = e->buf;
+        if (f->len + buf->len + WIRE_TX_TRAILER_SIZE > CONFIG_MESH_TX_AGGREGATE_FRAME || e->records == UINT8_MAX) {
+            close_frame(e);
+            return false;
+        }
+        memcpy(f->data + f->len, buf->data, buf->len);
+        f->len += buf->len;
+        e->records++;
+        return true;
+    }
+    return false;
+}
+#endif
+
+esp_err_t mesh_tx_send_buf(mesh_tx_class_t cls, const mesh_addr_t *to, int flag, pkt_buf_t *buf) {
+    if (cls >= MESH_TX_NUM_CLASSES || s_mutex == NULL) {
+        pkt_buf_release(buf);
+        return cls >= MESH_TX_NUM_CLASSES ? ESP_ERR_INVALID_ARG : ESP_ERR_INVALID_STATE;
+    }
+    tx_class_t *c = &s_classes[cls];
+    int64_t deadline_us = esp_timer_get_time() + CONFIG_MESH_TX_BULK_WAIT_MS * 1000LL;
+    bool open = false;
+
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+#ifdef CONFIG_MESH_TX_AGGREGATE
+    if (c->aggregate && buf->len <= MESH_TX_AGG_RECORD_MAX) {
+        if (append_to_frame(c, to, flag, buf)) {
+            c->stats.queued++;
+            c->stats.aggregated++;
+            xSemaphoreGive(s_mutex);
+            pkt_buf_release(buf);
+            return ESP_OK;
+        }
+        open = true;
+    }
+#endif
+    while (c->count == c->depth && !make_room(c)) {
+        if (c->policy != FULL_WAIT || esp_timer_get_time() >= deadline_us) {
+            c->stats.dropped_full++;
+            xSemaphoreGive(s_mutex);
+            pkt_buf_release(buf);
+            return ESP_ERR_NO_MEM;
+        }
+        xSemaphoreGive(s_mutex);
+        vTaskDelay(pdMS_TO_TICKS(CONFIG_MESH_TX_RETRY_MS));
+        xSemaphoreTake(s_mutex, portMAX_DELAY);
+    }
+    if (open) {
+        // This packet becomes the first record of a new frame, behind room for the frame header
+        memmove(buf->data + WIRE_TX_HDR_SIZE, buf->data, buf->len);
+        buf->len += WIRE_TX_HDR_SIZE;
+    }
+    *entry_at(c, c->count) = (tx_entry_t){
+        .to = *to,
+        .flag = flag,
+        .queued_us = esp_timer_get_time(),
+        .buf = buf,
+        .records = 1,
+        .open = open,
+    };
+    c->count++;
+    c->stats.queued++;
+    if (c->count > c->stats.max_depth) {
+        c->stats.max_depth = c->count;
+    }
+    xSemaphoreGive(s_mutex);
+    xTaskNotifyGive(s_task);
+    return ESP_OK;
+}
+
+esp_err_t mesh_tx_send(mesh_tx_class_t cls, const mesh_addr_t *to, int flag, ProtocolType type,
+                       const void *payload, uint16_t len) {
+    if (WIRE_TX_OVERHEAD + len > PKT_POOL_BUF_SIZE) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    pkt_buf_t *buf = pkt_pool_alloc();
+    if (buf == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    if (len > 0) {
+        memcpy(buf->data + WIRE_TX_HDR_SIZE, payload, len);
+    }
+    buf->len = wire_encode(buf->data, type, len);
+    return mesh_tx_send_buf(cls, to, flag, buf);
+}
+
+static void account_sent(tx_class_t *c, const tx_entry_t *e, int64_t now_us) {
+    uint32_t latency_us = (uint32_t)(now_us - e->queued_us);
+    c->stats.sent += e->records;
+    if (e->records > 1) {
+        c->stats.frames++;
+    }
+    c->stats.latency_last_us = latency_us;
+    c->stats.latency_sum_us += latency_us;
+    if (latency_us > c->stats.latency_max_us) {
+        c->stats.latency_max_us = latency_us;
+    }
+}
+
+/**
+ * @brief Send queued packets, highest class first, until all queues are empty or the mesh stack is full.
+ *
+ * A class whose head is an open frame waits for the frame's flush deadline; the classes below it go ahead.
+ *
+ * @return Ticks to wait before trying again (portMAX_DELAY: nothing left, wait for a new packet).
+ */
+static TickType_t drain(void) {
+    while (true) {
+        TickType_t wait = portMAX_DELAY;
+        xSemaphoreTake(s_mutex, portMAX_DELAY);
+        tx_class_t *c = NULL;
+        for (int i = 0; i < MESH_TX_NUM_CLASSES && c == NULL; i++) {
+            tx_class_t *cand = &s_classes[i];
+            if (cand->count == 0) {
+                continue;
+            }
+            tx_entry_t *head = &cand->ring[cand->head];
+            if (head->open) {
+                int64_t left_us = head->queued_us + AGG_FLUSH_US - esp_timer_get_time();
+                if (left_us > 0) {
+                    TickType_t ticks = pdMS_TO_TICKS((left_us + 999) / 1000);
+                    if (ticks == 0) {
+                        ticks = 1;
+                    }
+                    if (ticks < wait) {
+                        wait = ticks;
+                    }
+                    continue;
+                }
+                close_frame(head);
+            }
+            c = cand;
+        }
+        if (c == NULL) {
+            xSemaphoreGive(s_mutex);
+            return wait;
+        }
+        // Senders leave the head alone while it is in flight, so the copy stays current
+        c->in_flight = true;
+        tx_entry_t e = c->ring[c->head];
+        xSemaphoreGive(s_mutex);
+
+        int64_t now_us = esp_timer_get_time();
+        esp_err_t err = ESP_OK;
+        bool stale = c->max_age_us && now_us - e.queued_us > c->max_age_us;
+        if (!stale) {
+            mesh_data_t data;
+            data.data = e.buf->data;
+            data.size = e.buf->len;
+            data.proto = MESH_PROTO_BIN;
+            data.tos = MESH_TOS_P2P;
+            err = esp_mesh_send(&e.to, &data, e.flag | MESH_DATA_NONBLOCK, NULL, 0);
+        }
+
+        xSemaphoreTake(s_mutex, portMAX_DELAY);
+        c->in_flight = false;
+        if (err == ESP_ERR_MESH_QUEUE_FULL) {
+            // Keep it at the head; anything of higher priority queued meanwhile goes first on the retry
+            c->stats.retries++;
+            xSemaphoreGive(s_mutex);
+            return pdMS_TO_TICKS(CONFIG_MESH_TX_RETRY_MS) > 0 ? pdMS_TO_TICKS(CONFIG_MESH_TX_RETRY_MS) : 1;
+        }
+        if (stale) {
+            c->stats.dropped_stale += e.records;
+        } else if (err != ESP_OK) {
+            c->stats.send_errors += e.records;
+            ESP_LOGD(TAG, "%s send to "MACSTR" failed: 0x%x", c->name, MAC2STR(e.to.addr), err);
+        } else {
+            account_sent(c, &e, esp_timer_get_time());
+        }
+        remove_head(c);
+        xSemaphoreGive(s_mutex);
+    }
+}
+
+static void mesh_tx_task(void *arg) {
+    int64_t last_stats_us = esp_timer_get_time();
+    TickType_t wait = portMAX_DELAY;
+    while (true) {
+        TickType_t stats_wait = pdMS_TO_TICKS(STATS_INTERVAL_US / 1000);
+        ulTaskNotifyTake(pdTRUE, wait < stats_wait ? wait : stats_wait);
+        wait = drain();
+        if (esp_timer_get_time() - last_stats_us > STATS_INTERVAL_US) {
+            mesh_tx_log_stats();
+            last_stats_us = esp_timer_get_time();
+        }
+    }
+}
+
+esp_err_t mesh_tx_init(void) {
+    if (s_mutex != NULL) {
+        return ESP_OK;
+    }
+    s_mutex = xSemaphoreCreateMutex();
+    if (s_mutex == NULL) {
+        ESP_LOGE(TAG, "Failed to create TX mutex");
+        return ESP_ERR_NO_MEM;
+    }
+    // Above the serial task: an RTCM epoch handed over by the framer goes out right away
+    if (xTaskCreate(mesh_tx_task, "MeshTX", 3072, NULL, 7, &s_task) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create TX task");
+        vSemaphoreDelete(s_mutex);
+        s_mutex = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+void mesh_tx_get_stats(mesh_tx_class_t cls, mesh_tx_stats_t *stats) {
+    if (cls >= MESH_TX_NUM_CLASSES || s_mutex == NULL) {
+        *stats = (mesh_tx_stats_t){ 0 };
+        return;
+    }
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    *stats = s_classes[cls].stats;
+    xSemaphoreGive(s_mutex);
+}
+
+void mesh_tx_log_stats(void) {
+    pkt_pool_stats_t pool;
+    pkt_pool_get_stats(&pool);
+    ESP_LOGI(TAG, "Packet pool: %lu buffers, in use:%lu high water:%lu allocs:%lu exhausted:%lu",
+             pool.buffers, pool.in_use, pool.high_water, pool.allocs, pool.exhausted);
+    for (int i = 0; i < MESH_TX_NUM_CLASSES; i++) {
+        mesh_tx_stats_t st;
+        mesh_tx_get_stats(i, &st);
+        if (st.queued == 0) {
+            continue;
+        }
+        ESP_LOGI(TAG, "%s queued:%lu sent:%lu dropped full/stale:%lu/%lu errors:%lu retries:%lu max depth:%lu "
+                 "latency last/avg/max: %lu/%lu/%lu us",
+                 s_classes[i].name, st.queued, st.sent, st.dropped_full, st.dropped_stale, st.send_errors,
+                 st.retries, st.max_depth, st.latency_last_us,
+                 st.sent ? (uint32_t)(st.latency_sum_us / st.sent) : 0, st.latency_max_us);
+        if (st.aggregated) {
+            ESP_LOGI(TAG, "%s aggregated:%lu in %lu frames", s_classes[i].name, st.aggregated, st.frames);
+        }
+    }
+}
@@ -0,0 +1,132 @@
+#ifndef MESH_TX_H
+#define MESH_TX_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "esp_mesh.h"
+#include "freertos/FreeRTOS.h"
+#include "../protocol/protocol.h"
+#include "../pkt_pool/pkt_pool.h"
+#include "../protocol/wire.h"
+
+/*
+Prioritized mesh transmit engine.
+
+Every mesh packet except PTP_DATA goes through one TX task instead of being sent on the caller's
+task. Senders queue a pool buffer (pkt_pool.h) in its traffic class and return; the TX task always
+sends from the highest-priority non-empty class first:
+
+    class        queue                            full queue            waits in queue at most
+    corrections  CONFIG_MESH_TX_CORR_QUEUE_LEN    drop oldest           CONFIG_MESH_TX_CORR_MAX_AGE_MS
+    control      CONFIG_MESH_TX_CONTROL_QUEUE_LEN drop new packet       -
+    telemetry    CONFIG_MESH_TX_TELEM_QUEUE_LEN   drop oldest           -
+    bulk (OTA)   CONFIG_MESH_TX_BULK_QUEUE_LEN    sender waits up to    -
+                                                  CONFIG_MESH_TX_BULK_WAIT_MS
+
+Sends are non-blocking: when the mesh stack's own queue is full the packet stays at the head of its
+class and is retried after CONFIG_MESH_TX_RETRY_MS, and a newly queued higher-priority packet goes
+out first. A slow OTA transfer or a telemetry burst therefore never holds up an RTCM epoch.
+
+With CONFIG_MESH_TX_AGGREGATE, small control and telemetry packets (up to MESH_TX_AGG_RECORD_MAX)
+for the same destination are packed into one AGGREGATE frame of up to CONFIG_MESH_TX_AGGREGATE_FRAME
+bytes instead of one mesh send each. A frame is opened by the first such packet and queued in its
+place; later ones are appended while it waits, and it goes out once it is full or
+CONFIG_MESH_TX_AGGREGATE_FLUSH_MS after the first packet. A frame holding a single packet is sent as
+that packet. The records are whole packets with their own headers, so the dispatcher on the
+receiving node hands them to the handlers as if they had arrived one by one. The mesh stack picks the
+next hop per destination, so the destination is the only grouping the application can make; for
+the usual upstream reports to the root it is the parent link.
+
+PTP_DATA keeps calling esp_mesh_send() directly: its timestamps have to be taken at the send itself.
+*/
+
+#ifndef CONFIG_MESH_TX_CORR_QUEUE_LEN
+#define CONFIG_MESH_TX_CORR_QUEUE_LEN 4
+#endif
+#ifndef CONFIG_MESH_TX_CONTROL_QUEUE_LEN
+#define CONFIG_MESH_TX_CONTROL_QUEUE_LEN 8
+#endif
+#ifndef CONFIG_MESH_TX_TELEM_QUEUE_LEN
+#define CONFIG_MESH_TX_TELEM_QUEUE_LEN 4
+#endif
+#ifndef CONFIG_MESH_TX_BULK_QUEUE_LEN
+#define CONFIG_MESH_TX_BULK_QUEUE_LEN 4
+#endif
+#ifndef CONFIG_MESH_TX_CORR_MAX_AGE_MS
+#define CONFIG_MESH_TX_CORR_MAX_AGE_MS 1000
+#endif
+#ifndef CONFIG_MESH_TX_BULK_WAIT_MS
+#define CONFIG_MESH_TX_BULK_WAIT_MS 1000
+#endif
+#ifndef CONFIG_MESH_TX_RETRY_MS
+#define CONFIG_MESH_TX_RETRY_MS 10
+#endif
+#ifndef CONFIG_MESH_TX_AGGREGATE_FLUSH_MS
+#define CONFIG_MESH_TX_AGGREGATE_FLUSH_MS 20
+#endif
+#ifndef CONFIG_MESH_TX_AGGREGATE_FRAME
+#define CONFIG_MESH_TX_AGGREGATE_FRAME 1460
+#endif
+
+#define MESH_TX_MTU PKT_POOL_BUF_SIZE
+#define MESH_TX_AGG_RECORD_MAX  (CONFIG_MESH_TX_AGGREGATE_FRAME / 4)   // Larger packets are sent on their own
+
+_Static_assert(CONFIG_MESH_TX_AGGREGATE_FRAME <= MESH_TX_MTU, "aggregate frames fit a pool buffer");
+
+// Traffic classes, highest priority first
+typedef enum {
+    MESH_TX_CORRECTIONS,    // RTK_DATA
+    MESH_TX_CONTROL,        // Requests and replies (FW_QUERY/FW_REPORT, ...)
+    MESH_TX_TELEMETRY,      // Periodic state (ECHO_DATA, ROBOT_DATA, ...)
+    MESH_TX_BULK,           // OTA_DATA
+    MESH_TX_NUM_CLASSES,
+} mesh_tx_class_t;
+
+typedef struct {
+    uint32_t queued;
+    uint32_t sent;
+    uint32_t dropped_full;      // Queue full: oldest or new packet dropped, or bulk sender gave up waiting
+    uint32_t dropped_stale;     // Waited longer than the class allows
+    uint32_t send_errors;       // esp_mesh_send failed (no route, not connected, ...)
+    uint32_t retries;           // Mesh stack queue full, packet kept and sent again
+    uint32_t aggregated;        // Appended to a queued AGGREGATE frame instead of queued on their own
+    uint32_t frames;            // AGGREGATE frames sent
+    uint32_t max_depth;         // Queue high-water mark
+    uint32_t latency_last_us;   // Queued to handed to the mesh stack
+    uint32_t latency_max_us;
+    uint64_t latency_sum_us;
+} mesh_tx_stats_t;
+
+/**
+ * @brief Create the queues and the TX task; call once before anything is sent.
+ */
+esp_err_t mesh_tx_init(void);
+
+/**
+ * @brief Queue a packet (wire header + payload) for sending. Safe from any task.
+ *
+ * @param to      Destination (node or group address).
+ * @param flag    esp_mesh_send() flags, e.g. MESH_DATA_P2P or MESH_DATA_P2P | MESH_DATA_GROUP.
+ * @param type    ProtocolType of the packet.
+ * @param payload Copied into a pool buffer; the caller can reuse it as soon as this returns.
+ * @return ESP_OK when queued, ESP_ERR_INVALID_SIZE if it does not fit MESH_TX_MTU with WIRE_TX_OVERHEAD,
+ *         ESP_ERR_NO_MEM if the pool is empty or the packet was dropped by the class' full-queue policy.
+ */
+esp_err_t mesh_tx_send(mesh_tx_class_t cls, const mesh_addr_t *to, int flag, ProtocolType type,
+                       const void *payload, uint16_t len);
+
+/**
+ * @brief Queue a packet already assembled in a pool buffer (data[0..len) as returned by wire_encode()),
+ * without a copy.
+ *
+ * Takes over the caller's reference in every case: the buffer is released once sent or dropped.
+ * Returns as mesh_tx_send().
+ */
+esp_err_t mesh_tx_send_buf(mesh_tx_class_t cls, const mesh_addr_t *to, int flag, pkt_buf_t *buf);
+
+void mesh_tx_get_stats(mesh_tx_class_t cls, mesh_tx_stats_t *stats);
+void mesh_tx_log_stats(void);
+
+#endif // MESH_TX_H
@@ -0,0 +1,62 @@
+#include "pkt_pool.h"
+
+_Static_assert(CONFIG_PKT_POOL_BUFFERS >= 1 && CONFIG_PKT_POOL_BUFFERS <= 32, "The free bitmap is one 32-bit word");
+
+#define ALL_FREE ((uint32_t)(((uint64_t)1 << CONFIG_PKT_POOL_BUFFERS) - 1))
+
+static pkt_buf_t s_bufs[CONFIG_PKT_POOL_BUFFERS];
+static uint32_t s_free = ALL_FREE;      // Bit per free buffer
+static uint32_t s_in_use;
+static uint32_t s_high_water;
+static uint32_t s_allocs;
+static uint32_t s_exhausted;
+
+pkt_buf_t *pkt_pool_alloc(void) {
+    uint32_t free_mask = __atomic_load_n(&s_free, __ATOMIC_RELAXED);
+    uint32_t bit;
+    do {
+        if (free_mask == 0) {
+            __atomic_fetch_add(&s_exhausted, 1, __ATOMIC_RELAXED);
+            return NULL;
+        }
+        bit = free_mask & -free_mask;   // Lowest free buffer
+    } while (!__atomic_compare_exchange_n(&s_free, &free_mask, free_mask & ~bit, true,
+                                          __ATOMIC_ACQUIRE, __ATOMIC_RELAXED));
+
+    pkt_buf_t *buf = &s_bufs[__builtin_ctz(bit)];
+    buf->index = (uint8_t)__builtin_ctz(bit);
+    buf->len = 0;
+    __atomic_store_n(&buf->refs, 1, __ATOMIC_RELAXED);
+
+    __atomic_fetch_add(&s_allocs, 1, __ATOMIC_RELAXED);
+    uint32_t in_use = __atomic_add_fetch(&s_in_use, 1, __ATOMIC_RELAXED);
+    uint32_t high = __atomic_load_n(&s_high_water, __ATOMIC_RELAXED);
+    while (in_use > high &&
+           !__atomic_compare_exchange_n(&s_high_water, &high, in_use, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+    return buf;
+}
+
+void pkt_buf_ref(pkt_buf_t *buf) {
+    __atomic_fetch_add(&buf->refs, 1, __ATOMIC_RELAXED);
+}
+
+void pkt_buf_release(pkt_buf_t *buf) {
+    if (buf == NULL) {
+        return;
+    }
+    // Release: every write to the buffer by this owner happens before it can be reallocated
+    if (__atomic_sub_fetch(&buf->refs, 1, __ATOMIC_ACQ_REL) != 0) {
+        return;
+    }
+    __atomic_fetch_sub(&s_in_use, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_or(&s_free, 1u << buf->index, __ATOMIC_RELEASE);
+}
+
+void pkt_pool_get_stats(pkt_pool_stats_t *stats) {
+    stats->buffers = CONFIG_PKT_POOL_BUFFERS;
+    stats->in_use = __atomic_load_n(&s_in_use, __ATOMIC_RELAXED);
+    stats->high_water = __atomic_load_n(&s_high_water, __ATOMIC_RELAXED);
+    stats->allocs = __atomic_load_n(&s_allocs, __ATOMIC_RELAXED);
+    stats->exhausted = __atomic_load_n(&s_exhausted, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,70 @@
+#ifndef PKT_POOL_H
+#define PKT_POOL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+Fixed-size packet buffers with reference counts.
+
+All mesh packets (header + payload) live in one static pool of CONFIG_PKT_POOL_BUFFERS
+buffers of PKT_POOL_BUF_SIZE bytes, so nothing on the packet paths touches the heap and the pool's
+footprint never changes. A buffer is filled once (RTCM epoch from the framer, esp_mesh_recv) and then
+passed by pointer to the TX queues or the handlers; whoever keeps it beyond the call takes a
+reference, and the last pkt_buf_release() returns it to the pool.
+
+Allocation is lock-free (a CAS on a bitmap of free buffers) and safe from any task.
+
+No ESP-IDF dependencies: can be stress-tested on a host with threads.
+*/
+
+#ifndef CONFIG_PKT_POOL_BUFFERS
+#define CONFIG_PKT_POOL_BUFFERS 24
+#endif
+
+#define PKT_POOL_BUF_SIZE   1472    // Largest mesh packet (MESH_MPS): aggregate frames, OTA_DATA
+
+typedef struct {
+    uint32_t refs;          // Owners; the buffer is free at 0
+    uint16_t len;           // Bytes of data in use
+    uint8_t index;          // Position in the pool
+    uint8_t data[PKT_POOL_BUF_SIZE] __attribute__((aligned(4)));
+} pkt_buf_t;
+
+typedef struct {
+    uint32_t buffers;       // Pool size
+    uint32_t in_use;
+    uint32_t high_water;    // Most buffers in use at once
+    uint32_t allocs;
+    uint32_t exhausted;     // pkt_pool_alloc() found no free buffer
+} pkt_pool_stats_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Take a free buffer, with one reference held by the caller and len 0.
+ *
+ * @return NULL if every buffer is in use.
+ */
+pkt_buf_t *pkt_pool_alloc(void);
+
+/**
+ * @brief Add a reference, for a new owner that keeps the buffer beyond the current call.
+ */
+void pkt_buf_ref(pkt_buf_t *buf);
+
+/**
+ * @brief Drop a reference; the last one returns the buffer to the pool. NULL is ignored.
+ */
+void pkt_buf_release(pkt_buf_t *buf);
+
+void pkt_pool_get_stats(pkt_pool_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PKT_POOL_H
@@ -2,10 +2,17 @@
 #include "esp_mesh.h"
 #include "protocol.h"
 #include "cfg_helper.h"
+#include "../mesh_tx/mesh_tx.h"
+#include "../mesh_dispatch/mesh_dispatch.h"
+#include "../mesh_frag/mesh_frag.h"
+
+_Static_assert(ROBOT_DATA_MAX_PAYLOAD <= CONFIG_MESH_FRAG_MAX_MSG, "ROBOT_DATA fits one fragmented message");
+_Static_assert(MASTER_CLOCK_DATA_MAX_PAYLOAD <= CONFIG_MESH_FRAG_MAX_MSG,
+               "MASTER_CLOCK_DATA fits one fragmented message");
 
 const char *DATATAG = "DATA_TAG";
 
-void handle_echo_packet(const mesh_addr_t *from, const void *payload, size_t payload_len, int mesh_layer, int is_root, int send_count, uint8_t *tx_buf) {
+void handle_echo_packet(const mesh_addr_t *from, const void *payload, size_t payload_len, int mesh_layer, int is_root, int send_count) {
     if (payload_len < sizeof(int)) {
         ESP_LOGW("ECHO", "Echo payload too small");
         return;
@@ -16,34 +23,26 @@ void handle_echo_packet(const mesh_addr_t *from, const void *payload, size_t pay
         ESP_LOGI("ECHO", "[ECHO RX] from: "MACSTR", my_send_count: %d, rx_send_count: %d", MAC2STR(from->addr), send_count, rx_send_count);
     } else {
         // Non-root: attach own send_count and send back to root
-        ProtocolHeader_t *header = (ProtocolHeader_t *)tx_buf;
-        header->type = ECHO_DATA;
-        header->length = sizeof(int);
-        memcpy(tx_buf + sizeof(ProtocolHeader_t), &send_count, sizeof(int));
-        mesh_data_t data;
-        data.data = tx_buf;
-        data.size = sizeof(ProtocolHeader_t) + sizeof(int);
-        data.proto = MESH_PROTO_BIN;
-        data.tos = MESH_TOS_P2P;
-        esp_err_t err = esp_mesh_send(from, &data, MESH_DATA_P2P, NULL, 0);
+        esp_err_t err = mesh_tx_send(MESH_TX_TELEMETRY, from, MESH_DATA_P2P, ECHO_DATA, &send_count, sizeof(int));
         if (err) {
             ESP_LOGE("ECHO", "Failed to echo back to root: 0x%x", err);
         }
     }
 }
 
-void handle_fw_query_packet(const mesh_addr_t *from, uint8_t *tx_buf, device_config_t *config) {
-    // Prepare FW_REPORT packet with current MD5
-    ProtocolHeader_t *header = (ProtocolHeader_t *)tx_buf;
-    header->type = FW_REPORT;
-    header->length = 32; // MD5 hex string length
-    memcpy(tx_buf + sizeof(ProtocolHeader_t), config->fw_md5, 32);
-    mesh_data_t data;
-    data.data = tx_buf;
-    data.size = sizeof(ProtocolHeader_t) + 32;
-    data.proto = MESH_PROTO_BIN;
-    data.tos = MESH_TOS_P2P;
-    esp_err_t err = esp_mesh_send(from, &data, MESH_DATA_P2P, NULL, 0);
+void handle_fw_query_packet(const mesh_addr_t *from, const void *payload, size_t payload_len, device_config_t *config) {
+    if (payload_len >= 1 && *(const uint8_t *)payload != 0) {
+        // Asked to hash the firmware image again rather than trust the cached fingerprint
+        char fingerprint[33];
+        get_running_firmware_fingerprint(fingerprint, true);
+        if (strcmp(config->fw_md5, fingerprint) != 0) {
+            ESP_LOGW("FW_QUERY", "Firmware fingerprint was %s, now %s", config->fw_md5, fingerprint);
+            strncpy(config->fw_md5, fingerprint, sizeof(config->fw_md5));
+            save_device_config(config);
+        }
+    }
+    // Reply with a FW_REPORT packet carrying the current fingerprint
+    esp_err_t err = mesh_tx_send(MESH_TX_CONTROL, from, MESH_DATA_P2P, FW_REPORT, config->fw_md5, 32); // Hex string length
     if (err) {
         ESP_LOGE("FW_QUERY", "Failed to send FW_REPORT: 0x%x", err);
     }
@@ -53,8 +52,56 @@ void handle_fw_report_packet(const mesh_addr_t *from, const void *payload, size_
     char md5[33] = {0};
     if (payload_len >= 32) {
         memcpy(md5, payload, 32);
-        ESP_LOGI("FW_QUERY", "Node "MACSTR" reports firmware MD5: %s", MAC2STR(from->addr), md5);
+        ESP_LOGI("FW_QUERY", "Node "MACSTR" reports firmware fingerprint: %s", MAC2STR(from->addr), md5);
     } else {
         ESP_LOGW("FW_QUERY", "FW_REPORT payload too small");
     }
-}
\ No newline at end of file
+}
+static void rx_fw_query(const mesh_addr_t *from, const void *payload, size_t payload_len, pkt_buf_t *buf, void *arg) {
+    handle_fw_query_packet(from, payload, payload_len, (device_config_t *)arg);
+}
+
+static void rx_fw_report(const mesh_addr_t *from, const void *payload, size_t payload_len, pkt_buf_t *buf, void *arg) {
+    handle_fw_report_packet(from, payload, payload_len);
+}
+
+// Reassembled messages and single packets alike; buf is NULL for the former
+static void rx_robot_data(const mesh_addr_t *from, const void *payload, size_t payload_len, pkt_buf_t *buf, void *arg) {
+    ESP_LOGD("ROBOT_DATA", "%u bytes from "MACSTR, (unsigned)payload_len, MAC2STR(from->addr));
+}
+
+static void rx_master_clock_data(const mesh_addr_t *from, const void *payload, size_t payload_len, pkt_buf_t *buf,
+                                 void *arg) {
+    ESP_LOGD("MASTER_CLOCK", "%u bytes from "MACSTR, (unsigned)payload_len, MAC2STR(from->addr));
+}
+
+esp_err_t protocol_send_robot_data(const mesh_addr_t *to, const void *data, size_t len) {
+    if (len == 0 || len > ROBOT_DATA_MAX_PAYLOAD) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    return mesh_frag_send(MESH_TX_TELEMETRY, to, MESH_DATA_P2P, ROBOT_DATA, data, len);
+}
+
+esp_err_t protocol_send_master_clock_data(const mesh_addr_t *to, const void *data, size_t len) {
+    if (len == 0 || len > MASTER_CLOCK_DATA_MAX_PAYLOAD) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    return mesh_frag_send(MESH_TX_TELEMETRY, to, MESH_DATA_P2P, MASTER_CLOCK_DATA, data, len);
+}
+
+esp_err_t protocol_register_handlers(device_config_t *config) {
+    esp_err_t err = mesh_dispatch_register(FW_QUERY, "FW_QUERY", 0, MESH_TX_MTU - sizeof(ProtocolHeader_t),
+                                           rx_fw_query, config);
+    if (err == ESP_OK) {
+        err = mesh_dispatch_register(FW_REPORT, "FW_REPORT", 32, 32, rx_fw_report, NULL);
+    }
+    // On the RX task: large ones arrive reassembled by mesh_frag
+    if (err == ESP_OK) {
+        err = mesh_dispatch_register(ROBOT_DATA, "ROBOT_DATA", 1, ROBOT_DATA_MAX_PAYLOAD, rx_robot_data, NULL);
+    }
+    if (err == ESP_OK) {
+        err = mesh_dispatch_register(MASTER_CLOCK_DATA, "MASTER_CLOCK_DATA", 1, MASTER_CLOCK_DATA_MAX_PAYLOAD,
+                                     rx_master_clock_data, NULL);
+    }
+    return err;
+}
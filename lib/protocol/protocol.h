@@ -11,51 +11,11 @@
 #include "protocol.h"
 #include "esp_mac.h"
 #include "../xiao_esp32c6/cfg_helper.h"
+#include "protocol_gen.h"  // Packet structs and ProtocolType values (python/protocol_schema.json)
 
 extern const char *DATATAG;
 
-// Enumeration for protocol types (16-bit unsigned int)
-typedef uint16_t ProtocolType;
-
-enum {
-    NETWORK_DATA = 0,
-    RTK_DATA = 1,
-    ROBOT_DATA = 2,
-    PTP_DATA = 3,
-    MASTER_CLOCK_DATA = 4,
-    OTA_DATA = 5, // Added for OTA packets
-    ECHO_DATA = 6, // Added for echo protocol
-    FW_QUERY = 7,   // Firmware query protocol
-    FW_REPORT = 8,  // Firmware report protocol
-    // Add more types as needed
-};
-
-// Structure for protocol header
-typedef struct ProtocolHeader {
-    ProtocolType type;  // 16-bit unsigned int as an enumeration
-    uint16_t length;    // 16-bit unsigned int for length
-} ProtocolHeader_t;
-
-typedef struct NetworkData {
-    uint32_t send_count;
-    uint16_t battery_voltage;
-} NetworkData_t;
-
-typedef struct RTKData {
-    uint8_t data[1000];  // Example size, adjust as needed
-} RTKData_t;
-
-typedef struct RobotData {
-    uint8_t data[1000];  // Example size, adjust as needed
-} RobotData_t;
-
-typedef struct PTPData {
-    uint8_t data[1000];  // Example size, adjust as needed
-} PTPData_t;
-
-typedef struct MasterClockData {
-    uint8_t data[1000];  // Example size, adjust as needed
-} MasterClockData_t;
+#define RTK_DATA_HDR_SIZE offsetof(RTKData_t, data)
 
 #ifdef __cplusplus
 extern "C" {
@@ -83,21 +43,33 @@ static inline size_t protocol_base64_encode(const uint8_t *src, size_t len, char
 // --- Logging macro for struct as base64 ---
 #include "esp_log.h"
 
-#define PROTOCOL_LOG_STRUCT_BASE64(level, tag, struct_ptr, struct_type, format_str) do { \
-    const struct_type *plog_struct = (const struct_type *)(struct_ptr); \
-    size_t plog_struct_size = sizeof(struct_type); \
+#define PROTOCOL_LOG_STRUCT_BASE64(level, tag, struct_ptr, struct_type, format_str) \
+    PROTOCOL_LOG_BASE64(level, tag, (const struct_type *)(struct_ptr), sizeof(struct_type), #struct_type, format_str)
+
+// Same as PROTOCOL_LOG_STRUCT_BASE64 when the struct type is only known at run time (name and size passed in)
+#define PROTOCOL_LOG_BASE64(level, tag, ptr, size, name_str, format_str) do { \
+    size_t plog_struct_size = (size); \
     /* Calculate base64 output size: 4 * ((n+2)/3) + 1 for null */ \
     size_t plog_b64_size = 4 * ((plog_struct_size + 2) / 3) + 1; \
     char plog_b64[plog_b64_size]; \
-    protocol_base64_encode((const uint8_t*)plog_struct, plog_struct_size, plog_b64, plog_b64_size); \
-    ESP_LOG_LEVEL(level, tag, "NAME:%s FORMAT:%s LEN:%u BASE64:%s", #struct_type, format_str, (unsigned)plog_struct_size, plog_b64); \
+    protocol_base64_encode((const uint8_t*)(ptr), plog_struct_size, plog_b64, plog_b64_size); \
+    ESP_LOG_LEVEL(level, tag, "NAME:%s FORMAT:%s LEN:%u BASE64:%s", name_str, format_str, (unsigned)plog_struct_size, plog_b64); \
 } while(0)
 
 void protocol_handle_echo_packet(const mesh_addr_t *from, const void *payload, size_t payload_len, int mesh_layer, int is_root, int send_count);
-void handle_echo_packet(const mesh_addr_t *from, const void *payload, size_t payload_len, int mesh_layer, int is_root, int send_count, uint8_t *tx_buf);
-void handle_fw_query_packet(const mesh_addr_t *from, uint8_t *tx_buf, device_config_t *config);
+void handle_echo_packet(const mesh_addr_t *from, const void *payload, size_t payload_len, int mesh_layer, int is_root, int send_count);
+void handle_fw_query_packet(const mesh_addr_t *from, const void *payload, size_t payload_len, device_config_t *config);
 void handle_fw_report_packet(const mesh_addr_t *from, const void *payload, size_t payload_len);
 
+// Register the FW_QUERY/FW_REPORT, ROBOT_DATA and MASTER_CLOCK_DATA handlers with the mesh dispatcher;
+// FW_QUERY replies from `config` (a non-zero first payload byte has the firmware hashed again first)
+esp_err_t protocol_register_handlers(device_config_t *config);
+
+// Send ROBOT_DATA / MASTER_CLOCK_DATA of 1 to *_MAX_PAYLOAD bytes, in fragments when larger than one
+// packet (mesh_frag_send()); returns as mesh_frag_send()
+esp_err_t protocol_send_robot_data(const mesh_addr_t *to, const void *data, size_t len);
+esp_err_t protocol_send_master_clock_data(const mesh_addr_t *to, const void *data, size_t len);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,339 @@
+// Generated by python/gen_protocol.py from python/protocol_schema.json. Do not edit.
+// Mesh packet payloads (protocol.h)
+#ifndef PROTOCOL_GEN_H
+#define PROTOCOL_GEN_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Enumeration for protocol types (16-bit unsigned int)
+typedef uint16_t ProtocolType;
+
+// ProtocolType values
+enum {
+    NETWORK_DATA = 0,
+    RTK_DATA = 1,
+    ROBOT_DATA = 2,
+    PTP_DATA = 3,
+    MASTER_CLOCK_DATA = 4,
+    OTA_DATA = 5,           // Mesh OTA, mesh_ota_cmd_t in byte 0 (MeshOtaHeader and the struct of its command)
+    ECHO_DATA = 6,          // Echo protocol
+    FW_QUERY = 7,           // Firmware query protocol: FW_REPORT back; optional byte, non-zero: hash the firmware image again first
+    FW_REPORT = 8,          // Firmware report protocol: fingerprint, 32 hex digits (device_config_t.fw_md5)
+    RX_STATS_QUERY = 9,     // Ask for the receive dispatcher counters
+    RX_STATS_REPORT = 10,   // Receive dispatcher counters (RxStatsReport_t)
+    AGGREGATE = 11,         // Several whole packets for the same destination (mesh_tx.h)
+    FRAGMENT = 12,          // Part of a message too large for one packet (FragHeader_t, mesh_frag.h)
+    FRAG_NACK = 13,         // Fragments a receiver still misses, to the sender (FragNack_t)
+    BOOT_REPORT = 14,       // Boot phase timeline of a node, to the root (BootReport_t, boot_timeline.h)
+};
+
+// PTPData.msg
+enum {
+    PTP_MSG_SYNC = 0,
+    PTP_MSG_FOLLOW_UP = 1,
+    PTP_MSG_DELAY_REQ = 2,
+    PTP_MSG_DELAY_RESP = 3,
+};
+
+// MeshOtaHeader.cmd
+typedef enum {
+    MESH_OTA_CMD_START = 1, // Root to the OTA group: new image (MeshOtaStart)
+    MESH_OTA_CMD_DATA = 2,  // Root to the OTA group: one block (MeshOtaData)
+    MESH_OTA_CMD_END = 3,   // Root to the OTA group: nodes with the whole image boot it
+    MESH_OTA_CMD_ACK = 4,   // Node to root: state and received blocks (MeshOtaAck)
+    MESH_OTA_CMD_STATUS = 5, // Root to the OTA group: every target answers with an ACK
+} mesh_ota_cmd_t;
+
+// MeshOtaHeader.state (ACK)
+typedef enum {
+    MESH_OTA_STATE_IDLE = 0, // No transfer for this session (START missed)
+    MESH_OTA_STATE_RECEIVING = 1,
+    MESH_OTA_STATE_COMPLETE = 2, // Every block received and the image hash checked
+    MESH_OTA_STATE_CURRENT = 3, // Already running this image
+    MESH_OTA_STATE_FAILED = 4, // Image does not fit, or flash error
+    MESH_OTA_STATE_WRONG_BASE = 5, // Delta against firmware this node does not run
+} mesh_ota_state_t;
+
+// MeshOtaStart.encoding: what the blocks carry
+typedef enum {
+    MESH_OTA_ENCODING_RAW = 0, // The image itself
+    MESH_OTA_ENCODING_LZSS = 1, // Chunks of chunk_size image bytes, each LZSS-compressed on its own (ota_lzss.h)
+    MESH_OTA_ENCODING_DELTA = 2, // As LZSS, each chunk holding delta ops against the running firmware (ota_delta.h)
+} mesh_ota_encoding_t;
+
+// BootReport entries: init phases of app_main in their sequential order, then milestones
+typedef enum {
+    BOOT_PHASE_DELAY = 0,   // Fixed startup delay (none with fast boot)
+    BOOT_PHASE_CONFIG = 1,  // NVS init, device config load
+    BOOT_PHASE_FINGERPRINT = 2, // Firmware fingerprint (hashes the image only after an update)
+    BOOT_PHASE_NETIF = 3,   // TCP/IP stack, event loop, mesh netifs
+    BOOT_PHASE_BATTERY = 4, // ADC setup and first battery reading
+    BOOT_PHASE_MESH_TX = 5, // TX queues, dispatcher, fragmentation
+    BOOT_PHASE_SERIAL = 6,  // GNSS UART and RTK sink
+    BOOT_PHASE_ANTENNA = 7, // External antenna RF switch
+    BOOT_PHASE_WIFI = 8,    // Wi-Fi init and start
+    BOOT_PHASE_MESH_CONFIG = 9, // Mesh init and configuration
+    BOOT_PHASE_OTA = 10,    // Mesh OTA init, resuming a saved transfer
+    BOOT_PHASE_MESH_START = 11, // esp_mesh_start()
+    BOOT_PHASE_PARENT_CONNECTED = 12, // Milestone: first parent (or router, for the root) connected
+    BOOT_PHASE_GOT_IP = 13, // Milestone: root got its IP, log shipping starts connecting
+    BOOT_PHASE_FIRST_CORRECTION = 14, // Milestone: base, first correction epoch queued to the mesh; robot, first one written to the receiver
+} boot_phase_t;
+
+#define RTK_DATA_MAX_PAYLOAD          1448    // Fits a MESH_MPS packet with a v2 header and CRC
+#define RTK_DATA_FLAG_LAST_PART       0x01    // Last packet of the epoch
+#define RX_STATS_MAX_TYPES            16
+#define RX_STATS_REPORT_ENTRIES       13      // Fits one packet
+#define RX_STATS_HIST_BUCKETS         8       // Handler time in CPU cycles: <1k, <4k, <16k, ... >=4M
+#define MESH_OTA_BLOCK_SIZE           1024    // Image bytes per DATA packet, 4 per flash sector
+#define MESH_OTA_MAX_BLOCKS           4096    // 4 MB image
+#define MESH_OTA_BITMAP_SIZE          512     // Bit per block: MESH_OTA_MAX_BLOCKS / 8
+#define MESH_OTA_MAX_CHUNKS           512     // Compressed chunks per image: 4 MB in 8 KB chunks
+#define MESH_OTA_IMAGE_MAGIC          0x41544F4D // "MOTA": MeshOtaImageHeader.magic
+#define MESH_FRAG_MAX_FRAGMENTS       32      // Per message: FragNack_t.missing has a bit for each
+#define ROBOT_DATA_MAX_PAYLOAD        4096    // Up to CONFIG_MESH_FRAG_MAX_MSG: sent with mesh_frag_send()
+#define MASTER_CLOCK_DATA_MAX_PAYLOAD 4096    // Up to CONFIG_MESH_FRAG_MAX_MSG: sent with mesh_frag_send()
+#define BOOT_PHASE_COUNT              15      // boot_phase_t values
+#define BOOT_FLAG_FAST                0x01    // BootReport.flags: fast boot, init phases overlapped
+
+// v1 packet header (WireHeaderV1)
+typedef struct ProtocolHeader {
+    ProtocolType type;
+    uint16_t length;        // Payload bytes
+} ProtocolHeader_t;
+
+#define PROTOCOL_HEADER_NAME "ProtocolHeader"
+#define PROTOCOL_HEADER_SIZE 4
+#define PROTOCOL_HEADER_FORMAT "<2H"
+_Static_assert(sizeof(ProtocolHeader_t) == PROTOCOL_HEADER_SIZE, "ProtocolHeader layout (protocol_schema.json)");
+
+typedef struct NetworkData {
+    uint32_t send_count;
+    uint16_t battery_voltage;
+} NetworkData_t;
+
+#define NETWORK_DATA_NAME "NetworkData"
+#define NETWORK_DATA_SIZE 8
+#define NETWORK_DATA_FORMAT "<IH2x"
+_Static_assert(sizeof(NetworkData_t) == NETWORK_DATA_SIZE, "NetworkData layout (protocol_schema.json)");
+
+// RTK correction packet (RTK_DATA), sent by the base to the RTK group.
+// One GNSS epoch is carried in one or more packets sharing `seq`; frames are never split across packets.
+typedef struct RTKData {
+    uint16_t seq;           // Epoch sequence number (wraps)
+    uint8_t part;           // Packet index within the epoch
+    uint8_t flags;          // RTK_DATA_FLAG_*
+    uint32_t epoch_tow_ms;  // GNSS epoch as GPS time of week (ms) from the MSM header, 0 if unknown
+    uint32_t base_age_us;   // Time from the first frame reaching the base framer to the packet being queued for sending
+    uint8_t data[RTK_DATA_MAX_PAYLOAD]; // Whole RTCM3 frames back to back; length from the protocol header
+} RTKData_t;
+
+#define RTK_DATA_NAME "RTKData"
+#define RTK_DATA_SIZE 1460
+#define RTK_DATA_FORMAT "<H2B2I1448s"
+_Static_assert(sizeof(RTKData_t) == RTK_DATA_SIZE, "RTKData layout (protocol_schema.json)");
+
+// Robot application data (ROBOT_DATA), any length up to ROBOT_DATA_MAX_PAYLOAD, fragmented as needed
+typedef struct RobotData {
+    uint8_t data[ROBOT_DATA_MAX_PAYLOAD]; // Length from the message
+} RobotData_t;
+
+#define ROBOT_DATA_NAME "RobotData"
+#define ROBOT_DATA_SIZE 4096
+#define ROBOT_DATA_FORMAT "<4096s"
+_Static_assert(sizeof(RobotData_t) == ROBOT_DATA_SIZE, "RobotData layout (protocol_schema.json)");
+
+// Time sync packet (PTP_DATA), exchanged between a node and each of its children once per interval:
+// parent SYNC, parent FOLLOW_UP (SYNC send time), child DELAY_REQ, parent DELAY_RESP (DELAY_REQ arrival time).
+typedef struct PTPData {
+    uint8_t msg;            // PTP_MSG_*
+    uint8_t steps_removed;  // Sender's hops from the GNSS clock (0 = sender has a receiver)
+    uint16_t seq;           // Exchange number, echoed in every message of the exchange
+    uint32_t accuracy_us;   // Sender's clock accuracy (FOLLOW_UP)
+    uint64_t timestamp_us;  // Sender's GPS time of week: SYNC send (FOLLOW_UP) or DELAY_REQ arrival (DELAY_RESP)
+} PTPData_t;
+
+#define PTP_DATA_NAME "PTPData"
+#define PTP_DATA_SIZE 16
+#define PTP_DATA_FORMAT "<2BHIQ"
+_Static_assert(sizeof(PTPData_t) == PTP_DATA_SIZE, "PTPData layout (protocol_schema.json)");
+
+// Receive dispatcher counters (RX_STATS_REPORT), one entry per registered packet type
+typedef struct RxStatsEntry {
+    uint16_t type;          // ProtocolType
+    uint16_t reserved;
+    uint32_t packets;
+    uint32_t bytes;
+    uint32_t malformed;     // Dropped before the handler: bad length
+    uint32_t queue_full;    // Dropped before the handler: worker queue full
+    uint32_t avg_cycles;    // Handler time
+    uint32_t max_cycles;
+    uint32_t hist[RX_STATS_HIST_BUCKETS];
+    uint32_t seq_gaps;      // v2 sequence numbers never seen
+    uint32_t out_of_order;  // v2 duplicates and late arrivals
+    uint32_t latency_avg_us; // v2 one-way latency from the header timestamp
+    uint32_t latency_max_us;
+} RxStatsEntry_t;
+
+#define RX_STATS_ENTRY_NAME "RxStatsEntry"
+#define RX_STATS_ENTRY_SIZE 76
+#define RX_STATS_ENTRY_FORMAT "<2H18I"
+_Static_assert(sizeof(RxStatsEntry_t) == RX_STATS_ENTRY_SIZE, "RxStatsEntry layout (protocol_schema.json)");
+
+typedef struct RxStatsReport {
+    uint32_t unknown;       // Packets of a type with no handler
+    uint32_t bad_header;    // Unknown header version or CRC error
+    uint32_t v1_packets;    // By header version, before any other check
+    uint32_t v2_packets;
+    uint16_t cpu_mhz;       // Cycles per microsecond
+    uint8_t count;          // Entries in use; the packet ends after them
+    uint8_t reserved;
+    RxStatsEntry_t entries[RX_STATS_REPORT_ENTRIES];
+} RxStatsReport_t;
+
+#define RX_STATS_REPORT_NAME "RxStatsReport"
+#define RX_STATS_REPORT_SIZE 1008
+#define RX_STATS_REPORT_FORMAT "<4IH2B2H18I2H18I2H18I2H18I2H18I2H18I2H18I2H18I2H18I2H18I2H18I2H18I2H18I"
+_Static_assert(sizeof(RxStatsReport_t) == RX_STATS_REPORT_SIZE, "RxStatsReport layout (protocol_schema.json)");
+
+// FRAGMENT packet header, followed by bytes [offset, offset + n) of the message
+typedef struct FragHeader {
+    uint16_t msg_id;        // Per sender (wraps)
+    uint16_t total_len;     // Message payload bytes
+    uint16_t offset;        // Of this fragment in the message
+    uint8_t type;           // ProtocolType of the message
+    uint8_t index;
+    uint8_t count;          // Fragments in the message, 2 to MESH_FRAG_MAX_FRAGMENTS
+    uint8_t reserved;
+} FragHeader_t;
+
+#define FRAG_HEADER_NAME "FragHeader"
+#define FRAG_HEADER_SIZE 10
+#define FRAG_HEADER_FORMAT "<3H4B"
+_Static_assert(sizeof(FragHeader_t) == FRAG_HEADER_SIZE, "FragHeader layout (protocol_schema.json)");
+
+// Selective retransmission request (FRAG_NACK), sent P2P to the sender of an incomplete message
+typedef struct FragNack {
+    uint16_t msg_id;
+    uint16_t reserved;
+    uint32_t missing;       // Bit per fragment index still missing
+} FragNack_t;
+
+#define FRAG_NACK_NAME "FragNack"
+#define FRAG_NACK_SIZE 8
+#define FRAG_NACK_FORMAT "<2HI"
+_Static_assert(sizeof(FragNack_t) == FRAG_NACK_SIZE, "FragNack layout (protocol_schema.json)");
+
+// Boot timeline (BOOT_REPORT), sent to the root once connected and again at each later milestone
+typedef struct BootReport {
+    uint8_t reset_reason;   // esp_reset_reason_t
+    uint8_t flags;          // BOOT_FLAG_*
+    uint16_t reserved;
+    uint32_t start_ms[BOOT_PHASE_COUNT]; // esp_timer time (ms since the app started) each phase began; 0 for milestones
+    uint32_t end_ms[BOOT_PHASE_COUNT]; // Time it ended; 0: not reached (yet)
+} BootReport_t;
+
+#define BOOT_REPORT_NAME "BootReport"
+#define BOOT_REPORT_SIZE 124
+#define BOOT_REPORT_FORMAT "<2BH30I"
+_Static_assert(sizeof(BootReport_t) == BOOT_REPORT_SIZE, "BootReport layout (protocol_schema.json)");
+
+// Master clock application data (MASTER_CLOCK_DATA), any length up to MASTER_CLOCK_DATA_MAX_PAYLOAD, fragmented as needed
+typedef struct MasterClockData {
+    uint8_t data[MASTER_CLOCK_DATA_MAX_PAYLOAD]; // Length from the message
+} MasterClockData_t;
+
+#define MASTER_CLOCK_DATA_NAME "MasterClockData"
+#define MASTER_CLOCK_DATA_SIZE 4096
+#define MASTER_CLOCK_DATA_FORMAT "<4096s"
+_Static_assert(sizeof(MasterClockData_t) == MASTER_CLOCK_DATA_SIZE, "MasterClockData layout (protocol_schema.json)");
+
+// Start of every OTA_DATA payload; STATUS and END are this alone
+typedef struct MeshOtaHeader {
+    uint8_t cmd;            // mesh_ota_cmd_t
+    uint8_t state;          // mesh_ota_state_t (ACK)
+    uint16_t block;         // Block index (DATA)
+    uint32_t session;       // First 4 bytes of the image SHA-256
+} mesh_ota_header_t;
+
+#define MESH_OTA_HEADER_NAME "MeshOtaHeader"
+#define MESH_OTA_HEADER_SIZE 8
+#define MESH_OTA_HEADER_FORMAT "<2BHI"
+_Static_assert(sizeof(mesh_ota_header_t) == MESH_OTA_HEADER_SIZE, "MeshOtaHeader layout (protocol_schema.json)");
+
+// START: the image the OTA group is about to receive
+typedef struct MeshOtaStart {
+    uint8_t cmd;            // mesh_ota_cmd_t
+    uint8_t state;          // mesh_ota_state_t (ACK)
+    uint16_t block;         // Block index (DATA)
+    uint32_t session;       // First 4 bytes of the image SHA-256
+    uint32_t image_size;
+    uint16_t block_size;    // MESH_OTA_BLOCK_SIZE
+    uint16_t block_count;
+    uint8_t sha256[32];     // Of the image, as esp_partition_get_sha256()
+    uint8_t encoding;       // mesh_ota_encoding_t; the rest is for LZSS and DELTA
+    uint8_t window_bits;
+    uint8_t lookahead_bits;
+    uint8_t reserved;
+    uint16_t chunk_size;    // Image bytes per chunk, whole flash sectors
+    uint16_t chunk_count;
+    uint8_t base_md5[16];   // DELTA: device_config_t.fw_md5 of the firmware the ops read from
+    uint16_t chunk_len[MESH_OTA_MAX_CHUNKS]; // Compressed bytes of each chunk, sent in ceil(len / block_size) blocks of its own; len == the chunk's image bytes: stored as is
+} mesh_ota_start_t;
+
+#define MESH_OTA_START_NAME "MeshOtaStart"
+#define MESH_OTA_START_SIZE 1096
+#define MESH_OTA_START_FORMAT "<2BH2I2H32s4B2H16s512H"
+_Static_assert(sizeof(mesh_ota_start_t) == MESH_OTA_START_SIZE, "MeshOtaStart layout (protocol_schema.json)");
+
+// DATA: one block of the image
+typedef struct MeshOtaData {
+    uint8_t cmd;            // mesh_ota_cmd_t
+    uint8_t state;          // mesh_ota_state_t (ACK)
+    uint16_t block;         // Block index (DATA)
+    uint32_t session;       // First 4 bytes of the image SHA-256
+    uint8_t data[MESH_OTA_BLOCK_SIZE]; // Shorter for the last block
+} mesh_ota_data_t;
+
+#define MESH_OTA_DATA_NAME "MeshOtaData"
+#define MESH_OTA_DATA_SIZE 1032
+#define MESH_OTA_DATA_FORMAT "<2BHI1024s"
+_Static_assert(sizeof(mesh_ota_data_t) == MESH_OTA_DATA_SIZE, "MeshOtaData layout (protocol_schema.json)");
+
+// ACK: a target's progress, answering START and STATUS
+typedef struct MeshOtaAck {
+    uint8_t cmd;            // mesh_ota_cmd_t
+    uint8_t state;          // mesh_ota_state_t (ACK)
+    uint16_t block;         // Block index (DATA)
+    uint32_t session;       // First 4 bytes of the image SHA-256
+    uint16_t received;      // Blocks
+    uint16_t block_count;
+    uint8_t bitmap[MESH_OTA_BITMAP_SIZE]; // Bit per block received, LSB first; (block_count + 7) / 8 bytes sent
+} mesh_ota_ack_t;
+
+#define MESH_OTA_ACK_NAME "MeshOtaAck"
+#define MESH_OTA_ACK_SIZE 524
+#define MESH_OTA_ACK_FORMAT "<2BHI2H512s"
+_Static_assert(sizeof(mesh_ota_ack_t) == MESH_OTA_ACK_SIZE, "MeshOtaAck layout (protocol_schema.json)");
+
+// Start of an encoded image file (python/ota_image.py), then u16 chunk_len[chunk_count] and the chunks back to back
+typedef struct MeshOtaImageHeader {
+    uint32_t magic;         // MESH_OTA_IMAGE_MAGIC
+    uint8_t encoding;       // mesh_ota_encoding_t
+    uint8_t window_bits;
+    uint8_t lookahead_bits;
+    uint8_t reserved;
+    uint32_t image_size;    // Decoded
+    uint16_t chunk_size;
+    uint16_t chunk_count;
+    uint8_t sha256[32];     // Of the decoded image, as esp_partition_get_sha256()
+    uint8_t base_md5[16];   // DELTA: device_config_t.fw_md5 of the base firmware, zero otherwise
+} mesh_ota_image_header_t;
+
+#define MESH_OTA_IMAGE_HEADER_NAME "MeshOtaImageHeader"
+#define MESH_OTA_IMAGE_HEADER_SIZE 64
+#define MESH_OTA_IMAGE_HEADER_FORMAT "<I4BI2H32s16s"
+_Static_assert(sizeof(mesh_ota_image_header_t) == MESH_OTA_IMAGE_HEADER_SIZE, "MeshOtaImageHeader layout (protocol_schema.json)");
+
+#endif // PROTOCOL_GEN_H
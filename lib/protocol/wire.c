@@ -0,0 +1,139 @@
+#include "wire.h"
+#include "../gps_ptp_time/gps_ptp_time.h"
+
+#ifdef CONFIG_MESH_WIRE_V2_TX
+#define SEQ_SLOTS   32      // Types above share a counter (only costs apparent gaps)
+
+static uint32_t s_seq[SEQ_SLOTS];     // Low 16 bits sent
+#endif
+
+// CRC-16/CCITT-FALSE, a nibble at a time
+static const uint16_t s_crc_nibble[16] = {
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+    0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF,
+};
+
+uint16_t wire_crc16(const uint8_t *data, size_t len) {
+    uint16_t crc = 0xFFFF;
+    for (size_t i = 0; i < len; i++) {
+        crc = (crc << 4) ^ s_crc_nibble[(crc >> 12) ^ (data[i] >> 4)];
+        crc = (crc << 4) ^ s_crc_nibble[(crc >> 12) ^ (data[i] & 0x0F)];
+    }
+    return crc;
+}
+
+static inline uint16_t time_units(uint64_t gps_us) {
+    return (uint16_t)(gps_us / WIRE_TIME_UNIT_US);
+}
+
+size_t wire_encode(uint8_t *pkt, ProtocolType type, uint16_t payload_len) {
+#ifdef CONFIG_MESH_WIRE_V2_TX
+    wire_header_v2_t h = {
+        .type = type,
+        .version = WIRE_VERSION_2,
+        .length = payload_len,
+        .seq = (uint16_t)__atomic_fetch_add(&s_seq[type % SEQ_SLOTS], 1, __ATOMIC_RELAXED),
+    };
+    uint64_t now_us = gps_ptp_now_us();
+    if (now_us != 0) {
+        h.flags |= WIRE_FLAG_TIME;
+        h.timestamp = time_units(now_us);
+    }
+#ifdef CONFIG_MESH_WIRE_CRC
+    h.flags |= WIRE_FLAG_CRC;
+#endif
+    wire_header_v2_encode(&h, pkt);
+#ifdef CONFIG_MESH_WIRE_CRC
+    uint16_t crc = wire_crc16(pkt, WIRE_HEADER_V2_SIZE + payload_len);
+    pkt[WIRE_HEADER_V2_SIZE + payload_len] = (uint8_t)crc;
+    pkt[WIRE_HEADER_V2_SIZE + payload_len + 1] = (uint8_t)(crc >> 8);
+#endif
+#else
+    wire_header_v1_t h = { .type = type, .length = payload_len };
+    wire_header_v1_encode(&h, pkt);
+#endif
+    return WIRE_TX_OVERHEAD + payload_len;
+}
+
+wire_err_t wire_decode(const uint8_t *pkt, size_t size, wire_hdr_t *hdr) {
+    if (size < WIRE_HEADER_V1_SIZE) {
+        return WIRE_ERR_SHORT;
+    }
+    uint8_t version = pkt[1] >> 5;
+    if (version == WIRE_VERSION_1) {
+        wire_header_v1_t h;
+        wire_header_v1_decode(pkt, &h);
+        *hdr = (wire_hdr_t){
+            .type = h.type,
+            .version = WIRE_VERSION_1,
+            .hdr_size = WIRE_HEADER_V1_SIZE,
+            .length = h.length,
+        };
+        return size == WIRE_HEADER_V1_SIZE + h.length ? WIRE_OK : WIRE_ERR_LENGTH;
+    }
+    if (version != WIRE_VERSION_2) {
+        return WIRE_ERR_VERSION;
+    }
+    if (size < WIRE_HEADER_V2_SIZE) {
+        return WIRE_ERR_SHORT;
+    }
+    wire_header_v2_t h;
+    wire_header_v2_decode(pkt, &h);
+    *hdr = (wire_hdr_t){
+        .type = h.type,
+        .version = WIRE_VERSION_2,
+        .flags = h.flags,
+        .hdr_size = WIRE_HEADER_V2_SIZE,
+        .length = h.length,
+        .seq = h.seq,
+        .timestamp = h.timestamp,
+    };
+    size_t crc_size = (h.flags & WIRE_FLAG_CRC) ? 2 : 0;
+    if (size != WIRE_HEADER_V2_SIZE + h.length + crc_size) {
+        return WIRE_ERR_LENGTH;
+    }
+    if (crc_size) {
+        size_t end = WIRE_HEADER_V2_SIZE + h.length;
+        uint16_t crc = pkt[end] | (uint16_t)pkt[end + 1] << 8;
+        if (crc != wire_crc16(pkt, end)) {
+            return WIRE_ERR_CRC;
+        }
+    }
+    return WIRE_OK;
+}
+
+size_t wire_packet_size(const uint8_t *pkt, size_t avail) {
+    if (avail < WIRE_HEADER_V1_SIZE) {
+        return 0;
+    }
+    size_t size;
+    uint8_t version = pkt[1] >> 5;
+    if (version == WIRE_VERSION_1) {
+        wire_header_v1_t h;
+        wire_header_v1_decode(pkt, &h);
+        size = WIRE_HEADER_V1_SIZE + h.length;
+    } else if (version == WIRE_VERSION_2 && avail >= WIRE_HEADER_V2_SIZE) {
+        wire_header_v2_t h;
+        wire_header_v2_decode(pkt, &h);
+        size = WIRE_HEADER_V2_SIZE + h.length + ((h.flags & WIRE_FLAG_CRC) ? 2 : 0);
+    } else {
+        return 0;
+    }
+    return size <= avail ? size : 0;
+}
+
+bool wire_latency_us(const wire_hdr_t *hdr, uint32_t *latency_us) {
+    if (hdr->version != WIRE_VERSION_2 || !(hdr->flags & WIRE_FLAG_TIME)) {
+        return false;
+    }
+    uint64_t now_us = gps_ptp_now_us();
+    if (now_us == 0) {
+        return false;
+    }
+    uint32_t units = (uint16_t)(time_units(now_us) - hdr->timestamp);
+    if (units * WIRE_TIME_UNIT_US > WIRE_MAX_LATENCY_US) {
+        return false;
+    }
+    *latency_us = units * WIRE_TIME_UNIT_US;
+    return true;
+}
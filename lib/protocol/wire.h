@@ -0,0 +1,109 @@
+#ifndef WIRE_H
+#define WIRE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "protocol.h"
+#include "wire_gen.h"
+
+/*
+Packet header encode/decode, v1 and v2.
+
+v1 is ProtocolHeader_t: 16-bit type, 16-bit payload length. v2 (8 bytes, wire_gen.h) adds a
+version, flags, a sequence number per sender and type, and the low 16 bits of the sender's GPS
+time in WIRE_TIME_UNIT_US, optionally followed after the payload by a CRC-16 (2 bytes):
+
+    byte    0      1                   2..3     4..5   6..7        payload   [CRC]
+    v1      type (16 bit)              length
+    v2      type   flags | version<<5  length   seq    timestamp
+
+A v1 type is below 256, so byte 1 of a v1 header is 0 and its version reads as WIRE_VERSION_1.
+A v1 node sees the type of a v2 packet as >= 0x4000 and drops it as unknown.
+
+Receivers take both. Senders use v2 only with CONFIG_MESH_WIRE_V2_TX, to be enabled once every node
+runs firmware that receives v2 (rolling upgrade: update all nodes, then switch the senders over).
+The header size is fixed at build time, so packets can be assembled in place behind
+WIRE_TX_HDR_SIZE bytes.
+
+The layouts are generated from python/protocol_schema.json, like the Python decoder of log_server.py.
+*/
+
+#ifdef CONFIG_MESH_WIRE_V2_TX
+#define WIRE_TX_HDR_SIZE        WIRE_HEADER_V2_SIZE
+#ifdef CONFIG_MESH_WIRE_CRC
+#define WIRE_TX_TRAILER_SIZE    2
+#else
+#define WIRE_TX_TRAILER_SIZE    0
+#endif
+#else
+#define WIRE_TX_HDR_SIZE        WIRE_HEADER_V1_SIZE
+#define WIRE_TX_TRAILER_SIZE    0
+#endif
+
+#define WIRE_TX_OVERHEAD        (WIRE_TX_HDR_SIZE + WIRE_TX_TRAILER_SIZE)
+#define WIRE_MAX_OVERHEAD       (WIRE_HEADER_V2_SIZE + 2)
+#define WIRE_MAX_LATENCY_US     (5 * 1000 * 1000)
+
+_Static_assert(WIRE_HEADER_V1_SIZE == sizeof(ProtocolHeader_t), "v1 header is ProtocolHeader_t");
+
+typedef enum {
+    WIRE_OK,
+    WIRE_ERR_SHORT,     // Shorter than its header
+    WIRE_ERR_VERSION,   // Unknown header version
+    WIRE_ERR_LENGTH,    // Size does not match the header length
+    WIRE_ERR_CRC,
+} wire_err_t;
+
+typedef struct {
+    ProtocolType type;
+    uint8_t version;        // WIRE_VERSION_1 or WIRE_VERSION_2
+    uint8_t flags;          // WIRE_FLAG_* (v2)
+    uint16_t hdr_size;      // Payload offset
+    uint16_t length;        // Payload bytes
+    uint16_t seq;           // v2
+    uint16_t timestamp;     // v2 with WIRE_FLAG_TIME
+} wire_hdr_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Write the header (and CRC) of a packet whose payload is already at pkt + WIRE_TX_HDR_SIZE.
+ *
+ * Safe from any task; the sequence number is per type.
+ *
+ * @return Packet size: WIRE_TX_OVERHEAD + payload_len.
+ */
+size_t wire_encode(uint8_t *pkt, ProtocolType type, uint16_t payload_len);
+
+/**
+ * @brief Parse and check the header of a received packet (either version).
+ */
+wire_err_t wire_decode(const uint8_t *pkt, size_t size, wire_hdr_t *hdr);
+
+/**
+ * @brief Size of the packet starting at `pkt` (header, payload and CRC) as its header gives it.
+ *
+ * For walking packets stored back to back (AGGREGATE frames); the packet itself is checked by wire_decode().
+ *
+ * @return 0 if `avail` bytes cannot hold the header or the packet, or the version is unknown.
+ */
+size_t wire_packet_size(const uint8_t *pkt, size_t avail);
+
+/**
+ * @brief One-way latency of a v2 packet from its timestamp and this node's GPS time.
+ *
+ * @return false if the sender or this node has no GPS time, or the result is beyond
+ *         WIRE_MAX_LATENCY_US (clocks disagree, or the 6.5 s wrap was passed).
+ */
+bool wire_latency_us(const wire_hdr_t *hdr, uint32_t *latency_us);
+
+uint16_t wire_crc16(const uint8_t *data, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // WIRE_H
@@ -0,0 +1,74 @@
+// Generated by python/gen_protocol.py from python/protocol_schema.json. Do not edit.
+// Packet headers, v1 and v2 (wire.h)
+#ifndef WIRE_GEN_H
+#define WIRE_GEN_H
+
+#include <stdint.h>
+
+#define WIRE_VERSION_1    0       // version field of a v1 header: the high byte of its 16-bit type, always 0
+#define WIRE_VERSION_2    2
+#define WIRE_FLAG_CRC     1       // CRC-16/CCITT-FALSE of header + payload follows the payload (little endian)
+#define WIRE_FLAG_TIME    2       // timestamp holds the sender's GPS time
+#define WIRE_TIME_UNIT_US 100     // timestamp: GPS time of week in these units, modulo 2^16 (6.5 s)
+
+// Original packet header (ProtocolHeader_t)
+#define WIRE_HEADER_V1_NAME "WireHeaderV1"
+#define WIRE_HEADER_V1_SIZE 4
+#define WIRE_HEADER_V1_FORMAT "<2H"
+
+typedef struct {
+    uint16_t type;
+    uint16_t length;        // Payload bytes
+} wire_header_v1_t;
+
+static inline void wire_header_v1_encode(const wire_header_v1_t *s, uint8_t *out) {
+    { uint32_t v = (uint32_t)s->type;
+      out[0] = (uint8_t)(v >> 0); out[1] = (uint8_t)(v >> 8); }
+    { uint32_t v = (uint32_t)s->length;
+      out[2] = (uint8_t)(v >> 0); out[3] = (uint8_t)(v >> 8); }
+}
+
+static inline void wire_header_v1_decode(const uint8_t *in, wire_header_v1_t *s) {
+    s->type = (uint16_t)((uint32_t)in[0] << 0 | (uint32_t)in[1] << 8);
+    s->length = (uint16_t)((uint32_t)in[2] << 0 | (uint32_t)in[3] << 8);
+}
+
+// Compact v2 header. Byte 1 is the high byte of a v1 type, so v1 nodes see an unknown type and drop it
+#define WIRE_HEADER_V2_NAME "WireHeaderV2"
+#define WIRE_HEADER_V2_SIZE 8
+#define WIRE_HEADER_V2_FORMAT "<2B3H"
+
+typedef struct {
+    uint8_t type;           // ProtocolType
+    uint8_t flags;          // WIRE_FLAG_*
+    uint8_t version;        // WIRE_VERSION_2
+    uint16_t length;        // Payload bytes, CRC not included
+    uint16_t seq;           // Per sender and type, wraps
+    uint16_t timestamp;     // Sender GPS time when WIRE_FLAG_TIME, see WIRE_TIME_UNIT_US
+} wire_header_v2_t;
+
+static inline void wire_header_v2_encode(const wire_header_v2_t *s, uint8_t *out) {
+    { uint32_t v = (uint32_t)s->type;
+      out[0] = (uint8_t)(v >> 0); }
+    { uint32_t v = (uint32_t)((s->flags & 0x1F) << 0 | (s->version & 0x7) << 5);
+      out[1] = (uint8_t)(v >> 0); }
+    { uint32_t v = (uint32_t)s->length;
+      out[2] = (uint8_t)(v >> 0); out[3] = (uint8_t)(v >> 8); }
+    { uint32_t v = (uint32_t)s->seq;
+      out[4] = (uint8_t)(v >> 0); out[5] = (uint8_t)(v >> 8); }
+    { uint32_t v = (uint32_t)s->timestamp;
+      out[6] = (uint8_t)(v >> 0); out[7] = (uint8_t)(v >> 8); }
+}
+
+static inline void wire_header_v2_decode(const uint8_t *in, wire_header_v2_t *s) {
+    s->type = (uint8_t)((uint32_t)in[0] << 0);
+    { uint32_t v = (uint32_t)in[1] << 0;
+      s->flags = (v >> 0) & 0x1F;
+      s->version = (v >> 5) & 0x7;
+    }
+    s->length = (uint16_t)((uint32_t)in[2] << 0 | (uint32_t)in[3] << 8);
+    s->seq = (uint16_t)((uint32_t)in[4] << 0 | (uint32_t)in[5] << 8);
+    s->timestamp = (uint16_t)((uint32_t)in[6] << 0 | (uint32_t)in[7] << 8);
+}
+
+#endif // WIRE_GEN_H
@@ -0,0 +1,307 @@
+#include "rtk_corrections.h"
+#include "rtk_sink.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "../gps_ptp_time/gps_ptp_time.h"
+#include "../enu_frame/enu_frame.h"
+#include "../mesh_tx/mesh_tx.h"
+#include "../mesh_dispatch/mesh_dispatch.h"
+#include "../boot_timeline/boot_timeline.h"
+
+#define GPS_WEEK_MS (7ULL * 24 * 3600 * 1000)
+#define BDS_GPS_OFFSET_MS 14000 // BDT = GPST - 14 s
+#define RTCM3_MAX_FRAME (1023 + 6)
+
+_Static_assert(RTK_DATA_MAX_PAYLOAD >= RTCM3_MAX_FRAME, "the longest RTCM3 frame fits one RTK_DATA packet");
+_Static_assert(WIRE_TX_OVERHEAD + RTK_DATA_HDR_SIZE + RTK_DATA_MAX_PAYLOAD <= PKT_POOL_BUF_SIZE,
+               "a full RTK_DATA packet fits a pool buffer");
+
+static const char *TAG = "rtk_corr";
+static const mesh_addr_t s_group = { .addr = RTK_CORR_GROUP_ID };
+
+// Base side: packet under construction, assembled in place in a pool buffer that goes to mesh_tx as is
+static pkt_buf_t *s_buf;
+static uint16_t s_data_len;
+static uint8_t s_part;
+static uint32_t s_epoch_tow_ms;
+static uint16_t s_seq;
+static bool s_epoch_open;
+static bool s_epoch_broken;         // A frame of the open epoch was dropped: nothing more of it is sent
+static int64_t s_epoch_first_us;    // First frame of the epoch out of the framer
+static int64_t s_last_frame_us;
+
+// Robot side
+static bool s_have_seq;
+static uint16_t s_last_seq;
+static uint8_t s_last_part;
+
+static rtk_corr_stats_t s_stats;
+
+// Read `len` bits starting at bit `pos` (MSB first) of an RTCM3 payload
+static uint32_t getbitu(const uint8_t *buf, int pos, int len) {
+    uint32_t bits = 0;
+    for (int i = pos; i < pos + len; i++) {
+        bits = (bits << 1) | ((buf[i / 8] >> (7 - i % 8)) & 1u);
+    }
+    return bits;
+}
+
+// Signed (two's complement) `len`-bit field, up to 64 bits
+static int64_t getbits64(const uint8_t *buf, int pos, int len) {
+    uint64_t bits = 0;
+    for (int i = pos; i < pos + len; i++) {
+        bits = (bits << 1) | ((buf[i / 8] >> (7 - i % 8)) & 1u);
+    }
+    return (int64_t)(bits << (64 - len)) >> (64 - len);
+}
+
+// MSM1..7 of GPS (107x), GLONASS (108x), Galileo (109x), SBAS (110x), QZSS (111x), BeiDou (112x)
+static bool is_msm(uint16_t type) {
+    return type >= 1071 && type <= 1127 && (type % 10) >= 1 && (type % 10) <= 7;
+}
+
+/**
+ * @brief Parse the MSM header: epoch time as GPS time of week (if the constellation allows) and
+ * the multiple message bit (1 = more MSMs follow for this epoch).
+ */
+static void parse_msm(const rtk_frame_t *frame, uint32_t *tow_ms, bool *more) {
+    const uint8_t *payload = frame->data + 3;
+    uint16_t type = rtk_frame_rtcm_type(frame);
+    uint32_t epoch = getbitu(payload, 24, 30);
+    *more = getbitu(payload, 54, 1);
+    *tow_ms = 0;
+    switch (type / 10) {
+        case 107: // GPS
+        case 109: // Galileo (GST week aligned with GPS)
+        case 110: // SBAS
+        case 111: // QZSS
+            *tow_ms = epoch;
+            break;
+        case 112: // BeiDou
+            *tow_ms = (epoch + BDS_GPS_OFFSET_MS) % GPS_WEEK_MS;
+            break;
+        default:  // GLONASS carries day + time of day in Moscow time; not used for the epoch time
+            break;
+    }
+}
+
+static inline RTKData_t *packet(void) {
+    return (RTKData_t *)(s_buf->data + WIRE_TX_HDR_SIZE);
+}
+
+static void send_packet(bool last_part, int64_t now_us) {
+    uint32_t base_age_us = (uint32_t)(now_us - s_epoch_first_us);
+    if (s_buf != NULL) {
+        uint16_t len = RTK_DATA_HDR_SIZE + s_data_len;
+        RTKData_t *rtk = packet();
+        rtk->seq = s_seq;
+        rtk->part = s_part;
+        rtk->flags = last_part ? RTK_DATA_FLAG_LAST_PART : 0;
+        rtk->epoch_tow_ms = s_epoch_tow_ms;
+        rtk->base_age_us = base_age_us;
+        s_buf->len = wire_encode(s_buf->data, RTK_DATA, len);
+
+        // Highest TX class, and never blocks the UART path: a full queue drops its oldest epoch instead.
+        // The buffer goes to the queue without a copy; the next packet starts in a fresh one.
+        esp_err_t err = mesh_tx_send_buf(MESH_TX_CORRECTIONS, &s_group, MESH_DATA_P2P | MESH_DATA_GROUP, s_buf);
+        s_buf = NULL;
+        if (err != ESP_OK) {
+            s_stats.send_errors++;
+            ESP_LOGW(TAG, "RTK_DATA seq:%u part:%u send failed: 0x%x", s_seq, s_part, err);
+        } else {
+            s_stats.packets_sent++;
+            s_stats.bytes_sent += WIRE_TX_OVERHEAD + len;
+        }
+        if (base_age_us > s_stats.max_base_age_us) {
+            s_stats.max_base_age_us = base_age_us;
+        }
+    }
+
+    s_data_len = 0;
+    s_part++;
+    if (last_part) {
+        if (!s_epoch_broken) {
+            s_stats.epochs_sent++;
+            boot_timeline_end(BOOT_PHASE_FIRST_CORRECTION);
+        }
+        s_seq++;
+        s_epoch_open = false;
+    }
+}
+
+void rtk_corr_add_frame(const rtk_frame_t *frame, int64_t now_us) {
+    if (frame->len > RTK_DATA_MAX_PAYLOAD) {
+        // Longer than any RTCM3 frame, and would never fit a packet
+        s_stats.too_large++;
+        return;
+    }
+    if (!s_epoch_open) {
+        s_epoch_open = true;
+        s_epoch_first_us = now_us;
+        s_data_len = 0;
+        s_part = 0;
+        s_epoch_tow_ms = 0;
+        s_epoch_broken = false;
+    }
+    if (s_data_len > 0 && s_data_len + frame->len > RTK_DATA_MAX_PAYLOAD) {
+        send_packet(false, now_us);
+    }
+    if (s_buf == NULL && !s_epoch_broken) {
+        s_buf = pkt_pool_alloc();
+        if (s_buf == NULL) {
+            // Sending the rest would hand robots an epoch with a frame missing and the last part
+            // flag set. Stop here instead: the sink drops the epoch as partial (or never sees it).
+            s_stats.no_buffer++;
+            s_stats.epochs_dropped++;
+            s_epoch_broken = true;
+        }
+    }
+    if (s_buf != NULL) {
+        memcpy(packet()->data + s_data_len, frame->data, frame->len);
+        s_data_len += frame->len;
+    }
+    s_last_frame_us = now_us;
+
+    uint16_t type = rtk_frame_rtcm_type(frame);
+    if (is_msm(type) && frame->len >= 3 + 7 + 3) {
+        uint32_t tow_ms;
+        bool more;
+        parse_msm(frame, &tow_ms, &more);
+        if (s_epoch_tow_ms == 0) {
+            s_epoch_tow_ms = tow_ms;
+        }
+        if (!more) {
+            // Last MSM of the epoch: send right away rather than waiting for the line to go idle
+            send_packet(true, now_us);
+        }
+    }
+}
+
+TickType_t rtk_corr_poll(int64_t now_us) {
+    if (!s_epoch_open) {
+        return portMAX_DELAY;
+    }
+    int64_t due_us = s_last_frame_us + CONFIG_RTK_CORR_IDLE_FLUSH_MS * 1000LL;
+    if (now_us >= due_us) {
+        send_packet(true, now_us);
+        return portMAX_DELAY;
+    }
+    TickType_t ticks = pdMS_TO_TICKS((due_us - now_us + 999) / 1000);
+    return ticks > 0 ? ticks : 1;
+}
+
+static void handle_packet(const mesh_addr_t *from, const void *payload, size_t payload_len, pkt_buf_t *buf,
+                          void *arg);
+
+esp_err_t rtk_corr_join_group(void) {
+    esp_err_t err = mesh_dispatch_register(RTK_DATA, "RTK_DATA", RTK_DATA_HDR_SIZE, sizeof(RTKData_t),
+                                           handle_packet, NULL);
+    if (err != ESP_OK) {
+        return err;
+    }
+    err = esp_mesh_set_group_id(&s_group, 1);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to join RTK group: 0x%x", err);
+    } else {
+        ESP_LOGI(TAG, "Joined RTK group "MACSTR, MAC2STR(s_group.addr));
+    }
+    return err;
+}
+
+bool rtk_corr_gps_tow_ms_now(uint32_t *tow_ms) {
+    uint64_t now_us;
+    if (gps_ptp_from_local(esp_timer_get_time(), &now_us, NULL) == GPS_PTP_SOURCE_NONE) {
+        return false;
+    }
+    *tow_ms = (uint32_t)((now_us / 1000) % GPS_WEEK_MS);
+    return true;
+}
+
+// Sequence and age-of-correction accounting for a received packet
+static void track_packet(const mesh_addr_t *from, const RTKData_t *rtk, size_t payload_len) {
+    s_stats.packets_rx++;
+
+    if (s_have_seq) {
+        uint16_t delta = rtk->seq - s_last_seq;
+        if (delta == 0 && rtk->part <= s_last_part) {
+            s_stats.duplicates++;
+            return;
+        }
+        if (delta > 1 && delta < 0x8000) {
+            s_stats.seq_gaps += delta - 1;
+        } else if (delta >= 0x8000) {
+            s_stats.duplicates++; // Older epoch arriving late
+            return;
+        }
+    }
+    s_have_seq = true;
+    s_last_seq = rtk->seq;
+    s_last_part = rtk->part;
+
+    if (rtk->flags & RTK_DATA_FLAG_LAST_PART) {
+        s_stats.epochs_rx++;
+    }
+    uint32_t now_tow_ms;
+    if (rtk->part == 0 && rtk->epoch_tow_ms != 0 && rtk_corr_gps_tow_ms_now(&now_tow_ms)) {
+        uint32_t age_ms = (uint32_t)((now_tow_ms + GPS_WEEK_MS - rtk->epoch_tow_ms) % GPS_WEEK_MS);
+        s_stats.age_last_ms = age_ms;
+        s_stats.age_sum_ms += age_ms;
+        s_stats.age_samples++;
+        if (age_ms > s_stats.age_max_ms) {
+            s_stats.age_max_ms = age_ms;
+        }
+    }
+    ESP_LOGD(TAG, "RTK_DATA from "MACSTR" seq:%u part:%u len:%u", MAC2STR(from->addr), rtk->seq, rtk->part,
+             (unsigned)(payload_len - RTK_DATA_HDR_SIZE));
+}
+
+// Robot: the base antenna position in RTCM 1005 (ECEF, 0.1 mm) is the origin of the local ENU frame
+static void scan_reference(const uint8_t *data, size_t len) {
+    size_t i = 0;
+    while (i + 6 <= len && data[i] == 0xD3) {
+        size_t frame_payload_len = ((data[i + 1] & 0x03) << 8) | data[i + 2];
+        if (i + frame_payload_len + 6 > len) {
+            break;
+        }
+        const uint8_t *frame_payload = data + i + 3;
+        if (frame_payload_len >= 19 && getbitu(frame_payload, 0, 12) == 1005) {
+            int64_t x = getbits64(frame_payload, 34, 38);
+            int64_t y = getbits64(frame_payload, 74, 38);
+            int64_t z = getbits64(frame_payload, 114, 38);
+            if (enu_frame_set_reference(x, y, z)) {
+                ESP_LOGI(TAG, "ENU reference from RTCM 1005: %lld %lld %lld (0.1 mm)", x, y, z);
+            }
+        }
+        i += frame_payload_len + 6;
+    }
+}
+
+// Robot: RTK_DATA from the mesh, length checked by the dispatcher
+static void handle_packet(const mesh_addr_t *from, const void *payload, size_t payload_len, pkt_buf_t *buf,
+                          void *arg) {
+    const RTKData_t *rtk = (const RTKData_t *)payload;
+    track_packet(from, rtk, payload_len);
+    scan_reference(rtk->data, payload_len - RTK_DATA_HDR_SIZE);
+    // The sink does its own duplicate and ordering handling
+    rtk_sink_put(rtk, payload_len - RTK_DATA_HDR_SIZE);
+}
+
+void rtk_corr_get_stats(rtk_corr_stats_t *stats) {
+    *stats = s_stats;
+}
+
+void rtk_corr_log_stats(void) {
+    if (s_stats.packets_sent || s_stats.send_errors || s_stats.no_buffer || s_stats.too_large) {
+        ESP_LOGI(TAG, "TX epochs:%lu packets:%lu bytes:%lu errors:%lu no buffer:%lu (epochs cut:%lu) too large:%lu "
+                 "max base age:%luus", s_stats.epochs_sent, s_stats.packets_sent, s_stats.bytes_sent,
+                 s_stats.send_errors, s_stats.no_buffer, s_stats.epochs_dropped, s_stats.too_large,
+                 s_stats.max_base_age_us);
+    }
+    if (s_stats.packets_rx) {
+        ESP_LOGI(TAG, "RX packets:%lu epochs:%lu gaps:%lu dups:%lu age last/avg/max: %lu/%lu/%lu ms",
+                 s_stats.packets_rx, s_stats.epochs_rx, s_stats.seq_gaps, s_stats.duplicates,
+                 s_stats.age_last_ms,
+                 s_stats.age_samples ? (uint32_t)(s_stats.age_sum_ms / s_stats.age_samples) : 0,
+                 s_stats.age_max_ms);
+    }
+}
@@ -0,0 +1,87 @@
+#ifndef RTK_CORRECTIONS_H
+#define RTK_CORRECTIONS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "esp_mesh.h"
+#include "freertos/FreeRTOS.h"
+#include "../protocol/protocol.h"
+#include "../rtk_serial/rtk_framer.h"
+
+/*
+RTCM correction distribution (RTK_DATA).
+
+Base: RTCM3 frames from the framer are grouped per GNSS epoch and sent once to the RTK mesh group,
+which every ROBOT node joins, instead of one unicast per routing table entry. An epoch is closed when
+an MSM arrives with its multiple message bit cleared, or when the frame stream goes idle. Packets go
+out through the highest-priority class of the TX scheduler (mesh_tx.h). An epoch that loses a frame
+because the packet pool is empty is not sent any further, so robots never inject part of it.
+
+Robot: packets are checked for sequence gaps and duplicates, and the age of correction is measured
+against the robot's own GPS time (local GNSS time minus the epoch time in the MSM header). They are
+then handed to the RTCM sink (rtk_sink.h) for in-order injection into the local receiver. The base
+position in RTCM 1005 sets the origin of the robot's ENU frame (enu_frame.h).
+*/
+
+#ifndef CONFIG_RTK_CORR_IDLE_FLUSH_MS
+#define CONFIG_RTK_CORR_IDLE_FLUSH_MS 20
+#endif
+
+// Group address joined by ROBOT nodes ("RTK" in a locally administered multicast MAC)
+#define RTK_CORR_GROUP_ID { 0x01, 0x00, 0x5E, 0x52, 0x54, 0x4B }
+
+typedef struct {
+    // Base
+    uint32_t epochs_sent;
+    uint32_t packets_sent;
+    uint32_t bytes_sent;
+    uint32_t send_errors;       // Not queued for sending (mesh_tx stats count what the mesh stack rejected)
+    uint32_t no_buffer;         // Packet pool empty when a frame needed a new packet
+    uint32_t epochs_dropped;    // Epochs cut short that way: the rest of the epoch is not sent
+    uint32_t too_large;         // Frames dropped: longer than RTK_DATA_MAX_PAYLOAD
+    uint32_t max_base_age_us;   // Worst framer-to-TX-queue delay seen at the base
+    // Robot
+    uint32_t packets_rx;
+    uint32_t epochs_rx;         // Packets flagged as the last part of an epoch
+    uint32_t seq_gaps;          // Epochs never seen
+    uint32_t duplicates;
+    uint32_t age_samples;
+    uint32_t age_last_ms;       // Age of correction at receipt (robot GPS time - epoch time)
+    uint32_t age_max_ms;
+    uint64_t age_sum_ms;
+} rtk_corr_stats_t;
+
+/**
+ * @brief Base: add an RTCM3 frame to the current epoch, sending packets as they fill or the epoch ends.
+ *
+ * @param frame  Complete RTCM3 frame from the framer.
+ * @param now_us esp_timer time at which the frame came out of the framer.
+ */
+void rtk_corr_add_frame(const rtk_frame_t *frame, int64_t now_us);
+
+/**
+ * @brief Base: send the open epoch if no frame has arrived for CONFIG_RTK_CORR_IDLE_FLUSH_MS.
+ *
+ * @return Ticks until the next flush is due, or portMAX_DELAY when nothing is pending.
+ */
+TickType_t rtk_corr_poll(int64_t now_us);
+
+/**
+ * @brief Robot: register the RTK_DATA handler and join the RTK mesh group so corrections sent by the
+ * base are delivered here.
+ */
+esp_err_t rtk_corr_join_group(void);
+
+/**
+ * @brief Current GPS time of week (ms), see gps_ptp_now_us().
+ *
+ * @return false if this node has no GPS time source yet.
+ */
+bool rtk_corr_gps_tow_ms_now(uint32_t *tow_ms);
+
+void rtk_corr_get_stats(rtk_corr_stats_t *stats);
+void rtk_corr_log_stats(void);
+
+#endif // RTK_CORRECTIONS_H
@@ -0,0 +1,239 @@
+#include "rtk_sink.h"
+#include "rtk_corrections.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/semphr.h"
+#include "../rtk_serial/rtk_serial.h"
+#include "../boot_timeline/boot_timeline.h"
+
+#define GPS_WEEK_MS (7ULL * 24 * 3600 * 1000)
+// Further ahead than this: long outage. Further behind: base restarted with its sequence at 0
+#define RTK_SINK_RESYNC_DELTA (RTK_SINK_SLOTS * 4)
+
+static const char *TAG = "rtk_sink";
+
+typedef struct {
+    bool used;
+    bool out_of_order;      // A later epoch was already buffered when this one arrived
+    uint16_t seq;
+    uint8_t parts_mask;     // Bit per part received
+    int8_t last_part;       // Index of the part flagged RTK_DATA_FLAG_LAST_PART, -1 until seen
+    uint32_t epoch_tow_ms;
+    uint32_t base_age_us;
+    int64_t first_us;       // Local arrival of the first packet of this epoch
+    uint16_t part_len[RTK_SINK_MAX_PARTS];
+    // Part n is stored at n * RTK_DATA_MAX_PAYLOAD and compacted in place before injection
+    uint8_t data[RTK_SINK_MAX_PARTS * RTK_DATA_MAX_PAYLOAD];
+} sink_slot_t;
+
+static sink_slot_t s_slots[RTK_SINK_SLOTS];
+static SemaphoreHandle_t s_mutex;
+static bool s_have_next;
+static uint16_t s_next_seq;
+static int64_t s_next_since_us;     // When s_next_seq was last set or moved on
+static rtk_sink_stats_t s_stats;
+
+static bool slot_complete(const sink_slot_t *slot) {
+    return slot->last_part >= 0 && slot->parts_mask == (uint8_t)((1u << (slot->last_part + 1)) - 1);
+}
+
+// Age of correction in ms: GPS time against the epoch time when both are known, else local arrival time
+static uint32_t slot_age_ms(const sink_slot_t *slot, int64_t now_us) {
+    uint32_t now_tow_ms;
+    if (slot->epoch_tow_ms != 0 && rtk_corr_gps_tow_ms_now(&now_tow_ms)) {
+        return (uint32_t)((now_tow_ms + GPS_WEEK_MS - slot->epoch_tow_ms) % GPS_WEEK_MS);
+    }
+    return (uint32_t)((now_us - slot->first_us + slot->base_age_us) / 1000);
+}
+
+static sink_slot_t *find_slot(uint16_t seq) {
+    for (int i = 0; i < RTK_SINK_SLOTS; i++) {
+        if (s_slots[i].used && s_slots[i].seq == seq) {
+            return &s_slots[i];
+        }
+    }
+    return NULL;
+}
+
+// Buffered epoch closest after s_next_seq
+static sink_slot_t *oldest_slot(void) {
+    sink_slot_t *oldest = NULL;
+    for (int i = 0; i < RTK_SINK_SLOTS; i++) {
+        if (s_slots[i].used && (!oldest || (uint16_t)(s_slots[i].seq - s_next_seq) < (uint16_t)(oldest->seq - s_next_seq))) {
+            oldest = &s_slots[i];
+        }
+    }
+    return oldest;
+}
+
+static void inject(sink_slot_t *slot) {
+    // Pack the parts back to back so the epoch goes out in a single UART write
+    size_t len = 0;
+    for (int p = 0; p <= slot->last_part; p++) {
+        memmove(slot->data + len, slot->data + p * RTK_DATA_MAX_PAYLOAD, slot->part_len[p]);
+        len += slot->part_len[p];
+    }
+    if (rtk_serial_write(slot->data, len) < 0) {
+        s_stats.dropped_no_space++;
+        ESP_LOGW(TAG, "UART TX buffer full, dropped epoch seq:%u (%u bytes)", slot->seq, (unsigned)len);
+        return;
+    }
+    s_stats.epochs_injected++;
+    boot_timeline_end(BOOT_PHASE_FIRST_CORRECTION);
+    s_stats.bytes_injected += len;
+    if (slot->out_of_order) {
+        s_stats.epochs_reordered++;
+    }
+}
+
+// Inject or drop epochs in sequence order until the next one has to be waited for
+static void release(int64_t now_us) {
+    const int64_t reorder_us = CONFIG_RTK_SINK_REORDER_MS * 1000LL;
+    for (;;) {
+        sink_slot_t *slot = find_slot(s_next_seq);
+        if (slot) {
+            if (slot_complete(slot)) {
+                if (slot_age_ms(slot, now_us) > CONFIG_RTK_SINK_MAX_AGE_MS) {
+                    s_stats.dropped_stale++;
+                } else {
+                    inject(slot);
+                }
+            } else if (now_us - slot->first_us >= reorder_us) {
+                s_stats.dropped_partial++;
+            } else {
+                return;
+            }
+            slot->used = false;
+            s_next_seq++;
+            s_next_since_us = now_us;
+            continue;
+        }
+        // Next epoch not here yet: give it the reorder window, measured from the oldest later epoch
+        slot = oldest_slot();
+        if (!slot || now_us - slot->first_us < reorder_us) {
+            return;
+        }
+        s_stats.missing += (uint16_t)(slot->seq - s_next_seq);
+        s_next_seq = slot->seq;
+        s_next_since_us = now_us;
+    }
+}
+
+void rtk_sink_init(void) {
+    s_mutex = xSemaphoreCreateMutex();
+    if (s_mutex == NULL) {
+        ESP_LOGE(TAG, "Failed to create sink mutex");
+    }
+}
+
+void rtk_sink_put(const RTKData_t *rtk, size_t data_len) {
+    if (s_mutex == NULL || !xSemaphoreTake(s_mutex, portMAX_DELAY)) {
+        return;
+    }
+    int64_t now_us = esp_timer_get_time();
+    if (!s_have_next) {
+        s_have_next = true;
+        s_next_seq = rtk->seq;
+        s_next_since_us = now_us;
+    }
+    uint16_t delta = rtk->seq - s_next_seq;
+    // Late: a little behind while epochs still flow. Far behind, or with nothing released for
+    // longer than a correction stays usable, the base restarted and its sequence with it.
+    bool stalled = now_us - s_next_since_us > CONFIG_RTK_SINK_MAX_AGE_MS * 1000LL;
+    if (delta >= 0x8000 && (uint16_t)(s_next_seq - rtk->seq) <= RTK_SINK_RESYNC_DELTA && !stalled) {
+        s_stats.dropped_late++;
+        goto out;
+    }
+    if (delta >= RTK_SINK_RESYNC_DELTA) {
+        ESP_LOGW(TAG, "Sequence jump %u -> %u, resetting jitter buffer", s_next_seq, rtk->seq);
+        for (int i = 0; i < RTK_SINK_SLOTS; i++) {
+            if (s_slots[i].used) {
+                s_stats.dropped_partial++;
+                s_slots[i].used = false;
+            }
+        }
+        s_next_seq = rtk->seq;
+        s_next_since_us = now_us;
+    }
+    if (rtk->part >= RTK_SINK_MAX_PARTS || data_len > RTK_DATA_MAX_PAYLOAD) {
+        s_stats.dropped_no_space++;
+        goto out;
+    }
+
+    sink_slot_t *slot = find_slot(rtk->seq);
+    if (!slot) {
+        bool later_buffered = false;
+        for (int i = 0; i < RTK_SINK_SLOTS; i++) {
+            if (!s_slots[i].used) {
+                if (!slot) slot = &s_slots[i];
+            } else if ((uint16_t)(s_slots[i].seq - s_next_seq) > delta) {
+                later_buffered = true;
+            }
+        }
+        if (!slot) {
+            s_stats.dropped_no_space++;
+            goto out;
+        }
+        memset(slot->part_len, 0, sizeof(slot->part_len));
+        slot->used = true;
+        slot->out_of_order = later_buffered;
+        slot->seq = rtk->seq;
+        slot->parts_mask = 0;
+        slot->last_part = -1;
+        slot->epoch_tow_ms = 0;
+        slot->base_age_us = 0;
+        slot->first_us = now_us;
+    }
+    if (slot->parts_mask & (1u << rtk->part)) {
+        goto out; // Duplicate part
+    }
+    memcpy(slot->data + rtk->part * RTK_DATA_MAX_PAYLOAD, rtk->data, data_len);
+    slot->part_len[rtk->part] = data_len;
+    slot->parts_mask |= 1u << rtk->part;
+    if (rtk->flags & RTK_DATA_FLAG_LAST_PART) {
+        slot->last_part = rtk->part;
+    }
+    if (rtk->part == 0) {
+        slot->epoch_tow_ms = rtk->epoch_tow_ms;
+        slot->base_age_us = rtk->base_age_us;
+    }
+    release(now_us);
+out:
+    xSemaphoreGive(s_mutex);
+}
+
+TickType_t rtk_sink_poll(void) {
+    if (s_mutex == NULL || !xSemaphoreTake(s_mutex, portMAX_DELAY)) {
+        return portMAX_DELAY;
+    }
+    int64_t now_us = esp_timer_get_time();
+    release(now_us);
+
+    int64_t next_due_us = INT64_MAX;
+    for (int i = 0; i < RTK_SINK_SLOTS; i++) {
+        if (s_slots[i].used) {
+            int64_t due_us = s_slots[i].first_us + CONFIG_RTK_SINK_REORDER_MS * 1000LL;
+            if (due_us < next_due_us) {
+                next_due_us = due_us;
+            }
+        }
+    }
+    xSemaphoreGive(s_mutex);
+
+    if (next_due_us == INT64_MAX) {
+        return portMAX_DELAY;
+    }
+    TickType_t ticks = next_due_us > now_us ? pdMS_TO_TICKS((next_due_us - now_us + 999) / 1000) : 0;
+    return ticks > 0 ? ticks : 1;
+}
+
+void rtk_sink_get_stats(rtk_sink_stats_t *stats) {
+    *stats = s_stats;
+}
+
+void rtk_sink_log_stats(void) {
+    ESP_LOGI(TAG, "Injected epochs:%lu bytes:%lu reordered:%lu | dropped stale:%lu partial:%lu late:%lu no space:%lu | missing:%lu",
+             s_stats.epochs_injected, s_stats.bytes_injected, s_stats.epochs_reordered,
+             s_stats.dropped_stale, s_stats.dropped_partial, s_stats.dropped_late, s_stats.dropped_no_space,
+             s_stats.missing);
+}
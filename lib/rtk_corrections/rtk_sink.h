@@ -0,0 +1,63 @@
+#ifndef RTK_SINK_H
+#define RTK_SINK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "freertos/FreeRTOS.h"
+#include "../protocol/protocol.h"
+
+/*
+Robot-side RTCM sink.
+
+RTK_DATA packets are collected per epoch in a small jitter buffer, released strictly in sequence
+order and written to the local GNSS receiver with one UART write per epoch. Epochs that are
+incomplete or older than CONFIG_RTK_SINK_MAX_AGE_MS are dropped rather than injected: a partial or
+out-of-order epoch does more harm to the RTK fix than a missing one.
+*/
+
+#ifndef CONFIG_RTK_SINK_MAX_AGE_MS
+#define CONFIG_RTK_SINK_MAX_AGE_MS 1500
+#endif
+#ifndef CONFIG_RTK_SINK_REORDER_MS
+#define CONFIG_RTK_SINK_REORDER_MS 100
+#endif
+
+#define RTK_SINK_SLOTS      4   // Epochs held at once
+#define RTK_SINK_MAX_PARTS  3   // RTK_DATA packets per epoch
+
+typedef struct {
+    uint32_t epochs_injected;
+    uint32_t bytes_injected;
+    uint32_t epochs_reordered;  // Injected after arriving out of order
+    uint32_t dropped_stale;     // Complete but older than CONFIG_RTK_SINK_MAX_AGE_MS
+    uint32_t dropped_partial;   // Parts still missing when the epoch timed out
+    uint32_t dropped_late;      // Arrived after a newer epoch was already injected
+    uint32_t dropped_no_space;  // No free slot, too many parts, or UART TX buffer full
+    uint32_t missing;           // Sequence numbers never seen at all
+} rtk_sink_stats_t;
+
+/**
+ * @brief Create the sink; call once on ROBOT nodes after the serial port is set up.
+ */
+void rtk_sink_init(void);
+
+/**
+ * @brief Store an RTK_DATA packet and inject whatever became releasable.
+ *
+ * @param rtk     Packet header and data.
+ * @param data_len Number of RTCM bytes in rtk->data.
+ */
+void rtk_sink_put(const RTKData_t *rtk, size_t data_len);
+
+/**
+ * @brief Release or drop epochs whose reorder or age deadline has passed.
+ *
+ * @return Ticks until the next deadline, or portMAX_DELAY when nothing is pending.
+ */
+TickType_t rtk_sink_poll(void);
+
+void rtk_sink_get_stats(rtk_sink_stats_t *stats);
+void rtk_sink_log_stats(void);
+
+#endif // RTK_SINK_H
@@ -0,0 +1,201 @@
+#include <string.h>
+#include "rtk_framer.h"
+
+#define RING_MASK (RTK_FRAMER_RING_SIZE - 1)
+
+_Static_assert((RTK_FRAMER_RING_SIZE & RING_MASK) == 0, "RTK_FRAMER_RING_SIZE must be a power of two");
+_Static_assert(RTK_FRAMER_RING_SIZE > RTK_FRAMER_MAX_FRAME, "ring must hold at least one full frame");
+
+static const uint16_t rtcm_tracked_types[RTK_RTCM_NUM_TRACKED] = RTK_RTCM_TRACKED_TYPES;
+
+// CRC-24Q, polynomial 0x864CFB, MSB first (RTCM 10403.x section 4.2)
+static const uint32_t crc24q_table[256] = {
+    0x000000, 0x864CFB, 0x8AD50D, 0x0C99F6, 0x93E6E1, 0x15AA1A, 0x1933EC, 0x9F7F17,
+    0xA18139, 0x27CDC2, 0x2B5434, 0xAD18CF, 0x3267D8, 0xB42B23, 0xB8B2D5, 0x3EFE2E,
+    0xC54E89, 0x430272, 0x4F9B84, 0xC9D77F, 0x56A868, 0xD0E493, 0xDC7D65, 0x5A319E,
+    0x64CFB0, 0xE2834B, 0xEE1ABD, 0x685646, 0xF72951, 0x7165AA, 0x7DFC5C, 0xFBB0A7,
+    0x0CD1E9, 0x8A9D12, 0x8604E4, 0x00481F, 0x9F3708, 0x197BF3, 0x15E205, 0x93AEFE,
+    0xAD50D0, 0x2B1C2B, 0x2785DD, 0xA1C926, 0x3EB631, 0xB8FACA, 0xB4633C, 0x322FC7,
+    0xC99F60, 0x4FD39B, 0x434A6D, 0xC50696, 0x5A7981, 0xDC357A, 0xD0AC8C, 0x56E077,
+    0x681E59, 0xEE52A2, 0xE2CB54, 0x6487AF, 0xFBF8B8, 0x7DB443, 0x712DB5, 0xF7614E,
+    0x19A3D2, 0x9FEF29, 0x9376DF, 0x153A24, 0x8A4533, 0x0C09C8, 0x00903E, 0x86DCC5,
+    0xB822EB, 0x3E6E10, 0x32F7E6, 0xB4BB1D, 0x2BC40A, 0xAD88F1, 0xA11107, 0x275DFC,
+    0xDCED5B, 0x5AA1A0, 0x563856, 0xD074AD, 0x4F0BBA, 0xC94741, 0xC5DEB7, 0x43924C,
+    0x7D6C62, 0xFB2099, 0xF7B96F, 0x71F594, 0xEE8A83, 0x68C678, 0x645F8E, 0xE21375,
+    0x15723B, 0x933EC0, 0x9FA736, 0x19EBCD, 0x8694DA, 0x00D821, 0x0C41D7, 0x8A0D2C,
+    0xB4F302, 0x32BFF9, 0x3E260F, 0xB86AF4, 0x2715E3, 0xA15918, 0xADC0EE, 0x2B8C15,
+    0xD03CB2, 0x567049, 0x5AE9BF, 0xDCA544, 0x43DA53, 0xC596A8, 0xC90F5E, 0x4F43A5,
+    0x71BD8B, 0xF7F170, 0xFB6886, 0x7D247D, 0xE25B6A, 0x641791, 0x688E67, 0xEEC29C,
+    0x3347A4, 0xB50B5F, 0xB992A9, 0x3FDE52, 0xA0A145, 0x26EDBE, 0x2A7448, 0xAC38B3,
+    0x92C69D, 0x148A66, 0x181390, 0x9E5F6B, 0x01207C, 0x876C87, 0x8BF571, 0x0DB98A,
+    0xF6092D, 0x7045D6, 0x7CDC20, 0xFA90DB, 0x65EFCC, 0xE3A337, 0xEF3AC1, 0x69763A,
+    0x578814, 0xD1C4EF, 0xDD5D19, 0x5B11E2, 0xC46EF5, 0x42220E, 0x4EBBF8, 0xC8F703,
+    0x3F964D, 0xB9DAB6, 0xB54340, 0x330FBB, 0xAC70AC, 0x2A3C57, 0x26A5A1, 0xA0E95A,
+    0x9E1774, 0x185B8F, 0x14C279, 0x928E82, 0x0DF195, 0x8BBD6E, 0x872498, 0x016863,
+    0xFAD8C4, 0x7C943F, 0x700DC9, 0xF64132, 0x693E25, 0xEF72DE, 0xE3EB28, 0x65A7D3,
+    0x5B59FD, 0xDD1506, 0xD18CF0, 0x57C00B, 0xC8BF1C, 0x4EF3E7, 0x426A11, 0xC426EA,
+    0x2AE476, 0xACA88D, 0xA0317B, 0x267D80, 0xB90297, 0x3F4E6C, 0x33D79A, 0xB59B61,
+    0x8B654F, 0x0D29B4, 0x01B042, 0x87FCB9, 0x1883AE, 0x9ECF55, 0x9256A3, 0x141A58,
+    0xEFAAFF, 0x69E604, 0x657FF2, 0xE33309, 0x7C4C1E, 0xFA00E5, 0xF69913, 0x70D5E8,
+    0x4E2BC6, 0xC8673D, 0xC4FECB, 0x42B230, 0xDDCD27, 0x5B81DC, 0x57182A, 0xD154D1,
+    0x26359F, 0xA07964, 0xACE092, 0x2AAC69, 0xB5D37E, 0x339F85, 0x3F0673, 0xB94A88,
+    0x87B4A6, 0x01F85D, 0x0D61AB, 0x8B2D50, 0x145247, 0x921EBC, 0x9E874A, 0x18CBB1,
+    0xE37B16, 0x6537ED, 0x69AE1B, 0xEFE2E0, 0x709DF7, 0xF6D10C, 0xFA48FA, 0x7C0401,
+    0x42FA2F, 0xC4B6D4, 0xC82F22, 0x4E63D9, 0xD11CCE, 0x575035, 0x5BC9C3, 0xDD8538,
+};
+
+static inline uint8_t peek(const rtk_framer_t *f, uint32_t i) {
+    return f->buf[(f->head + i) & RING_MASK];
+}
+
+static inline void skip(rtk_framer_t *f, uint32_t n) {
+    f->head += n;
+    f->stats.skipped_bytes += n;
+}
+
+// Make the frame at the read position contiguous and return a pointer to it.
+// A frame that wraps has its head part mirrored into the spare area after the ring.
+static const uint8_t *frame_ptr(rtk_framer_t *f, uint16_t len) {
+    uint32_t start = f->head & RING_MASK;
+    if (start + len > RTK_FRAMER_RING_SIZE) {
+        memcpy(&f->buf[RTK_FRAMER_RING_SIZE], f->buf, start + len - RTK_FRAMER_RING_SIZE);
+    }
+    return &f->buf[start];
+}
+
+uint32_t rtk_crc24q(uint32_t crc, const uint8_t *data, size_t len) {
+    while (len--) {
+        crc = ((crc << 8) ^ crc24q_table[((crc >> 16) ^ *data++) & 0xFF]) & 0xFFFFFF;
+    }
+    return crc;
+}
+
+int rtk_rtcm_type_index(uint16_t msg_type) {
+    for (int i = 0; i < RTK_RTCM_NUM_TRACKED; i++) {
+        if (rtcm_tracked_types[i] == msg_type) {
+            return i;
+        }
+    }
+    return RTK_RTCM_OTHER;
+}
+
+uint16_t rtk_rtcm_type_at(int index) {
+    return index < RTK_RTCM_NUM_TRACKED ? rtcm_tracked_types[index] : 0;
+}
+
+void rtk_framer_init(rtk_framer_t *f) {
+    f->head = 0;
+    f->tail = 0;
+    f->held = 0;
+    memset(&f->stats, 0, sizeof(f->stats));
+}
+
+uint8_t *rtk_framer_write_ptr(rtk_framer_t *f, size_t *space) {
+    uint32_t idx = f->tail & RING_MASK;
+    size_t free_bytes = RTK_FRAMER_RING_SIZE - (f->tail - f->head);
+    size_t contiguous = RTK_FRAMER_RING_SIZE - idx;
+    *space = free_bytes < contiguous ? free_bytes : contiguous;
+    return &f->buf[idx];
+}
+
+void rtk_framer_commit(rtk_framer_t *f, size_t len) {
+    f->tail += len;
+}
+
+size_t rtk_framer_push(rtk_framer_t *f, const uint8_t *data, size_t len) {
+    size_t done = 0;
+    while (done < len) {
+        size_t space;
+        uint8_t *dst = rtk_framer_write_ptr(f, &space);
+        if (space == 0) {
+            f->stats.overflow_bytes += len - done;
+            break;
+        }
+        size_t n = len - done < space ? len - done : space;
+        memcpy(dst, data + done, n);
+        rtk_framer_commit(f, n);
+        done += n;
+    }
+    return done;
+}
+
+bool rtk_framer_next(rtk_framer_t *f, rtk_frame_t *frame) {
+    // Release the frame handed out by the previous call
+    f->head += f->held;
+    f->held = 0;
+
+    for (;;) {
+        uint32_t avail = f->tail - f->head;
+        if (avail == 0) {
+            return false;
+        }
+        uint8_t b0 = peek(f, 0);
+        if (b0 == UBX_SYNC_CHAR_1) {
+            if (avail < 2) return false;
+            if (peek(f, 1) != UBX_SYNC_CHAR_2) {
+                skip(f, 1);
+                continue;
+            }
+            if (avail < 6) return false;
+            uint16_t payload_len = peek(f, 4) | (peek(f, 5) << 8);
+            if (payload_len > RTK_FRAMER_MAX_UBX_PAYLOAD) {
+                skip(f, 1);
+                continue;
+            }
+            uint16_t len = payload_len + 8; // sync(2) + class/id(2) + length(2) + payload + CRC(2)
+            if (avail < len) return false;
+
+            const uint8_t *data = frame_ptr(f, len);
+            // Fletcher-8 over class, id, length and payload
+            uint8_t ck_a = 0, ck_b = 0;
+            for (uint16_t i = 2; i < len - 2; i++) {
+                ck_a += data[i];
+                ck_b += ck_a;
+            }
+            if (ck_a != data[len - 2] || ck_b != data[len - 1]) {
+                f->stats.ubx_crc_errors++;
+                skip(f, 1);
+                continue;
+            }
+            f->stats.ubx_frames++;
+            frame->type = RTK_FRAME_UBX;
+            frame->data = data;
+            frame->len = len;
+            f->held = len;
+            return true;
+        } else if (b0 == RTCM3_PREAMBLE) {
+            if (avail < 3) return false;
+            uint8_t b1 = peek(f, 1);
+            uint16_t payload_len = ((b1 & 0x03) << 8) | peek(f, 2);
+            // The 6 reserved bits must be zero and every message carries at least its 12-bit number
+            if ((b1 & 0xFC) != 0 || payload_len < 2) {
+                skip(f, 1);
+                continue;
+            }
+            uint16_t len = payload_len + 6; // preamble/length(3) + payload + CRC-24Q(3)
+            if (avail < len) return false;
+
+            const uint8_t *data = frame_ptr(f, len);
+            uint32_t crc = rtk_crc24q(0, data, len - 3);
+            uint32_t msg_crc = ((uint32_t)data[len - 3] << 16) | (data[len - 2] << 8) | data[len - 1];
+            rtk_rtcm_type_stats_t *type_stats = &f->stats.rtcm_types[rtk_rtcm_type_index((data[3] << 4) | (data[4] >> 4))];
+            if (crc != msg_crc) {
+                // Drop it before it reaches the mesh; the length may be bogus too, so resync byte by byte
+                f->stats.rtcm_crc_errors++;
+                type_stats->rejected++;
+                skip(f, 1);
+                continue;
+            }
+            f->stats.rtcm_frames++;
+            type_stats->accepted++;
+            type_stats->bytes += len;
+            frame->type = RTK_FRAME_RTCM3;
+            frame->data = data;
+            frame->len = len;
+            f->held = len;
+            return true;
+        } else {
+            skip(f, 1);
+        }
+    }
+}
@@ -0,0 +1,152 @@
+#ifndef RTK_FRAMER_H
+#define RTK_FRAMER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+Streaming UBX / RTCM3 framer.
+
+UART bytes are written straight into a persistent ring buffer and complete
+frames are handed back as pointers into that ring, so nothing is allocated
+or moved per read. A frame split across reads just waits for the rest of its
+bytes, and any byte that cannot start a valid frame is skipped one at a time
+so the framer resyncs on its own after line noise or a corrupted frame.
+
+No ESP-IDF dependencies: captured byte streams can be fed to it on a host.
+*/
+
+#define RTK_FRAMER_RING_SIZE        4096    // Must be a power of two
+#define RTK_FRAMER_MAX_UBX_PAYLOAD  1024    // Longer UBX frames are treated as garbage
+#define RTK_FRAMER_MAX_FRAME        (RTK_FRAMER_MAX_UBX_PAYLOAD + 8) // Also covers RTCM3 (1023 + 6)
+
+#define UBX_SYNC_CHAR_1     0xB5
+#define UBX_SYNC_CHAR_2     0x62
+#define RTCM3_PREAMBLE      0xD3
+
+typedef enum {
+    RTK_FRAME_UBX,
+    RTK_FRAME_RTCM3,
+} rtk_frame_type_t;
+
+/**
+ * @brief A complete frame inside the framer ring.
+ *
+ * `data` points at the first preamble byte and covers the whole frame (header, payload and
+ * checksum). It stays valid until the next call to rtk_framer_next().
+ */
+typedef struct {
+    rtk_frame_type_t type;
+    const uint8_t *data;
+    uint16_t len;
+} rtk_frame_t;
+
+// RTCM3 message numbers with their own counters (see the base station configuration in rtk_serial.h).
+// Anything else is accumulated in the last slot.
+#define RTK_RTCM_TRACKED_TYPES  { 1005, 1074, 1084, 1094, 1124, 1230 }
+#define RTK_RTCM_NUM_TRACKED    6
+#define RTK_RTCM_OTHER          RTK_RTCM_NUM_TRACKED
+
+typedef struct {
+    uint32_t accepted;          // Frames that passed CRC-24Q
+    uint32_t rejected;          // Frames dropped on a CRC-24Q mismatch
+    uint32_t bytes;             // Bytes of accepted frames (header and CRC included)
+} rtk_rtcm_type_stats_t;
+
+typedef struct {
+    uint32_t ubx_frames;        // UBX frames returned (checksum passed)
+    uint32_t rtcm_frames;       // RTCM3 frames returned (CRC-24Q passed)
+    uint32_t ubx_crc_errors;    // UBX candidates rejected by the Fletcher-8 check
+    uint32_t rtcm_crc_errors;   // RTCM3 candidates rejected by the CRC-24Q check
+    uint32_t skipped_bytes;     // Bytes discarded while searching for a preamble
+    uint32_t overflow_bytes;    // Bytes that did not fit in the ring
+    rtk_rtcm_type_stats_t rtcm_types[RTK_RTCM_NUM_TRACKED + 1]; // Indexed by rtk_rtcm_type_index()
+} rtk_framer_stats_t;
+
+typedef struct {
+    // The extra MAX_FRAME bytes past the ring let a frame that wraps be made contiguous.
+    uint8_t buf[RTK_FRAMER_RING_SIZE + RTK_FRAMER_MAX_FRAME];
+    uint32_t head;      // Read index (free running)
+    uint32_t tail;      // Write index (free running)
+    uint16_t held;      // Length of the frame last handed out, released on the next call
+    rtk_framer_stats_t stats;
+} rtk_framer_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Reset the framer to an empty ring and zero its statistics.
+ */
+void rtk_framer_init(rtk_framer_t *f);
+
+/**
+ * @brief Get the contiguous free region at the write position of the ring.
+ *
+ * Lets the caller read from the UART directly into the ring. Follow with rtk_framer_commit().
+ *
+ * @param space Set to the number of bytes that may be written at the returned pointer.
+ * @return Pointer to the write position (never NULL; `*space` may be 0 when the ring is full).
+ */
+uint8_t *rtk_framer_write_ptr(rtk_framer_t *f, size_t *space);
+
+/**
+ * @brief Publish `len` bytes written at rtk_framer_write_ptr().
+ */
+void rtk_framer_commit(rtk_framer_t *f, size_t len);
+
+/**
+ * @brief Copy bytes into the ring (convenience for host tools feeding captures).
+ *
+ * @return Number of bytes accepted; the remainder is counted in `overflow_bytes`.
+ */
+size_t rtk_framer_push(rtk_framer_t *f, const uint8_t *data, size_t len);
+
+/**
+ * @brief Extract the next complete frame from the ring.
+ *
+ * Releases the frame returned by the previous call, then scans forward from the read position.
+ *
+ * @param frame Filled in when a frame is available.
+ * @return true if a frame was returned, false if more bytes are needed.
+ */
+bool rtk_framer_next(rtk_framer_t *f, rtk_frame_t *frame);
+
+/**
+ * @brief CRC-24Q (RTCM3 / Qualcomm) over `len` bytes, table driven.
+ *
+ * @param crc Initial value (0 for a new frame); lets a frame be checked in pieces.
+ */
+uint32_t rtk_crc24q(uint32_t crc, const uint8_t *data, size_t len);
+
+/**
+ * @brief Slot in rtk_framer_stats_t.rtcm_types for an RTCM3 message number.
+ */
+int rtk_rtcm_type_index(uint16_t msg_type);
+
+/**
+ * @brief Message number tracked by a slot of rtk_framer_stats_t.rtcm_types (0 for the "other" slot).
+ */
+uint16_t rtk_rtcm_type_at(int index);
+
+/**
+ * @brief Number of unread bytes in the ring (including a held frame).
+ */
+static inline size_t rtk_framer_used(const rtk_framer_t *f) {
+    return f->tail - f->head;
+}
+
+/**
+ * @brief RTCM3 message number (first 12 bits of the payload).
+ */
+static inline uint16_t rtk_frame_rtcm_type(const rtk_frame_t *frame) {
+    return (uint16_t)((frame->data[3] << 4) | (frame->data[4] >> 4));
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // RTK_FRAMER_H
@@ -2,113 +2,183 @@
 
 
 #define UART_NUM UART_NUM_1
-#define UART_BAUD_RATE 115200
-#define UART_BUF_SIZE 1024
+#ifndef CONFIG_RTK_UART_BAUD_RATE
+#define CONFIG_RTK_UART_BAUD_RATE 115200
+#endif
+#ifndef CONFIG_RTK_UART_RX_BUF_SIZE
+#define CONFIG_RTK_UART_RX_BUF_SIZE 8192
+#endif
+#ifndef CONFIG_RTK_UART_TX_BUF_SIZE
+#define CONFIG_RTK_UART_TX_BUF_SIZE 4096
+#endif
+#ifndef CONFIG_RTK_UART_EVENT_QUEUE_LEN
+#define CONFIG_RTK_UART_EVENT_QUEUE_LEN 32
+#endif
+#ifndef CONFIG_RTK_UART_RX_TIMEOUT_SYMBOLS
+#define CONFIG_RTK_UART_RX_TIMEOUT_SYMBOLS 3
+#endif
+#define UART_RX_FULL_THRESHOLD 96 // bytes in the 128-byte HW FIFO before an RX interrupt
 
 static const char *TAG = "rtk_serial";
 
-UBXNavPVT g_nav_pvt;
-UBXNavSVIN g_nav_svin;
-SemaphoreHandle_t g_nav_data_mutex; // Mutex for protecting nav_pvt and nav_svin
+// Latest decoded UBX messages: written by the serial task only, read lock-free through rtk_ubx_get()
+static UBXNavPVT s_pvt_bufs[2];
+static UBXNavSVIN s_svin_bufs[2];
+static UBXNavHPPOSLLH s_hpposllh_bufs[2];
+static UBXNavHPPOSECEF s_hpposecef_bufs[2];
+static UBXNavRELPOSNED s_relposned_bufs[2];
+static UBXTimTP s_tim_tp_bufs[2];
 
-// Python struct format strings for UBXNavPVT and UBXNavSVIN (compact form)
-const char *UBXNavPVT_FORMAT = "<IH6BIi4B4i2I5i2I2HIihH";
-const char *UBXNavSVIN_FORMAT = "<B3x2I3i3bx2I2B2x";
+typedef struct {
+    seqlock_t lock;
+    void *bufs;
+    const char *struct_name;
+    const char *format;     // Python struct format string for the base64 dump (C layout, ubx_gen.h)
+} ubx_snapshot_t;
 
+static ubx_snapshot_t s_ubx[UBX_MSG_COUNT] = {
+    [UBX_MSG_NAV_PVT]       = { SEQLOCK_INIT, s_pvt_bufs, UBX_NAV_PVT_NAME, UBX_NAV_PVT_FORMAT },
+    [UBX_MSG_NAV_SVIN]      = { SEQLOCK_INIT, s_svin_bufs, UBX_NAV_SVIN_NAME, UBX_NAV_SVIN_FORMAT },
+    [UBX_MSG_NAV_HPPOSLLH]  = { SEQLOCK_INIT, s_hpposllh_bufs, UBX_NAV_HPPOSLLH_NAME, UBX_NAV_HPPOSLLH_FORMAT },
+    [UBX_MSG_NAV_HPPOSECEF] = { SEQLOCK_INIT, s_hpposecef_bufs, UBX_NAV_HPPOSECEF_NAME, UBX_NAV_HPPOSECEF_FORMAT },
+    [UBX_MSG_NAV_RELPOSNED] = { SEQLOCK_INIT, s_relposned_bufs, UBX_NAV_RELPOSNED_NAME, UBX_NAV_RELPOSNED_FORMAT },
+    [UBX_MSG_TIM_TP]        = { SEQLOCK_INIT, s_tim_tp_bufs, UBX_TIM_TP_NAME, UBX_TIM_TP_FORMAT },
+};
+
+// Persistent framer state: survives partial frames between reads
+static rtk_framer_t s_framer;
+static QueueHandle_t s_uart_queue;
+static rtk_uart_stats_t s_uart_stats;
+
+
+// NAV-PVT carries the GPS time used for PTP: publish it when date, time and resolution are all valid
+static void publish_pvt_time(const UBXNavPVT *pvt) {
+    // Valid bit 1 is valid Date, 2 is valid Time, 4 is fully resolved:
+    // 0x07 = 1 + 2 + 4. See https://content.u-blox.com/sites/default/files/ZED-F9P_IntegrationManual_UBX-18010802.pdf pg 61 for details.
+    if ((pvt->valid & 0x07) != 0x07) {
+        ESP_LOGW(TAG, "NAV-PVT time not valid: 0x%02X", pvt->valid);
+        return;
+    }
+    gps_ptp_time_t time;
+    time.gps_iTOW_us = pvt->iTOW * 1000ULL + (int64_t)((pvt->nano + 500) / 1000); // Combine iTOW and nano, both in us
+    time.updated_us = (uint64_t)esp_timer_get_time(); // Already in us
+    time.tAcc_us = (pvt->tAcc + 500) / 1000; // Convert ns to us, rounding
+    gps_ptp_time_publish(&time);
+    ESP_LOGI(TAG, "NAV-PVT iTOW: %llu, tAcc: %lu, updated_us: %llu", time.gps_iTOW_us, time.tAcc_us, time.updated_us);
+}
+
+// A finished survey-in fixes the base position: it becomes the origin of the ENU frame
+static void publish_svin_reference(const UBXNavSVIN *svin) {
+    if (!svin->valid || svin->active) {
+        return;
+    }
+    int64_t x = svin->meanX * 100LL + svin->meanXHP;
+    int64_t y = svin->meanY * 100LL + svin->meanYHP;
+    int64_t z = svin->meanZ * 100LL + svin->meanZHP;
+    if (enu_frame_set_reference(x, y, z)) {
+        ESP_LOGI(TAG, "ENU reference from survey-in: %lld %lld %lld (0.1 mm), acc %lu", x, y, z, svin->meanAcc);
+    }
+}
 
 /**
- * @brief Process a UBX message from the provided data buffer.
+ * @brief Process a UBX frame handed out by the framer.
  *
- * This function checks the UBX header and, if valid, processes supported UBX messages (NAV-SVIN and NAV-PVT).
- * It verifies the message type, checks the CRC (Fletcher-8), and only copies the payload into the appropriate global structure (nav_svin or nav_pvt) if the CRC is valid.
- * The function also manages a mutex to protect shared data, and removes the processed message from the buffer. If the CRC fails, the message is rejected and not copied.
+ * The framer has already checked the sync chars, length and CRC (Fletcher-8). Supported messages
+ * (see ubx_decoder.h) are decoded field by field straight from the frame into the spare seqlock
+ * buffer, then published; logging happens afterwards so readers never wait behind it.
+ * Anything else is ignored.
  *
- * @param data    Pointer to the buffer containing the UBX message. The buffer may contain additional data after the message.
- * @param length  Pointer to the length of the data buffer. This will be updated to reflect the remaining unprocessed data.
- * @return true if a supported UBX message was processed and copied (CRC must pass); false otherwise.
+ * @param frame  Complete UBX frame (header, payload and CRC).
+ * @return true if a supported UBX message was decoded and published; false otherwise.
  */
-bool process_ubx_message(uint8_t *data, uint16_t *length) {
-    UBXHeader *header = (UBXHeader *)data;
-    if (header->preamble1 == 0xB5 && header->preamble2 == 0x62 && header->msg_class == 0x01){
-        // Calculate UBX message length: header (6) + payload + CRC (2)
-        int payload_len = header->length;
-        int ubx_msg_len = sizeof(UBXHeader) + payload_len + 2;
-        if (*length < ubx_msg_len) {
-            ESP_LOGE(TAG, "UBX message incomplete: got %d, expected %d", *length, ubx_msg_len);
-            return false;
-        }
-        // Calculate CRC (Fletcher-8)
-        uint8_t ck_a = 0, ck_b = 0;
-        for (int i = 2; i < 6 + payload_len; i++) { // class, id, length, payload
-            ck_a += data[i];
-            ck_b += ck_a;
-        }
-        uint8_t msg_ck_a = data[6 + payload_len];
-        uint8_t msg_ck_b = data[6 + payload_len + 1];
-        if (ck_a != msg_ck_a || ck_b != msg_ck_b) {
-            ESP_DRAM_LOGW(TAG, "UBX CRC mismatch: calc=0x%02X%02X, msg=0x%02X%02X", ck_a, ck_b, msg_ck_a, msg_ck_b);
-            return false;
-        }
-        if (header->msg_id == 0x3B) {
-            ESP_LOGI(TAG, "NAV-SVIN message received");
-            // Lock the mutex before modifying nav_svin
-            if (xSemaphoreTake(g_nav_data_mutex, portMAX_DELAY)) {
-                memcpy(&g_nav_svin, data + sizeof(UBXHeader), sizeof(UBXNavSVIN));
-                PROTOCOL_LOG_STRUCT_BASE64(ESP_LOG_INFO, DATATAG, &g_nav_svin, UBXNavSVIN, UBXNavSVIN_FORMAT);
-                xSemaphoreGive(g_nav_data_mutex); // Unlock the mutex
-            } else {
-                ESP_LOGE(TAG, "Failed to lock mutex for nav_svin");
-            }
-            // Remove the UBX header and NAV-SVIN from the data buffer if it has additional data.
-            int copied_bytes = sizeof(UBXHeader) + sizeof(UBXNavSVIN) + 2; // 2 bytes for CRC
-            if (*length > copied_bytes) {
-                ESP_LOGI(TAG, "NAV-SVIN message has additional data, length: %d", header->length);
-                memcpy(data, data + copied_bytes, *length - copied_bytes);
-            }
-            *length -= copied_bytes;
-            return true;
-        } else if (header->msg_id == 0x07) {
-            ESP_LOGI(TAG, "NAV-PVT message received");
-            // Lock the mutex before modifying nav_pvt
-            if (xSemaphoreTake(g_nav_data_mutex, portMAX_DELAY)) {
-                memcpy(&g_nav_pvt, data + sizeof(UBXHeader), sizeof(UBXNavPVT));
-                PROTOCOL_LOG_STRUCT_BASE64(ESP_LOG_INFO, DATATAG, &g_nav_pvt, UBXNavPVT, UBXNavPVT_FORMAT);
-                xSemaphoreGive(g_nav_data_mutex); // Unlock the mutex
-            } else {
-                ESP_LOGE(TAG, "Failed to lock mutex for nav_pvt");
-            }
-            // Update global GPS PTP time structure (in microseconds)
-            // Valid bit 1 is valid Date, 2 is valid Time, 4 is fully resolved:
-            // 0x07 = 1 + 2 + 4. See https://content.u-blox.com/sites/default/files/ZED-F9P_IntegrationManual_UBX-18010802.pdf pg 61 for details.
-            if ( ((g_nav_pvt.valid & 0x07) == 0x07) && xSemaphoreTake(g_gps_ptp_time_mutex, portMAX_DELAY)) {
-                g_gps_ptp_time.gps_iTOW_us = g_nav_pvt.iTOW * 1000ULL + (int64_t)((g_nav_pvt.nano + 500) / 1000); // Combine iTOW and nano, both in us
-                g_gps_ptp_time.updated_us = (uint64_t)esp_timer_get_time(); // Already in us
-                g_gps_ptp_time.tAcc_us = (g_nav_pvt.tAcc + 500) / 1000; // Convert ns to us, rounding
-                xSemaphoreGive(g_gps_ptp_time_mutex);
-                ESP_LOGI(TAG, "NAV-PVT iTOW: %llu, tAcc: %lu, updated_us: %llu", g_gps_ptp_time.gps_iTOW_us, g_gps_ptp_time.tAcc_us, g_gps_ptp_time.updated_us);
-            }
-            else {
-                ESP_LOGW(TAG, "NAV-PVT time not valid: 0x%02X", g_nav_pvt.valid);
-            }
-            // Remove the UBX header and NAV-PVT from the data buffer if it has additional data.
-            int copied_bytes = sizeof(UBXHeader) + sizeof(UBXNavPVT) + 2; // 2 bytes for CRC
-            if (*length > copied_bytes) {
-                ESP_LOGI(TAG, "NAV-PVT message has additional data, length: %d", header->length);
-                memcpy(data, data + copied_bytes, *length - copied_bytes);
-            }
-            *length -= copied_bytes;
-            return true;
-        }
+static bool process_ubx_message(const rtk_frame_t *frame) {
+    const uint8_t *data = frame->data;
+    uint8_t msg_class = data[2];
+    uint8_t msg_id = data[3];
+    uint16_t payload_len = frame->len - sizeof(UBXHeader) - 2;
+    const uint8_t *payload = data + sizeof(UBXHeader);
+
+    ubx_msg_t msg = ubx_msg_lookup(msg_class, msg_id);
+    if (msg == UBX_MSG_COUNT) {
+        ESP_LOGD(TAG, "Unhandled UBX message: c:0x%02X id:0x%02X l:%u", msg_class, msg_id, payload_len);
+        return false;
     }
-    ESP_LOGE(TAG, "Invalid UBX header: p1:0x%02X p2:0x%02X c:0x%02X id:0x%02X l:%d", 
-        header->preamble1, header->preamble2, header->msg_class, header->msg_id, header->length);
-    return false;
+    const ubx_msg_desc_t *desc = ubx_msg_desc(msg);
+    ubx_snapshot_t *snap = &s_ubx[msg];
+    void *out = seqlock_write_begin(&snap->lock, snap->bufs, desc->struct_size);
+    if (!ubx_decode(msg, payload, payload_len, out)) {
+        seqlock_write_abort(&snap->lock);
+        ESP_LOGW(TAG, "%s rejected: length %u, version %u", desc->name, payload_len, payload_len ? payload[0] : 0);
+        return false;
+    }
+    seqlock_write_end(&snap->lock);
+    // Only this task rewrites the buffer, and not before the next-but-one message: safe to read here
+
+    ESP_LOGI(TAG, "%s message received", desc->name);
+    PROTOCOL_LOG_BASE64(ESP_LOG_INFO, DATATAG, out, desc->struct_size, snap->struct_name, snap->format);
+    if (msg == UBX_MSG_NAV_PVT) {
+        publish_pvt_time((const UBXNavPVT *)out);
+    } else if (msg == UBX_MSG_NAV_SVIN) {
+        publish_svin_reference((const UBXNavSVIN *)out);
+    }
+    return true;
+}
+
+bool rtk_ubx_get(ubx_msg_t msg, void *out) {
+    const ubx_msg_desc_t *desc = ubx_msg_desc(msg);
+    if (desc == NULL) {
+        return false;
+    }
+    return seqlock_read(&s_ubx[msg].lock, s_ubx[msg].bufs, desc->struct_size, out);
+}
+
+bool rtk_nav_get_pvt(UBXNavPVT *pvt) {
+    return rtk_ubx_get(UBX_MSG_NAV_PVT, pvt);
+}
+
+bool rtk_nav_get_svin(UBXNavSVIN *svin) {
+    return rtk_ubx_get(UBX_MSG_NAV_SVIN, svin);
+}
+
+bool rtk_nav_get_enu(enu_pos_t *pos, uint32_t *iTOW) {
+    enu_frame_t frame;
+    if (!enu_frame_get(&frame)) {
+        return false;
+    }
+    UBXNavHPPOSECEF ecef;
+    UBXNavHPPOSLLH llh;
+    UBXNavPVT pvt;
+    bool have_ecef = rtk_ubx_get(UBX_MSG_NAV_HPPOSECEF, &ecef) && !(ecef.flags & 0x01);  // invalidEcef
+    bool have_llh = rtk_ubx_get(UBX_MSG_NAV_HPPOSLLH, &llh) && !(llh.flags & 0x01);      // invalidLlh
+    bool have_pvt = rtk_ubx_get(UBX_MSG_NAV_PVT, &pvt) && (pvt.flags & 0x01);            // gnssFixOK
+
+    // Newest message wins; for the same epoch the high precision ones are preferred
+    uint32_t tow;
+    bool ok;
+    if (have_ecef && (!have_llh || ecef.iTOW >= llh.iTOW) && (!have_pvt || ecef.iTOW >= pvt.iTOW)) {
+        tow = ecef.iTOW;
+        ok = enu_from_ecef(&frame, ecef.ecefX * 100LL + ecef.ecefXHp, ecef.ecefY * 100LL + ecef.ecefYHp,
+                           ecef.ecefZ * 100LL + ecef.ecefZHp, pos);
+    } else if (have_llh && (!have_pvt || llh.iTOW >= pvt.iTOW)) {
+        tow = llh.iTOW;
+        ok = enu_from_llh(&frame, llh.lat * 100LL + llh.latHp, llh.lon * 100LL + llh.lonHp,
+                          llh.height * 10LL + llh.heightHp, pos);
+    } else if (have_pvt) {
+        tow = pvt.iTOW;
+        ok = enu_from_llh(&frame, pvt.lat * 100LL, pvt.lon * 100LL, pvt.height * 10LL, pos);
+    } else {
+        return false;
+    }
+    if (ok && iTOW) {
+        *iTOW = tow;
+    }
+    return ok;
 }
 
 void setup_serial_port() {
     // Configure UART
     uart_config_t uart_config = {
-        .baud_rate = UART_BAUD_RATE,
+        .baud_rate = CONFIG_RTK_UART_BAUD_RATE,
         .data_bits = UART_DATA_8_BITS,
         .parity = UART_PARITY_DISABLE,
         .stop_bits = UART_STOP_BITS_1,
@@ -116,102 +186,118 @@ void setup_serial_port() {
     };
     uart_param_config(UART_NUM, &uart_config);
     uart_set_pin(UART_NUM, 16, 17, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE);
-    uart_driver_install(UART_NUM, UART_BUF_SIZE, 0, 0, NULL, 0);
+    uart_driver_install(UART_NUM, CONFIG_RTK_UART_RX_BUF_SIZE, CONFIG_RTK_UART_TX_BUF_SIZE,
+                        CONFIG_RTK_UART_EVENT_QUEUE_LEN, &s_uart_queue, 0);
+    // Wake the reader when the FIFO fills or the line goes idle for a few byte times (end of a frame),
+    // instead of polling the driver buffer.
+    uart_set_rx_full_threshold(UART_NUM, UART_RX_FULL_THRESHOLD);
+    uart_set_rx_timeout(UART_NUM, CONFIG_RTK_UART_RX_TIMEOUT_SYMBOLS);
 
-    ESP_LOGI(TAG, "UART configured and driver installed");
+    ESP_LOGI(TAG, "UART configured and driver installed (rx buf %d)", CONFIG_RTK_UART_RX_BUF_SIZE);
 
-    // Initialize the mutex
-    g_nav_data_mutex = xSemaphoreCreateMutex();
-    if (g_nav_data_mutex == NULL) {
-        ESP_LOGE(TAG, "Failed to create mutex for nav data");
-    }
-    g_gps_ptp_time_mutex = xSemaphoreCreateMutex();
-    if (g_gps_ptp_time_mutex == NULL) {
-        ESP_LOGE(TAG, "Failed to create mutex for time data");
-    }
+    rtk_framer_init(&s_framer);
 }
 
-uint8_t *read_serial_data(uint16_t *total_length) {
-    uint16_t data_length;
-    uint8_t *data_buffer = NULL;
-    uint8_t *rtcm_buffer = NULL;
-    uint16_t rtcm_length = 0;
-    uint16_t bytes_read = 0;
-    int length = 0;
-
-    ESP_ERROR_CHECK(uart_get_buffered_data_len(UART_NUM, (size_t*)&length));
-
-    
-    if (length <= 0) {
-        // ESP_LOGI(TAG, "No data available in serial port.");
-        return NULL;
-    }
-
-    
-    // Allocate buffer for the UART data
-    *total_length = length;
-    data_buffer = (uint8_t *)malloc(length);
-    rtcm_buffer = (uint8_t *)malloc(length);
-    if (!data_buffer || !rtcm_buffer) {
-        ESP_LOGE(TAG, "Failed to allocate memory for buffers");
-        return NULL;
-    }
-
-    // Read the data from UART
-    bytes_read = uart_read_bytes(UART_NUM, data_buffer, length, pdMS_TO_TICKS(100));
-
-    int msg_count = 0;
-    while(bytes_read > 0) {
-        switch (data_buffer[0])  // Check the first byte of the data
-        {
-        case 0xD3:
-            // Extract data length from byte 2 and byte 3
-            data_length = ((data_buffer[1] & 0x03) << 8) | data_buffer[2];
-
-            if (bytes_read < data_length + 6) {
-                ESP_LOGE(TAG, "Failed to read data bytes: got %d, expected %d", bytes_read, data_length + 3);
-                free(data_buffer);
-                return NULL;
-            }
-            memcpy(rtcm_buffer + rtcm_length, data_buffer, data_length + 6);
-            rtcm_length += data_length + 6;
-            
-            memcpy(data_buffer, data_buffer + data_length + 6, bytes_read - (data_length + 6));
-            bytes_read -= data_length + 6;
-
-            ESP_LOGI(TAG, "Successfully read %d bytes", data_length + 6);
-            if (bytes_read > 0) {
-                ESP_LOGI(TAG, "Remaining bytes: %d", bytes_read);
+bool rtk_serial_wait(TickType_t ticks_to_wait) {
+    uart_event_t event;
+    if (s_uart_queue == NULL || !xQueueReceive(s_uart_queue, &event, ticks_to_wait)) {
+        return false;
+    }
+    switch (event.type) {
+        case UART_DATA:
+            s_uart_stats.data_events++;
+            return true;
+        case UART_FIFO_OVF:
+        case UART_BUFFER_FULL:
+            // The ISR could not keep up or the ring filled: what is buffered is already torn,
+            // so drop it and let the framer resync on the next preamble.
+            if (event.type == UART_FIFO_OVF) {
+                s_uart_stats.fifo_overflows++;
+            } else {
+                s_uart_stats.buffer_full++;
             }
+            ESP_LOGW(TAG, "UART %s, flushing input", event.type == UART_FIFO_OVF ? "FIFO overflow" : "buffer full");
+            uart_flush_input(UART_NUM);
+            xQueueReset(s_uart_queue);
+            return false;
+        case UART_FRAME_ERR:
+        case UART_PARITY_ERR:
+            s_uart_stats.line_errors++;
+            return false;
+        default:
+            return false;
+    }
+}
 
-            continue;
+void rtk_serial_get_uart_stats(rtk_uart_stats_t *stats) {
+    *stats = s_uart_stats;
+}
 
-        case 0xB5:  
-            if(!process_ubx_message(data_buffer, &bytes_read)) {
-                free(data_buffer);
-                return NULL;
-            }
-            continue;
+size_t rtk_serial_read(TickType_t ticks_to_wait) {
+    size_t total = 0;
+    size_t buffered = 0;
 
-        default:
-            ESP_LOGE(TAG, "Unknown header byte: 0x%02X. Length: %d", data_buffer[0], bytes_read);
-            free(data_buffer);
-            return NULL;
+    ESP_ERROR_CHECK(uart_get_buffered_data_len(UART_NUM, &buffered));
+    // Two passes at most: the free region of the ring may wrap
+    for (int pass = 0; pass < 2 && buffered > 0; pass++) {
+        size_t space;
+        uint8_t *dst = rtk_framer_write_ptr(&s_framer, &space);
+        if (space == 0) {
+            ESP_LOGW(TAG, "Framer ring full, %u bytes left in UART buffer", (unsigned)buffered);
             break;
-        }  
-        if (msg_count > 4) {
-            ESP_LOGI(TAG, "Ending message reading due to excessive messages");
-            free(rtcm_buffer);
-            free(data_buffer);
-            return NULL;
         }
-        msg_count++;
+        size_t to_read = buffered < space ? buffered : space;
+        int n = uart_read_bytes(UART_NUM, dst, to_read, ticks_to_wait);
+        if (n <= 0) {
+            break;
+        }
+        rtk_framer_commit(&s_framer, n);
+        total += n;
+        buffered -= n;
+    }
+    return total;
+}
+
+bool rtk_serial_next_rtcm(rtk_frame_t *frame) {
+    while (rtk_framer_next(&s_framer, frame)) {
+        if (frame->type == RTK_FRAME_RTCM3) {
+            ESP_LOGD(TAG, "RTCM3 %u frame, %u bytes", rtk_frame_rtcm_type(frame), frame->len);
+            return true;
+        }
+        process_ubx_message(frame);
     }
-    free(data_buffer);
-    if (rtcm_length > 0) {
-        ESP_LOGI(TAG, "RTCM data length: %d", rtcm_length);
-        return rtcm_buffer;
+    return false;
+}
+
+int rtk_serial_write(const uint8_t *data, size_t len) {
+    size_t free_bytes = 0;
+    // Never block the caller on the UART: the driver copies into its TX ring and the ISR drains it
+    if (uart_get_tx_buffer_free_size(UART_NUM, &free_bytes) != ESP_OK || free_bytes < len) {
+        return -1;
     }
-    free(rtcm_buffer);
-    return NULL;
-}
\ No newline at end of file
+    return uart_write_bytes(UART_NUM, data, len);
+}
+
+void rtk_serial_get_framer_stats(rtk_framer_stats_t *stats) {
+    *stats = s_framer.stats;
+}
+
+void rtk_serial_log_stats(void) {
+    const rtk_framer_stats_t *st = &s_framer.stats;
+    ESP_LOGI(TAG, "Framer: ubx:%lu (crc err %lu), rtcm:%lu (crc err %lu), skipped:%lu, overflow:%lu",
+             st->ubx_frames, st->ubx_crc_errors, st->rtcm_frames, st->rtcm_crc_errors,
+             st->skipped_bytes, st->overflow_bytes);
+    ESP_LOGI(TAG, "UART: data events:%lu, fifo overflows:%lu, buffer full:%lu, line errors:%lu",
+             s_uart_stats.data_events, s_uart_stats.fifo_overflows, s_uart_stats.buffer_full, s_uart_stats.line_errors);
+    for (int i = 0; i <= RTK_RTCM_NUM_TRACKED; i++) {
+        const rtk_rtcm_type_stats_t *ts = &st->rtcm_types[i];
+        if (ts->accepted == 0 && ts->rejected == 0) {
+            continue;
+        }
+        if (i == RTK_RTCM_OTHER) {
+            ESP_LOGI(TAG, "RTCM other: accepted:%lu rejected:%lu bytes:%lu", ts->accepted, ts->rejected, ts->bytes);
+        } else {
+            ESP_LOGI(TAG, "RTCM %u: accepted:%lu rejected:%lu bytes:%lu", rtk_rtcm_type_at(i), ts->accepted, ts->rejected, ts->bytes);
+        }
+    }
+}
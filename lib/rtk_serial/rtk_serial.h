@@ -8,8 +8,12 @@
 #include "driver/uart.h"
 #include "esp_log.h"
 #include "../gps_ptp_time/gps_ptp_time.h"
+#include "../seqlock/seqlock.h"
+#include "../enu_frame/enu_frame.h"
 #include "../protocol/protocol.h" // For PROTOCOL_LOG_STRUCT_BASE64
 #include "esp_timer.h" // For esp_timer_get_time()
+#include "rtk_framer.h"
+#include "ubx_decoder.h"
 
 /*
 U-center MSG configuration for base station:
@@ -18,6 +22,8 @@ NAV-SVIN (Survey In, if RTK is ready) 5s
     found here: https://content.u-blox.com/sites/default/files/products/documents/u-blox8-M8_ReceiverDescrProtSpec_UBX-13003221.pdf?utm_content=UBX-13003221
 NAV-PVT (Position Velocity Time, Master time and fix information) 5s
     found here: https://content.u-blox.com/sites/default/files/LAP120_Interfacedescription_UBX-20046191.pdf
+Also decoded when enabled: NAV-HPPOSLLH, NAV-HPPOSECEF, NAV-RELPOSNED (moving base / robots), TIM-TP (time pulse)
+Robots: enable NAV-HPPOSECEF (or NAV-HPPOSLLH) for positions in the base's ENU frame at 0.1 mm, NAV-PVT only gives 1 cm
 
 0xD3 Messages
 RTCM3.3 1005 1s
@@ -27,69 +33,45 @@ RTCM3.3 1094 1s
 RTCM3.3 1124 1s
 RTCM3.3 1230 x 5s
 */
-typedef struct UBXHeader {
-    uint8_t preamble1;
-    uint8_t preamble2;
-    uint8_t msg_class;
-    uint8_t msg_id;
-    uint16_t length;
-} UBXHeader;
-
-typedef struct UBXNavPVT {
-    uint32_t iTOW;
-    uint16_t year;
-    uint8_t month;
-    uint8_t day;
-    uint8_t hour;
-    uint8_t min;
-    uint8_t sec;
-    uint8_t valid;
-    uint32_t tAcc;
-    int32_t nano;
-    uint8_t fixType;
-    uint8_t flags;
-    uint8_t flags2;
-    uint8_t numSV;
-    int32_t lon;
-    int32_t lat;
-    int32_t height;
-    int32_t hMSL;
-    uint32_t hAcc;
-    uint32_t vAcc;
-    int32_t velN;
-    int32_t velE;
-    int32_t velD;
-    int32_t gSpeed;
-    int32_t headMot;
-    uint32_t sAcc;
-    uint32_t headAcc;
-    uint16_t pDOP;
-    uint16_t flags3;
-    uint32_t reserved0;
-    int32_t headVeh;
-    int16_t magDec;
-    uint16_t magAcc;
-} UBXNavPVT;
-
-typedef struct UBXNavSVIN {
-    uint8_t version;
-    uint32_t iTOW;
-    uint32_t dur;
-    int32_t meanX;
-    int32_t meanY;
-    int32_t meanZ;
-    int8_t meanXHP;
-    int8_t meanYHP;
-    int8_t meanZHP;
-    uint32_t meanAcc;
-    uint32_t obs;
-    uint8_t valid;
-    uint8_t active;
-} UBXNavSVIN;
-
-extern UBXNavPVT g_nav_pvt;
-extern UBXNavSVIN g_nav_svin;
-extern SemaphoreHandle_t g_nav_data_mutex; // Mutex for protecting nav_pvt and nav_svin
+typedef struct {
+    uint32_t data_events;       // UART_DATA events (FIFO threshold or RX idle timeout)
+    uint32_t fifo_overflows;    // UART_FIFO_OVF: HW FIFO overran before the ISR drained it
+    uint32_t buffer_full;       // UART_BUFFER_FULL: driver RX ring (CONFIG_RTK_UART_RX_BUF_SIZE) filled up
+    uint32_t line_errors;       // Framing or parity errors
+} rtk_uart_stats_t;
+
+/**
+ * @brief Get a consistent copy of the latest decoded UBX message without locking (safe from any task).
+ *
+ * @param out Struct matching `msg` (UBXNavPVT, UBXNavSVIN, UBXNavHPPOSLLH, UBXNavHPPOSECEF, UBXNavRELPOSNED or UBXTimTP).
+ * @return false if that message has not been received yet.
+ */
+bool rtk_ubx_get(ubx_msg_t msg, void *out);
+
+/**
+ * @brief Get a consistent copy of the latest NAV-PVT without locking (safe from any task).
+ *
+ * @return false if no NAV-PVT has been received yet.
+ */
+bool rtk_nav_get_pvt(UBXNavPVT *pvt);
+
+/**
+ * @brief Get a consistent copy of the latest NAV-SVIN without locking (safe from any task).
+ *
+ * @return false if no NAV-SVIN has been received yet.
+ */
+bool rtk_nav_get_svin(UBXNavSVIN *svin);
+
+/**
+ * @brief Latest position in the local ENU frame around the base (see enu_frame.h), safe from any task.
+ *
+ * Uses the newest of NAV-HPPOSECEF, NAV-HPPOSLLH and NAV-PVT that carries a valid position.
+ *
+ * @param pos  East/north/up in 0.1 mm.
+ * @param iTOW Optional: GPS time of week (ms) of the position.
+ * @return false without an ENU reference (survey-in result or RTCM 1005) or a valid position in range.
+ */
+bool rtk_nav_get_enu(enu_pos_t *pos, uint32_t *iTOW);
 
 
 /**
@@ -98,13 +80,55 @@ extern SemaphoreHandle_t g_nav_data_mutex; // Mutex for protecting nav_pvt and n
 void setup_serial_port(void);
 
 /**
- * @brief Reads a data packet from the UART serial interface.
- * 
- * @param total_length Pointer to a variable where the total length of the received data will be stored.
- *                     This includes the header, payload, and CRC.
- * @return A pointer to the dynamically allocated buffer containing the received data, or NULL if an error occurs.
- *         The caller is responsible for freeing the allocated memory using `free`.
+ * @brief Blocks on the UART driver event queue until data arrives.
+ *
+ * Overflow events are counted and the driver input flushed; the framer resyncs afterwards.
+ *
+ * @param ticks_to_wait Maximum time to wait for an event.
+ * @return true if a data event arrived and rtk_serial_read() should be called.
+ */
+bool rtk_serial_wait(TickType_t ticks_to_wait);
+
+/**
+ * @brief Copies the UART driver event counters (overflows, line errors).
+ */
+void rtk_serial_get_uart_stats(rtk_uart_stats_t *stats);
+
+/**
+ * @brief Moves whatever the UART driver has buffered into the framer ring.
+ *
+ * Reads directly into the ring; no allocation or copy. Partial frames are kept for the next call.
+ *
+ * @param ticks_to_wait Maximum time to wait in uart_read_bytes().
+ * @return Number of bytes read from the UART.
+ */
+size_t rtk_serial_read(TickType_t ticks_to_wait);
+
+/**
+ * @brief Returns the next complete RTCM3 frame from the framer.
+ *
+ * UBX frames found on the way are decoded and published for rtk_ubx_get().
+ *
+ * @param frame Filled with a pointer into the framer ring; valid until the next call.
+ * @return true if an RTCM3 frame was returned, false when the ring holds no more complete frames.
+ */
+bool rtk_serial_next_rtcm(rtk_frame_t *frame);
+
+/**
+ * @brief Writes a block (e.g. one RTCM epoch) to the GNSS receiver in a single UART write.
+ *
+ * @return Number of bytes queued, or -1 if the UART TX buffer cannot take the whole block.
+ */
+int rtk_serial_write(const uint8_t *data, size_t len);
+
+/**
+ * @brief Copies the framer statistics (frame counts, CRC errors, resync bytes).
+ */
+void rtk_serial_get_framer_stats(rtk_framer_stats_t *stats);
+
+/**
+ * @brief Logs the framer statistics, including per-RTCM-message-type accepted/rejected/bytes counters.
  */
-uint8_t *read_serial_data(uint16_t *total_length);
+void rtk_serial_log_stats(void);
 
 #endif // RTK_SERIAL_H
\ No newline at end of file
@@ -0,0 +1,68 @@
+#include "ubx_decoder.h"
+
+#define FIELD(s, member, wire_offset, type) \
+    { (wire_offset), (type), offsetof(s, member), sizeof(((s *)0)->member) },
+#define COUNT(a) (sizeof(a) / sizeof((a)[0]))
+
+// Offsets from the u-blox F9P interface description (UBX-18010854), kept in python/protocol_schema.json
+static const ubx_field_t nav_pvt_fields[] = { UBX_NAV_PVT_FIELDS(FIELD) };
+static const ubx_field_t nav_svin_fields[] = { UBX_NAV_SVIN_FIELDS(FIELD) };
+static const ubx_field_t nav_hpposllh_fields[] = { UBX_NAV_HPPOSLLH_FIELDS(FIELD) };
+static const ubx_field_t nav_hpposecef_fields[] = { UBX_NAV_HPPOSECEF_FIELDS(FIELD) };
+static const ubx_field_t nav_relposned_fields[] = { UBX_NAV_RELPOSNED_FIELDS(FIELD) };
+static const ubx_field_t tim_tp_fields[] = { UBX_TIM_TP_FIELDS(FIELD) };
+
+#define MESSAGE(m, name, fields) \
+    { m##_CLASS, m##_ID, m##_VERSION, COUNT(fields), m##_PAYLOAD_LEN, m##_SIZE, (name), (fields) }
+
+static const ubx_msg_desc_t ubx_messages[UBX_MSG_COUNT] = {
+    [UBX_MSG_NAV_PVT]       = MESSAGE(UBX_NAV_PVT, "NAV-PVT", nav_pvt_fields),
+    [UBX_MSG_NAV_SVIN]      = MESSAGE(UBX_NAV_SVIN, "NAV-SVIN", nav_svin_fields),
+    [UBX_MSG_NAV_HPPOSLLH]  = MESSAGE(UBX_NAV_HPPOSLLH, "NAV-HPPOSLLH", nav_hpposllh_fields),
+    [UBX_MSG_NAV_HPPOSECEF] = MESSAGE(UBX_NAV_HPPOSECEF, "NAV-HPPOSECEF", nav_hpposecef_fields),
+    [UBX_MSG_NAV_RELPOSNED] = MESSAGE(UBX_NAV_RELPOSNED, "NAV-RELPOSNED", nav_relposned_fields),
+    [UBX_MSG_TIM_TP]        = MESSAGE(UBX_TIM_TP, "TIM-TP", tim_tp_fields),
+};
+
+const ubx_msg_desc_t *ubx_msg_desc(ubx_msg_t msg) {
+    return msg < UBX_MSG_COUNT ? &ubx_messages[msg] : NULL;
+}
+
+ubx_msg_t ubx_msg_lookup(uint8_t msg_class, uint8_t msg_id) {
+    for (int i = 0; i < UBX_MSG_COUNT; i++) {
+        if (ubx_messages[i].msg_class == msg_class && ubx_messages[i].msg_id == msg_id) {
+            return (ubx_msg_t)i;
+        }
+    }
+    return UBX_MSG_COUNT;
+}
+
+bool ubx_decode(ubx_msg_t msg, const uint8_t *payload, uint16_t len, void *out) {
+    const ubx_msg_desc_t *desc = ubx_msg_desc(msg);
+    if (desc == NULL || len < desc->payload_len) {
+        return false;
+    }
+    if (desc->version != UBX_NO_VERSION && payload[0] != desc->version) {
+        return false;
+    }
+    uint8_t *dst = (uint8_t *)out;
+    for (int i = 0; i < desc->num_fields; i++) {
+        const ubx_field_t *fd = &desc->fields[i];
+        const uint8_t *p = payload + fd->wire_offset;
+        uint32_t v;
+        switch (fd->type) {
+            case UBX_U1: v = p[0]; break;
+            case UBX_I1: v = (uint32_t)(int32_t)(int8_t)p[0]; break;
+            case UBX_U2: v = p[0] | (p[1] << 8); break;
+            case UBX_I2: v = (uint32_t)(int32_t)(int16_t)(p[0] | (p[1] << 8)); break;
+            default:     v = p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24); break;
+        }
+        // Members are naturally aligned in the C struct, so these stores are aligned
+        switch (fd->size) {
+            case 1:  *(uint8_t *)(dst + fd->offset) = (uint8_t)v; break;
+            case 2:  *(uint16_t *)(dst + fd->offset) = (uint16_t)v; break;
+            default: *(uint32_t *)(dst + fd->offset) = v; break;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,86 @@
+#ifndef UBX_DECODER_H
+#define UBX_DECODER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+Table-driven UBX payload decoder.
+
+Each supported message has a field table giving the wire offset and type of every field (from the
+u-blox interface description) and the offset of the matching member in its C struct (ubx_gen.h). Payload
+bytes are read one at a time as little-endian and stored straight into the destination struct in a
+single pass, so the C layout (padding, alignment, host byte order) never has to match the wire.
+Reserved wire bytes are simply not listed.
+
+No ESP-IDF dependencies: decoding can be checked on a host against captured frames.
+*/
+
+#include "ubx_gen.h"    // Message structs and field tables, from python/protocol_schema.json
+
+typedef enum {
+    UBX_MSG_NAV_PVT,
+    UBX_MSG_NAV_SVIN,
+    UBX_MSG_NAV_HPPOSLLH,
+    UBX_MSG_NAV_HPPOSECEF,
+    UBX_MSG_NAV_RELPOSNED,
+    UBX_MSG_TIM_TP,
+    UBX_MSG_COUNT,
+} ubx_msg_t;
+
+typedef enum {
+    UBX_U1, UBX_I1, UBX_U2, UBX_I2, UBX_U4, UBX_I4,
+} ubx_field_type_t;
+
+typedef struct {
+    uint8_t wire_offset;    // Byte offset in the UBX payload
+    uint8_t type;           // ubx_field_type_t
+    uint8_t offset;         // offsetof() the member in the C struct
+    uint8_t size;           // sizeof() the member
+} ubx_field_t;
+
+typedef struct {
+    uint8_t msg_class;
+    uint8_t msg_id;
+    uint8_t version;        // Required value of payload byte 0, or UBX_NO_VERSION
+    uint8_t num_fields;
+    uint16_t payload_len;   // Minimum payload length
+    uint16_t struct_size;
+    const char *name;
+    const ubx_field_t *fields;
+} ubx_msg_desc_t;
+
+#define UBX_NO_VERSION 0xFF
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Descriptor of a supported message (indexed by ubx_msg_t).
+ */
+const ubx_msg_desc_t *ubx_msg_desc(ubx_msg_t msg);
+
+/**
+ * @brief Find the supported message for a UBX class/id pair.
+ *
+ * @return The message, or UBX_MSG_COUNT if it is not supported.
+ */
+ubx_msg_t ubx_msg_lookup(uint8_t msg_class, uint8_t msg_id);
+
+/**
+ * @brief Decode a UBX payload into its C struct.
+ *
+ * @param payload Payload bytes (after the 6-byte header); any alignment.
+ * @param len     Payload length from the header.
+ * @param out     Destination struct of ubx_msg_desc(msg)->struct_size bytes.
+ * @return false if the payload is too short or carries an unsupported message version (`out` untouched).
+ */
+bool ubx_decode(ubx_msg_t msg, const uint8_t *payload, uint16_t len, void *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // UBX_DECODER_H
@@ -0,0 +1,305 @@
+// Generated by python/gen_protocol.py from python/protocol_schema.json. Do not edit.
+// UBX messages decoded by ubx_decoder.c, in their C layout (the rtk_serial base64 dumps).
+// ubx_offset is the byte offset in the UBX payload, from the u-blox F9P interface description (UBX-18010854).
+#ifndef UBX_GEN_H
+#define UBX_GEN_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef struct UBXHeader {
+    uint8_t preamble1;
+    uint8_t preamble2;
+    uint8_t msg_class;
+    uint8_t msg_id;
+    uint16_t length;
+} UBXHeader;
+
+#define UBX_HEADER_NAME "UBXHeader"
+#define UBX_HEADER_SIZE 6
+#define UBX_HEADER_FORMAT "<4BH"
+_Static_assert(sizeof(UBXHeader) == UBX_HEADER_SIZE, "UBXHeader layout (protocol_schema.json)");
+
+// NAV-PVT (0x01 0x07), 92 byte payload
+typedef struct UBXNavPVT {
+    uint32_t iTOW;
+    uint16_t year;
+    uint8_t month;
+    uint8_t day;
+    uint8_t hour;
+    uint8_t min;
+    uint8_t sec;
+    uint8_t valid;
+    uint32_t tAcc;
+    int32_t nano;
+    uint8_t fixType;
+    uint8_t flags;
+    uint8_t flags2;
+    uint8_t numSV;
+    int32_t lon;
+    int32_t lat;
+    int32_t height;
+    int32_t hMSL;
+    uint32_t hAcc;
+    uint32_t vAcc;
+    int32_t velN;
+    int32_t velE;
+    int32_t velD;
+    int32_t gSpeed;
+    int32_t headMot;
+    uint32_t sAcc;
+    uint32_t headAcc;
+    uint16_t pDOP;
+    uint16_t flags3;
+    uint32_t reserved0;
+    int32_t headVeh;
+    int16_t magDec;
+    uint16_t magAcc;
+} UBXNavPVT;
+
+#define UBX_NAV_PVT_NAME "UBXNavPVT"
+#define UBX_NAV_PVT_SIZE 92
+#define UBX_NAV_PVT_FORMAT "<IH6BIi4B4i2I5i2I2HIihH"
+#define UBX_NAV_PVT_CLASS 0x01
+#define UBX_NAV_PVT_ID 0x07
+#define UBX_NAV_PVT_PAYLOAD_LEN 92
+#define UBX_NAV_PVT_VERSION UBX_NO_VERSION
+// X(UBXNavPVT, member, payload offset, ubx_field_type_t) per decoded field
+#define UBX_NAV_PVT_FIELDS(X) \
+    X(UBXNavPVT, iTOW, 0, UBX_U4) \
+    X(UBXNavPVT, year, 4, UBX_U2) \
+    X(UBXNavPVT, month, 6, UBX_U1) \
+    X(UBXNavPVT, day, 7, UBX_U1) \
+    X(UBXNavPVT, hour, 8, UBX_U1) \
+    X(UBXNavPVT, min, 9, UBX_U1) \
+    X(UBXNavPVT, sec, 10, UBX_U1) \
+    X(UBXNavPVT, valid, 11, UBX_U1) \
+    X(UBXNavPVT, tAcc, 12, UBX_U4) \
+    X(UBXNavPVT, nano, 16, UBX_I4) \
+    X(UBXNavPVT, fixType, 20, UBX_U1) \
+    X(UBXNavPVT, flags, 21, UBX_U1) \
+    X(UBXNavPVT, flags2, 22, UBX_U1) \
+    X(UBXNavPVT, numSV, 23, UBX_U1) \
+    X(UBXNavPVT, lon, 24, UBX_I4) \
+    X(UBXNavPVT, lat, 28, UBX_I4) \
+    X(UBXNavPVT, height, 32, UBX_I4) \
+    X(UBXNavPVT, hMSL, 36, UBX_I4) \
+    X(UBXNavPVT, hAcc, 40, UBX_U4) \
+    X(UBXNavPVT, vAcc, 44, UBX_U4) \
+    X(UBXNavPVT, velN, 48, UBX_I4) \
+    X(UBXNavPVT, velE, 52, UBX_I4) \
+    X(UBXNavPVT, velD, 56, UBX_I4) \
+    X(UBXNavPVT, gSpeed, 60, UBX_I4) \
+    X(UBXNavPVT, headMot, 64, UBX_I4) \
+    X(UBXNavPVT, sAcc, 68, UBX_U4) \
+    X(UBXNavPVT, headAcc, 72, UBX_U4) \
+    X(UBXNavPVT, pDOP, 76, UBX_U2) \
+    X(UBXNavPVT, flags3, 78, UBX_U2) \
+    X(UBXNavPVT, reserved0, 80, UBX_U4) \
+    X(UBXNavPVT, headVeh, 84, UBX_I4) \
+    X(UBXNavPVT, magDec, 88, UBX_I2) \
+    X(UBXNavPVT, magAcc, 90, UBX_U2)
+_Static_assert(sizeof(UBXNavPVT) == UBX_NAV_PVT_SIZE, "UBXNavPVT layout (protocol_schema.json)");
+
+// NAV-SVIN (0x01 0x3B), 40 byte payload
+typedef struct UBXNavSVIN {
+    uint8_t version;
+    uint32_t iTOW;
+    uint32_t dur;
+    int32_t meanX;
+    int32_t meanY;
+    int32_t meanZ;
+    int8_t meanXHP;
+    int8_t meanYHP;
+    int8_t meanZHP;
+    uint32_t meanAcc;
+    uint32_t obs;
+    uint8_t valid;
+    uint8_t active;
+} UBXNavSVIN;
+
+#define UBX_NAV_SVIN_NAME "UBXNavSVIN"
+#define UBX_NAV_SVIN_SIZE 40
+#define UBX_NAV_SVIN_FORMAT "<B3x2I3i3bx2I2B2x"
+#define UBX_NAV_SVIN_CLASS 0x01
+#define UBX_NAV_SVIN_ID 0x3B
+#define UBX_NAV_SVIN_PAYLOAD_LEN 40
+#define UBX_NAV_SVIN_VERSION 0
+// X(UBXNavSVIN, member, payload offset, ubx_field_type_t) per decoded field
+#define UBX_NAV_SVIN_FIELDS(X) \
+    X(UBXNavSVIN, version, 0, UBX_U1) \
+    X(UBXNavSVIN, iTOW, 4, UBX_U4) \
+    X(UBXNavSVIN, dur, 8, UBX_U4) \
+    X(UBXNavSVIN, meanX, 12, UBX_I4) \
+    X(UBXNavSVIN, meanY, 16, UBX_I4) \
+    X(UBXNavSVIN, meanZ, 20, UBX_I4) \
+    X(UBXNavSVIN, meanXHP, 24, UBX_I1) \
+    X(UBXNavSVIN, meanYHP, 25, UBX_I1) \
+    X(UBXNavSVIN, meanZHP, 26, UBX_I1) \
+    X(UBXNavSVIN, meanAcc, 28, UBX_U4) \
+    X(UBXNavSVIN, obs, 32, UBX_U4) \
+    X(UBXNavSVIN, valid, 36, UBX_U1) \
+    X(UBXNavSVIN, active, 37, UBX_U1)
+_Static_assert(sizeof(UBXNavSVIN) == UBX_NAV_SVIN_SIZE, "UBXNavSVIN layout (protocol_schema.json)");
+_Static_assert(offsetof(UBXNavSVIN, iTOW) == 4, "UBXNavSVIN layout (protocol_schema.json)");
+_Static_assert(offsetof(UBXNavSVIN, meanAcc) == 28, "UBXNavSVIN layout (protocol_schema.json)");
+
+// NAV-HPPOSLLH (0x01 0x14), 36 byte payload, version 0
+typedef struct UBXNavHPPOSLLH {
+    uint8_t version;
+    uint8_t flags;          // Bit 0: invalidLlh
+    uint32_t iTOW;
+    int32_t lon;            // 1e-7 deg
+    int32_t lat;            // 1e-7 deg
+    int32_t height;         // mm
+    int32_t hMSL;           // mm
+    int8_t lonHp;           // 1e-9 deg
+    int8_t latHp;           // 1e-9 deg
+    int8_t heightHp;        // 0.1 mm
+    int8_t hMSLHp;          // 0.1 mm
+    uint32_t hAcc;          // 0.1 mm
+    uint32_t vAcc;          // 0.1 mm
+} UBXNavHPPOSLLH;
+
+#define UBX_NAV_HPPOSLLH_NAME "UBXNavHPPOSLLH"
+#define UBX_NAV_HPPOSLLH_SIZE 36
+#define UBX_NAV_HPPOSLLH_FORMAT "<2B2xI4i4b2I"
+#define UBX_NAV_HPPOSLLH_CLASS 0x01
+#define UBX_NAV_HPPOSLLH_ID 0x14
+#define UBX_NAV_HPPOSLLH_PAYLOAD_LEN 36
+#define UBX_NAV_HPPOSLLH_VERSION 0
+// X(UBXNavHPPOSLLH, member, payload offset, ubx_field_type_t) per decoded field
+#define UBX_NAV_HPPOSLLH_FIELDS(X) \
+    X(UBXNavHPPOSLLH, version, 0, UBX_U1) \
+    X(UBXNavHPPOSLLH, flags, 3, UBX_U1) \
+    X(UBXNavHPPOSLLH, iTOW, 4, UBX_U4) \
+    X(UBXNavHPPOSLLH, lon, 8, UBX_I4) \
+    X(UBXNavHPPOSLLH, lat, 12, UBX_I4) \
+    X(UBXNavHPPOSLLH, height, 16, UBX_I4) \
+    X(UBXNavHPPOSLLH, hMSL, 20, UBX_I4) \
+    X(UBXNavHPPOSLLH, lonHp, 24, UBX_I1) \
+    X(UBXNavHPPOSLLH, latHp, 25, UBX_I1) \
+    X(UBXNavHPPOSLLH, heightHp, 26, UBX_I1) \
+    X(UBXNavHPPOSLLH, hMSLHp, 27, UBX_I1) \
+    X(UBXNavHPPOSLLH, hAcc, 28, UBX_U4) \
+    X(UBXNavHPPOSLLH, vAcc, 32, UBX_U4)
+_Static_assert(sizeof(UBXNavHPPOSLLH) == UBX_NAV_HPPOSLLH_SIZE, "UBXNavHPPOSLLH layout (protocol_schema.json)");
+_Static_assert(offsetof(UBXNavHPPOSLLH, iTOW) == 4, "UBXNavHPPOSLLH layout (protocol_schema.json)");
+
+// NAV-HPPOSECEF (0x01 0x13), 28 byte payload, version 0
+typedef struct UBXNavHPPOSECEF {
+    uint8_t version;
+    uint8_t flags;          // Bit 0: invalidEcef
+    uint32_t iTOW;
+    int32_t ecefX;          // cm
+    int32_t ecefY;
+    int32_t ecefZ;
+    int8_t ecefXHp;         // 0.1 mm
+    int8_t ecefYHp;
+    int8_t ecefZHp;
+    uint32_t pAcc;          // 0.1 mm
+} UBXNavHPPOSECEF;
+
+#define UBX_NAV_HPPOSECEF_NAME "UBXNavHPPOSECEF"
+#define UBX_NAV_HPPOSECEF_SIZE 28
+#define UBX_NAV_HPPOSECEF_FORMAT "<2B2xI3i3bxI"
+#define UBX_NAV_HPPOSECEF_CLASS 0x01
+#define UBX_NAV_HPPOSECEF_ID 0x13
+#define UBX_NAV_HPPOSECEF_PAYLOAD_LEN 28
+#define UBX_NAV_HPPOSECEF_VERSION 0
+// X(UBXNavHPPOSECEF, member, payload offset, ubx_field_type_t) per decoded field
+#define UBX_NAV_HPPOSECEF_FIELDS(X) \
+    X(UBXNavHPPOSECEF, version, 0, UBX_U1) \
+    X(UBXNavHPPOSECEF, flags, 23, UBX_U1) \
+    X(UBXNavHPPOSECEF, iTOW, 4, UBX_U4) \
+    X(UBXNavHPPOSECEF, ecefX, 8, UBX_I4) \
+    X(UBXNavHPPOSECEF, ecefY, 12, UBX_I4) \
+    X(UBXNavHPPOSECEF, ecefZ, 16, UBX_I4) \
+    X(UBXNavHPPOSECEF, ecefXHp, 20, UBX_I1) \
+    X(UBXNavHPPOSECEF, ecefYHp, 21, UBX_I1) \
+    X(UBXNavHPPOSECEF, ecefZHp, 22, UBX_I1) \
+    X(UBXNavHPPOSECEF, pAcc, 24, UBX_U4)
+_Static_assert(sizeof(UBXNavHPPOSECEF) == UBX_NAV_HPPOSECEF_SIZE, "UBXNavHPPOSECEF layout (protocol_schema.json)");
+_Static_assert(offsetof(UBXNavHPPOSECEF, iTOW) == 4, "UBXNavHPPOSECEF layout (protocol_schema.json)");
+_Static_assert(offsetof(UBXNavHPPOSECEF, pAcc) == 24, "UBXNavHPPOSECEF layout (protocol_schema.json)");
+
+// NAV-RELPOSNED (0x01 0x3C), 64 byte payload, version 1 (F9P)
+typedef struct UBXNavRELPOSNED {
+    uint8_t version;
+    uint16_t refStationId;
+    uint32_t iTOW;
+    int32_t relPosN;        // cm
+    int32_t relPosE;
+    int32_t relPosD;
+    int32_t relPosLength;
+    int32_t relPosHeading;  // 1e-5 deg
+    int8_t relPosHPN;       // 0.1 mm
+    int8_t relPosHPE;
+    int8_t relPosHPD;
+    int8_t relPosHPLength;
+    uint32_t accN;          // 0.1 mm
+    uint32_t accE;
+    uint32_t accD;
+    uint32_t accLength;
+    uint32_t accHeading;    // 1e-5 deg
+    uint32_t flags;         // gnssFixOK, diffSoln, relPosValid, carrSoln, ...
+} UBXNavRELPOSNED;
+
+#define UBX_NAV_RELPOSNED_NAME "UBXNavRELPOSNED"
+#define UBX_NAV_RELPOSNED_SIZE 56
+#define UBX_NAV_RELPOSNED_FORMAT "<BxHI5i4b6I"
+#define UBX_NAV_RELPOSNED_CLASS 0x01
+#define UBX_NAV_RELPOSNED_ID 0x3C
+#define UBX_NAV_RELPOSNED_PAYLOAD_LEN 64
+#define UBX_NAV_RELPOSNED_VERSION 1
+// X(UBXNavRELPOSNED, member, payload offset, ubx_field_type_t) per decoded field
+#define UBX_NAV_RELPOSNED_FIELDS(X) \
+    X(UBXNavRELPOSNED, version, 0, UBX_U1) \
+    X(UBXNavRELPOSNED, refStationId, 2, UBX_U2) \
+    X(UBXNavRELPOSNED, iTOW, 4, UBX_U4) \
+    X(UBXNavRELPOSNED, relPosN, 8, UBX_I4) \
+    X(UBXNavRELPOSNED, relPosE, 12, UBX_I4) \
+    X(UBXNavRELPOSNED, relPosD, 16, UBX_I4) \
+    X(UBXNavRELPOSNED, relPosLength, 20, UBX_I4) \
+    X(UBXNavRELPOSNED, relPosHeading, 24, UBX_I4) \
+    X(UBXNavRELPOSNED, relPosHPN, 32, UBX_I1) \
+    X(UBXNavRELPOSNED, relPosHPE, 33, UBX_I1) \
+    X(UBXNavRELPOSNED, relPosHPD, 34, UBX_I1) \
+    X(UBXNavRELPOSNED, relPosHPLength, 35, UBX_I1) \
+    X(UBXNavRELPOSNED, accN, 36, UBX_U4) \
+    X(UBXNavRELPOSNED, accE, 40, UBX_U4) \
+    X(UBXNavRELPOSNED, accD, 44, UBX_U4) \
+    X(UBXNavRELPOSNED, accLength, 48, UBX_U4) \
+    X(UBXNavRELPOSNED, accHeading, 52, UBX_U4) \
+    X(UBXNavRELPOSNED, flags, 60, UBX_U4)
+_Static_assert(sizeof(UBXNavRELPOSNED) == UBX_NAV_RELPOSNED_SIZE, "UBXNavRELPOSNED layout (protocol_schema.json)");
+_Static_assert(offsetof(UBXNavRELPOSNED, refStationId) == 2, "UBXNavRELPOSNED layout (protocol_schema.json)");
+
+// TIM-TP (0x0D 0x01), 16 byte payload: time of the next time pulse
+typedef struct UBXTimTP {
+    uint32_t towMS;
+    uint32_t towSubMS;      // 2^-32 ms
+    int32_t qErr;           // ps, quantization error of the pulse
+    uint16_t week;
+    uint8_t flags;
+    uint8_t refInfo;
+} UBXTimTP;
+
+#define UBX_TIM_TP_NAME "UBXTimTP"
+#define UBX_TIM_TP_SIZE 16
+#define UBX_TIM_TP_FORMAT "<2IiH2B"
+#define UBX_TIM_TP_CLASS 0x0D
+#define UBX_TIM_TP_ID 0x01
+#define UBX_TIM_TP_PAYLOAD_LEN 16
+#define UBX_TIM_TP_VERSION UBX_NO_VERSION
+// X(UBXTimTP, member, payload offset, ubx_field_type_t) per decoded field
+#define UBX_TIM_TP_FIELDS(X) \
+    X(UBXTimTP, towMS, 0, UBX_U4) \
+    X(UBXTimTP, towSubMS, 4, UBX_U4) \
+    X(UBXTimTP, qErr, 8, UBX_I4) \
+    X(UBXTimTP, week, 12, UBX_U2) \
+    X(UBXTimTP, flags, 14, UBX_U1) \
+    X(UBXTimTP, refInfo, 15, UBX_U1)
+_Static_assert(sizeof(UBXTimTP) == UBX_TIM_TP_SIZE, "UBXTimTP layout (protocol_schema.json)");
+
+#endif // UBX_GEN_H
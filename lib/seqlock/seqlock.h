@@ -0,0 +1,103 @@
+#ifndef SEQLOCK_H
+#define SEQLOCK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+/*
+Single-writer, many-reader snapshot publication (double-buffered seqlock).
+
+The writer fills the buffer readers are not using and then flips the sequence counter, so readers
+never wait on the writer: they copy the last completed snapshot and only retry if the writer
+completed another publish while they were copying. Unlike a plain seqlock, a reader that preempts
+a half-finished write on the single-core C6 does not spin, it just reads the previous snapshot.
+
+Usage:
+    static seqlock_t s_lock = SEQLOCK_INIT;
+    static my_struct_t s_bufs[2];
+    seqlock_publish(&s_lock, s_bufs, sizeof(s_bufs[0]), &value);   // writer task only
+    seqlock_read(&s_lock, s_bufs, sizeof(s_bufs[0]), &copy);        // any task
+*/
+
+typedef struct {
+    volatile uint32_t seq;  // Odd while a write is in progress; snapshot (seq / 2) & 1 is the latest complete one
+    uint32_t retries;       // Reads copied again because the writer overtook them (counted by readers)
+} seqlock_t;
+
+#define SEQLOCK_INIT { 0, 0 }
+
+/**
+ * @brief Start writing a new snapshot in place. Must only ever be called from one task.
+ *
+ * Lets the writer build the snapshot directly in the spare buffer (e.g. decode into it) instead of
+ * copying a finished one. Follow with seqlock_write_end() or seqlock_write_abort().
+ *
+ * @param bufs Two consecutive buffers of `size` bytes owned by this seqlock.
+ * @return The buffer to fill; it keeps the contents of the snapshot before the latest one.
+ */
+static inline void *seqlock_write_begin(seqlock_t *sl, void *bufs, size_t size) {
+    uint32_t seq = __atomic_load_n(&sl->seq, __ATOMIC_RELAXED);
+    __atomic_store_n(&sl->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE); // Odd count visible before any byte of the new snapshot
+    return (uint8_t *)bufs + ((seq / 2 + 1) & 1) * size;
+}
+
+/**
+ * @brief Make the snapshot started by seqlock_write_begin() the latest one.
+ */
+static inline void seqlock_write_end(seqlock_t *sl) {
+    __atomic_store_n(&sl->seq, __atomic_load_n(&sl->seq, __ATOMIC_RELAXED) + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Give up the snapshot started by seqlock_write_begin(); the previous one stays the latest.
+ */
+static inline void seqlock_write_abort(seqlock_t *sl) {
+    __atomic_store_n(&sl->seq, __atomic_load_n(&sl->seq, __ATOMIC_RELAXED) - 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Publish a new snapshot by copying it. Must only ever be called from one task.
+ *
+ * @param bufs Two consecutive buffers of `size` bytes owned by this seqlock.
+ */
+static inline void seqlock_publish(seqlock_t *sl, void *bufs, size_t size, const void *src) {
+    memcpy(seqlock_write_begin(sl, bufs, size), src, size);
+    seqlock_write_end(sl);
+}
+
+/**
+ * @brief Copy the latest complete snapshot without locking.
+ *
+ * @return false if nothing has been published yet (`dst` then holds the zero-initialised buffer).
+ */
+static inline bool seqlock_read(const seqlock_t *sl, const void *bufs, size_t size, void *dst) {
+    for (;;) {
+        uint32_t seq = __atomic_load_n(&sl->seq, __ATOMIC_ACQUIRE);
+        memcpy(dst, (const uint8_t *)bufs + ((seq / 2) & 1) * size, size);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        // The buffer just copied is only rewritten two half-steps later
+        if (__atomic_load_n(&sl->seq, __ATOMIC_RELAXED) - seq <= 1) {
+            return seq >= 2;
+        }
+        __atomic_fetch_add((uint32_t *)&sl->retries, 1, __ATOMIC_RELAXED);
+    }
+}
+
+/**
+ * @brief Number of completed publishes (cheap change detection for pollers).
+ */
+static inline uint32_t seqlock_count(const seqlock_t *sl) {
+    return __atomic_load_n(&sl->seq, __ATOMIC_ACQUIRE) / 2;
+}
+
+/**
+ * @brief Number of times readers had to copy again (how often the writer overtakes them).
+ */
+static inline uint32_t seqlock_retries(const seqlock_t *sl) {
+    return __atomic_load_n(&sl->retries, __ATOMIC_RELAXED);
+}
+
+#endif // SEQLOCK_H
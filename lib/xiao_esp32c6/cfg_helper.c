@@ -1,6 +1,12 @@
+#include <stddef.h>
+#include <stdio.h>
 #include "cfg_helper.h"
+#include "esp_app_desc.h"
+#include "esp_image_format.h"
+#include "esp_timer.h"
 
 #define DEVICE_CONFIG_NAMESPACE "devcfg"
+#define FW_FINGERPRINT_KEY "fw_fp"
 
 esp_err_t save_device_config(const device_config_t *config) {
     nvs_handle_t nvs;
@@ -22,31 +28,50 @@ esp_err_t load_device_config(device_config_t *config) {
     return err;
 }
 
-void compute_running_firmware_md5(char *out_md5_hex) {
+// What the cached fingerprint was hashed from
+typedef struct {
+    uint32_t address;           // Running partition
+    uint32_t image_len;
+    uint8_t elf_sha256[32];     // App descriptor: differs between builds of the same size
+    uint8_t image_sha256[32];
+} fw_fingerprint_t;
+
+void get_running_firmware_fingerprint(char *out_hex, bool rehash) {
     const esp_partition_t *part = esp_ota_get_running_partition();
-    if (!part) {
-        strcpy(out_md5_hex, "ERROR");
+    esp_image_metadata_t meta;
+    if (!part || esp_image_get_metadata(&(esp_partition_pos_t){ .offset = part->address, .size = part->size },
+                                        &meta) != ESP_OK) {
+        strcpy(out_hex, "ERROR");
         return;
     }
-    mbedtls_md5_context ctx;
-    mbedtls_md5_init(&ctx);
-    mbedtls_md5_starts(&ctx);
-    uint8_t buf[1024];
-    size_t offset = 0;
-    while (offset < part->size) {
-        size_t to_read = sizeof(buf);
-        if (part->size - offset < to_read) to_read = part->size - offset;
-        if (esp_partition_read(part, offset, buf, to_read) != ESP_OK) {
-            strcpy(out_md5_hex, "ERROR");
-            mbedtls_md5_free(&ctx);
+    fw_fingerprint_t fp = { .address = part->address, .image_len = meta.image_len };
+    memcpy(fp.elf_sha256, esp_app_get_description()->app_elf_sha256, sizeof(fp.elf_sha256));
+
+    fw_fingerprint_t cached;
+    size_t size = sizeof(cached);
+    bool hit = false;
+    nvs_handle_t nvs;
+    if (!rehash && nvs_open(DEVICE_CONFIG_NAMESPACE, NVS_READONLY, &nvs) == ESP_OK) {
+        hit = nvs_get_blob(nvs, FW_FINGERPRINT_KEY, &cached, &size) == ESP_OK && size == sizeof(cached) &&
+              memcmp(&cached, &fp, offsetof(fw_fingerprint_t, image_sha256)) == 0;
+        nvs_close(nvs);
+    }
+    if (hit) {
+        memcpy(fp.image_sha256, cached.image_sha256, sizeof(fp.image_sha256));
+    } else {
+        // Checks the image up to its end, not the whole partition
+        int64_t start_us = esp_timer_get_time();
+        if (esp_partition_get_sha256(part, fp.image_sha256) != ESP_OK) {
+            strcpy(out_hex, "ERROR");
             return;
         }
-        mbedtls_md5_update(&ctx, buf, to_read);
-        offset += to_read;
+        ESP_LOGI(CFG_H_TAG, "Firmware image of %lu bytes hashed in %lld ms", meta.image_len,
+                 (esp_timer_get_time() - start_us) / 1000);
+        if (nvs_open(DEVICE_CONFIG_NAMESPACE, NVS_READWRITE, &nvs) == ESP_OK) {
+            if (nvs_set_blob(nvs, FW_FINGERPRINT_KEY, &fp, sizeof(fp)) == ESP_OK) nvs_commit(nvs);
+            nvs_close(nvs);
+        }
     }
-    uint8_t md5[16];
-    mbedtls_md5_finish(&ctx, md5);
-    mbedtls_md5_free(&ctx);
-    for (int i = 0; i < 16; ++i) sprintf(out_md5_hex + i*2, "%02x", md5[i]);
-    out_md5_hex[32] = '\0';
+    for (int i = 0; i < 16; ++i) sprintf(out_hex + i*2, "%02x", fp.image_sha256[i]);
+    out_hex[32] = '\0';
 }
@@ -9,9 +9,7 @@
 #include "nvs_flash.h"
 #include "nvs.h"
 #include <string.h>
-//https://github.com/platformio/platform-espressif32/issues/957
-#define MBEDTLS_CONFIG_FILE "mbedtls/esp_config.h"
-#include "mbedtls/md5.h"
+#include <stdbool.h>
 #include "esp_ota_ops.h"
 
 
@@ -88,7 +86,7 @@ typedef struct {
     uint8_t node_type; // node type identifier
     int8_t battery_analog_pin; // Analog pin for battery voltage reading
     uint8_t ext_antenna; // Flag to indicate if external antenna is used
-    char fw_md5[33]; // 32 hex chars + null terminator for firmware signature
+    char fw_md5[33]; // Firmware fingerprint: 32 hex chars + null terminator (get_running_firmware_fingerprint)
     // Add other config items as needed
 } device_config_t;
 
@@ -96,7 +94,14 @@ typedef struct {
 esp_err_t save_device_config(const device_config_t *config);
 esp_err_t load_device_config(device_config_t *config);
 
-
-void compute_running_firmware_md5(char *out_md5_hex);
+/**
+ * @brief Fingerprint of the running firmware: the first 16 bytes of its image SHA-256 (the digest
+ * esptool appends to the image), as 32 hex digits, or "ERROR".
+ *
+ * Hashing the image takes a read of all of it, so the result is cached in NVS for the running
+ * partition and image size (and the ELF SHA-256 of the app descriptor, which tells two builds of
+ * the same size apart): the image is hashed once after an update, then on boot only when `rehash`.
+ */
+void get_running_firmware_fingerprint(char *out_hex, bool rehash);
 
 #endif // CFG_HELPER_H
\ No newline at end of file
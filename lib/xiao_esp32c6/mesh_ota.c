@@ -1,66 +1,1001 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "mesh_ota.h"
+#include "esp_log.h"
+#include "esp_ota_ops.h"
+#include "esp_partition.h"
+#include "esp_image_format.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include "nvs.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "../mesh_tx/mesh_tx.h"
+#include "../protocol/wire.h"
+#include "ota_writer.h"
+#include "ota_lzss.h"
+#include "ota_delta.h"
 
 #define OTA_TAG "mesh_ota"
 
-// Handle a received OTA packet (to be called by central RX dispatcher)
-void mesh_ota_handle_packet(const mesh_ota_packet_t *pkt) {
-    static esp_ota_handle_t ota_handle = 0;
-    static const esp_partition_t *ota_partition = NULL;
-    static bool ota_in_progress = false;
-    static uint32_t expected_offset = 0;
-    esp_err_t err;
+#define NVS_NAMESPACE       "mesh_ota"
+#define START_TRIES         5
+#define STATUS_TRIES        3
+#define END_REPEATS         3
+#define MAX_GROUPS          4
 
-    switch (pkt->cmd) {
-        case MESH_OTA_CMD_START:
-            ESP_LOGI(OTA_TAG, "OTA START received, size=%lu", pkt->size);
-            ota_partition = esp_ota_get_next_update_partition(NULL);
-            if (!ota_partition) {
-                ESP_LOGE(OTA_TAG, "No OTA partition found!");
-                break;
+_Static_assert(OTA_WRITER_SECTOR_SIZE % MESH_OTA_BLOCK_SIZE == 0, "blocks never straddle a flash sector");
+_Static_assert(MESH_OTA_MAX_BLOCKS * MESH_OTA_BLOCK_SIZE <= OTA_WRITER_MAX_SECTORS * OTA_WRITER_SECTOR_SIZE,
+               "the largest image fits the writer");
+_Static_assert(MESH_OTA_DATA_SIZE <= MESH_TX_MTU - WIRE_MAX_OVERHEAD, "a block fits one packet");
+_Static_assert(MESH_OTA_ACK_SIZE <= MESH_TX_MTU - WIRE_MAX_OVERHEAD, "an ACK fits one packet");
+_Static_assert(MESH_OTA_START_SIZE <= MESH_TX_MTU - WIRE_MAX_OVERHEAD, "a START with a full chunk table fits one packet");
+
+static const mesh_addr_t s_group = { .addr = MESH_OTA_GROUP_ID };
+
+// Target side: transfer in progress, saved to NVS as is (OTA worker task only)
+typedef struct {
+    uint32_t session;       // 0: none
+    uint32_t image_size;
+    uint16_t block_count;
+    uint16_t received;
+    uint8_t state;          // mesh_ota_state_t
+    uint8_t sha256[32];
+    uint8_t bitmap[MESH_OTA_BITMAP_SIZE];
+    uint8_t encoding;       // mesh_ota_encoding_t; the rest is for LZSS and DELTA, as in the START
+    uint8_t window_bits;
+    uint8_t lookahead_bits;
+    uint16_t chunk_size;
+    uint16_t chunk_count;
+    uint8_t base_md5[16];
+    uint16_t chunk_len[MESH_OTA_MAX_CHUNKS];
+} ota_progress_t;
+
+// Target side: a compressed chunk being decoded. Its blocks have to come in order: a block past a gap
+// is dropped unmarked, and comes again with the missing one.
+typedef struct {
+    int chunk;              // -1: free
+    uint16_t first;         // Block of the chunk's first bytes
+    uint16_t next_block;    // Within the chunk
+    uint32_t out_pos;       // Image bytes of the chunk decoded so far
+    uint32_t last_use;
+    ota_lzss_t lzss;
+    ota_delta_t delta;      // DELTA: applied to what lzss outputs
+} decode_slot_t;
+
+static ota_progress_t s_rx;
+static bool s_dirty;        // Bitmap changed since last saved (blocks may still be staged in RAM)
+static const esp_partition_t *s_rx_part;
+static mesh_addr_t s_root;
+static decode_slot_t s_slots[CONFIG_MESH_OTA_LZSS_SLOTS];
+static uint32_t s_slot_clock;
+static const esp_partition_t *s_base_part;     // Running firmware: what delta ops read
+static uint8_t s_base_md5[16];                  // Its fw_md5
+static bool s_base_known;
+
+// Root side
+typedef struct {
+    mesh_ota_target_report_t report;
+    bool answered;          // ACK seen for the current START/STATUS round
+    bool silent;            // No ACK for a whole round: skipped until it answers again
+    uint8_t bitmap[MESH_OTA_BITMAP_SIZE];
+} ota_target_t;
+
+static SemaphoreHandle_t s_mutex;   // Root state, between the rollout task and the OTA worker
+static ota_target_t *s_targets;     // Allocated for a rollout: only the root needs them
+static int s_num_targets;
+static bool s_rollout_running;
+static TaskHandle_t s_rollout_task;
+static const esp_partition_t *s_src;
+static uint32_t s_src_data;         // Offset of the first block in s_src: past the header of an encoded image
+static mesh_ota_start_t s_start;
+static int64_t s_rollout_start_us;
+
+static inline bool bit_get(const uint8_t *map, uint32_t i) {
+    return map[i / 8] & (1u << (i % 8));
+}
+
+static inline void bit_set(uint8_t *map, uint32_t i) {
+    map[i / 8] |= 1u << (i % 8);
+}
+
+static inline void bit_clear(uint8_t *map, uint32_t i) {
+    map[i / 8] &= ~(1u << (i % 8));
+}
+
+static inline uint16_t blocks_of(uint32_t len) {
+    return (len + MESH_OTA_BLOCK_SIZE - 1) / MESH_OTA_BLOCK_SIZE;
+}
+
+/**
+ * @brief Chunk of an LZSS image holding `block`, with its first block and the offset of its
+ * compressed bytes in the stream. -1 past the last chunk.
+ */
+static int chunk_of(const uint16_t *chunk_len, uint16_t chunk_count, uint16_t block, uint16_t *first,
+                    uint32_t *offset) {
+    uint16_t b = 0;
+    uint32_t off = 0;
+    for (int c = 0; c < chunk_count; c++) {
+        uint16_t n = blocks_of(chunk_len[c]);
+        if (block < b + n) {
+            *first = b;
+            *offset = off;
+            return c;
+        }
+        b += n;
+        off += chunk_len[c];
+    }
+    return -1;
+}
+
+// Image bytes of a chunk: chunk_size but for the last one
+static uint32_t chunk_image_len(int c) {
+    uint32_t start = (uint32_t)c * s_rx.chunk_size;
+    return s_rx.image_size - start < s_rx.chunk_size ? s_rx.image_size - start : s_rx.chunk_size;
+}
+
+static void save_progress(void) {
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs);
+    if (err == ESP_OK) {
+        err = s_rx.session ? nvs_set_blob(nvs, "progress", &s_rx, sizeof(s_rx)) : nvs_erase_key(nvs, "progress");
+        if (err == ESP_OK || err == ESP_ERR_NVS_NOT_FOUND) {
+            err = nvs_commit(nvs);
+        }
+        nvs_close(nvs);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGW(OTA_TAG, "Failed to save OTA progress: 0x%x", err);
+    }
+    s_dirty = false;
+}
+
+static bool read_base(void *ctx, uint32_t offset, void *dst, size_t len) {
+    return esp_partition_read(s_base_part, offset, dst, len) == ESP_OK;
+}
+
+static inline bool base_matches(const uint8_t *md5) {
+    return s_base_known && memcmp(md5, s_base_md5, sizeof(s_base_md5)) == 0;
+}
+
+// Whether the image of SHA-256 `sha256` is the one running. Its fingerprint is the start of that digest,
+// cached at boot: the running partition is only hashed again when the fingerprint was not given.
+static bool running_image(const uint8_t *sha256) {
+    if (s_base_known) {
+        return base_matches(sha256);
+    }
+    uint8_t running[32];
+    return esp_partition_get_sha256(esp_ota_get_running_partition(), running) == ESP_OK &&
+           memcmp(running, sha256, sizeof(running)) == 0;
+}
+
+static void reset_slots(void) {
+    for (int i = 0; i < CONFIG_MESH_OTA_LZSS_SLOTS; i++) {
+        s_slots[i].chunk = -1;
+    }
+}
+
+// Decoding of the chunk lost: every block of it has to come again, from the first one
+static void forget_chunk(int c, uint16_t first) {
+    for (uint16_t b = first; b < first + blocks_of(s_rx.chunk_len[c]); b++) {
+        if (bit_get(s_rx.bitmap, b)) {
+            bit_clear(s_rx.bitmap, b);
+            s_rx.received--;
+            s_dirty = true;
+        }
+    }
+}
+
+// Resuming after a reboot: a sector holding a received block was erased for this session already
+static void resume_writer(void) {
+    reset_slots();
+    if (s_rx.encoding == MESH_OTA_ENCODING_DELTA && !base_matches(s_rx.base_md5)) {
+        s_rx.state = MESH_OTA_STATE_WRONG_BASE;     // Booted other firmware since
+        return;
+    }
+    if (ota_writer_begin(s_rx_part, s_rx.image_size) != ESP_OK) {
+        s_rx.state = MESH_OTA_STATE_FAILED;
+        return;
+    }
+    if (s_rx.encoding == MESH_OTA_ENCODING_RAW) {
+        for (uint32_t b = 0; b < s_rx.block_count; b++) {
+            if (bit_get(s_rx.bitmap, b)) {
+                ota_writer_set_erased(b * MESH_OTA_BLOCK_SIZE);
             }
-            err = esp_ota_begin(ota_partition, pkt->size, &ota_handle);
+        }
+        return;
+    }
+    // The decoders are gone: only whole chunks are kept, the sectors of the others are erased again
+    uint16_t first = 0;
+    for (int c = 0; c < s_rx.chunk_count; c++) {
+        uint16_t n = blocks_of(s_rx.chunk_len[c]);
+        bool whole = true;
+        for (uint16_t b = first; b < first + n && whole; b++) {
+            whole = bit_get(s_rx.bitmap, b);
+        }
+        if (!whole) {
+            forget_chunk(c, first);
+        } else {
+            for (uint32_t off = 0; off < chunk_image_len(c); off += OTA_WRITER_SECTOR_SIZE) {
+                ota_writer_set_erased((uint32_t)c * s_rx.chunk_size + off);
+            }
+        }
+        first += n;
+    }
+}
+
+static void write_failed(esp_err_t err) {
+    ESP_LOGE(OTA_TAG, "OTA session %08lx failed: 0x%x", s_rx.session, err);
+    s_rx.state = MESH_OTA_STATE_FAILED;
+    save_progress();
+}
+
+// The saved bitmap never runs ahead of the flash
+static void save_received(void) {
+    esp_err_t err = ota_writer_flush();
+    if (err != ESP_OK) {
+        write_failed(err);
+    } else {
+        save_progress();
+    }
+}
+
+static void send_ack(uint32_t session) {
+    static mesh_ota_ack_t ack;      // Too big for the worker stack
+    ack = (mesh_ota_ack_t){ .cmd = MESH_OTA_CMD_ACK, .session = session, .state = MESH_OTA_STATE_IDLE };
+    size_t bitmap_len = 0;
+    if (session == s_rx.session) {
+        ack.state = s_rx.state;
+        ack.received = s_rx.received;
+        ack.block_count = s_rx.block_count;
+        bitmap_len = (s_rx.block_count + 7) / 8;
+        memcpy(ack.bitmap, s_rx.bitmap, bitmap_len);
+    }
+    esp_err_t err = mesh_tx_send(MESH_TX_CONTROL, &s_root, MESH_DATA_P2P, OTA_DATA, &ack,
+                                 offsetof(mesh_ota_ack_t, bitmap) + bitmap_len);
+    if (err != ESP_OK) {
+        ESP_LOGW(OTA_TAG, "Failed to send ACK: 0x%x", err);
+    }
+}
+
+// Blocks as the START lays them out: the image itself, or its chunks each compressed on its own
+static bool layout_valid(const mesh_ota_start_t *start, size_t len) {
+    if (start->block_size != MESH_OTA_BLOCK_SIZE || start->block_count > MESH_OTA_MAX_BLOCKS) {
+        return false;
+    }
+    if (start->encoding == MESH_OTA_ENCODING_RAW) {
+        return start->block_count == blocks_of(start->image_size);
+    }
+    if ((start->encoding != MESH_OTA_ENCODING_LZSS && start->encoding != MESH_OTA_ENCODING_DELTA) ||
+        start->chunk_size == 0 ||
+        start->chunk_size % OTA_WRITER_SECTOR_SIZE != 0 || start->chunk_count > MESH_OTA_MAX_CHUNKS ||
+        start->chunk_count != (start->image_size + start->chunk_size - 1) / start->chunk_size ||
+        len < offsetof(mesh_ota_start_t, chunk_len) + start->chunk_count * sizeof(uint16_t) ||
+        !ota_lzss_init(&s_slots[0].lzss, start->window_bits, start->lookahead_bits)) {
+        return false;
+    }
+    uint32_t blocks = 0;
+    for (int c = 0; c < start->chunk_count; c++) {
+        uint32_t image_len = start->image_size - (uint32_t)c * start->chunk_size;
+        if (start->chunk_len[c] == 0 || start->chunk_len[c] > (image_len < start->chunk_size ? image_len
+                                                                                             : start->chunk_size)) {
+            return false;
+        }
+        blocks += blocks_of(start->chunk_len[c]);
+    }
+    return blocks == start->block_count;
+}
+
+static bool same_transfer(const mesh_ota_start_t *start) {
+    return start->session == s_rx.session && start->block_count == s_rx.block_count &&
+           start->encoding == s_rx.encoding && start->chunk_count == s_rx.chunk_count &&
+           memcmp(start->base_md5, s_rx.base_md5, sizeof(s_rx.base_md5)) == 0 &&
+           memcmp(start->chunk_len, s_rx.chunk_len, s_rx.chunk_count * sizeof(uint16_t)) == 0;
+}
+
+static void rx_start(const mesh_addr_t *from, const mesh_ota_start_t *start, size_t len) {
+    s_root = *from;
+    if (same_transfer(start)) {
+        send_ack(start->session);      // Repeated START, or resuming after a reboot
+        return;
+    }
+    memset(&s_rx, 0, sizeof(s_rx));
+    reset_slots();
+    s_rx.session = start->session;
+    s_rx.image_size = start->image_size;
+    s_rx.block_count = start->block_count;
+    s_rx.state = MESH_OTA_STATE_RECEIVING;
+    memcpy(s_rx.sha256, start->sha256, sizeof(s_rx.sha256));
+    // Kept whatever the state, for same_transfer()
+    s_rx.encoding = start->encoding;
+    s_rx.window_bits = start->window_bits;
+    s_rx.lookahead_bits = start->lookahead_bits;
+    s_rx.chunk_size = start->chunk_size;
+    memcpy(s_rx.base_md5, start->base_md5, sizeof(s_rx.base_md5));
+    if (start->chunk_count <= MESH_OTA_MAX_CHUNKS) {
+        s_rx.chunk_count = start->chunk_count;
+        memcpy(s_rx.chunk_len, start->chunk_len, start->chunk_count * sizeof(uint16_t));
+    }
+
+    if (running_image(start->sha256)) {
+        s_rx.state = MESH_OTA_STATE_CURRENT;
+    } else if (start->encoding == MESH_OTA_ENCODING_DELTA && !base_matches(start->base_md5)) {
+        ESP_LOGW(OTA_TAG, "OTA delta image against other firmware, refused");
+        s_rx.state = MESH_OTA_STATE_WRONG_BASE;
+    } else if (s_rx_part == NULL || !layout_valid(start, len) ||
+               ota_writer_begin(s_rx_part, start->image_size) != ESP_OK) {
+        ESP_LOGE(OTA_TAG, "OTA image of %lu bytes does not fit, or unknown encoding %u", start->image_size,
+                 start->encoding);
+        s_rx.state = MESH_OTA_STATE_FAILED;
+    }
+    ESP_LOGI(OTA_TAG, "OTA session %08lx: %lu bytes in %u blocks, encoding %u, state %u", s_rx.session,
+             s_rx.image_size, s_rx.block_count, s_rx.encoding, s_rx.state);
+    save_progress();
+    send_ack(start->session);
+}
+
+// Every block in: the partition has to hash to the image the root announced
+static void check_image(void) {
+    esp_err_t err = ota_writer_flush();
+    if (err != ESP_OK) {
+        write_failed(err);
+        return;
+    }
+    ota_writer_log_stats();
+    uint8_t sha[32];
+    if (esp_partition_get_sha256(s_rx_part, sha) == ESP_OK && memcmp(sha, s_rx.sha256, sizeof(sha)) == 0) {
+        s_rx.state = MESH_OTA_STATE_COMPLETE;
+        ESP_LOGI(OTA_TAG, "OTA session %08lx complete, image checked", s_rx.session);
+    } else {
+        // Start over: the root sends every block again
+        ESP_LOGE(OTA_TAG, "OTA session %08lx: image hash mismatch, receiving again", s_rx.session);
+        memset(s_rx.bitmap, 0, sizeof(s_rx.bitmap));
+        s_rx.received = 0;
+        reset_slots();
+        ota_writer_begin(s_rx_part, s_rx.image_size);
+    }
+    save_progress();
+}
+
+// The slot decoding chunk `c` if its block `k` comes next; a new slot for its first block, taken
+// from the chunk used the longest ago if none is free. NULL: the block has to wait for the others.
+static decode_slot_t *decode_slot(int c, uint16_t first, uint16_t k) {
+    decode_slot_t *lru = &s_slots[0];
+    for (int i = 0; i < CONFIG_MESH_OTA_LZSS_SLOTS; i++) {
+        decode_slot_t *slot = &s_slots[i];
+        if (slot->chunk == c) {
+            return slot->next_block == k ? slot : NULL;
+        }
+        if (lru->chunk >= 0 && (slot->chunk < 0 || slot->last_use < lru->last_use)) {
+            lru = slot;
+        }
+    }
+    if (k != 0) {
+        return NULL;
+    }
+    if (lru->chunk >= 0) {
+        forget_chunk(lru->chunk, lru->first);
+    }
+    lru->chunk = c;
+    lru->first = first;
+    lru->next_block = 0;
+    lru->out_pos = 0;
+    ota_lzss_init(&lru->lzss, s_rx.window_bits, s_rx.lookahead_bits);
+    // Delta ops start reading the base where the chunk sits in the image
+    ota_delta_init(&lru->delta, read_base, NULL, s_base_part->size, (uint32_t)c * s_rx.chunk_size);
+    return lru;
+}
+
+// Decode a block of the slot's chunk into the writer, a page at a time. A page cut between two
+// blocks may reach the flash in two writes, each with 0xFF over the other part: programming only
+// clears bits, so the second write completes the page (as does decoding a chunk again after it
+// lost its slot, over the same bytes).
+static esp_err_t decode_block(decode_slot_t *slot, const uint8_t *in, size_t len) {
+    uint32_t base = (uint32_t)slot->chunk * s_rx.chunk_size;
+    uint32_t image_len = chunk_image_len(slot->chunk);
+    bool delta = s_rx.encoding == MESH_OTA_ENCODING_DELTA;
+    uint8_t ops[OTA_WRITER_PAGE_SIZE];      // DELTA: decoded, not applied yet
+    const uint8_t *op = ops;
+    size_t op_len = 0;
+    uint8_t out[OTA_WRITER_PAGE_SIZE];
+    while (slot->out_pos < image_len) {
+        size_t want = image_len - slot->out_pos < sizeof(out) ? image_len - slot->out_pos : sizeof(out);
+        size_t n;
+        if (!delta) {
+            n = ota_lzss_decode(&slot->lzss, &in, &len, out, want);
+        } else {
+            n = ota_delta_apply(&slot->delta, &op, &op_len, out, want);
+            if (slot->delta.error) {
+                ESP_LOGE(OTA_TAG, "OTA chunk %d: bad delta op", slot->chunk);
+                return ESP_ERR_INVALID_RESPONSE;
+            }
+            if (n < want) {
+                // Ops used up: decode more from the block
+                op = ops;
+                op_len = ota_lzss_decode(&slot->lzss, &in, &len, ops, sizeof(ops));
+            }
+        }
+        if (n > 0) {
+            esp_err_t err = ota_writer_write(base + slot->out_pos, out, n);
             if (err != ESP_OK) {
-                ESP_LOGE(OTA_TAG, "esp_ota_begin failed: 0x%x", err);
-                break;
+                return err;
+            }
+            slot->out_pos += n;
+        }
+        if (n < want && (!delta || (n == 0 && op_len == 0))) {
+            break;      // Block used up
+        }
+    }
+    return ESP_OK;
+}
+
+static void rx_data(const mesh_ota_data_t *data, size_t len) {
+    uint16_t block = data->block;
+    if (data->session != s_rx.session || s_rx.state != MESH_OTA_STATE_RECEIVING || block >= s_rx.block_count ||
+        bit_get(s_rx.bitmap, block)) {
+        return;     // Other session, or resent for another target
+    }
+    uint32_t offset;        // In the image
+    uint32_t expected;
+    int chunk = -1;         // Compressed chunk holding the block
+    uint16_t first = 0;
+    if (s_rx.encoding == MESH_OTA_ENCODING_RAW) {
+        offset = (uint32_t)block * MESH_OTA_BLOCK_SIZE;
+        expected = s_rx.image_size - offset;
+    } else {
+        uint32_t stream_offset;
+        int c = chunk_of(s_rx.chunk_len, s_rx.chunk_count, block, &first, &stream_offset);
+        uint32_t k_offset = (uint32_t)(block - first) * MESH_OTA_BLOCK_SIZE;
+        offset = (uint32_t)c * s_rx.chunk_size + k_offset;
+        expected = s_rx.chunk_len[c] - k_offset;
+        if (s_rx.chunk_len[c] != chunk_image_len(c)) {
+            chunk = c;
+        }   // else stored as is: written like a raw block
+    }
+    if (expected > MESH_OTA_BLOCK_SIZE) {
+        expected = MESH_OTA_BLOCK_SIZE;
+    }
+    if (len != expected) {
+        ESP_LOGW(OTA_TAG, "OTA block %u: %u bytes, expected %lu", block, (unsigned)len, expected);
+        return;
+    }
+    decode_slot_t *slot = NULL;
+    if (chunk >= 0 && (slot = decode_slot(chunk, first, block - first)) == NULL) {
+        return;     // Past a gap in its chunk: sent again after the missing block
+    }
+    // Staged in RAM: the writer task erases and programs whole sectors while the next blocks come in
+    esp_err_t err = slot != NULL ? decode_block(slot, data->data, len) : ota_writer_write(offset, data->data, len);
+    if (err != ESP_OK) {
+        write_failed(err);
+        return;
+    }
+    bit_set(s_rx.bitmap, block);
+    s_rx.received++;
+    s_dirty = true;
+    if (slot != NULL) {
+        slot->last_use = ++s_slot_clock;
+        if (++slot->next_block == blocks_of(s_rx.chunk_len[chunk])) {
+            if (slot->out_pos != chunk_image_len(chunk)) {
+                ESP_LOGW(OTA_TAG, "OTA chunk %d decodes to %lu bytes, expected %lu", chunk, slot->out_pos,
+                         chunk_image_len(chunk));
+                forget_chunk(chunk, first);
+            }
+            slot->chunk = -1;
+        }
+    }
+    if (s_rx.received == s_rx.block_count) {
+        check_image();
+    }
+}
+
+static void rx_status(const mesh_addr_t *from, uint32_t session) {
+    s_root = *from;
+    if (session == s_rx.session && s_dirty) {
+        save_received();
+    }
+    send_ack(session);
+}
+
+static void rx_end(uint32_t session) {
+    if (session != s_rx.session) {
+        return;
+    }
+    if (s_rx.state == MESH_OTA_STATE_COMPLETE) {
+        esp_err_t err = esp_ota_set_boot_partition(s_rx_part);
+        if (err != ESP_OK) {
+            ESP_LOGE(OTA_TAG, "esp_ota_set_boot_partition failed: 0x%x", err);
+            return;
+        }
+        s_rx.session = 0;
+        save_progress();
+        ESP_LOGI(OTA_TAG, "OTA update complete, rebooting...");
+        vTaskDelay(pdMS_TO_TICKS(1000));
+        esp_restart();
+    } else if (s_rx.state == MESH_OTA_STATE_RECEIVING) {
+        // Kept: a later rollout of the same image resumes from here
+        if (s_dirty) {
+            save_received();
+        }
+        ESP_LOGW(OTA_TAG, "OTA session %08lx ended with %u of %u blocks", s_rx.session, s_rx.received,
+                 s_rx.block_count);
+    } else {
+        s_rx.session = 0;
+        save_progress();
+    }
+}
+
+static ota_target_t *find_target(const mesh_addr_t *addr) {
+    for (int i = 0; i < s_num_targets; i++) {
+        if (memcmp(s_targets[i].report.addr.addr, addr->addr, sizeof(addr->addr)) == 0) {
+            return &s_targets[i];
+        }
+    }
+    return NULL;
+}
+
+static void rx_ack(const mesh_addr_t *from, const mesh_ota_ack_t *ack, size_t len) {
+    size_t bitmap_len = len - offsetof(mesh_ota_ack_t, bitmap);
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    ota_target_t *t = s_rollout_running && ack->session == s_start.session ? find_target(from) : NULL;
+    if (t != NULL) {
+        t->answered = true;
+        t->silent = false;
+        t->report.state = ack->state;
+        t->report.received = ack->received;
+        if (ack->state == MESH_OTA_STATE_RECEIVING && bitmap_len == (s_start.block_count + 7u) / 8) {
+            memcpy(t->bitmap, ack->bitmap, bitmap_len);
+        }
+        if (ack->state == MESH_OTA_STATE_COMPLETE && t->report.duration_ms == 0) {
+            uint32_t ms = (uint32_t)((esp_timer_get_time() - s_rollout_start_us) / 1000);
+            t->report.duration_ms = ms > 0 ? ms : 1;
+            t->report.throughput_bps = (uint32_t)((uint64_t)s_start.image_size * 1000 / t->report.duration_ms);
+        }
+    }
+    xSemaphoreGive(s_mutex);
+    if (t != NULL) {
+        xTaskNotifyGive(s_rollout_task);
+    }
+}
+
+void mesh_ota_handle_packet(const mesh_addr_t *from, const void *payload, size_t payload_len) {
+    mesh_ota_header_t h;
+    memcpy(&h, payload, sizeof(h));
+    switch (h.cmd) {
+        case MESH_OTA_CMD_START:
+            // Sent without the unused part of the chunk table (all of it for a raw image)
+            if (payload_len >= offsetof(mesh_ota_start_t, encoding) && payload_len <= sizeof(mesh_ota_start_t)) {
+                static mesh_ota_start_t start;      // Too big for the worker stack
+                memset(&start, 0, sizeof(start));
+                memcpy(&start, payload, payload_len);
+                rx_start(from, &start, payload_len);
             }
-            ota_in_progress = true;
-            expected_offset = 0;
             break;
         case MESH_OTA_CMD_DATA:
-            if (!ota_in_progress) break;
-            if (pkt->offset != expected_offset) {
-                ESP_LOGW(OTA_TAG, "Unexpected offset: got %lu, expected %lu", pkt->offset, expected_offset);
-                break;
-            }
-            err = esp_ota_write(ota_handle, pkt->data, pkt->size);
-            if (err != ESP_OK) {
-                ESP_LOGE(OTA_TAG, "esp_ota_write failed: 0x%x", err);
-                break;
+            if (payload_len > offsetof(mesh_ota_data_t, data)) {
+                rx_data(payload, payload_len - offsetof(mesh_ota_data_t, data));
             }
-            expected_offset += pkt->size;
+            break;
+        case MESH_OTA_CMD_STATUS:
+            rx_status(from, h.session);
             break;
         case MESH_OTA_CMD_END:
-            if (!ota_in_progress) break;
-            err = esp_ota_end(ota_handle);
-            if (err == ESP_OK) {
-                ESP_LOGI(OTA_TAG, "OTA update complete, rebooting...");
-                esp_ota_set_boot_partition(ota_partition);
-                vTaskDelay(1000 / portTICK_PERIOD_MS);
-                esp_restart();
-            } else {
-                ESP_LOGE(OTA_TAG, "esp_ota_end failed: 0x%x", err);
-            }
-            ota_in_progress = false;
+            rx_end(h.session);
+            break;
+        case MESH_OTA_CMD_ACK:
+            if (payload_len >= offsetof(mesh_ota_ack_t, bitmap)) {
+                rx_ack(from, payload, payload_len);
+            }
             break;
         default:
-            ESP_LOGW(OTA_TAG, "Unknown OTA command: %d", pkt->cmd);
+            ESP_LOGW(OTA_TAG, "Unknown OTA command: %d", h.cmd);
+            break;
+    }
+}
+
+// Root: targets that still take blocks (no ACK yet counts as missing everything)
+static inline bool target_active(const ota_target_t *t) {
+    return !t->silent && (t->report.state == MESH_OTA_STATE_IDLE || t->report.state == MESH_OTA_STATE_RECEIVING);
+}
+
+static bool any_active(void) {
+    bool active = false;
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    for (int i = 0; i < s_num_targets && !active; i++) {
+        active = target_active(&s_targets[i]);
+    }
+    xSemaphoreGive(s_mutex);
+    return active;
+}
+
+/**
+ * @brief Ask every active target for an ACK and wait for them, up to `tries` rounds of
+ * CONFIG_MESH_OTA_ACK_TIMEOUT_MS. START while a target has not taken the session, else STATUS;
+ * both go through the bulk queue, behind the blocks already queued. Targets that never answer are
+ * marked silent: no blocks are sent for them until they answer a later round.
+ */
+static void collect_acks(int tries) {
+    for (int i = 0; i < tries; i++) {
+        bool start = false;
+        xSemaphoreTake(s_mutex, portMAX_DELAY);
+        for (int t = 0; t < s_num_targets; t++) {
+            s_targets[t].answered = !target_active(&s_targets[t]);
+            start |= s_targets[t].report.state == MESH_OTA_STATE_IDLE;
+        }
+        xSemaphoreGive(s_mutex);
+
+        mesh_ota_header_t status = { .cmd = MESH_OTA_CMD_STATUS, .session = s_start.session };
+        if (start) {
+            mesh_tx_send(MESH_TX_BULK, &s_group, MESH_DATA_P2P | MESH_DATA_GROUP, OTA_DATA, &s_start,
+                         offsetof(mesh_ota_start_t, chunk_len) + s_start.chunk_count * sizeof(uint16_t));
+        } else {
+            mesh_tx_send(MESH_TX_BULK, &s_group, MESH_DATA_P2P | MESH_DATA_GROUP, OTA_DATA, &status, sizeof(status));
+        }
+
+        int64_t deadline_us = esp_timer_get_time() + CONFIG_MESH_OTA_ACK_TIMEOUT_MS * 1000LL;
+        while (true) {
+            bool all = true;
+            xSemaphoreTake(s_mutex, portMAX_DELAY);
+            for (int t = 0; t < s_num_targets && all; t++) {
+                all = s_targets[t].answered;
+            }
+            xSemaphoreGive(s_mutex);
+            int64_t left_us = deadline_us - esp_timer_get_time();
+            if (all) {
+                return;
+            }
+            if (left_us <= 0) {
+                break;
+            }
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(left_us / 1000) + 1);
+        }
+    }
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    for (int t = 0; t < s_num_targets; t++) {
+        if (!s_targets[t].answered) {
+            s_targets[t].silent = true;
+            ESP_LOGW(OTA_TAG, "Node "MACSTR" does not answer", MAC2STR(s_targets[t].report.addr.addr));
+        }
+    }
+    xSemaphoreGive(s_mutex);
+}
+
+static esp_err_t send_block(uint16_t block) {
+    pkt_buf_t *buf;
+    while ((buf = pkt_pool_alloc()) == NULL) {
+        vTaskDelay(1);
+    }
+    // Raw: the image itself; LZSS or DELTA: the chunk's compressed bytes, from its own first block
+    uint32_t offset = (uint32_t)block * MESH_OTA_BLOCK_SIZE;
+    uint32_t end = s_start.image_size;
+    if (s_start.encoding != MESH_OTA_ENCODING_RAW) {
+        uint16_t first = 0;
+        uint32_t chunk_offset = 0;
+        int c = chunk_of(s_start.chunk_len, s_start.chunk_count, block, &first, &chunk_offset);
+        offset = chunk_offset + (uint32_t)(block - first) * MESH_OTA_BLOCK_SIZE;
+        end = chunk_offset + s_start.chunk_len[c];
+    }
+    size_t len = end - offset < MESH_OTA_BLOCK_SIZE ? end - offset : MESH_OTA_BLOCK_SIZE;
+    mesh_ota_data_t *data = (mesh_ota_data_t *)(buf->data + WIRE_TX_HDR_SIZE);
+    data->cmd = MESH_OTA_CMD_DATA;
+    data->state = 0;
+    data->block = block;
+    data->session = s_start.session;
+    esp_err_t err = esp_partition_read(s_src, s_src_data + offset, data->data, len);
+    if (err != ESP_OK) {
+        pkt_buf_release(buf);
+        return err;
+    }
+    buf->len = wire_encode(buf->data, OTA_DATA, offsetof(mesh_ota_data_t, data) + len);
+    return mesh_tx_send_buf(MESH_TX_BULK, &s_group, MESH_DATA_P2P | MESH_DATA_GROUP, buf);
+}
+
+/**
+ * @brief Send blocks [first, end) to the targets lacking them, in up to CONFIG_MESH_OTA_MAX_PASSES
+ * passes with a status round every CONFIG_MESH_OTA_WINDOW blocks and after each pass.
+ *
+ * @param again Sent before (an earlier sweep): every block sent counts as resent.
+ * @return Blocks sent, of them `*resent` sent again.
+ */
+static uint32_t send_span(uint16_t first, uint16_t end, bool again, uint32_t *resent) {
+    uint32_t sent = 0;
+    for (int pass = 0; pass < CONFIG_MESH_OTA_MAX_PASSES && any_active(); pass++) {
+        int in_window = 0;
+        uint32_t pass_sent = 0;
+        for (uint16_t b = first; b < end; b++) {
+            int lacking = 0;
+            xSemaphoreTake(s_mutex, portMAX_DELAY);
+            for (int i = 0; i < s_num_targets; i++) {
+                ota_target_t *t = &s_targets[i];
+                if (target_active(t) && !bit_get(t->bitmap, b)) {
+                    lacking++;
+                    t->report.resent += again || pass > 0;
+                }
+            }
+            xSemaphoreGive(s_mutex);
+            if (lacking == 0) {
+                continue;   // Every target has it: no airtime spent
+            }
+            esp_err_t err = send_block(b);
+            if (err != ESP_OK) {
+                ESP_LOGW(OTA_TAG, "OTA block %u not sent: 0x%x", b, err);
+            }
+            pass_sent++;
+            *resent += again || pass > 0;
+            if (++in_window == CONFIG_MESH_OTA_WINDOW) {
+                collect_acks(STATUS_TRIES);
+                in_window = 0;
+            }
+        }
+        if (pass_sent == 0) {
+            break;      // Every target has the span
+        }
+        sent += pass_sent;
+        collect_acks(STATUS_TRIES);
+        ESP_LOGD(OTA_TAG, "OTA blocks %u-%u pass %d done: %lu blocks sent", first, end - 1, pass + 1, pass_sent);
+    }
+    return sent;
+}
+
+static void rollout_task(void *arg) {
+    s_rollout_start_us = esp_timer_get_time();
+    ESP_LOGI(OTA_TAG, "OTA rollout of %lu bytes (session %08lx) to %d nodes", s_start.image_size, s_start.session,
+             s_num_targets);
+
+    collect_acks(START_TRIES);
+
+    // Raw: passes over the whole image. Encoded: over one chunk at a time, as targets decode a chunk
+    // only in order, with few open at once: a chunk left with a gap would be forgotten once the
+    // following chunks take its slot, however many of its blocks came in. Then again from the first
+    // chunk while a target lacks any (one that found its image corrupt starts over).
+    bool raw = s_start.encoding == MESH_OTA_ENCODING_RAW;
+    uint32_t sent = 0;
+    uint32_t resent = 0;
+    for (int sweep = 0; sweep < (raw ? 1 : CONFIG_MESH_OTA_MAX_PASSES) && any_active(); sweep++) {
+        uint32_t sweep_sent = 0;
+        uint16_t first = 0;
+        for (int c = 0; c < (raw ? 1 : s_start.chunk_count) && any_active(); c++) {
+            uint16_t end = raw ? s_start.block_count : first + blocks_of(s_start.chunk_len[c]);
+            sweep_sent += send_span(first, end, sweep > 0, &resent);
+            first = end;
+        }
+        if (sweep_sent == 0) {
             break;
+        }
+        sent += sweep_sent;
+        ESP_LOGI(OTA_TAG, "OTA sweep %d done: %lu blocks sent, %lu of them again", sweep + 1, sent, resent);
+    }
+
+    mesh_ota_header_t end = { .cmd = MESH_OTA_CMD_END, .session = s_start.session };
+    for (int i = 0; i < END_REPEATS; i++) {
+        mesh_tx_send(MESH_TX_BULK, &s_group, MESH_DATA_P2P | MESH_DATA_GROUP, OTA_DATA, &end, sizeof(end));
+        vTaskDelay(pdMS_TO_TICKS(100));
     }
+
+    uint32_t elapsed_ms = (uint32_t)((esp_timer_get_time() - s_rollout_start_us) / 1000);
+    ESP_LOGI(OTA_TAG, "OTA rollout finished in %lu ms: %lu blocks sent for %u in the image", elapsed_ms, sent,
+             s_start.block_count);
+    mesh_ota_log_report();
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    s_rollout_running = false;
+    xSemaphoreGive(s_mutex);
+    vTaskDelete(NULL);
 }
 
-// Root node: send firmware to all nodes (stub)
-esp_err_t mesh_ota_send_firmware(const char *fw_path) {
-    // TODO: Open firmware file, send in chunks using esp_mesh_send
-    ESP_LOGI(OTA_TAG, "Send firmware from: %s (stub)", fw_path);
+/**
+ * @brief Fill `start` (but for the session) from the image in `src`: an encoded image file
+ * (python/ota_image.py) or an app image, sent raw. `data` is the offset of its first block.
+ */
+static esp_err_t read_image(const esp_partition_t *src, mesh_ota_start_t *start, uint32_t *data) {
+    mesh_ota_image_header_t h;
+    *start = (mesh_ota_start_t){ .cmd = MESH_OTA_CMD_START, .block_size = MESH_OTA_BLOCK_SIZE };
+    esp_err_t err = esp_partition_read(src, 0, &h, sizeof(h));
+    if (err == ESP_OK && h.magic == MESH_OTA_IMAGE_MAGIC) {
+        if ((h.encoding != MESH_OTA_ENCODING_LZSS && h.encoding != MESH_OTA_ENCODING_DELTA) ||
+            h.chunk_count > MESH_OTA_MAX_CHUNKS) {
+            ESP_LOGE(OTA_TAG, "Encoded image in partition %s: encoding %u, %u chunks not supported", src->label,
+                     h.encoding, h.chunk_count);
+            return ESP_ERR_NOT_SUPPORTED;
+        }
+        err = esp_partition_read(src, sizeof(h), start->chunk_len, h.chunk_count * sizeof(uint16_t));
+        if (err != ESP_OK) {
+            return err;
+        }
+        uint32_t blocks = 0;
+        uint32_t len = 0;
+        for (int c = 0; c < h.chunk_count; c++) {
+            blocks += blocks_of(start->chunk_len[c]);
+            len += start->chunk_len[c];
+        }
+        *data = sizeof(h) + h.chunk_count * sizeof(uint16_t);
+        if (blocks > MESH_OTA_MAX_BLOCKS || *data + len > src->size) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+        start->image_size = h.image_size;
+        start->block_count = blocks;
+        memcpy(start->sha256, h.sha256, sizeof(h.sha256));
+        start->encoding = h.encoding;
+        start->window_bits = h.window_bits;
+        start->lookahead_bits = h.lookahead_bits;
+        start->chunk_size = h.chunk_size;
+        start->chunk_count = h.chunk_count;
+        memcpy(start->base_md5, h.base_md5, sizeof(h.base_md5));
+        ESP_LOGI(OTA_TAG, "%s image in partition %s: %lu bytes in %lu blocks instead of %u",
+                 h.encoding == MESH_OTA_ENCODING_DELTA ? "Delta" : "LZSS", src->label, h.image_size, blocks,
+                 blocks_of(h.image_size));
+        return ESP_OK;
+    }
+
+    esp_partition_pos_t pos = { .offset = src->address, .size = src->size };
+    esp_image_metadata_t meta;
+    if (esp_image_get_metadata(&pos, &meta) != ESP_OK || esp_partition_get_sha256(src, start->sha256) != ESP_OK) {
+        ESP_LOGE(OTA_TAG, "No valid image in partition %s", src->label);
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (meta.image_len > MESH_OTA_MAX_BLOCKS * MESH_OTA_BLOCK_SIZE) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    start->image_size = meta.image_len;
+    start->block_count = blocks_of(meta.image_len);
+    *data = 0;
     return ESP_OK;
 }
+
+esp_err_t mesh_ota_send_firmware(const char *label) {
+    if (s_mutex == NULL || !esp_mesh_is_root()) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    // An encoded image may sit in a data partition as well as in an app slot
+    const esp_partition_t *src = label ? esp_partition_find_first(ESP_PARTITION_TYPE_ANY, ESP_PARTITION_SUBTYPE_ANY,
+                                                                  label)
+                                       : esp_ota_get_running_partition();
+    if (src == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    mesh_ota_start_t *start = malloc(sizeof(mesh_ota_start_t));
+    if (start == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    uint32_t data;
+    esp_err_t err = read_image(src, start, &data);
+    if (err != ESP_OK) {
+        free(start);
+        return err;
+    }
+
+    // Every node of the mesh but this one
+    int table_size = esp_mesh_get_routing_table_size();
+    mesh_addr_t *table = calloc(table_size > 0 ? table_size : 1, sizeof(mesh_addr_t));
+    if (table == NULL) {
+        free(start);
+        return ESP_ERR_NO_MEM;
+    }
+    int n = 0;
+    esp_mesh_get_routing_table(table, table_size * sizeof(mesh_addr_t), &n);
+    uint8_t self[6];
+    esp_wifi_get_mac(WIFI_IF_STA, self);
+
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    if (s_rollout_running) {
+        xSemaphoreGive(s_mutex);
+        free(table);
+        free(start);
+        return ESP_ERR_INVALID_STATE;
+    }
+    free(s_targets);
+    s_targets = calloc(CONFIG_MESH_OTA_MAX_TARGETS, sizeof(ota_target_t));
+    s_num_targets = 0;
+    for (int i = 0; i < n && s_targets != NULL; i++) {
+        if (memcmp(table[i].addr, self, sizeof(self)) == 0) {
+            continue;
+        }
+        if (s_num_targets == CONFIG_MESH_OTA_MAX_TARGETS) {
+            ESP_LOGW(OTA_TAG, "More than %d nodes, the rest are left out", CONFIG_MESH_OTA_MAX_TARGETS);
+            break;
+        }
+        s_targets[s_num_targets++].report.addr = table[i];
+    }
+    free(table);
+    if (s_targets == NULL || s_num_targets == 0) {
+        xSemaphoreGive(s_mutex);
+        free(start);
+        return s_targets == NULL ? ESP_ERR_NO_MEM : ESP_ERR_NOT_FOUND;
+    }
+    s_src = src;
+    s_src_data = data;
+    s_start = *start;
+    free(start);
+    const uint8_t *sha = s_start.sha256;
+    s_start.session = sha[0] | sha[1] << 8 | sha[2] << 16 | (uint32_t)sha[3] << 24;
+    s_rollout_running = true;
+    xSemaphoreGive(s_mutex);
+
+    if (xTaskCreate(rollout_task, "MeshOTARoot", 4096, NULL, 4, &s_rollout_task) != pdPASS) {
+        s_rollout_running = false;
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+// Add the OTA group to the node's groups, keeping the others (RTK corrections)
+static esp_err_t join_group(void) {
+    mesh_addr_t groups[MAX_GROUPS];
+    int n = esp_mesh_get_group_num();
+    if (n < 0 || n >= MAX_GROUPS || esp_mesh_get_group_list(groups, n) != ESP_OK) {
+        n = 0;
+    }
+    for (int i = 0; i < n; i++) {
+        if (memcmp(groups[i].addr, s_group.addr, sizeof(s_group.addr)) == 0) {
+            return ESP_OK;
+        }
+    }
+    groups[n++] = s_group;
+    return esp_mesh_set_group_id(groups, n);
+}
+
+esp_err_t mesh_ota_init(const char *fw_md5) {
+    s_mutex = xSemaphoreCreateMutex();
+    if (s_mutex == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    s_rx_part = esp_ota_get_next_update_partition(NULL);
+    s_base_part = esp_ota_get_running_partition();
+    s_base_known = fw_md5 != NULL && strlen(fw_md5) == 2 * sizeof(s_base_md5);
+    for (int i = 0; i < sizeof(s_base_md5) && s_base_known; i++) {
+        unsigned v;
+        s_base_known = sscanf(fw_md5 + 2 * i, "%2x", &v) == 1;
+        s_base_md5[i] = v;
+    }
+    reset_slots();
+    esp_err_t err = ota_writer_init();
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    nvs_handle_t nvs;
+    size_t size = sizeof(s_rx);
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &nvs) == ESP_OK) {
+        if (nvs_get_blob(nvs, "progress", &s_rx, &size) != ESP_OK || size != sizeof(s_rx)) {
+            memset(&s_rx, 0, sizeof(s_rx));
+        }
+        nvs_close(nvs);
+    }
+    if (s_rx.session != 0 && s_rx.state == MESH_OTA_STATE_RECEIVING) {
+        resume_writer();
+        ESP_LOGI(OTA_TAG, "Resuming OTA session %08lx: %u of %u blocks, state %u", s_rx.session, s_rx.received,
+                 s_rx.block_count, s_rx.state);
+    }
+
+    err = join_group();
+    if (err != ESP_OK) {
+        ESP_LOGE(OTA_TAG, "Failed to join OTA group: 0x%x", err);
+    }
+    return err;
+}
+
+int mesh_ota_get_report(mesh_ota_target_report_t *reports, int max) {
+    if (s_mutex == NULL) {
+        return 0;
+    }
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    int n = s_num_targets < max ? s_num_targets : max;
+    for (int i = 0; i < n; i++) {
+        reports[i] = s_targets[i].report;
+    }
+    xSemaphoreGive(s_mutex);
+    return n;
+}
+
+void mesh_ota_log_report(void) {
+    static const char *states[] = { "no answer", "receiving", "complete", "current", "failed", "wrong base" };
+    static mesh_ota_target_report_t reports[CONFIG_MESH_OTA_MAX_TARGETS];
+    int n = mesh_ota_get_report(reports, CONFIG_MESH_OTA_MAX_TARGETS);
+    for (int i = 0; i < n; i++) {
+        const mesh_ota_target_report_t *r = &reports[i];
+        ESP_LOGI(OTA_TAG, "  "MACSTR" %s, %u of %u blocks, %lu resent, %lu ms, %lu B/s", MAC2STR(r->addr.addr),
+                 r->state < sizeof(states) / sizeof(states[0]) ? states[r->state] : "?", r->received,
+                 s_start.block_count, r->resent, r->duration_ms, r->throughput_bps);
+    }
+}
@@ -2,34 +2,112 @@
 #define MESH_OTA_H
 
 #include <stdint.h>
+#include <stddef.h>
 #include "esp_err.h"
-#include "esp_log.h"
-#include "esp_ota_ops.h"
 #include "esp_mesh.h"
-#include <string.h>
-#include "freertos/FreeRTOS.h"
-#include "freertos/task.h"
-
-// OTA message types
-typedef enum {
-    MESH_OTA_CMD_START = 1,
-    MESH_OTA_CMD_DATA = 2,
-    MESH_OTA_CMD_END = 3,
-    MESH_OTA_CMD_ACK = 4
-} mesh_ota_cmd_t;
-
-// OTA message structure
+
+// OTA_DATA messages (MeshOtaHeader and the struct of each command)
+#include "../protocol/protocol_gen.h"
+
+/*
+Root-driven mesh OTA.
+
+The root sends the image once to every target through the OTA group (multicast), in blocks of
+MESH_OTA_BLOCK_SIZE, and only resends what some target still misses:
+
+    root                                      targets (OTA group)
+    START(session, size, SHA-256)  -------->  start erasing ahead, or resume a saved session
+                                   <--------  ACK(state, bitmap of blocks received)
+    DATA(block) x CONFIG_MESH_OTA_WINDOW --->  block staged in RAM, flash written a sector at a time
+    STATUS                         -------->
+                                   <--------  ACK (after the blocks before it: the same worker)
+    ... next window, then further passes with only the blocks missing somewhere ...
+    END                            -------->  targets with the checked image boot it
+
+The session is the start of the image's SHA-256, so it survives a reboot of either side. Targets
+save their bitmap to NVS at each STATUS, once the staged blocks are on flash (ota_writer.h), and
+pick up where they were after a reboot; the flash keeps the blocks already written. A target runs the image only once every block is in and the hash
+of the partition matches; one already running it answers CURRENT and receives nothing.
+
+An image compressed by python/ota_image.py (written to a partition of the root, sent with its
+label) goes out as is: chunks of whole flash sectors, each LZSS-compressed on its own (ota_lzss.h)
+and sent in blocks of its own, so blocks of different chunks may still come in any order and be
+resent alone. A target decodes each chunk straight into the writer as its blocks come, in
+CONFIG_MESH_OTA_LZSS_SLOTS decoders of one window each (4 KB at most): a block past a gap in its
+chunk waits for the next pass, and a chunk pushed out of its decoder, or cut by a reboot, is
+received again from its first block. So the root makes its passes over one chunk at a time, then
+sweeps the image again from the first chunk for targets still missing some. The hash is still of
+the decoded image.
+
+A delta image (python/ota_image.py delta) is chunked the same way, but its chunks decode to ops
+that rebuild the image from the firmware the node runs (ota_delta.h): a release that changes
+little takes a few blocks per 60 KB of image. START names the base by its fw_md5; a node running
+anything else answers WRONG_BASE and receives nothing, like one already running the image.
+
+STATUS goes through the bulk queue behind the window's blocks, so a target's ACK also paces the
+root to the slowest flash writer. A target that misses a whole status round gets no more blocks
+until it answers again. Throughput per target (image bytes over the time to COMPLETE) is logged at
+the end of the rollout.
+*/
+
+#ifndef CONFIG_MESH_OTA_WINDOW
+#define CONFIG_MESH_OTA_WINDOW 32
+#endif
+#ifndef CONFIG_MESH_OTA_ACK_TIMEOUT_MS
+#define CONFIG_MESH_OTA_ACK_TIMEOUT_MS 2000
+#endif
+#ifndef CONFIG_MESH_OTA_MAX_PASSES
+#define CONFIG_MESH_OTA_MAX_PASSES 8
+#endif
+#ifndef CONFIG_MESH_OTA_MAX_TARGETS
+#define CONFIG_MESH_OTA_MAX_TARGETS 32
+#endif
+#ifndef CONFIG_MESH_OTA_LZSS_SLOTS
+#define CONFIG_MESH_OTA_LZSS_SLOTS 2
+#endif
+
+#define MESH_OTA_GROUP_ID { 0x01, 0x00, 0x5E, 0x00, 0x00, 0x02 }
+
 typedef struct {
-    mesh_ota_cmd_t cmd;
-    uint32_t offset;
-    uint32_t size;
-    uint8_t data[1024]; // Adjust as needed
-} mesh_ota_packet_t;
+    mesh_addr_t addr;
+    uint8_t state;          // mesh_ota_state_t, as last reported
+    uint16_t received;      // Blocks
+    uint32_t resent;        // Blocks sent again while this target missed them
+    uint32_t duration_ms;   // Rollout start to COMPLETE, 0 until then
+    uint32_t throughput_bps;    // Image bytes per second to COMPLETE
+} mesh_ota_target_report_t;
+
+/**
+ * @brief Load the saved progress of an interrupted transfer and join the OTA group (on top of any
+ * other group). Call once after nvs_flash_init() and esp_mesh_set_config().
+ *
+ * @param fw_md5 Fingerprint of the running firmware (device_config_t.fw_md5, hex): delta images
+ *        against any other base are refused, and a START of the image it starts is answered as
+ *        current without hashing the running partition.
+ */
+esp_err_t mesh_ota_init(const char *fw_md5);
+
+/**
+ * @brief Root: start sending an app image to every other node of the mesh, on a task of its own.
+ *
+ * @param label Partition holding the image, an app or one encoded by python/ota_image.py; NULL: the
+ *        running firmware.
+ * @return ESP_ERR_INVALID_STATE if this node is not the root or a rollout is running,
+ *         ESP_ERR_NOT_FOUND if there is no valid image or no other node.
+ */
+esp_err_t mesh_ota_send_firmware(const char *label);
 
-// Root node: start OTA update
-esp_err_t mesh_ota_send_firmware(const char *fw_path);
+/**
+ * @brief Handle an OTA_DATA payload (registered on the OTA worker: flash writes block).
+ */
+void mesh_ota_handle_packet(const mesh_addr_t *from, const void *payload, size_t payload_len);
 
-// Handle incoming OTA packets (dispatcher model)
-void mesh_ota_handle_packet(const mesh_ota_packet_t *pkt);
+/**
+ * @brief Root: progress of the current or last rollout.
+ *
+ * @return Number of targets written to `reports` (up to `max`).
+ */
+int mesh_ota_get_report(mesh_ota_target_report_t *reports, int max);
+void mesh_ota_log_report(void);
 
 #endif // MESH_OTA_H
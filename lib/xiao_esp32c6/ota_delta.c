@@ -0,0 +1,95 @@
+#include <string.h>
+#include "ota_delta.h"
+
+enum {
+    STATE_OP,
+    STATE_HEADER,
+    STATE_BODY,
+};
+
+void ota_delta_init(ota_delta_t *d, ota_delta_read_t read, void *ctx, uint32_t base_size, uint32_t cursor) {
+    memset(d, 0, sizeof(*d));
+    d->read = read;
+    d->ctx = ctx;
+    d->base_size = base_size;
+    d->cursor = cursor;
+    d->state = STATE_OP;
+}
+
+// Header complete: move the cursor, and check the op stays within the base
+static bool start_body(ota_delta_t *d) {
+    if (d->op == OTA_DELTA_INSERT) {
+        d->left = d->hdr[0] | d->hdr[1] << 8;
+        return true;
+    }
+    int32_t seek = (int32_t)(d->hdr[0] | d->hdr[1] << 8 | d->hdr[2] << 16 | (uint32_t)d->hdr[3] << 24);
+    d->left = d->hdr[4] | d->hdr[5] << 8;
+    int64_t cursor = (int64_t)d->cursor + seek;
+    if (cursor < 0 || cursor + d->left > d->base_size) {
+        return false;
+    }
+    d->cursor = (uint32_t)cursor;
+    return true;
+}
+
+size_t ota_delta_apply(ota_delta_t *d, const uint8_t **in, size_t *in_len, uint8_t *out, size_t out_len) {
+    size_t n = 0;
+    while (n < out_len && !d->error) {
+        if (d->state == STATE_OP) {
+            if (*in_len == 0) {
+                break;
+            }
+            d->op = *(*in)++;
+            (*in_len)--;
+            d->hdr_len = 0;
+            d->state = STATE_HEADER;
+            d->error = d->op > OTA_DELTA_INSERT;
+            continue;
+        }
+        if (d->state == STATE_HEADER) {
+            uint8_t size = d->op == OTA_DELTA_INSERT ? 2 : 6;
+            while (d->hdr_len < size && *in_len > 0) {
+                d->hdr[d->hdr_len++] = *(*in)++;
+                (*in_len)--;
+            }
+            if (d->hdr_len < size) {
+                break;
+            }
+            d->error = !start_body(d);
+            d->state = d->left > 0 ? STATE_BODY : STATE_OP;
+            continue;
+        }
+        // STATE_BODY: COPY needs no input, the others one byte per byte output
+        size_t k = out_len - n < d->left ? out_len - n : d->left;
+        if (d->op != OTA_DELTA_COPY && *in_len < k) {
+            k = *in_len;
+        }
+        if (k == 0) {
+            break;
+        }
+        if (d->op == OTA_DELTA_INSERT) {
+            memcpy(out + n, *in, k);
+        } else {
+            if (!d->read(d->ctx, d->cursor, out + n, k)) {
+                d->error = true;
+                break;
+            }
+            d->cursor += k;
+            if (d->op == OTA_DELTA_ADD) {
+                for (size_t i = 0; i < k; i++) {
+                    out[n + i] += (*in)[i];
+                }
+            }
+        }
+        if (d->op != OTA_DELTA_COPY) {
+            *in += k;
+            *in_len -= k;
+        }
+        n += k;
+        d->left -= k;
+        if (d->left == 0) {
+            d->state = STATE_OP;
+        }
+    }
+    return n;
+}
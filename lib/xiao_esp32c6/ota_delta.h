@@ -0,0 +1,62 @@
+#ifndef OTA_DELTA_H
+#define OTA_DELTA_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/*
+Streaming delta decoder: rebuilds firmware from the firmware already on flash (the base) and a
+stream of ops written by python/ota_image.py delta. Every op starts with its code, then
+little-endian fields:
+
+    OTA_DELTA_COPY    seek (i32), length (u16)              base bytes as they are
+    OTA_DELTA_ADD     seek (i32), length (u16), bytes       base bytes plus these, modulo 256
+    OTA_DELTA_INSERT  length (u16), bytes                   new bytes
+
+COPY and ADD read the base from its cursor moved by seek, and leave the cursor past what they read:
+code moved by a few bytes shows up as a small seek, and code that only changed its addresses as an
+ADD of mostly zeros, both of which compress well (the stream is LZSS-coded on the wire, ota_lzss.h).
+
+Like ota_lzss_decode(), ota_delta_apply() takes its input in pieces of any size and stops whenever
+the input or the output space runs out. The base is read through a callback, a piece of the output
+at a time, so the decoder itself needs no buffer. Plain C, no IDF.
+*/
+
+#define OTA_DELTA_COPY      0
+#define OTA_DELTA_ADD       1
+#define OTA_DELTA_INSERT    2
+
+/**
+ * @brief Read `len` base bytes at `offset` into `dst`.
+ */
+typedef bool (*ota_delta_read_t)(void *ctx, uint32_t offset, void *dst, size_t len);
+
+typedef struct {
+    ota_delta_read_t read;
+    void *ctx;
+    uint32_t base_size;
+    uint32_t cursor;        // Base offset of the next byte read
+    uint8_t state;          // Field expected next
+    uint8_t op;
+    uint8_t hdr_len;        // Header bytes of the op received so far
+    uint8_t hdr[6];
+    uint16_t left;          // Bytes of the op still to output
+    bool error;             // Unknown op, or read outside the base: nothing more is output
+} ota_delta_t;
+
+/**
+ * @brief Start a stream with the base cursor at `cursor`.
+ */
+void ota_delta_init(ota_delta_t *d, ota_delta_read_t read, void *ctx, uint32_t base_size, uint32_t cursor);
+
+/**
+ * @brief Apply ops from `*in` into `out` until either runs out.
+ *
+ * @param in, in_len Advanced past the bytes consumed.
+ * @return Bytes written to `out`: less than `out_len` only once the input is used up, or on error
+ *         (`error` set).
+ */
+size_t ota_delta_apply(ota_delta_t *d, const uint8_t **in, size_t *in_len, uint8_t *out, size_t out_len);
+
+#endif // OTA_DELTA_H
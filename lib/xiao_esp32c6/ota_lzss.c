@@ -0,0 +1,85 @@
+#include <string.h>
+#include "ota_lzss.h"
+
+enum {
+    STATE_TAG,
+    STATE_LITERAL,
+    STATE_DISTANCE,
+    STATE_COUNT,
+    STATE_COPY,
+};
+
+bool ota_lzss_init(ota_lzss_t *d, uint8_t window_bits, uint8_t lookahead_bits) {
+    if (window_bits < 4 || window_bits > OTA_LZSS_MAX_WINDOW_BITS || lookahead_bits < 2 ||
+        lookahead_bits >= window_bits) {
+        return false;
+    }
+    memset(d, 0, sizeof(*d));
+    d->window_bits = window_bits;
+    d->lookahead_bits = lookahead_bits;
+    d->state = STATE_TAG;
+    return true;
+}
+
+// Up to 12 bits; false until the input holds all of them
+static inline bool get_bits(ota_lzss_t *d, const uint8_t **in, size_t *in_len, uint8_t n, uint16_t *v) {
+    while (d->bit_count < n) {
+        if (*in_len == 0) {
+            return false;
+        }
+        d->bit_buf = d->bit_buf << 8 | *(*in)++;
+        (*in_len)--;
+        d->bit_count += 8;
+    }
+    d->bit_count -= n;
+    *v = (d->bit_buf >> d->bit_count) & ((1u << n) - 1);
+    return true;
+}
+
+size_t ota_lzss_decode(ota_lzss_t *d, const uint8_t **in, size_t *in_len, uint8_t *out, size_t out_len) {
+    uint16_t mask = (1u << d->window_bits) - 1;
+    size_t n = 0;
+    uint16_t v;
+    while (n < out_len) {
+        uint8_t byte;
+        switch (d->state) {
+            case STATE_TAG:
+                if (!get_bits(d, in, in_len, 1, &v)) {
+                    return n;
+                }
+                d->state = v ? STATE_LITERAL : STATE_DISTANCE;
+                continue;
+            case STATE_LITERAL:
+                if (!get_bits(d, in, in_len, 8, &v)) {
+                    return n;
+                }
+                byte = (uint8_t)v;
+                d->state = STATE_TAG;
+                break;
+            case STATE_DISTANCE:
+                if (!get_bits(d, in, in_len, d->window_bits, &v)) {
+                    return n;
+                }
+                d->distance = v;
+                d->state = STATE_COUNT;
+                continue;
+            case STATE_COUNT:
+                if (!get_bits(d, in, in_len, d->lookahead_bits, &v)) {
+                    return n;
+                }
+                d->count = v + OTA_LZSS_MIN_MATCH;
+                d->state = STATE_COPY;
+                continue;
+            default:    // STATE_COPY
+                byte = d->window[(d->head - d->distance - 1) & mask];
+                if (--d->count == 0) {
+                    d->state = STATE_TAG;
+                }
+                break;
+        }
+        d->window[d->head] = byte;
+        d->head = (d->head + 1) & mask;
+        out[n++] = byte;
+    }
+    return n;
+}
@@ -0,0 +1,55 @@
+#ifndef OTA_LZSS_H
+#define OTA_LZSS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/*
+Streaming LZSS decoder for compressed firmware (python/ota_image.py writes the other side).
+
+The stream is a sequence of bit fields, most significant bit first:
+
+    1, byte                                     literal
+    0, distance - 1 (window_bits), length - OTA_LZSS_MIN_MATCH (lookahead_bits)
+                                                copy from the last 2^window_bits bytes output
+
+The decoder keeps only the window, so its RAM is fixed by window_bits whatever the image size. It
+takes input in pieces of any size (a bit field may straddle two) and stops whenever the input or the
+output space runs out, to go on with the next call. No end marker: the caller knows how many bytes
+to expect and ignores the padding bits of the last byte.
+
+Plain C, no IDF: the host benchmark of ota_image.py builds this file as is.
+*/
+
+#define OTA_LZSS_MAX_WINDOW_BITS    12
+#define OTA_LZSS_MIN_MATCH          2
+
+typedef struct {
+    uint8_t window_bits;
+    uint8_t lookahead_bits;
+    uint8_t state;          // Field expected next
+    uint8_t bit_count;      // Bits not consumed yet in bit_buf
+    uint32_t bit_buf;
+    uint16_t distance;      // Of the copy in progress, minus 1
+    uint16_t count;         // Bytes left to copy
+    uint16_t head;          // Window position of the next byte output
+    uint8_t window[1 << OTA_LZSS_MAX_WINDOW_BITS];
+} ota_lzss_t;
+
+/**
+ * @brief Start a stream.
+ *
+ * @return false if window_bits is above OTA_LZSS_MAX_WINDOW_BITS or either size is unusable.
+ */
+bool ota_lzss_init(ota_lzss_t *d, uint8_t window_bits, uint8_t lookahead_bits);
+
+/**
+ * @brief Decode from `*in` into `out` until either runs out.
+ *
+ * @param in, in_len Advanced past the bytes consumed.
+ * @return Bytes written to `out`: less than `out_len` only once the input is used up.
+ */
+size_t ota_lzss_decode(ota_lzss_t *d, const uint8_t **in, size_t *in_len, uint8_t *out, size_t out_len);
+
+#endif // OTA_LZSS_H
@@ -0,0 +1,303 @@
+#include <string.h>
+#include "ota_writer.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+static const char *TAG = "ota_writer";
+
+#define PAGES_PER_SECTOR    (OTA_WRITER_SECTOR_SIZE / OTA_WRITER_PAGE_SIZE)
+#define BLOCK_SIZE          (64 * 1024)     // Erased with one command, several times faster than its sectors
+#define SECTORS_PER_BLOCK   (BLOCK_SIZE / OTA_WRITER_SECTOR_SIZE)
+
+_Static_assert(PAGES_PER_SECTOR <= 16, "page mask is 16 bits");
+
+typedef struct {
+    uint32_t sector;        // Index in the partition
+    uint16_t pages;         // Bit per page staged, whole or in part
+    uint16_t bytes;         // Staged: the sector is complete at its bytes within the image
+    uint8_t data[OTA_WRITER_SECTOR_SIZE];   // 0xFF where nothing is staged
+} stage_buf_t;
+
+static stage_buf_t s_bufs[CONFIG_MESH_OTA_STAGING_SECTORS];
+static QueueHandle_t s_free;        // Buffers ready to fill
+static QueueHandle_t s_full;        // Buffers for the writer task
+static stage_buf_t *s_filling[CONFIG_MESH_OTA_STAGING_SECTORS];    // Taken by the caller, oldest first
+static int s_num_filling;
+
+// Image, erased sectors and stats: held by the writer task for each flash operation. The caller
+// only takes it to start an image or read stats; s_err and the waits count are atomic.
+static SemaphoreHandle_t s_lock;
+static const esp_partition_t *s_part;
+static uint32_t s_size;
+static uint32_t s_sectors;
+static uint32_t s_erase_next;       // Next sector to look at for erasing ahead
+static bool s_hold;                 // No erasing ahead before the first write: sectors may be set erased
+static uint8_t s_erased[OTA_WRITER_MAX_SECTORS / 8];
+static esp_err_t s_err;
+static ota_writer_stats_t s_stats;
+static bool s_started;              // Writer task running
+
+static inline bool bit_get(const uint8_t *map, uint32_t i) {
+    return map[i / 8] & (1u << (i % 8));
+}
+
+static inline void bit_set(uint8_t *map, uint32_t i) {
+    map[i / 8] |= 1u << (i % 8);
+}
+
+static inline void set_err(esp_err_t err) {
+    esp_err_t ok = ESP_OK;
+    __atomic_compare_exchange_n(&s_err, &ok, err, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
+// Call with s_lock held
+static esp_err_t erase_sectors(uint32_t sector, uint32_t count) {
+    esp_err_t err = esp_partition_erase_range(s_part, sector * OTA_WRITER_SECTOR_SIZE, count * OTA_WRITER_SECTOR_SIZE);
+    for (uint32_t i = 0; i < count && err == ESP_OK; i++) {
+        bit_set(s_erased, sector + i);
+    }
+    return err;
+}
+
+// Call with s_lock held: the whole 64 KB block when it is aligned, in the partition and untouched
+static void erase_ahead(uint32_t sector) {
+    uint32_t count = 1;
+    if (sector % SECTORS_PER_BLOCK == 0 && s_part->address % BLOCK_SIZE == 0 &&
+        (sector + SECTORS_PER_BLOCK) * OTA_WRITER_SECTOR_SIZE <= s_part->size &&
+        sector + SECTORS_PER_BLOCK <= OTA_WRITER_MAX_SECTORS) {
+        count = SECTORS_PER_BLOCK;
+        for (uint32_t i = 0; i < SECTORS_PER_BLOCK; i++) {
+            if (bit_get(s_erased, sector + i)) {
+                count = 1;
+                break;
+            }
+        }
+    }
+    esp_err_t err = erase_sectors(sector, count);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Sector %lu: erase error 0x%x", sector, err);
+        set_err(err);
+    }
+    s_stats.erased_ahead += count;
+}
+
+// Call with s_lock held
+static esp_err_t program(const stage_buf_t *buf) {
+    esp_err_t err = ESP_OK;
+    if (!bit_get(s_erased, buf->sector)) {
+        err = erase_sectors(buf->sector, 1);
+        s_stats.erased_on_write++;
+    }
+    // One write per run of staged pages: a whole sector when it came complete
+    uint32_t base = buf->sector * OTA_WRITER_SECTOR_SIZE;
+    int p = 0;
+    while (p < PAGES_PER_SECTOR && err == ESP_OK) {
+        if (!(buf->pages & (1u << p))) {
+            p++;
+            continue;
+        }
+        int end = p;
+        while (end < PAGES_PER_SECTOR && (buf->pages & (1u << end))) {
+            end++;
+        }
+        err = esp_partition_write(s_part, base + p * OTA_WRITER_PAGE_SIZE, buf->data + p * OTA_WRITER_PAGE_SIZE,
+                                  (end - p) * OTA_WRITER_PAGE_SIZE);
+        s_stats.flash_writes++;
+        p = end;
+    }
+    s_stats.sectors_written++;
+    return err;
+}
+
+static void writer_task(void *arg) {
+    while (true) {
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        while (s_erase_next < s_sectors && bit_get(s_erased, s_erase_next)) {
+            s_erase_next++;
+        }
+        bool pending =
+            __atomic_load_n(&s_err, __ATOMIC_RELAXED) == ESP_OK && !s_hold && s_erase_next < s_sectors;
+        xSemaphoreGive(s_lock);
+
+        // Writes first; erase ahead only when there is none, a block at a time
+        stage_buf_t *buf;
+        if (!xQueueReceive(s_full, &buf, pending ? 0 : portMAX_DELAY)) {
+            xSemaphoreTake(s_lock, portMAX_DELAY);
+            if (!s_hold && s_erase_next < s_sectors && !bit_get(s_erased, s_erase_next)) {
+                erase_ahead(s_erase_next);
+            }
+            xSemaphoreGive(s_lock);
+            continue;
+        }
+        if (buf == NULL) {
+            continue;   // New image: look for sectors to erase
+        }
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        if (__atomic_load_n(&s_err, __ATOMIC_RELAXED) == ESP_OK) {
+            esp_err_t err = program(buf);
+            if (err != ESP_OK) {
+                ESP_LOGE(TAG, "Sector %lu: flash error 0x%x", buf->sector, err);
+                set_err(err);
+            }
+        }
+        xSemaphoreGive(s_lock);
+
+        buf->pages = 0;
+        buf->bytes = 0;
+        memset(buf->data, 0xFF, sizeof(buf->data));
+        xQueueSend(s_free, &buf, portMAX_DELAY);
+    }
+}
+
+static void submit(int i) {
+    stage_buf_t *buf = s_filling[i];
+    memmove(&s_filling[i], &s_filling[i + 1], (s_num_filling - i - 1) * sizeof(s_filling[0]));
+    s_num_filling--;
+    xQueueSend(s_full, &buf, portMAX_DELAY);    // Never full: as long as the buffer count
+}
+
+// Staging buffer for `sector`: the one filling it, else a free one
+static stage_buf_t *stage_for(uint32_t sector) {
+    for (int i = 0; i < s_num_filling; i++) {
+        if (s_filling[i]->sector == sector) {
+            return s_filling[i];
+        }
+    }
+    stage_buf_t *buf;
+    if (!xQueueReceive(s_free, &buf, 0)) {
+        // Make room: the oldest sector goes to flash as it is
+        if (s_num_filling == CONFIG_MESH_OTA_STAGING_SECTORS) {
+            submit(0);
+        }
+        __atomic_fetch_add(&s_stats.waits, 1, __ATOMIC_RELAXED);
+        xQueueReceive(s_free, &buf, portMAX_DELAY);
+    }
+    buf->sector = sector;
+    s_filling[s_num_filling++] = buf;
+    return buf;
+}
+
+// Bytes of `sector` within the image
+static uint32_t sector_bytes(uint32_t sector) {
+    uint32_t left = s_size - sector * OTA_WRITER_SECTOR_SIZE;
+    return left < OTA_WRITER_SECTOR_SIZE ? left : OTA_WRITER_SECTOR_SIZE;
+}
+
+esp_err_t ota_writer_write(uint32_t offset, const void *data, size_t len) {
+    if (offset > s_size || len > s_size - offset) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (s_hold) {
+        // Wake the writer task to start erasing ahead
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        s_hold = false;
+        xSemaphoreGive(s_lock);
+        stage_buf_t *none = NULL;
+        xQueueSend(s_full, &none, 0);
+    }
+    const uint8_t *src = data;
+    while (len > 0) {
+        uint32_t sector = offset / OTA_WRITER_SECTOR_SIZE;
+        uint32_t in = offset % OTA_WRITER_SECTOR_SIZE;
+        size_t n = OTA_WRITER_SECTOR_SIZE - in < len ? OTA_WRITER_SECTOR_SIZE - in : len;
+        stage_buf_t *buf = stage_for(sector);
+        memcpy(buf->data + in, src, n);
+        uint32_t first = in / OTA_WRITER_PAGE_SIZE;
+        uint32_t last = (in + n - 1) / OTA_WRITER_PAGE_SIZE;
+        buf->pages |= (uint16_t)(((1u << (last + 1)) - 1) & ~((1u << first) - 1));
+        buf->bytes += n;
+        // Counted, not masked: a write may cover part of a page (bytes written twice count twice,
+        // at worst sending the sector early)
+        if (buf->bytes >= sector_bytes(sector)) {
+            for (int i = 0; i < s_num_filling; i++) {
+                if (s_filling[i] == buf) {
+                    submit(i);
+                    break;
+                }
+            }
+        }
+        offset += n;
+        src += n;
+        len -= n;
+    }
+    return __atomic_load_n(&s_err, __ATOMIC_RELAXED);
+}
+
+esp_err_t ota_writer_flush(void) {
+    while (s_num_filling > 0) {
+        submit(0);
+    }
+    // Every buffer back in the free queue: nothing staged is left in RAM
+    stage_buf_t *bufs[CONFIG_MESH_OTA_STAGING_SECTORS];
+    for (int i = 0; i < CONFIG_MESH_OTA_STAGING_SECTORS; i++) {
+        xQueueReceive(s_free, &bufs[i], portMAX_DELAY);
+    }
+    for (int i = 0; i < CONFIG_MESH_OTA_STAGING_SECTORS; i++) {
+        xQueueSend(s_free, &bufs[i], portMAX_DELAY);
+    }
+    return __atomic_load_n(&s_err, __ATOMIC_RELAXED);
+}
+
+esp_err_t ota_writer_begin(const esp_partition_t *part, uint32_t size) {
+    uint32_t sectors = (size + OTA_WRITER_SECTOR_SIZE - 1) / OTA_WRITER_SECTOR_SIZE;
+    if (size > part->size || sectors > OTA_WRITER_MAX_SECTORS) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    ota_writer_flush();
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_part = part;
+    s_size = size;
+    s_sectors = sectors;
+    s_erase_next = 0;
+    s_hold = true;
+    s_err = ESP_OK;
+    memset(s_erased, 0, sizeof(s_erased));
+    xSemaphoreGive(s_lock);
+    return ESP_OK;
+}
+
+void ota_writer_set_erased(uint32_t offset) {
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    bit_set(s_erased, offset / OTA_WRITER_SECTOR_SIZE);
+    xSemaphoreGive(s_lock);
+}
+
+esp_err_t ota_writer_init(void) {
+    if (s_started) {
+        return ESP_OK;
+    }
+    s_lock = xSemaphoreCreateMutex();
+    s_free = xQueueCreate(CONFIG_MESH_OTA_STAGING_SECTORS, sizeof(stage_buf_t *));
+    // One more slot: the first write of an image wakes the task with a NULL entry
+    s_full = xQueueCreate(CONFIG_MESH_OTA_STAGING_SECTORS + 1, sizeof(stage_buf_t *));
+    if (s_lock == NULL || s_free == NULL || s_full == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    for (int i = 0; i < CONFIG_MESH_OTA_STAGING_SECTORS; i++) {
+        stage_buf_t *buf = &s_bufs[i];
+        memset(buf->data, 0xFF, sizeof(buf->data));
+        xQueueSend(s_free, &buf, 0);
+    }
+    // Below the OTA worker: staging a block always comes before flash work
+    if (xTaskCreate(writer_task, "OTAWrite", 3072, NULL, 3, NULL) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    s_started = true;
+    return ESP_OK;
+}
+
+void ota_writer_get_stats(ota_writer_stats_t *stats) {
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    *stats = s_stats;
+    xSemaphoreGive(s_lock);
+}
+
+void ota_writer_log_stats(void) {
+    ota_writer_stats_t st;
+    ota_writer_get_stats(&st);
+    ESP_LOGI(TAG, "sectors written:%lu flash writes:%lu erased ahead:%lu erased on write:%lu waits:%lu",
+             st.sectors_written, st.flash_writes, st.erased_ahead, st.erased_on_write, st.waits);
+}
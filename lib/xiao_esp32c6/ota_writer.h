@@ -0,0 +1,84 @@
+#ifndef OTA_WRITER_H
+#define OTA_WRITER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "esp_partition.h"
+
+/*
+Sector-staged writes of a firmware image into an OTA partition.
+
+ota_writer_write() copies data into one of CONFIG_MESH_OTA_STAGING_SECTORS RAM buffers of one
+flash sector each and returns: the caller never waits for flash unless every buffer is busy. A
+buffer goes to the writer task once every byte of its sector (within the image) is staged, or
+when a write for another sector needs the buffer, so a sector is erased and programmed in one go
+while the next one fills. Data may come in any order and in any size; a sector staged in several
+pieces is programmed only on the pages each piece covers (0xFF padding leaves the rest erased), and
+a page split between two pieces is programmed twice: programming only clears bits, so the 0xFF
+over the other part changes nothing.
+
+When it has nothing to write, the writer task erases the image ahead, in 64 KB blocks where the
+partition allows (one block erase takes a fraction of the time of its 16 sector erases), so writes
+rarely pay for an erase. Sectors already erased for this image (holding data before a
+reboot) are marked with ota_writer_set_erased() and never erased again: erasing ahead starts with
+the first write, so mark them before that.
+
+ota_writer_flush() returns once everything staged is on flash: call it before recording progress
+anywhere that survives a reboot. One task calls the write side at a time.
+*/
+
+#ifndef CONFIG_MESH_OTA_STAGING_SECTORS
+#define CONFIG_MESH_OTA_STAGING_SECTORS 4
+#endif
+
+#define OTA_WRITER_SECTOR_SIZE  4096
+#define OTA_WRITER_PAGE_SIZE    256
+#define OTA_WRITER_MAX_SECTORS  1024    // 4 MB image
+
+typedef struct {
+    uint32_t sectors_written;   // Staged buffers programmed
+    uint32_t flash_writes;      // esp_partition_write calls: one per run of staged pages
+    uint32_t erased_ahead;      // By the writer task while idle
+    uint32_t erased_on_write;   // Not erased ahead in time: the write paid for it
+    uint32_t waits;             // Caller blocked for a free buffer
+} ota_writer_stats_t;
+
+/**
+ * @brief Allocate the staging buffers and start the writer task. Once started, later calls do nothing:
+ * the task and its buffers stay, and ota_writer_begin() starts each image afresh.
+ */
+esp_err_t ota_writer_init(void);
+
+/**
+ * @brief Flush anything staged, then start an image of `size` bytes in `part` with no sector
+ * erased yet. The writer task starts erasing ahead with the first write.
+ *
+ * @return ESP_ERR_INVALID_SIZE if the image does not fit the partition or OTA_WRITER_MAX_SECTORS.
+ */
+esp_err_t ota_writer_begin(const esp_partition_t *part, uint32_t size);
+
+/**
+ * @brief The sector holding `offset` was erased for this image already (resuming after a reboot).
+ * Call before the first ota_writer_write() of the image.
+ */
+void ota_writer_set_erased(uint32_t offset);
+
+/**
+ * @brief Stage image bytes at `offset`. Blocks only while every staging buffer is being written.
+ *
+ * @return First flash error of this image so far, ESP_ERR_INVALID_SIZE past the image end.
+ */
+esp_err_t ota_writer_write(uint32_t offset, const void *data, size_t len);
+
+/**
+ * @brief Wait until everything staged is on flash.
+ *
+ * @return First flash error of this image, if any.
+ */
+esp_err_t ota_writer_flush(void);
+
+void ota_writer_get_stats(ota_writer_stats_t *stats);
+void ota_writer_log_stats(void);
+
+#endif // OTA_WRITER_H
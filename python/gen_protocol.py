@@ -0,0 +1,410 @@
+"""Generate the C and Python code of every mesh packet and telemetry struct from protocol_schema.json.
+
+    python python/gen_protocol.py           # rewrite the generated files
+    python python/gen_protocol.py --check   # exit 1 if any of them is stale
+
+Each entry of "headers" becomes one C header, and everything goes into python/protocol_gen.py. All of
+them are checked in; rerun after editing the schema.
+
+Struct layouts:
+  "wire"    Byte-packed little-endian, with generated encode/decode functions (packet headers).
+  native    The C compiler's layout with natural alignment (the default). The generator computes the
+            same layout, so the Python format strings include the padding, and emits _Static_asserts on
+            the size and on every padded offset so the two can never drift apart. "packed": true refuses
+            any padding, which keeps payloads that are sent as raw structs free of holes.
+
+Fields: "count" makes an array (a number or a constant name), "tail": true marks the variable-length
+array ending a payload (the Python decoder takes whatever is present), "c_type" overrides the C type,
+"bits" splits a wire field, and "ubx_offset" gives the byte offset in the UBX payload (ubx_decoder.c).
+"""
+import json
+import os
+import sys
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+ROOT = os.path.dirname(HERE)
+SCHEMA = os.path.join(HERE, "protocol_schema.json")
+PY_OUT = os.path.join(HERE, "protocol_gen.py")
+
+# schema type: (struct format char, size, C type, numpy type)
+TYPES = {
+    "u8": ("B", 1, "uint8_t", "u1"),
+    "i8": ("b", 1, "int8_t", "i1"),
+    "u16": ("H", 2, "uint16_t", "<u2"),
+    "i16": ("h", 2, "int16_t", "<i2"),
+    "u32": ("I", 4, "uint32_t", "<u4"),
+    "i32": ("i", 4, "int32_t", "<i4"),
+    "u64": ("Q", 8, "uint64_t", "<u8"),
+    "i64": ("q", 8, "int64_t", "<i8"),
+}
+
+UBX_TYPES = {"u8": "UBX_U1", "i8": "UBX_I1", "u16": "UBX_U2", "i16": "UBX_I2", "u32": "UBX_U4", "i32": "UBX_I4"}
+
+GENERATED = "Generated by python/gen_protocol.py from python/protocol_schema.json. Do not edit."
+
+COMMENT_COLUMN = 28
+
+
+def fail(msg):
+    raise SystemExit(f"protocol_schema.json: {msg}")
+
+
+def doc_lines(doc):
+    if not doc:
+        return []
+    return doc if isinstance(doc, list) else [doc]
+
+
+def with_comment(text, doc, column=COMMENT_COLUMN):
+    if not doc:
+        return text
+    return f"{text.ljust(column - 1)} // {doc}" if len(text) < column - 1 else f"{text} // {doc}"
+
+
+class Layout:
+    """Offsets, padding and format of one struct, computed the way the C compiler lays it out."""
+
+    def __init__(self, st, structs, constants):
+        self.st = st
+        self.wire = st.get("layout") == "wire"
+        self.items = []     # (field, offset, count, element size) in order
+        self.pads = []      # (offset, bytes) in order, for the format string
+        self.padded = set() # fields placed after padding
+        offset, align = 0, 1
+        for i, f in enumerate(st["fields"]):
+            count = f.get("count", 1)
+            if isinstance(count, str):
+                if count not in constants:
+                    fail(f"{st['name']}.{f['name']}: unknown count {count}")
+                count = int(str(constants[count]), 0)
+            if f.get("tail") and i != len(st["fields"]) - 1:
+                fail(f"{st['name']}.{f['name']}: only the last field can be a tail")
+            if f["type"] in TYPES:
+                size = falign = TYPES[f["type"]][1]
+            elif f["type"] in structs:
+                if not f.get("tail"):
+                    fail(f"{st['name']}.{f['name']}: struct fields must be the tail")
+                size, falign = structs[f["type"]].size, structs[f["type"]].align
+            else:
+                fail(f"{st['name']}.{f['name']}: unknown type {f['type']}")
+            if "bits" in f:
+                if not self.wire:
+                    fail(f"{st['name']}.{f['name']}: bit fields need the wire layout")
+                if sum(b["width"] for b in f["bits"]) > 8 * size:
+                    fail(f"{st['name']}.{f['name']}: bit fields wider than {f['type']}")
+            if not self.wire:
+                pad = -offset % falign
+                if pad:
+                    self.pads.append((offset, pad))
+                    self.padded.add(f["name"])
+                    offset += pad
+                align = max(align, falign)
+            self.items.append((f, offset, count, size))
+            offset += count * size
+        if not self.wire and offset % align:
+            self.pads.append((offset, align - offset % align))
+            offset += align - offset % align
+        self.size, self.align = offset, align
+        if st.get("packed") and self.pads:
+            fail(f"{st['name']}: packed but padded at offset {self.pads[0][0]}")
+        tail = self.items[-1] if self.items and self.items[-1][0].get("tail") else None
+        self.head_size = tail[1] if tail else self.size
+
+    def tokens(self, structs, head_only=False):
+        """Format string tokens as (count, char), padding included."""
+        out, pads = [], list(self.pads)
+        for f, offset, count, size in self.items:
+            while pads and pads[0][0] < offset:
+                out.append((pads.pop(0)[1], "x"))
+            if head_only and f.get("tail"):
+                return out
+            if f["type"] in structs:
+                for _ in range(count):
+                    out += structs[f["type"]].tokens(structs)
+            elif f["type"] == "u8" and count > 1:
+                out.append((count, "s"))
+            else:
+                out.append((count, TYPES[f["type"]][0]))
+        out += [(n, "x") for _, n in pads]
+        return out
+
+    def format(self, structs, head_only=False):
+        merged = []
+        for n, c in self.tokens(structs, head_only):
+            if merged and merged[-1][1] == c and c != "s":
+                merged[-1] = (merged[-1][0] + n, c)
+            else:
+                merged.append((n, c))
+        return "<" + "".join(f"{n if n > 1 else ''}{c}" for n, c in merged)
+
+
+def snake(macro):
+    return macro.lower()
+
+
+def gen_constants(items):
+    out = []
+    width = max(len(c["name"]) for c in items) + 1
+    for c in items:
+        out.append(with_comment(f"#define {c['name'].ljust(width)}{c['value']}", c.get("doc"),
+                                len("#define ") + width + 8))
+    return out
+
+
+def gen_enum(enum):
+    out = [f"// {line}" for line in doc_lines(enum.get("doc"))]
+    out.append("typedef enum {" if enum.get("name") else "enum {")
+    for v in enum["values"]:
+        out.append(with_comment(f"    {v['name']} = {v['value']},", v.get("doc")))
+    out.append(f"}} {enum['name']};" if enum.get("name") else "};")
+    return out
+
+
+def gen_wire_struct(st, layout):
+    upper, cname = st["macro"], st["c_type"][:-2]
+    out = [f"// {line}" for line in doc_lines(st.get("doc"))]
+    out.append(f"#define {upper}_NAME \"{st['name']}\"")
+    out.append(f"#define {upper}_SIZE {layout.size}")
+    out.append(f"#define {upper}_FORMAT \"{layout.format({})}\"")
+    out.append("")
+    out.append("typedef struct {")
+    for f in st["fields"]:
+        if "bits" in f:
+            for b in f["bits"]:
+                ctype = "uint8_t" if b["width"] <= 8 else "uint16_t" if b["width"] <= 16 else "uint32_t"
+                out.append(with_comment(f"    {ctype} {b['name']};", b.get("doc")))
+        else:
+            out.append(with_comment(f"    {TYPES[f['type']][2]} {f['name']};", f.get("doc")))
+    out.append(f"}} {st['c_type']};")
+    out.append("")
+
+    enc = [f"static inline void {cname}_encode(const {st['c_type']} *s, uint8_t *out) {{"]
+    dec = [f"static inline void {cname}_decode(const uint8_t *in, {st['c_type']} *s) {{"]
+    for f, pos, _, size in layout.items:
+        utype = f"uint{max(8 * size, 32)}_t" if size < 8 else "uint64_t"
+        if "bits" in f:
+            parts, shift = [], 0
+            for b in f["bits"]:
+                parts.append(f"(s->{b['name']} & 0x{(1 << b['width']) - 1:X}) << {shift}")
+                shift += b["width"]
+            value = f"({utype})(" + " | ".join(parts) + ")"
+        else:
+            value = f"({utype})s->{f['name']}"
+        enc.append(f"    {{ {utype} v = {value};")
+        enc.append("      " + " ".join(f"out[{pos + i}] = (uint8_t)(v >> {8 * i});" for i in range(size)) + " }")
+        raw = " | ".join(f"({utype})in[{pos + i}] << {8 * i}" for i in range(size))
+        if "bits" in f:
+            dec.append(f"    {{ {utype} v = {raw};")
+            shift = 0
+            for b in f["bits"]:
+                dec.append(f"      s->{b['name']} = (v >> {shift}) & 0x{(1 << b['width']) - 1:X};")
+                shift += b["width"]
+            dec.append("    }")
+        else:
+            dec.append(f"    s->{f['name']} = ({TYPES[f['type']][2]})({raw});")
+    enc.append("}")
+    dec.append("}")
+    return out + enc + [""] + dec
+
+
+def gen_native_struct(st, layout, structs):
+    upper = st["macro"]
+    out = [f"// {line}" for line in doc_lines(st.get("doc"))]
+    out.append(f"typedef struct {st['name']} {{")
+    for f in st["fields"]:
+        if f["type"] in TYPES:
+            ctype = f.get("c_type", TYPES[f["type"]][2])
+        else:
+            ctype = structs[f["type"]].st["c_type"]
+        array = f"[{f['count']}]" if "count" in f else ""
+        out.append(with_comment(f"    {ctype} {f['name']}{array};", f.get("doc")))
+    out.append(f"}} {st['c_type']};")
+    out.append("")
+    out.append(f"#define {upper}_NAME \"{st['name']}\"")
+    out.append(f"#define {upper}_SIZE {layout.size}")
+    out.append(f"#define {upper}_FORMAT \"{layout.format(structs)}\"")
+    if "ubx" in st:
+        ubx = st["ubx"]
+        out.append(f"#define {upper}_CLASS {ubx['msg_class']}")
+        out.append(f"#define {upper}_ID {ubx['msg_id']}")
+        out.append(f"#define {upper}_PAYLOAD_LEN {ubx['payload_len']}")
+        out.append(f"#define {upper}_VERSION {ubx.get('version', 'UBX_NO_VERSION')}")
+        out.append(f"// X({st['c_type']}, member, payload offset, ubx_field_type_t) per decoded field")
+        out.append(f"#define {upper}_FIELDS(X) \\")
+        for i, f in enumerate(st["fields"]):
+            if f["type"] not in UBX_TYPES or "ubx_offset" not in f or "count" in f:
+                fail(f"{st['name']}.{f['name']}: UBX fields need a 1, 2 or 4 byte type and ubx_offset")
+            end = " \\" if i < len(st["fields"]) - 1 else ""
+            out.append(f"    X({st['c_type']}, {f['name']}, {f['ubx_offset']}, {UBX_TYPES[f['type']]}){end}")
+    why = f"\"{st['name']} layout (protocol_schema.json)\""
+    out.append(f"_Static_assert(sizeof({st['c_type']}) == {upper}_SIZE, {why});")
+    for f, offset, _, _ in layout.items:
+        if f["name"] in layout.padded:
+            out.append(f"_Static_assert(offsetof({st['c_type']}, {f['name']}) == {offset}, {why});")
+    return out
+
+
+def gen_header(header, layouts, structs):
+    name = os.path.basename(header["path"])
+    guard = name.replace(".", "_").upper()
+    out = [f"// {GENERATED}"]
+    out += [f"// {line}" for line in doc_lines(header.get("doc"))]
+    out += [f"#ifndef {guard}", f"#define {guard}", "", "#include <stdint.h>"]
+    if any(st.get("layout") != "wire" for st in header.get("structs", [])):
+        out.append("#include <stddef.h>")
+    out.append("")
+    for t in header.get("typedefs", []):
+        out += [f"// {line}" for line in doc_lines(t.get("doc"))]
+        out += [f"typedef {TYPES[t['type']][2]} {t['name']};", ""]
+    for enum in header.get("enums", []):
+        out += gen_enum(enum) + [""]
+    if header.get("constants"):
+        out += gen_constants(header["constants"]) + [""]
+    for st in header.get("structs", []):
+        if st.get("layout") == "wire":
+            out += gen_wire_struct(st, layouts[st["name"]])
+        else:
+            out += gen_native_struct(st, layouts[st["name"]], structs)
+        out.append("")
+    out.append(f"#endif // {guard}")
+    return "\n".join(out) + "\n"
+
+
+def py_value_exprs(st, layout, structs):
+    """Python expressions building the decoded dict from `v` (the unpacked head)."""
+    exprs, index = [], 0
+    for f, offset, count, _ in layout.items:
+        if f.get("tail"):
+            if f["type"] in structs:
+                sub = structs[f["type"]]
+                size = f"{sub.st['macro']}_SIZE"
+                exprs.append((f["name"], f"[decode_{snake(sub.st['macro'])}(buf, o) for o in "
+                                          f"range(offset + {offset}, len(buf) - {size} + 1, {size})]"))
+            else:
+                exprs.append((f["name"], f"bytes(buf[offset + {offset}:])"))
+        elif "bits" in f:
+            shift = 0
+            for b in f["bits"]:
+                exprs.append((b["name"], f"(v[{index}] >> {shift}) & 0x{(1 << b['width']) - 1:X}"))
+                shift += b["width"]
+            index += 1
+        elif count > 1 and f["type"] != "u8":
+            exprs.append((f["name"], f"list(v[{index}:{index + count}])"))
+            index += count
+        else:
+            exprs.append((f["name"], f"v[{index}]"))
+            index += 1
+    return exprs
+
+
+def py_dtype(st, layout):
+    if layout.head_size != layout.size:
+        return None
+    names, formats, offsets = [], [], []
+    for f, offset, count, _ in layout.items:
+        np_type = TYPES[f["type"]][3]
+        names.append(f["name"])
+        formats.append(f"({count},){np_type}" if count > 1 else np_type)
+        offsets.append(offset)
+    return {"names": names, "formats": formats, "offsets": offsets, "itemsize": layout.size}
+
+
+def gen_py(schema, layouts, structs):
+    out = [f'"""{GENERATED}', "",
+           "decode_<struct>(buf, offset=0) returns a dict; DECODERS maps the struct names logged by",
+           "PROTOCOL_LOG_BASE64 to them. For bulk decoding, <STRUCT>_STRUCT.iter_unpack() or",
+           "numpy.frombuffer(data, dtype=numpy.dtype(DTYPES[name])) take many records at once.",
+           '"""', "import struct", ""]
+    for header in schema["headers"]:
+        if not header.get("enums") and not header.get("constants"):
+            continue
+        out.append(f"# {os.path.basename(header['path'])}")
+        for enum in header.get("enums", []):
+            out += [f"{v['name']} = {v['value']}" for v in enum["values"]]
+        out += [f"{c['name']} = {c['value']}" for c in header.get("constants", [])]
+        out.append("")
+    names = []
+    for header in schema["headers"]:
+        for st in header.get("structs", []):
+            layout, upper = layouts[st["name"]], st["macro"]
+            fmt = layout.format(structs, head_only=True)
+            out.append("")
+            out.append(f"{upper}_STRUCT = struct.Struct(\"{fmt}\")")
+            out.append(f"{upper}_SIZE = {layout.size}")
+            dtype = py_dtype(st, layout)
+            if dtype:
+                out.append(f"{upper}_DTYPE = {dtype!r}")
+            if "ubx" in st:
+                out.append(f"{upper}_CLASS = {st['ubx']['msg_class']}")
+                out.append(f"{upper}_ID = {st['ubx']['msg_id']}")
+            out.append("")
+            out.append("")
+            out.append(f"def decode_{snake(upper)}(buf, offset=0):")
+            docs = doc_lines(st.get("doc"))
+            if docs:
+                out.append(f'    """{" ".join(docs)}"""')
+            if layout.head_size:
+                out.append(f"    v = {upper}_STRUCT.unpack_from(buf, offset)")
+            out.append("    return {")
+            for name, expr in py_value_exprs(st, layout, structs):
+                out.append(f"        {name!r}: {expr},")
+            out.append("    }")
+            out.append("")
+            names.append((st["name"], upper, dtype is not None, layout.format(structs)))
+    out.append("")
+    out.append("# Struct name as logged by PROTOCOL_LOG_BASE64 -> (decoder, size)")
+    out.append("DECODERS = {")
+    out += [f"    {name!r}: (decode_{snake(upper)}, {upper}_SIZE)," for name, upper, _, _ in names]
+    out.append("}")
+    out.append("")
+    out.append("# Struct name -> format string logged with it (the whole C struct)")
+    out.append("FORMATS = {")
+    out += [f"    {name!r}: \"{fmt}\"," for name, _, _, fmt in names]
+    out.append("}")
+    out.append("")
+    out.append("# Struct name -> numpy dtype description (fixed-size structs)")
+    out.append("DTYPES = {")
+    out += [f"    {name!r}: {upper}_DTYPE," for name, upper, has_dtype, _ in names if has_dtype]
+    out.append("}")
+    return "\n".join(out) + "\n"
+
+
+def generate(schema):
+    constants, structs, layouts = {}, {}, {}
+    for header in schema["headers"]:
+        constants.update({c["name"]: c["value"] for c in header.get("constants", [])})
+        for st in header.get("structs", []):
+            if st["name"] in structs:
+                fail(f"{st['name']} defined twice")
+            layouts[st["name"]] = structs[st["name"]] = Layout(st, structs, constants)
+    files = {os.path.join(ROOT, h["path"]): gen_header(h, layouts, structs) for h in schema["headers"]}
+    files[PY_OUT] = gen_py(schema, layouts, structs)
+    return files
+
+
+def main():
+    with open(SCHEMA) as f:
+        schema = json.load(f)
+    files = generate(schema)
+    if "--check" in sys.argv[1:]:
+        stale = []
+        for path, text in files.items():
+            try:
+                with open(path) as f:
+                    if f.read() == text:
+                        continue
+            except FileNotFoundError:
+                pass
+            stale.append(os.path.relpath(path, ROOT))
+        if stale:
+            print("Stale, rerun python/gen_protocol.py: " + ", ".join(stale))
+            sys.exit(1)
+        return
+    for path, text in files.items():
+        with open(path, "w") as f:
+            f.write(text)
+        print(f"Wrote {os.path.relpath(path, ROOT)}")
+
+
+if __name__ == "__main__":
+    main()
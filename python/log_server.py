@@ -5,26 +5,11 @@ import base64
 import struct
 import re
 
+from protocol_gen import DECODERS, FORMATS
+
 HOST = ''  # Listen on all interfaces
 PORT = 9000  # You can change this port if needed
 
-# Map struct names to their Python struct format strings and field names
-STRUCT_FORMATS = {
-    "UBXNavPVT": {
-        "format": "<IH6BIi4B4i2I5i2I2HIihH",
-        "fields": [
-            "iTOW", "year", "month", "day", "hour", "min", "sec", "valid", "tAcc", "nano", "fixType", "flags", "flags2", "numSV", "lon", "lat", "height", "hMSL", "hAcc", "vAcc", "velN", "velE", "velD", "gSpeed", "headMot", "sAcc", "headAcc", "pDOP", "flags3", "reserved0", "headVeh", "magDec", "magAcc"
-        ]
-    },
-    "UBXNavSVIN": {
-        "format": "<B3x2I3i3bx2I2B2x",
-        "fields": [
-            "version", "iTOW", "dur", "meanX", "meanY", "meanZ", "meanXHP", "meanYHP", "meanZHP", "meanAcc", "obs", "valid", "active"
-        ]
-    },
-    # Add more as needed
-}
-
 def parse_and_print_struct(struct_name, fmt, fields, b64data):
     try:
         bin_data = base64.b64decode(b64data)
@@ -39,6 +24,16 @@ def parse_and_print_struct(struct_name, fmt, fields, b64data):
     except Exception as e:
         print(f"  [ERROR] Could not decode/parse struct: {e}")
 
+def decode_generated(struct_name, b64data):
+    decoder, size = DECODERS[struct_name]
+    try:
+        bin_data = base64.b64decode(b64data)
+        print(f"  Decoded {struct_name}:")
+        for name, v in decoder(bin_data[:size]).items():
+            print(f"    {name}: {v}")
+    except Exception as e:
+        print(f"  [ERROR] Could not decode/parse struct: {e}")
+
 class LogHandler(socketserver.BaseRequestHandler):
     def handle(self):
         client_ip = self.client_address[0]
@@ -63,9 +58,8 @@ class LogHandler(socketserver.BaseRequestHandler):
                     if m:
                         struct_name, fmt, length, b64data = m.groups()
                         print(f"  [DATA_TAG] Struct: {struct_name}, Format: {fmt}, Length: {length}")
-                        struct_info = STRUCT_FORMATS.get(struct_name)
-                        if struct_info and struct_info["format"] == fmt:
-                            parse_and_print_struct(struct_name, struct_info["format"], struct_info["fields"], b64data)
+                        if struct_name in DECODERS and FORMATS[struct_name] == fmt:
+                            decode_generated(struct_name, b64data)
                         else:
                             print("  [DATA_TAG] Unknown struct or format mismatch, raw decode:")
                             parse_and_print_struct(struct_name, fmt, [f"field_{i}" for i in range(int(length))], b64data)
@@ -0,0 +1,513 @@
+"""Build encoded firmware images for the mesh OTA (lib/xiao_esp32c6/mesh_ota.h).
+
+    python python/ota_image.py compress firmware.bin -o firmware.mota
+    python python/ota_image.py delta old.bin firmware.bin -o firmware.mota
+    python python/ota_image.py bench firmware.bin      # ratio and decoder speed per setting
+
+An encoded image is a MeshOtaImageHeader, u16 chunk_len[chunk_count], then the chunks back to back.
+The image is cut into chunks of chunk_size bytes, each compressed on its own (LZSS, ota_lzss.h) so a
+node can decode a chunk as soon as its blocks are in, whatever the order of the others; a chunk that
+does not shrink is stored as is (chunk_len equal to its image bytes). Write the file to a partition of
+the root and pass its label to mesh_ota_send_firmware().
+
+A delta image (ota_delta.h) is encoded the same way, but each chunk holds the ops that rebuild it
+from the firmware the nodes run, read from their running partition. Nodes whose fw_md5 (the
+FW_REPORT of each node, device_config_t: the start of the image SHA-256) is not the one in the
+header refuse it.
+
+The header carries the SHA-256 esp_partition_get_sha256() gives for the decoded image in an app
+partition: the digest appended to the image when it has one, else the hash of the whole file.
+"""
+import argparse
+import ctypes
+import hashlib
+import itertools
+import os
+import struct
+import subprocess
+import sys
+import tempfile
+import time
+
+from protocol_gen import (MESH_OTA_BLOCK_SIZE, MESH_OTA_ENCODING_DELTA, MESH_OTA_ENCODING_LZSS,
+                          MESH_OTA_IMAGE_HEADER_SIZE, MESH_OTA_IMAGE_HEADER_STRUCT, MESH_OTA_IMAGE_MAGIC,
+                          MESH_OTA_MAX_BLOCKS, MESH_OTA_MAX_CHUNKS, decode_mesh_ota_image_header)
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+ROOT = os.path.dirname(HERE)
+DECODER_C = os.path.join(ROOT, "lib", "xiao_esp32c6", "ota_lzss.c")
+
+MIN_MATCH = 2           # OTA_LZSS_MIN_MATCH
+MAX_WINDOW_BITS = 12    # OTA_LZSS_MAX_WINDOW_BITS
+SECTOR_SIZE = 4096
+MAX_CHAIN = 64          # Match candidates tried per position
+
+DELTA_COPY, DELTA_ADD, DELTA_INSERT = 0, 1, 2   # ota_delta.h
+DELTA_KEY = 8           # Bytes of a base match seed
+DELTA_SAMPLE = 4        # Base positions indexed: every DELTA_SAMPLE-th
+DELTA_MISMATCH = 4      # Score of a differing byte in a match, against +1 for an equal one
+DELTA_MIN_COPY = 12     # Shorter equal runs stay in an ADD
+
+
+def image_sha256(image):
+    """esp_partition_get_sha256() of an app partition holding `image`."""
+    esp_image_magic, hash_appended_offset = 0xE9, 23
+    if len(image) > 32 and image[0] == esp_image_magic and image[hash_appended_offset] == 1:
+        return bytes(image[-32:])
+    return hashlib.sha256(image).digest()
+
+
+class BitWriter:
+    def __init__(self):
+        self.out = bytearray()
+        self.acc = 0
+        self.bits = 0
+
+    def put(self, value, n):
+        self.acc = (self.acc << n) | value
+        self.bits += n
+        while self.bits >= 8:
+            self.bits -= 8
+            self.out.append((self.acc >> self.bits) & 0xFF)
+        self.acc &= (1 << self.bits) - 1
+
+    def finish(self):
+        if self.bits:
+            self.out.append((self.acc << (8 - self.bits)) & 0xFF)
+        return bytes(self.out)
+
+
+def lzss_compress(data, window_bits, lookahead_bits):
+    """Greedy LZSS with one step of lazy matching, hash chains on 3-byte prefixes."""
+    window = 1 << window_bits
+    max_len = (1 << lookahead_bits) - 1 + MIN_MATCH
+    n = len(data)
+    chains = {}
+    w = BitWriter()
+
+    def longest(i):
+        best_len, best_dist = 0, 0
+        limit = min(max_len, n - i)
+        if limit < 3:
+            return best_len, best_dist
+        cands = chains.get(data[i:i + 3])
+        if not cands:
+            return best_len, best_dist
+        tries = 0
+        for p in reversed(cands):
+            dist = i - p
+            if dist > window or tries == MAX_CHAIN:
+                break
+            tries += 1
+            if best_len and data[p + best_len] != data[i + best_len]:
+                continue
+            length = 3
+            while length < limit and data[p + length] == data[i + length]:
+                length += 1
+            if length > best_len:
+                best_len, best_dist = length, dist
+                if length == limit:
+                    break
+        return best_len, best_dist
+
+    def insert(i):
+        if i + 3 <= n:
+            chains.setdefault(data[i:i + 3], []).append(i)
+
+    i = 0
+    pending = None
+    while i < n:
+        length, dist = pending if pending else longest(i)
+        pending = None
+        if length >= 3 and i + 1 < n:
+            insert(i)
+            nxt = longest(i + 1)
+            if nxt[0] > length:
+                # A literal now buys a longer match at the next byte
+                w.put(1, 1)
+                w.put(data[i], 8)
+                i += 1
+                pending = nxt
+                continue
+            for k in range(i + 1, i + length):
+                insert(k)
+        else:
+            insert(i)
+        if length >= 3:
+            w.put(0, 1)
+            w.put(dist - 1, window_bits)
+            w.put(length - MIN_MATCH, lookahead_bits)
+            i += length
+        else:
+            w.put(1, 1)
+            w.put(data[i], 8)
+            i += 1
+    return w.finish()
+
+
+def lzss_stream(comp, window_bits, lookahead_bits):
+    """Reference decoder (ota_lzss.c is the one that counts): the decoded bytes, one at a time."""
+    out = bytearray()
+    acc = bits = pos = 0
+
+    def get(n):
+        nonlocal acc, bits, pos
+        while bits < n:
+            acc = (acc << 8) | comp[pos]
+            pos += 1
+            bits += 8
+        bits -= n
+        v = (acc >> bits) & ((1 << n) - 1)
+        acc &= (1 << bits) - 1
+        return v
+
+    while True:
+        if get(1):
+            out.append(get(8))
+            yield out[-1]
+        else:
+            dist = get(window_bits) + 1
+            for _ in range(get(lookahead_bits) + MIN_MATCH):
+                # A window of zeros before the first byte, as in the C decoder
+                out.append(out[-dist] if dist <= len(out) else 0)
+                yield out[-1]
+
+
+def lzss_decompress(comp, size, window_bits, lookahead_bits):
+    return bytes(itertools.islice(lzss_stream(comp, window_bits, lookahead_bits), size))
+
+
+def delta_index(base):
+    """Base positions by their first DELTA_KEY bytes, a few of the last ones per key."""
+    index = {}
+    for q in range(0, len(base) - DELTA_KEY + 1, DELTA_SAMPLE):
+        index.setdefault(base[q:q + DELTA_KEY], []).append(q)
+    for key, qs in index.items():
+        if len(qs) > 4:
+            index[key] = qs[-4:]
+    return index
+
+
+def delta_extend(new, base, p, q, end):
+    """Length of the best approximate match of new[p:end] at base[q:] (bsdiff-like: scored equal
+    bytes minus DELTA_MISMATCH per differing one), and its score."""
+    limit = min(end - p, len(base) - q)
+    i = score = best_len = best_score = 0
+    while i < limit:
+        if new[p + i] == base[q + i]:
+            j = i + 1
+            while j + 32 <= limit and new[p + j:p + j + 32] == base[q + j:q + j + 32]:
+                j += 32
+            while j < limit and new[p + j] == base[q + j]:
+                j += 1
+            score += j - i
+            i = j
+            if score > best_score:
+                best_len, best_score = i, score
+        else:
+            score -= DELTA_MISMATCH
+            i += 1
+            if score < best_score - 32:
+                break
+    return best_len, best_score
+
+
+def delta_ops(new, base, index, start, end):
+    """Ops rebuilding new[start:end] from base, the cursor starting at `start`."""
+    ops = bytearray()
+    cursor = start
+    disp = 0                # Base minus new offset of the last match: code moved by that much
+    p = insert_from = start
+
+    def flush_insert(to):
+        if to > insert_from:
+            ops.extend(struct.pack("<BH", DELTA_INSERT, to - insert_from))
+            ops.extend(new[insert_from:to])
+
+    while p < end:
+        cands = {p + disp}
+        for j in range(DELTA_SAMPLE):
+            for q in index.get(new[p + j:p + j + DELTA_KEY], ()):
+                if q >= j:
+                    cands.add(q - j)
+        best = (0, 0, 0)
+        for q in cands:
+            if 0 <= q < len(base):
+                length, score = delta_extend(new, base, p, q, end)
+                if score > best[1]:
+                    best = (length, score, q)
+        length, score, q = best
+        if score < 2 * DELTA_KEY:
+            p += 1
+            continue
+        flush_insert(p)
+        # Equal runs as COPY, the rest as ADD; only the first op moves the cursor
+        i = 0
+        seek = q - cursor
+        while i < length:
+            j = i
+            while j < length and new[p + j] == base[q + j]:
+                j += 1
+            if j - i >= DELTA_MIN_COPY or j == length:
+                ops.extend(struct.pack("<BiH", DELTA_COPY, seek, j - i))
+            else:
+                # ADD up to the next equal run long enough for a COPY
+                j = i
+                run = 0
+                while j < length and run < DELTA_MIN_COPY:
+                    run = run + 1 if new[p + j] == base[q + j] else 0
+                    j += 1
+                if run == DELTA_MIN_COPY:
+                    j -= run
+                ops.extend(struct.pack("<BiH", DELTA_ADD, seek, j - i))
+                ops.extend((new[p + k] - base[q + k]) & 0xFF for k in range(i, j))
+            seek = 0
+            i = j
+        cursor = q + length
+        disp = q - p
+        p += length
+        insert_from = p
+    flush_insert(end)
+    return bytes(ops)
+
+
+def delta_apply(ops, base, cursor, size):
+    """Reference for ota_delta.c: `size` bytes from an iterator of op bytes."""
+    out = bytearray()
+
+    def take(n):
+        return bytes(itertools.islice(ops, n))
+
+    while len(out) < size:
+        op = next(ops)
+        if op == DELTA_INSERT:
+            (n,) = struct.unpack("<H", take(2))
+            out += take(n)
+            continue
+        seek, n = struct.unpack("<iH", take(6))
+        cursor += seek
+        if op == DELTA_COPY:
+            out += base[cursor:cursor + n]
+        else:
+            out += bytes((b + d) & 0xFF for b, d in zip(base[cursor:cursor + n], take(n)))
+        cursor += n
+    return bytes(out)
+
+
+def encode(image, window_bits, lookahead_bits, chunk_size, base=None, base_md5=bytes(16)):
+    """The encoded image file, and its chunk lengths. With a base: a delta image against it."""
+    chunks = [image[i:i + chunk_size] for i in range(0, len(image), chunk_size)]
+    if len(chunks) > MESH_OTA_MAX_CHUNKS:
+        raise ValueError(f"{len(chunks)} chunks, at most {MESH_OTA_MAX_CHUNKS}: use larger chunks")
+    index = delta_index(base) if base is not None else None
+    lens, bodies = [], []
+    for c, chunk in enumerate(chunks):
+        if base is not None:
+            start = c * chunk_size
+            chunk_ops = delta_ops(image, base, index, start, start + len(chunk))
+            comp = lzss_compress(chunk_ops, window_bits, lookahead_bits)
+            # New code with nothing like it in the base: no worse than compressing the chunk
+            plain = lzss_compress(struct.pack("<BH", DELTA_INSERT, len(chunk)) + chunk, window_bits, lookahead_bits)
+            if len(plain) < len(comp):
+                comp = plain
+        else:
+            comp = lzss_compress(chunk, window_bits, lookahead_bits)
+        if len(comp) >= len(chunk):
+            comp = chunk
+        lens.append(len(comp))
+        bodies.append(comp)
+    blocks = sum((n + MESH_OTA_BLOCK_SIZE - 1) // MESH_OTA_BLOCK_SIZE for n in lens)
+    if blocks > MESH_OTA_MAX_BLOCKS:
+        raise ValueError(f"{blocks} blocks, at most {MESH_OTA_MAX_BLOCKS}")
+    encoding = MESH_OTA_ENCODING_DELTA if base is not None else MESH_OTA_ENCODING_LZSS
+    header = MESH_OTA_IMAGE_HEADER_STRUCT.pack(MESH_OTA_IMAGE_MAGIC, encoding, window_bits, lookahead_bits, 0,
+                                               len(image), chunk_size, len(chunks), image_sha256(image),
+                                               base_md5)
+    table = struct.pack(f"<{len(lens)}H", *lens)
+    return header + table + b"".join(bodies), lens
+
+
+def decode(encoded, base=None):
+    """Decoded image of an encoded file, with the reference decoders."""
+    h = decode_mesh_ota_image_header(encoded)
+    if h["magic"] != MESH_OTA_IMAGE_MAGIC or h["encoding"] not in (MESH_OTA_ENCODING_LZSS, MESH_OTA_ENCODING_DELTA):
+        raise ValueError("not an encoded image")
+    if h["encoding"] == MESH_OTA_ENCODING_DELTA and base is None:
+        raise ValueError("a delta image decodes only with its base")
+    lens = struct.unpack_from(f"<{h['chunk_count']}H", encoded, MESH_OTA_IMAGE_HEADER_SIZE)
+    pos = MESH_OTA_IMAGE_HEADER_SIZE + 2 * h["chunk_count"]
+    out = bytearray()
+    for c, n in enumerate(lens):
+        size = min(h["chunk_size"], h["image_size"] - c * h["chunk_size"])
+        body = encoded[pos:pos + n]
+        if n == size:
+            out += body
+        elif h["encoding"] == MESH_OTA_ENCODING_DELTA:
+            out += delta_apply(lzss_stream(body, h["window_bits"], h["lookahead_bits"]), base,
+                               c * h["chunk_size"], size)
+        else:
+            out += lzss_decompress(body, size, h["window_bits"], h["lookahead_bits"])
+        pos += n
+    return bytes(out)
+
+
+def blocks_of(lens):
+    return sum((n + MESH_OTA_BLOCK_SIZE - 1) // MESH_OTA_BLOCK_SIZE for n in lens)
+
+
+def check_settings(window_bits, lookahead_bits, chunk_size):
+    if not 4 <= window_bits <= MAX_WINDOW_BITS or not 2 <= lookahead_bits < window_bits:
+        raise ValueError(f"window bits 4..{MAX_WINDOW_BITS}, lookahead bits 2..window bits - 1")
+    if chunk_size % SECTOR_SIZE or not 0 < chunk_size <= 0xFFFF - SECTOR_SIZE + 1:
+        raise ValueError(f"chunk size: a multiple of {SECTOR_SIZE} up to 60 KB")
+
+
+def cmd_compress(args):
+    check_settings(args.window, args.lookahead, args.chunk)
+    with open(args.image, "rb") as f:
+        image = f.read()
+    encoded, lens = encode(image, args.window, args.lookahead, args.chunk)
+    if decode(encoded) != image:
+        sys.exit("internal error: the encoded image does not decode back")
+    out = args.output or os.path.splitext(args.image)[0] + ".mota"
+    with open(out, "wb") as f:
+        f.write(encoded)
+    raw_blocks = (len(image) + MESH_OTA_BLOCK_SIZE - 1) // MESH_OTA_BLOCK_SIZE
+    print(f"{out}: {len(image)} -> {len(encoded)} bytes ({100 * len(encoded) / len(image):.1f}%), "
+          f"{blocks_of(lens)} blocks instead of {raw_blocks}, {len(lens)} chunks, "
+          f"sha256 {image_sha256(image).hex()}")
+
+
+def base_fingerprint(base, args):
+    """fw_md5 of the base as the nodes report it (get_running_firmware_fingerprint()): --base-md5,
+    else the first 16 bytes of the image SHA-256."""
+    if args.base_md5:
+        md5 = bytes.fromhex(args.base_md5)
+        if len(md5) != 16:
+            raise ValueError("--base-md5: 32 hex digits")
+        return md5
+    return image_sha256(base)[:16]
+
+
+def cmd_delta(args):
+    check_settings(args.window, args.lookahead, args.chunk)
+    with open(args.base, "rb") as f:
+        base = f.read()
+    with open(args.image, "rb") as f:
+        image = f.read()
+    base_md5 = base_fingerprint(base, args)
+    start = time.perf_counter()
+    encoded, lens = encode(image, args.window, args.lookahead, args.chunk, base, base_md5)
+    elapsed = time.perf_counter() - start
+    if decode(encoded, base) != image:
+        sys.exit("internal error: the delta image does not decode back")
+    out = args.output or os.path.splitext(args.image)[0] + ".mota"
+    with open(out, "wb") as f:
+        f.write(encoded)
+    raw_blocks = (len(image) + MESH_OTA_BLOCK_SIZE - 1) // MESH_OTA_BLOCK_SIZE
+    _, lzss_lens = encode(image, args.window, args.lookahead, args.chunk)
+    print(f"{out}: {len(image)} bytes as a delta of {len(encoded)} bytes against base fw_md5 {base_md5.hex()}")
+    print(f"  {blocks_of(lens)} blocks: {raw_blocks / blocks_of(lens):.1f}x fewer than raw ({raw_blocks}), "
+          f"{blocks_of(lzss_lens) / blocks_of(lens):.1f}x fewer than compressed ({blocks_of(lzss_lens)}); "
+          f"{len(lens)} chunks, encoded in {elapsed:.1f} s")
+
+
+def build_decoder():
+    """ota_lzss.c as a host shared library, or None without a C compiler."""
+    tmp = tempfile.mkdtemp()
+    lib = os.path.join(tmp, "ota_lzss.so")
+    try:
+        subprocess.run([os.environ.get("CC", "cc"), "-O2", "-shared", "-fPIC", DECODER_C, "-o", lib],
+                       check=True, capture_output=True)
+    except (OSError, subprocess.CalledProcessError) as e:
+        print(f"No decoder speed: cannot build {DECODER_C} ({e})")
+        return None
+    return ctypes.CDLL(lib)
+
+
+def decode_speed(lib, encoded, repeat=3):
+    """Host MB/s of ota_lzss.c decoding every chunk in 256-byte pieces, as mesh_ota.c does."""
+    h = decode_mesh_ota_image_header(encoded)
+    lens = struct.unpack_from(f"<{h['chunk_count']}H", encoded, MESH_OTA_IMAGE_HEADER_SIZE)
+    state = ctypes.create_string_buffer((1 << MAX_WINDOW_BITS) + 64)
+    out = ctypes.create_string_buffer(256)
+    best = None
+    for _ in range(repeat):
+        pos = MESH_OTA_IMAGE_HEADER_SIZE + 2 * len(lens)
+        start = time.perf_counter()
+        for c, n in enumerate(lens):
+            size = min(h["chunk_size"], h["image_size"] - c * h["chunk_size"])
+            if n == size:
+                pos += n
+                continue
+            lib.ota_lzss_init(state, h["window_bits"], h["lookahead_bits"])
+            buf = ctypes.create_string_buffer(encoded[pos:pos + n], n)
+            inp = ctypes.c_void_p(ctypes.addressof(buf))
+            left = ctypes.c_size_t(n)
+            while size > 0:
+                got = lib.ota_lzss_decode(state, ctypes.byref(inp), ctypes.byref(left), out, min(256, size))
+                size -= got
+                if got == 0:
+                    break
+            pos += n
+        elapsed = time.perf_counter() - start
+        best = elapsed if best is None else min(best, elapsed)
+    return h["image_size"] / best / 1e6
+
+
+def cmd_bench(args):
+    with open(args.image, "rb") as f:
+        image = f.read()
+    lib = build_decoder()
+    if lib is not None:
+        lib.ota_lzss_decode.restype = ctypes.c_size_t
+    raw_blocks = (len(image) + MESH_OTA_BLOCK_SIZE - 1) // MESH_OTA_BLOCK_SIZE
+    print(f"{args.image}: {len(image)} bytes, {raw_blocks} blocks raw")
+    print("window lookahead  chunk   ratio  blocks  decoder RAM  host decode MB/s")
+    for window_bits in args.windows:
+        for lookahead_bits in args.lookaheads:
+            for chunk_size in args.chunks:
+                check_settings(window_bits, lookahead_bits, chunk_size)
+                encoded, lens = encode(image, window_bits, lookahead_bits, chunk_size)
+                speed = f"{decode_speed(lib, encoded):.0f}" if lib is not None else "-"
+                print(f"{window_bits:6} {lookahead_bits:9} {chunk_size // 1024:5}K {len(encoded) / len(image):7.3f} "
+                      f"{blocks_of(lens):7} {1 << window_bits:10} B {speed:>17}")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    sub = parser.add_subparsers(dest="command", required=True)
+    p = sub.add_parser("compress", help="LZSS-encode an app image")
+    p.add_argument("image")
+    p.add_argument("-o", "--output", help="default: the image name with .mota")
+    p.add_argument("--window", type=int, default=11, help="window bits (default 11: 2 KB)")
+    p.add_argument("--lookahead", type=int, default=4, help="lookahead bits (default 4)")
+    p.add_argument("--chunk", type=int, default=8192,
+                   help="image bytes per chunk (default 8192: a lost block costs the rest of its chunk for a pass)")
+    p.set_defaults(func=cmd_compress)
+    p = sub.add_parser("delta", help="delta image against the firmware the nodes run")
+    p.add_argument("base", help="app image the nodes run")
+    p.add_argument("image")
+    p.add_argument("-o", "--output", help="default: the image name with .mota")
+    p.add_argument("--base-md5", help="fw_md5 the nodes report for the base (FW_REPORT); default: taken from "
+                                      "the base image as they do")
+    p.add_argument("--window", type=int, default=11, help="window bits (default 11: 2 KB)")
+    p.add_argument("--lookahead", type=int, default=4, help="lookahead bits (default 4)")
+    p.add_argument("--chunk", type=int, default=61440,
+                   help="image bytes per chunk (default 61440: a delta chunk takes a block or two)")
+    p.set_defaults(func=cmd_delta)
+    p = sub.add_parser("bench", help="ratio and decoder speed for a range of settings")
+    p.add_argument("image")
+    p.add_argument("--windows", type=int, nargs="+", default=[8, 10, 11, 12])
+    p.add_argument("--lookaheads", type=int, nargs="+", default=[4, 5])
+    p.add_argument("--chunks", type=int, nargs="+", default=[8192, 16384])
+    p.set_defaults(func=cmd_bench)
+    args = parser.parse_args()
+    try:
+        args.func(args)
+    except ValueError as e:
+        sys.exit(str(e))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,661 @@
+"""Generated by python/gen_protocol.py from python/protocol_schema.json. Do not edit.
+
+decode_<struct>(buf, offset=0) returns a dict; DECODERS maps the struct names logged by
+PROTOCOL_LOG_BASE64 to them. For bulk decoding, <STRUCT>_STRUCT.iter_unpack() or
+numpy.frombuffer(data, dtype=numpy.dtype(DTYPES[name])) take many records at once.
+"""
+import struct
+
+# wire_gen.h
+WIRE_VERSION_1 = 0
+WIRE_VERSION_2 = 2
+WIRE_FLAG_CRC = 1
+WIRE_FLAG_TIME = 2
+WIRE_TIME_UNIT_US = 100
+
+# protocol_gen.h
+NETWORK_DATA = 0
+RTK_DATA = 1
+ROBOT_DATA = 2
+PTP_DATA = 3
+MASTER_CLOCK_DATA = 4
+OTA_DATA = 5
+ECHO_DATA = 6
+FW_QUERY = 7
+FW_REPORT = 8
+RX_STATS_QUERY = 9
+RX_STATS_REPORT = 10
+AGGREGATE = 11
+FRAGMENT = 12
+FRAG_NACK = 13
+BOOT_REPORT = 14
+PTP_MSG_SYNC = 0
+PTP_MSG_FOLLOW_UP = 1
+PTP_MSG_DELAY_REQ = 2
+PTP_MSG_DELAY_RESP = 3
+MESH_OTA_CMD_START = 1
+MESH_OTA_CMD_DATA = 2
+MESH_OTA_CMD_END = 3
+MESH_OTA_CMD_ACK = 4
+MESH_OTA_CMD_STATUS = 5
+MESH_OTA_STATE_IDLE = 0
+MESH_OTA_STATE_RECEIVING = 1
+MESH_OTA_STATE_COMPLETE = 2
+MESH_OTA_STATE_CURRENT = 3
+MESH_OTA_STATE_FAILED = 4
+MESH_OTA_STATE_WRONG_BASE = 5
+MESH_OTA_ENCODING_RAW = 0
+MESH_OTA_ENCODING_LZSS = 1
+MESH_OTA_ENCODING_DELTA = 2
+BOOT_PHASE_DELAY = 0
+BOOT_PHASE_CONFIG = 1
+BOOT_PHASE_FINGERPRINT = 2
+BOOT_PHASE_NETIF = 3
+BOOT_PHASE_BATTERY = 4
+BOOT_PHASE_MESH_TX = 5
+BOOT_PHASE_SERIAL = 6
+BOOT_PHASE_ANTENNA = 7
+BOOT_PHASE_WIFI = 8
+BOOT_PHASE_MESH_CONFIG = 9
+BOOT_PHASE_OTA = 10
+BOOT_PHASE_MESH_START = 11
+BOOT_PHASE_PARENT_CONNECTED = 12
+BOOT_PHASE_GOT_IP = 13
+BOOT_PHASE_FIRST_CORRECTION = 14
+RTK_DATA_MAX_PAYLOAD = 1448
+RTK_DATA_FLAG_LAST_PART = 0x01
+RX_STATS_MAX_TYPES = 16
+RX_STATS_REPORT_ENTRIES = 13
+RX_STATS_HIST_BUCKETS = 8
+MESH_OTA_BLOCK_SIZE = 1024
+MESH_OTA_MAX_BLOCKS = 4096
+MESH_OTA_BITMAP_SIZE = 512
+MESH_OTA_MAX_CHUNKS = 512
+MESH_OTA_IMAGE_MAGIC = 0x41544F4D
+MESH_FRAG_MAX_FRAGMENTS = 32
+ROBOT_DATA_MAX_PAYLOAD = 4096
+MASTER_CLOCK_DATA_MAX_PAYLOAD = 4096
+BOOT_PHASE_COUNT = 15
+BOOT_FLAG_FAST = 0x01
+
+
+WIRE_HEADER_V1_STRUCT = struct.Struct("<2H")
+WIRE_HEADER_V1_SIZE = 4
+WIRE_HEADER_V1_DTYPE = {'names': ['type', 'length'], 'formats': ['<u2', '<u2'], 'offsets': [0, 2], 'itemsize': 4}
+
+
+def decode_wire_header_v1(buf, offset=0):
+    """Original packet header (ProtocolHeader_t)"""
+    v = WIRE_HEADER_V1_STRUCT.unpack_from(buf, offset)
+    return {
+        'type': v[0],
+        'length': v[1],
+    }
+
+
+WIRE_HEADER_V2_STRUCT = struct.Struct("<2B3H")
+WIRE_HEADER_V2_SIZE = 8
+WIRE_HEADER_V2_DTYPE = {'names': ['type', 'ver_flags', 'length', 'seq', 'timestamp'], 'formats': ['u1', 'u1', '<u2', '<u2', '<u2'], 'offsets': [0, 1, 2, 4, 6], 'itemsize': 8}
+
+
+def decode_wire_header_v2(buf, offset=0):
+    """Compact v2 header. Byte 1 is the high byte of a v1 type, so v1 nodes see an unknown type and drop it"""
+    v = WIRE_HEADER_V2_STRUCT.unpack_from(buf, offset)
+    return {
+        'type': v[0],
+        'flags': (v[1] >> 0) & 0x1F,
+        'version': (v[1] >> 5) & 0x7,
+        'length': v[2],
+        'seq': v[3],
+        'timestamp': v[4],
+    }
+
+
+PROTOCOL_HEADER_STRUCT = struct.Struct("<2H")
+PROTOCOL_HEADER_SIZE = 4
+PROTOCOL_HEADER_DTYPE = {'names': ['type', 'length'], 'formats': ['<u2', '<u2'], 'offsets': [0, 2], 'itemsize': 4}
+
+
+def decode_protocol_header(buf, offset=0):
+    """v1 packet header (WireHeaderV1)"""
+    v = PROTOCOL_HEADER_STRUCT.unpack_from(buf, offset)
+    return {
+        'type': v[0],
+        'length': v[1],
+    }
+
+
+NETWORK_DATA_STRUCT = struct.Struct("<IH2x")
+NETWORK_DATA_SIZE = 8
+NETWORK_DATA_DTYPE = {'names': ['send_count', 'battery_voltage'], 'formats': ['<u4', '<u2'], 'offsets': [0, 4], 'itemsize': 8}
+
+
+def decode_network_data(buf, offset=0):
+    v = NETWORK_DATA_STRUCT.unpack_from(buf, offset)
+    return {
+        'send_count': v[0],
+        'battery_voltage': v[1],
+    }
+
+
+RTK_DATA_STRUCT = struct.Struct("<H2B2I")
+RTK_DATA_SIZE = 1460
+
+
+def decode_rtk_data(buf, offset=0):
+    """RTK correction packet (RTK_DATA), sent by the base to the RTK group. One GNSS epoch is carried in one or more packets sharing `seq`; frames are never split across packets."""
+    v = RTK_DATA_STRUCT.unpack_from(buf, offset)
+    return {
+        'seq': v[0],
+        'part': v[1],
+        'flags': v[2],
+        'epoch_tow_ms': v[3],
+        'base_age_us': v[4],
+        'data': bytes(buf[offset + 12:]),
+    }
+
+
+ROBOT_DATA_STRUCT = struct.Struct("<")
+ROBOT_DATA_SIZE = 4096
+
+
+def decode_robot_data(buf, offset=0):
+    """Robot application data (ROBOT_DATA), any length up to ROBOT_DATA_MAX_PAYLOAD, fragmented as needed"""
+    return {
+        'data': bytes(buf[offset + 0:]),
+    }
+
+
+PTP_DATA_STRUCT = struct.Struct("<2BHIQ")
+PTP_DATA_SIZE = 16
+PTP_DATA_DTYPE = {'names': ['msg', 'steps_removed', 'seq', 'accuracy_us', 'timestamp_us'], 'formats': ['u1', 'u1', '<u2', '<u4', '<u8'], 'offsets': [0, 1, 2, 4, 8], 'itemsize': 16}
+
+
+def decode_ptp_data(buf, offset=0):
+    """Time sync packet (PTP_DATA), exchanged between a node and each of its children once per interval: parent SYNC, parent FOLLOW_UP (SYNC send time), child DELAY_REQ, parent DELAY_RESP (DELAY_REQ arrival time)."""
+    v = PTP_DATA_STRUCT.unpack_from(buf, offset)
+    return {
+        'msg': v[0],
+        'steps_removed': v[1],
+        'seq': v[2],
+        'accuracy_us': v[3],
+        'timestamp_us': v[4],
+    }
+
+
+RX_STATS_ENTRY_STRUCT = struct.Struct("<2H18I")
+RX_STATS_ENTRY_SIZE = 76
+RX_STATS_ENTRY_DTYPE = {'names': ['type', 'reserved', 'packets', 'bytes', 'malformed', 'queue_full', 'avg_cycles', 'max_cycles', 'hist', 'seq_gaps', 'out_of_order', 'latency_avg_us', 'latency_max_us'], 'formats': ['<u2', '<u2', '<u4', '<u4', '<u4', '<u4', '<u4', '<u4', '(8,)<u4', '<u4', '<u4', '<u4', '<u4'], 'offsets': [0, 2, 4, 8, 12, 16, 20, 24, 28, 60, 64, 68, 72], 'itemsize': 76}
+
+
+def decode_rx_stats_entry(buf, offset=0):
+    """Receive dispatcher counters (RX_STATS_REPORT), one entry per registered packet type"""
+    v = RX_STATS_ENTRY_STRUCT.unpack_from(buf, offset)
+    return {
+        'type': v[0],
+        'reserved': v[1],
+        'packets': v[2],
+        'bytes': v[3],
+        'malformed': v[4],
+        'queue_full': v[5],
+        'avg_cycles': v[6],
+        'max_cycles': v[7],
+        'hist': list(v[8:16]),
+        'seq_gaps': v[16],
+        'out_of_order': v[17],
+        'latency_avg_us': v[18],
+        'latency_max_us': v[19],
+    }
+
+
+RX_STATS_REPORT_STRUCT = struct.Struct("<4IH2B")
+RX_STATS_REPORT_SIZE = 1008
+
+
+def decode_rx_stats_report(buf, offset=0):
+    v = RX_STATS_REPORT_STRUCT.unpack_from(buf, offset)
+    return {
+        'unknown': v[0],
+        'bad_header': v[1],
+        'v1_packets': v[2],
+        'v2_packets': v[3],
+        'cpu_mhz': v[4],
+        'count': v[5],
+        'reserved': v[6],
+        'entries': [decode_rx_stats_entry(buf, o) for o in range(offset + 20, len(buf) - RX_STATS_ENTRY_SIZE + 1, RX_STATS_ENTRY_SIZE)],
+    }
+
+
+FRAG_HEADER_STRUCT = struct.Struct("<3H4B")
+FRAG_HEADER_SIZE = 10
+FRAG_HEADER_DTYPE = {'names': ['msg_id', 'total_len', 'offset', 'type', 'index', 'count', 'reserved'], 'formats': ['<u2', '<u2', '<u2', 'u1', 'u1', 'u1', 'u1'], 'offsets': [0, 2, 4, 6, 7, 8, 9], 'itemsize': 10}
+
+
+def decode_frag_header(buf, offset=0):
+    """FRAGMENT packet header, followed by bytes [offset, offset + n) of the message"""
+    v = FRAG_HEADER_STRUCT.unpack_from(buf, offset)
+    return {
+        'msg_id': v[0],
+        'total_len': v[1],
+        'offset': v[2],
+        'type': v[3],
+        'index': v[4],
+        'count': v[5],
+        'reserved': v[6],
+    }
+
+
+FRAG_NACK_STRUCT = struct.Struct("<2HI")
+FRAG_NACK_SIZE = 8
+FRAG_NACK_DTYPE = {'names': ['msg_id', 'reserved', 'missing'], 'formats': ['<u2', '<u2', '<u4'], 'offsets': [0, 2, 4], 'itemsize': 8}
+
+
+def decode_frag_nack(buf, offset=0):
+    """Selective retransmission request (FRAG_NACK), sent P2P to the sender of an incomplete message"""
+    v = FRAG_NACK_STRUCT.unpack_from(buf, offset)
+    return {
+        'msg_id': v[0],
+        'reserved': v[1],
+        'missing': v[2],
+    }
+
+
+BOOT_REPORT_STRUCT = struct.Struct("<2BH30I")
+BOOT_REPORT_SIZE = 124
+BOOT_REPORT_DTYPE = {'names': ['reset_reason', 'flags', 'reserved', 'start_ms', 'end_ms'], 'formats': ['u1', 'u1', '<u2', '(15,)<u4', '(15,)<u4'], 'offsets': [0, 1, 2, 4, 64], 'itemsize': 124}
+
+
+def decode_boot_report(buf, offset=0):
+    """Boot timeline (BOOT_REPORT), sent to the root once connected and again at each later milestone"""
+    v = BOOT_REPORT_STRUCT.unpack_from(buf, offset)
+    return {
+        'reset_reason': v[0],
+        'flags': v[1],
+        'reserved': v[2],
+        'start_ms': list(v[3:18]),
+        'end_ms': list(v[18:33]),
+    }
+
+
+MASTER_CLOCK_DATA_STRUCT = struct.Struct("<")
+MASTER_CLOCK_DATA_SIZE = 4096
+
+
+def decode_master_clock_data(buf, offset=0):
+    """Master clock application data (MASTER_CLOCK_DATA), any length up to MASTER_CLOCK_DATA_MAX_PAYLOAD, fragmented as needed"""
+    return {
+        'data': bytes(buf[offset + 0:]),
+    }
+
+
+MESH_OTA_HEADER_STRUCT = struct.Struct("<2BHI")
+MESH_OTA_HEADER_SIZE = 8
+MESH_OTA_HEADER_DTYPE = {'names': ['cmd', 'state', 'block', 'session'], 'formats': ['u1', 'u1', '<u2', '<u4'], 'offsets': [0, 1, 2, 4], 'itemsize': 8}
+
+
+def decode_mesh_ota_header(buf, offset=0):
+    """Start of every OTA_DATA payload; STATUS and END are this alone"""
+    v = MESH_OTA_HEADER_STRUCT.unpack_from(buf, offset)
+    return {
+        'cmd': v[0],
+        'state': v[1],
+        'block': v[2],
+        'session': v[3],
+    }
+
+
+MESH_OTA_START_STRUCT = struct.Struct("<2BH2I2H32s4B2H16s")
+MESH_OTA_START_SIZE = 1096
+
+
+def decode_mesh_ota_start(buf, offset=0):
+    """START: the image the OTA group is about to receive"""
+    v = MESH_OTA_START_STRUCT.unpack_from(buf, offset)
+    return {
+        'cmd': v[0],
+        'state': v[1],
+        'block': v[2],
+        'session': v[3],
+        'image_size': v[4],
+        'block_size': v[5],
+        'block_count': v[6],
+        'sha256': v[7],
+        'encoding': v[8],
+        'window_bits': v[9],
+        'lookahead_bits': v[10],
+        'reserved': v[11],
+        'chunk_size': v[12],
+        'chunk_count': v[13],
+        'base_md5': v[14],
+        'chunk_len': bytes(buf[offset + 72:]),
+    }
+
+
+MESH_OTA_DATA_STRUCT = struct.Struct("<2BHI")
+MESH_OTA_DATA_SIZE = 1032
+
+
+def decode_mesh_ota_data(buf, offset=0):
+    """DATA: one block of the image"""
+    v = MESH_OTA_DATA_STRUCT.unpack_from(buf, offset)
+    return {
+        'cmd': v[0],
+        'state': v[1],
+        'block': v[2],
+        'session': v[3],
+        'data': bytes(buf[offset + 8:]),
+    }
+
+
+MESH_OTA_ACK_STRUCT = struct.Struct("<2BHI2H")
+MESH_OTA_ACK_SIZE = 524
+
+
+def decode_mesh_ota_ack(buf, offset=0):
+    """ACK: a target's progress, answering START and STATUS"""
+    v = MESH_OTA_ACK_STRUCT.unpack_from(buf, offset)
+    return {
+        'cmd': v[0],
+        'state': v[1],
+        'block': v[2],
+        'session': v[3],
+        'received': v[4],
+        'block_count': v[5],
+        'bitmap': bytes(buf[offset + 12:]),
+    }
+
+
+MESH_OTA_IMAGE_HEADER_STRUCT = struct.Struct("<I4BI2H32s16s")
+MESH_OTA_IMAGE_HEADER_SIZE = 64
+MESH_OTA_IMAGE_HEADER_DTYPE = {'names': ['magic', 'encoding', 'window_bits', 'lookahead_bits', 'reserved', 'image_size', 'chunk_size', 'chunk_count', 'sha256', 'base_md5'], 'formats': ['<u4', 'u1', 'u1', 'u1', 'u1', '<u4', '<u2', '<u2', '(32,)u1', '(16,)u1'], 'offsets': [0, 4, 5, 6, 7, 8, 12, 14, 16, 48], 'itemsize': 64}
+
+
+def decode_mesh_ota_image_header(buf, offset=0):
+    """Start of an encoded image file (python/ota_image.py), then u16 chunk_len[chunk_count] and the chunks back to back"""
+    v = MESH_OTA_IMAGE_HEADER_STRUCT.unpack_from(buf, offset)
+    return {
+        'magic': v[0],
+        'encoding': v[1],
+        'window_bits': v[2],
+        'lookahead_bits': v[3],
+        'reserved': v[4],
+        'image_size': v[5],
+        'chunk_size': v[6],
+        'chunk_count': v[7],
+        'sha256': v[8],
+        'base_md5': v[9],
+    }
+
+
+UBX_HEADER_STRUCT = struct.Struct("<4BH")
+UBX_HEADER_SIZE = 6
+UBX_HEADER_DTYPE = {'names': ['preamble1', 'preamble2', 'msg_class', 'msg_id', 'length'], 'formats': ['u1', 'u1', 'u1', 'u1', '<u2'], 'offsets': [0, 1, 2, 3, 4], 'itemsize': 6}
+
+
+def decode_ubx_header(buf, offset=0):
+    v = UBX_HEADER_STRUCT.unpack_from(buf, offset)
+    return {
+        'preamble1': v[0],
+        'preamble2': v[1],
+        'msg_class': v[2],
+        'msg_id': v[3],
+        'length': v[4],
+    }
+
+
+UBX_NAV_PVT_STRUCT = struct.Struct("<IH6BIi4B4i2I5i2I2HIihH")
+UBX_NAV_PVT_SIZE = 92
+UBX_NAV_PVT_DTYPE = {'names': ['iTOW', 'year', 'month', 'day', 'hour', 'min', 'sec', 'valid', 'tAcc', 'nano', 'fixType', 'flags', 'flags2', 'numSV', 'lon', 'lat', 'height', 'hMSL', 'hAcc', 'vAcc', 'velN', 'velE', 'velD', 'gSpeed', 'headMot', 'sAcc', 'headAcc', 'pDOP', 'flags3', 'reserved0', 'headVeh', 'magDec', 'magAcc'], 'formats': ['<u4', '<u2', 'u1', 'u1', 'u1', 'u1', 'u1', 'u1', '<u4', '<i4', 'u1', 'u1', 'u1', 'u1', '<i4', '<i4', '<i4', '<i4', '<u4', '<u4', '<i4', '<i4', '<i4', '<i4', '<i4', '<u4', '<u4', '<u2', '<u2', '<u4', '<i4', '<i2', '<u2'], 'offsets': [0, 4, 6, 7, 8, 9, 10, 11, 12, 16, 20, 21, 22, 23, 24, 28, 32, 36, 40, 44, 48, 52, 56, 60, 64, 68, 72, 76, 78, 80, 84, 88, 90], 'itemsize': 92}
+UBX_NAV_PVT_CLASS = 0x01
+UBX_NAV_PVT_ID = 0x07
+
+
+def decode_ubx_nav_pvt(buf, offset=0):
+    """NAV-PVT (0x01 0x07), 92 byte payload"""
+    v = UBX_NAV_PVT_STRUCT.unpack_from(buf, offset)
+    return {
+        'iTOW': v[0],
+        'year': v[1],
+        'month': v[2],
+        'day': v[3],
+        'hour': v[4],
+        'min': v[5],
+        'sec': v[6],
+        'valid': v[7],
+        'tAcc': v[8],
+        'nano': v[9],
+        'fixType': v[10],
+        'flags': v[11],
+        'flags2': v[12],
+        'numSV': v[13],
+        'lon': v[14],
+        'lat': v[15],
+        'height': v[16],
+        'hMSL': v[17],
+        'hAcc': v[18],
+        'vAcc': v[19],
+        'velN': v[20],
+        'velE': v[21],
+        'velD': v[22],
+        'gSpeed': v[23],
+        'headMot': v[24],
+        'sAcc': v[25],
+        'headAcc': v[26],
+        'pDOP': v[27],
+        'flags3': v[28],
+        'reserved0': v[29],
+        'headVeh': v[30],
+        'magDec': v[31],
+        'magAcc': v[32],
+    }
+
+
+UBX_NAV_SVIN_STRUCT = struct.Struct("<B3x2I3i3bx2I2B2x")
+UBX_NAV_SVIN_SIZE = 40
+UBX_NAV_SVIN_DTYPE = {'names': ['version', 'iTOW', 'dur', 'meanX', 'meanY', 'meanZ', 'meanXHP', 'meanYHP', 'meanZHP', 'meanAcc', 'obs', 'valid', 'active'], 'formats': ['u1', '<u4', '<u4', '<i4', '<i4', '<i4', 'i1', 'i1', 'i1', '<u4', '<u4', 'u1', 'u1'], 'offsets': [0, 4, 8, 12, 16, 20, 24, 25, 26, 28, 32, 36, 37], 'itemsize': 40}
+UBX_NAV_SVIN_CLASS = 0x01
+UBX_NAV_SVIN_ID = 0x3B
+
+
+def decode_ubx_nav_svin(buf, offset=0):
+    """NAV-SVIN (0x01 0x3B), 40 byte payload"""
+    v = UBX_NAV_SVIN_STRUCT.unpack_from(buf, offset)
+    return {
+        'version': v[0],
+        'iTOW': v[1],
+        'dur': v[2],
+        'meanX': v[3],
+        'meanY': v[4],
+        'meanZ': v[5],
+        'meanXHP': v[6],
+        'meanYHP': v[7],
+        'meanZHP': v[8],
+        'meanAcc': v[9],
+        'obs': v[10],
+        'valid': v[11],
+        'active': v[12],
+    }
+
+
+UBX_NAV_HPPOSLLH_STRUCT = struct.Struct("<2B2xI4i4b2I")
+UBX_NAV_HPPOSLLH_SIZE = 36
+UBX_NAV_HPPOSLLH_DTYPE = {'names': ['version', 'flags', 'iTOW', 'lon', 'lat', 'height', 'hMSL', 'lonHp', 'latHp', 'heightHp', 'hMSLHp', 'hAcc', 'vAcc'], 'formats': ['u1', 'u1', '<u4', '<i4', '<i4', '<i4', '<i4', 'i1', 'i1', 'i1', 'i1', '<u4', '<u4'], 'offsets': [0, 1, 4, 8, 12, 16, 20, 24, 25, 26, 27, 28, 32], 'itemsize': 36}
+UBX_NAV_HPPOSLLH_CLASS = 0x01
+UBX_NAV_HPPOSLLH_ID = 0x14
+
+
+def decode_ubx_nav_hpposllh(buf, offset=0):
+    """NAV-HPPOSLLH (0x01 0x14), 36 byte payload, version 0"""
+    v = UBX_NAV_HPPOSLLH_STRUCT.unpack_from(buf, offset)
+    return {
+        'version': v[0],
+        'flags': v[1],
+        'iTOW': v[2],
+        'lon': v[3],
+        'lat': v[4],
+        'height': v[5],
+        'hMSL': v[6],
+        'lonHp': v[7],
+        'latHp': v[8],
+        'heightHp': v[9],
+        'hMSLHp': v[10],
+        'hAcc': v[11],
+        'vAcc': v[12],
+    }
+
+
+UBX_NAV_HPPOSECEF_STRUCT = struct.Struct("<2B2xI3i3bxI")
+UBX_NAV_HPPOSECEF_SIZE = 28
+UBX_NAV_HPPOSECEF_DTYPE = {'names': ['version', 'flags', 'iTOW', 'ecefX', 'ecefY', 'ecefZ', 'ecefXHp', 'ecefYHp', 'ecefZHp', 'pAcc'], 'formats': ['u1', 'u1', '<u4', '<i4', '<i4', '<i4', 'i1', 'i1', 'i1', '<u4'], 'offsets': [0, 1, 4, 8, 12, 16, 20, 21, 22, 24], 'itemsize': 28}
+UBX_NAV_HPPOSECEF_CLASS = 0x01
+UBX_NAV_HPPOSECEF_ID = 0x13
+
+
+def decode_ubx_nav_hpposecef(buf, offset=0):
+    """NAV-HPPOSECEF (0x01 0x13), 28 byte payload, version 0"""
+    v = UBX_NAV_HPPOSECEF_STRUCT.unpack_from(buf, offset)
+    return {
+        'version': v[0],
+        'flags': v[1],
+        'iTOW': v[2],
+        'ecefX': v[3],
+        'ecefY': v[4],
+        'ecefZ': v[5],
+        'ecefXHp': v[6],
+        'ecefYHp': v[7],
+        'ecefZHp': v[8],
+        'pAcc': v[9],
+    }
+
+
+UBX_NAV_RELPOSNED_STRUCT = struct.Struct("<BxHI5i4b6I")
+UBX_NAV_RELPOSNED_SIZE = 56
+UBX_NAV_RELPOSNED_DTYPE = {'names': ['version', 'refStationId', 'iTOW', 'relPosN', 'relPosE', 'relPosD', 'relPosLength', 'relPosHeading', 'relPosHPN', 'relPosHPE', 'relPosHPD', 'relPosHPLength', 'accN', 'accE', 'accD', 'accLength', 'accHeading', 'flags'], 'formats': ['u1', '<u2', '<u4', '<i4', '<i4', '<i4', '<i4', '<i4', 'i1', 'i1', 'i1', 'i1', '<u4', '<u4', '<u4', '<u4', '<u4', '<u4'], 'offsets': [0, 2, 4, 8, 12, 16, 20, 24, 28, 29, 30, 31, 32, 36, 40, 44, 48, 52], 'itemsize': 56}
+UBX_NAV_RELPOSNED_CLASS = 0x01
+UBX_NAV_RELPOSNED_ID = 0x3C
+
+
+def decode_ubx_nav_relposned(buf, offset=0):
+    """NAV-RELPOSNED (0x01 0x3C), 64 byte payload, version 1 (F9P)"""
+    v = UBX_NAV_RELPOSNED_STRUCT.unpack_from(buf, offset)
+    return {
+        'version': v[0],
+        'refStationId': v[1],
+        'iTOW': v[2],
+        'relPosN': v[3],
+        'relPosE': v[4],
+        'relPosD': v[5],
+        'relPosLength': v[6],
+        'relPosHeading': v[7],
+        'relPosHPN': v[8],
+        'relPosHPE': v[9],
+        'relPosHPD': v[10],
+        'relPosHPLength': v[11],
+        'accN': v[12],
+        'accE': v[13],
+        'accD': v[14],
+        'accLength': v[15],
+        'accHeading': v[16],
+        'flags': v[17],
+    }
+
+
+UBX_TIM_TP_STRUCT = struct.Struct("<2IiH2B")
+UBX_TIM_TP_SIZE = 16
+UBX_TIM_TP_DTYPE = {'names': ['towMS', 'towSubMS', 'qErr', 'week', 'flags', 'refInfo'], 'formats': ['<u4', '<u4', '<i4', '<u2', 'u1', 'u1'], 'offsets': [0, 4, 8, 12, 14, 15], 'itemsize': 16}
+UBX_TIM_TP_CLASS = 0x0D
+UBX_TIM_TP_ID = 0x01
+
+
+def decode_ubx_tim_tp(buf, offset=0):
+    """TIM-TP (0x0D 0x01), 16 byte payload: time of the next time pulse"""
+    v = UBX_TIM_TP_STRUCT.unpack_from(buf, offset)
+    return {
+        'towMS': v[0],
+        'towSubMS': v[1],
+        'qErr': v[2],
+        'week': v[3],
+        'flags': v[4],
+        'refInfo': v[5],
+    }
+
+
+# Struct name as logged by PROTOCOL_LOG_BASE64 -> (decoder, size)
+DECODERS = {
+    'WireHeaderV1': (decode_wire_header_v1, WIRE_HEADER_V1_SIZE),
+    'WireHeaderV2': (decode_wire_header_v2, WIRE_HEADER_V2_SIZE),
+    'ProtocolHeader': (decode_protocol_header, PROTOCOL_HEADER_SIZE),
+    'NetworkData': (decode_network_data, NETWORK_DATA_SIZE),
+    'RTKData': (decode_rtk_data, RTK_DATA_SIZE),
+    'RobotData': (decode_robot_data, ROBOT_DATA_SIZE),
+    'PTPData': (decode_ptp_data, PTP_DATA_SIZE),
+    'RxStatsEntry': (decode_rx_stats_entry, RX_STATS_ENTRY_SIZE),
+    'RxStatsReport': (decode_rx_stats_report, RX_STATS_REPORT_SIZE),
+    'FragHeader': (decode_frag_header, FRAG_HEADER_SIZE),
+    'FragNack': (decode_frag_nack, FRAG_NACK_SIZE),
+    'BootReport': (decode_boot_report, BOOT_REPORT_SIZE),
+    'MasterClockData': (decode_master_clock_data, MASTER_CLOCK_DATA_SIZE),
+    'MeshOtaHeader': (decode_mesh_ota_header, MESH_OTA_HEADER_SIZE),
+    'MeshOtaStart': (decode_mesh_ota_start, MESH_OTA_START_SIZE),
+    'MeshOtaData': (decode_mesh_ota_data, MESH_OTA_DATA_SIZE),
+    'MeshOtaAck': (decode_mesh_ota_ack, MESH_OTA_ACK_SIZE),
+    'MeshOtaImageHeader': (decode_mesh_ota_image_header, MESH_OTA_IMAGE_HEADER_SIZE),
+    'UBXHeader': (decode_ubx_header, UBX_HEADER_SIZE),
+    'UBXNavPVT': (decode_ubx_nav_pvt, UBX_NAV_PVT_SIZE),
+    'UBXNavSVIN': (decode_ubx_nav_svin, UBX_NAV_SVIN_SIZE),
+    'UBXNavHPPOSLLH': (decode_ubx_nav_hpposllh, UBX_NAV_HPPOSLLH_SIZE),
+    'UBXNavHPPOSECEF': (decode_ubx_nav_hpposecef, UBX_NAV_HPPOSECEF_SIZE),
+    'UBXNavRELPOSNED': (decode_ubx_nav_relposned, UBX_NAV_RELPOSNED_SIZE),
+    'UBXTimTP': (decode_ubx_tim_tp, UBX_TIM_TP_SIZE),
+}
+
+# Struct name -> format string logged with it (the whole C struct)
+FORMATS = {
+    'WireHeaderV1': "<2H",
+    'WireHeaderV2': "<2B3H",
+    'ProtocolHeader': "<2H",
+    'NetworkData': "<IH2x",
+    'RTKData': "<H2B2I1448s",
+    'RobotData': "<4096s",
+    'PTPData': "<2BHIQ",
+    'RxStatsEntry': "<2H18I",
+    'RxStatsReport': "<4IH2B2H18I2H18I2H18I2H18I2H18I2H18I2H18I2H18I2H18I2H18I2H18I2H18I2H18I",
+    'FragHeader': "<3H4B",
+    'FragNack': "<2HI",
+    'BootReport': "<2BH30I",
+    'MasterClockData': "<4096s",
+    'MeshOtaHeader': "<2BHI",
+    'MeshOtaStart': "<2BH2I2H32s4B2H16s512H",
+    'MeshOtaData': "<2BHI1024s",
+    'MeshOtaAck': "<2BHI2H512s",
+    'MeshOtaImageHeader': "<I4BI2H32s16s",
+    'UBXHeader': "<4BH",
+    'UBXNavPVT': "<IH6BIi4B4i2I5i2I2HIihH",
+    'UBXNavSVIN': "<B3x2I3i3bx2I2B2x",
+    'UBXNavHPPOSLLH': "<2B2xI4i4b2I",
+    'UBXNavHPPOSECEF': "<2B2xI3i3bxI",
+    'UBXNavRELPOSNED': "<BxHI5i4b6I",
+    'UBXTimTP': "<2IiH2B",
+}
+
+# Struct name -> numpy dtype description (fixed-size structs)
+DTYPES = {
+    'WireHeaderV1': WIRE_HEADER_V1_DTYPE,
+    'WireHeaderV2': WIRE_HEADER_V2_DTYPE,
+    'ProtocolHeader': PROTOCOL_HEADER_DTYPE,
+    'NetworkData': NETWORK_DATA_DTYPE,
+    'PTPData': PTP_DATA_DTYPE,
+    'RxStatsEntry': RX_STATS_ENTRY_DTYPE,
+    'FragHeader': FRAG_HEADER_DTYPE,
+    'FragNack': FRAG_NACK_DTYPE,
+    'BootReport': BOOT_REPORT_DTYPE,
+    'MeshOtaHeader': MESH_OTA_HEADER_DTYPE,
+    'MeshOtaImageHeader': MESH_OTA_IMAGE_HEADER_DTYPE,
+    'UBXHeader': UBX_HEADER_DTYPE,
+    'UBXNavPVT': UBX_NAV_PVT_DTYPE,
+    'UBXNavSVIN': UBX_NAV_SVIN_DTYPE,
+    'UBXNavHPPOSLLH': UBX_NAV_HPPOSLLH_DTYPE,
+    'UBXNavHPPOSECEF': UBX_NAV_HPPOSECEF_DTYPE,
+    'UBXNavRELPOSNED': UBX_NAV_RELPOSNED_DTYPE,
+    'UBXTimTP': UBX_TIM_TP_DTYPE,
+}
@@ -17,10 +17,16 @@
 #include "esp_mesh.h"
 #include "esp_mesh_internal.h"
 #include "nvs_flash.h"
-#include <sys/socket.h>
-#include <netdb.h>
 #include "mesh_ota.h"
 #include "protocol.h"
+#include "rtk_corrections.h"
+#include "rtk_sink.h"
+#include "mesh_ptp.h"
+#include "mesh_tx.h"
+#include "mesh_dispatch.h"
+#include "mesh_frag.h"
+#include "boot_timeline.h"
+#include "log_ship.h"
 
 /*******************************************************
  *                Macros
@@ -29,17 +35,15 @@
 /*******************************************************
  *                Constants
  *******************************************************/
-#define RX_SIZE          (1040)
-#define TX_SIZE          (1000)
+#define RX_SIZE          PKT_POOL_BUF_SIZE
 #define LOG_BUFFER_SIZE 4096
+#define SERIAL_STATS_INTERVAL_US (60 * 1000 * 1000)
 
 /*******************************************************
  *                Variable Definitions
  *******************************************************/
 static const char *MESH_TAG = "mesh_main";
 static const uint8_t MESH_ID[6] = { 0x5A, 0x54, 0x6F, 0x6B, 0x52, 0x42 };
-static uint8_t tx_buf[TX_SIZE] = { 0, };
-static uint8_t rx_buf[RX_SIZE] = { 0, };
 static bool is_running = true;
 static bool is_mesh_connected = false;
 static mesh_addr_t mesh_parent_addr;
@@ -73,11 +77,6 @@ void esp_mesh_p2p_tx_main(void *arg)
     int send_count = 0;
     mesh_addr_t route_table[CONFIG_MESH_ROUTE_TABLE_SIZE];
     int route_table_size = 0;
-    mesh_data_t data;
-    data.data = tx_buf;
-    data.size = sizeof(tx_buf);
-    data.proto = MESH_PROTO_BIN;
-    data.tos = MESH_TOS_P2P;
     is_running = true;
 
 
@@ -93,20 +92,15 @@ void esp_mesh_p2p_tx_main(void *arg)
         esp_mesh_get_routing_table((mesh_addr_t *) &route_table,
                                    CONFIG_MESH_ROUTE_TABLE_SIZE * 6, &route_table_size);
         send_count++;
-        // Prepare echo protocol packet
-        ProtocolHeader_t *header = (ProtocolHeader_t *)tx_buf;
-        header->type = ECHO_DATA; // Add ECHO_DATA to ProtocolType in protocol.h
-        header->length = sizeof(send_count);
-        memcpy(tx_buf + sizeof(ProtocolHeader_t), &send_count, sizeof(send_count));
-        data.size = sizeof(ProtocolHeader_t) + sizeof(send_count);
+        // Echo protocol packet to every node, queued as telemetry behind corrections and control traffic
         for (i = 0; i < route_table_size; i++) {
-            err = esp_mesh_send(&route_table[i], &data, MESH_DATA_P2P, NULL, 0);
+            err = mesh_tx_send(MESH_TX_TELEMETRY, &route_table[i], MESH_DATA_P2P, ECHO_DATA,
+                               &send_count, sizeof(send_count));
             if (err) {
                 ESP_LOGE(MESH_TAG,
-                         "[ECHO:%d][L:%d]parent:"MACSTR" to "MACSTR", heap:%" PRId32 "[err:0x%x, proto:%d, tos:%d]",
+                         "[ECHO:%d][L:%d]parent:"MACSTR" to "MACSTR", heap:%" PRId32 "[err:0x%x]",
                          send_count, mesh_layer, MAC2STR(mesh_parent_addr.addr),
-                         MAC2STR(route_table[i].addr), esp_get_minimum_free_heap_size(),
-                         err, data.proto, data.tos);
+                         MAC2STR(route_table[i].addr), esp_get_minimum_free_heap_size(), err);
             }
         }
         if (route_table_size < 10) {
@@ -117,54 +111,42 @@ void esp_mesh_p2p_tx_main(void *arg)
     vTaskDelete(NULL);
 }
 
+static void rx_ota(const mesh_addr_t *from, const void *payload, size_t payload_len, pkt_buf_t *buf, void *arg)
+{
+    mesh_ota_handle_packet(from, payload, payload_len);
+}
+
+static void rx_echo(const mesh_addr_t *from, const void *payload, size_t payload_len, pkt_buf_t *buf, void *arg)
+{
+    handle_echo_packet(from, payload, payload_len, mesh_layer, esp_mesh_is_root(), 0);
+}
+
 void esp_mesh_p2p_rx_main(void *arg)
 {
     esp_err_t err;
     mesh_addr_t from;
-    int send_count = 0;
     mesh_data_t data;
     int flag = 0;
-    data.data = rx_buf;
-    data.size = RX_SIZE;
     is_running = true;
 
     while (is_running) {
+        // Each packet lands in its own pool buffer: a handler that keeps it takes a reference instead of copying
+        pkt_buf_t *buf = pkt_pool_alloc();
+        if (buf == NULL) {
+            vTaskDelay(1);
+            continue;
+        }
+        data.data = buf->data;
         data.size = RX_SIZE;
         err = esp_mesh_recv(&from, &data, portMAX_DELAY, &flag, NULL, 0);
         if (err != ESP_OK || !data.size) {
             ESP_LOGE(MESH_TAG, "err:0x%x, size:%d", err, data.size);
+            pkt_buf_release(buf);
             continue;
         }
-        if (data.size < sizeof(ProtocolHeader_t)) {
-            ESP_LOGW(MESH_TAG, "Received packet too small for ProtocolHeader");
-            continue;
-        }
-        ProtocolHeader_t *header = (ProtocolHeader_t *)data.data;
-        void *payload = (void *)(data.data + sizeof(ProtocolHeader_t));
-        size_t payload_len = data.size - sizeof(ProtocolHeader_t);
-
-        switch (header->type) {
-            case OTA_DATA: // Add OTA_DATA to your ProtocolType enum in protocol.h
-                if (payload_len >= sizeof(mesh_ota_packet_t)) {
-                    mesh_ota_handle_packet((const mesh_ota_packet_t *)payload);
-                } else {
-                    ESP_LOGW(MESH_TAG, "OTA packet too small: %u", (unsigned)payload_len);
-                }
-                break;
-            case ECHO_DATA:
-                handle_echo_packet(&from, payload, payload_len, mesh_layer, esp_mesh_is_root(), send_count, tx_buf);
-                break;
-            case FW_QUERY:
-                handle_fw_query_packet(&from, tx_buf, &dcfg);
-                break;
-            case FW_REPORT:
-                handle_fw_report_packet(&from, payload, payload_len);
-                break;
-            // ... handle other protocol types as before ...
-            default:
-                ESP_LOGW(MESH_TAG, "Unknown ProtocolType: %u", header->type);
-                break;
-        }
+        buf->len = data.size;
+        mesh_dispatch_packet(&from, buf);
+        pkt_buf_release(buf);
     }
     vTaskDelete(NULL);
 }
@@ -174,6 +156,19 @@ esp_err_t esp_mesh_comm_p2p_start(void)
     static bool is_comm_p2p_started = false;
     if (!is_comm_p2p_started) {
         is_comm_p2p_started = true;
+        // Handlers first: the RX task drops packets of types nobody registered.
+        // OTA writes erase flash for up to hundreds of ms: they run on their own task, below the RX task.
+        mesh_worker_t *ota_worker = mesh_worker_create("MeshOTA", CONFIG_MESH_OTA_RX_QUEUE_LEN, 4096, 4);
+        if (ota_worker != NULL) {
+            // Largest: a START with a full chunk table
+            mesh_dispatch_register_worker(ota_worker, OTA_DATA, "OTA_DATA", sizeof(mesh_ota_header_t),
+                                          sizeof(mesh_ota_start_t), rx_ota, NULL);
+        }
+        mesh_dispatch_register(ECHO_DATA, "ECHO_DATA", sizeof(int), sizeof(int), rx_echo, NULL);
+        protocol_register_handlers(&dcfg);
+        boot_timeline_register();
+        // Pass GPS time down to this node's children once it has a source
+        mesh_ptp_start();
         xTaskCreate(esp_mesh_p2p_tx_main, "MPTX", 3072, NULL, 5, NULL);
         xTaskCreate(esp_mesh_p2p_rx_main, "MPRX", 3072, NULL, 5, NULL);
     }
@@ -247,6 +242,7 @@ void mesh_event_handler(void *arg, esp_event_base_t event_base,
                  (mesh_layer == 2) ? "<layer2>" : "", MAC2STR(id.addr), connected->duty);
         last_layer = mesh_layer;
         is_mesh_connected = true;
+        boot_timeline_end(BOOT_PHASE_PARENT_CONNECTED);
         if (esp_mesh_is_root()) {
             // Only RTK node (BASE) should fix itself as root
             if (dcfg.node_type == BASE) {
@@ -295,6 +291,8 @@ void mesh_event_handler(void *arg, esp_event_base_t event_base,
         mesh_event_root_address_t *root_addr = (mesh_event_root_address_t *)event_data;
         ESP_LOGI(MESH_TAG, "<MESH_EVENT_ROOT_ADDRESS>root address:"MACSTR"",
                  MAC2STR(root_addr->addr));
+        // Root known: the boot timeline goes to it (or to the log, on the root itself)
+        boot_timeline_set_root(root_addr);
     }
     break;
     case MESH_EVENT_VOTE_STARTED: {
@@ -397,23 +395,43 @@ void mesh_event_handler(void *arg, esp_event_base_t event_base,
 
 /**
  * @brief Task to read and process serial data.
+ *
+ * Woken by the UART driver event queue (FIFO threshold or RX idle timeout) rather than polling,
+ * so a correction reaches the framer about one frame time after its last byte. On the base every
+ * RTCM3 frame goes straight into the mesh correction pipeline.
  */
 void serial_data_task(void *arg) {
+    rtk_frame_t frame;
+    int64_t last_stats_us = esp_timer_get_time();
+    TickType_t wait = pdMS_TO_TICKS(SERIAL_STATS_INTERVAL_US / 1000);
     while (is_running) {
         /* Serial data */
-        uint16_t total_serlength;
-        uint8_t *serdata = read_serial_data(&total_serlength);
-
-        if (serdata) {
-            // Process the data
-            ESP_LOGI("APP", "Received data of length %d", total_serlength);
-
-            // Free the allocated memory after use
-            free(serdata);
+        if (rtk_serial_wait(wait)) {
+            rtk_serial_read(0);
+            while (rtk_serial_next_rtcm(&frame)) {
+                if (dcfg.node_type == BASE) {
+                    rtk_corr_add_frame(&frame, esp_timer_get_time());
+                }
+            }
+        }
+        wait = pdMS_TO_TICKS(SERIAL_STATS_INTERVAL_US / 1000);
+        if (dcfg.node_type == BASE) {
+            // Flush an epoch whose last frame did not close it (no MSM end bit) once the line is idle
+            TickType_t corr_wait = rtk_corr_poll(esp_timer_get_time());
+            if (corr_wait < wait) wait = corr_wait;
+        } else if (dcfg.node_type == ROBOT) {
+            // Release buffered correction epochs whose reorder window has expired
+            TickType_t sink_wait = rtk_sink_poll();
+            if (sink_wait < wait) wait = sink_wait;
+        }
+        if (esp_timer_get_time() - last_stats_us > SERIAL_STATS_INTERVAL_US) {
+            rtk_serial_log_stats();
+            rtk_corr_log_stats();
+            if (dcfg.node_type == ROBOT) {
+                rtk_sink_log_stats();
+            }
+            last_stats_us = esp_timer_get_time();
         }
-
-        // Add a small delay to avoid busy looping
-        vTaskDelay(pdMS_TO_TICKS(100));
     }
     vTaskDelete(NULL);
 }
@@ -431,69 +449,25 @@ void set_node_type() {
 }
 
 
-// Pointer to store the original vprintf function
-static vprintf_like_t original_vprintf = NULL;
-
-// TCP log server configuration
-#ifndef CONFIG_DATASERVER_ADDRESS
-#define CONFIG_DATASERVER_ADDRESS "machine.local"
-#endif
-#ifndef CONFIG_DATASERVER_PORT
-#define CONFIG_DATASERVER_PORT 9000
-#endif
-static int log_server_sock = -1;
-
-// Connect to the log server (call once at startup)
-static void connect_log_server(void) {
-    // Only support hostnames (no .local) or IPv4 addresses
-    const char *addr = CONFIG_DATASERVER_ADDRESS;
-    // Try to parse as IPv4 address first
-    struct sockaddr_in sa = {0};
-    sa.sin_family = AF_INET;
-    sa.sin_port = htons(CONFIG_DATASERVER_PORT);
-    if (inet_pton(AF_INET, addr, &sa.sin_addr) == 1) {
-        // It's a valid IPv4 address
-        log_server_sock = socket(AF_INET, SOCK_STREAM, 0);
-        if (log_server_sock >= 0 && connect(log_server_sock, (struct sockaddr *)&sa, sizeof(sa)) == 0) {
-            ESP_LOGI(MESH_TAG, "Connected to log server at %s:%d (IPv4)", addr, CONFIG_DATASERVER_PORT);
-            return;
-        }
-        ESP_LOGE(MESH_TAG, "Failed to connect to log server at %s:%d (IPv4)", addr, CONFIG_DATASERVER_PORT);
-        if (log_server_sock >= 0) close(log_server_sock);
-        log_server_sock = -1;
-        return;
-    }
-}
-
-// Wrapper function to log to both the original function and the remote log server
-static int dual_log_function(const char *format, va_list args) {
-    int written = 0;
-    if (original_vprintf) {
-        written = original_vprintf(format, args);
-    }
-    if (log_server_sock >= 0) {
-        char log_line[256];
-        int len = vsnprintf(log_line, sizeof(log_line), format, args);
-        if (len > 0) {
-            // Send to server, ignore errors
-            send(log_server_sock, log_line, len, 0);
-        }
-    }
-    return written;
-}
-
 void ip_event_handler(void *arg, esp_event_base_t event_base,
                       int32_t event_id, void *event_data) {
     ip_event_got_ip_t *event = (ip_event_got_ip_t *) event_data;
     ESP_LOGI(MESH_TAG, "<IP_EVENT_STA_GOT_IP>IP:" IPSTR, IP2STR(&event->ip_info.ip));
 
-    connect_log_server();
+    log_ship_connect();
+    boot_timeline_end(BOOT_PHASE_GOT_IP);
 }
 
-void app_main(void)
+// Run one init phase, timestamped in the boot timeline
+static void run_phase(boot_phase_t phase, void (*init)(void))
 {
-    vTaskDelay(pdMS_TO_TICKS(2000)); // Add 2 second delay at startup
+    boot_timeline_begin(phase);
+    init();
+    boot_timeline_end(phase);
+}
 
+static void init_config(void)
+{
     set_node_type();
     ESP_ERROR_CHECK(nvs_flash_init());
 
@@ -511,30 +485,40 @@ void app_main(void)
         ESP_LOGI(MESH_TAG, "Device config loaded from NVS");
     }
 
-    // Compute and store firmware MD5 signature
+    if (dcfg.node_type == BASE){
+        // Logs also go to the log server, from a ring drained by their own task
+        log_ship_init();
+    }
+
+    ESP_LOGI(MESH_TAG, "Node type: %d", dcfg.node_type);
+}
+
+static void init_fingerprint(void)
+{
+    // Firmware fingerprint: the image is hashed only after an update, cached in NVS otherwise
     char current_md5[33];
-    compute_running_firmware_md5(current_md5);
+    get_running_firmware_fingerprint(current_md5, false);
     if (strcmp(dcfg.fw_md5, current_md5) != 0) {
         strncpy(dcfg.fw_md5, current_md5, sizeof(dcfg.fw_md5));
         save_device_config(&dcfg);
-        ESP_LOGI(MESH_TAG, "Updated firmware MD5 in config: %s", dcfg.fw_md5);
+        ESP_LOGI(MESH_TAG, "Updated firmware fingerprint in config: %s", dcfg.fw_md5);
     } else {
-        ESP_LOGI(MESH_TAG, "Firmware MD5: %s", dcfg.fw_md5);
-    }
-
-    if (dcfg.node_type == BASE){
-        original_vprintf = esp_log_set_vprintf(dual_log_function); 
+        ESP_LOGI(MESH_TAG, "Firmware fingerprint: %s", dcfg.fw_md5);
     }
+}
 
-    ESP_LOGI(MESH_TAG, "Node type: %d", dcfg.node_type);
-
+static void init_netif(void)
+{
     /*  tcpip initialization */
     ESP_ERROR_CHECK(esp_netif_init());
     /*  event initialization */
     ESP_ERROR_CHECK(esp_event_loop_create_default());
     /*  create network interfaces for mesh (only station instance saved for further manipulation, soft AP instance ignored */
     ESP_ERROR_CHECK(esp_netif_create_default_wifi_mesh_netifs(&netif_sta, NULL));
-    
+}
+
+static void init_battery(void)
+{
     if (dcfg.battery_analog_pin >= 0) {
         // Configure the analog input pin for battery voltage if selected
         int analog_pin = CONFIG_BATTERY_ANALOG_PIN;
@@ -558,26 +542,74 @@ void app_main(void)
             }
         }
     }
+}
 
+static void init_mesh_tx(void)
+{
+    // Every mesh packet but PTP_DATA goes out through the prioritized TX task
+    ESP_ERROR_CHECK(mesh_tx_init());
+    ESP_ERROR_CHECK(mesh_dispatch_init());
+    ESP_ERROR_CHECK(mesh_frag_init());
+}
+
+static void init_serial(void)
+{
     if (dcfg.node_type == BASE || dcfg.node_type == ROBOT){
         /*  serial initialization */
         // Setup the serial port
         setup_serial_port();
+        if (dcfg.node_type == ROBOT) {
+            // Corrections from the mesh are written back to the local receiver
+            rtk_sink_init();
+        }
         // Create the serial data task
-        xTaskCreate(serial_data_task, "SerialDataTask", 4096, NULL, 5, NULL);
+        xTaskCreate(serial_data_task, "SerialDataTask", 4096, NULL, 6, NULL);
     }
+}
 
-    /*  wifi initialization */
-    wifi_init_config_t config = WIFI_INIT_CONFIG_DEFAULT();
+static void init_antenna(void)
+{
     /*  XIAO ESP32C6 External Antenna Setup*/
     if (dcfg.ext_antenna){
         rf_switch_ext();
     }
+}
+
+#ifdef CONFIG_BOOT_FAST
+static SemaphoreHandle_t boot_aux_done;
+
+/**
+ * @brief Fast boot: the init phases that need neither the network stack nor each other.
+ *
+ * Runs beside app_main, above its priority so the antenna switch's settle delay starts at once
+ * and app_main carries on while it waits.
+ */
+static void boot_aux_task(void *arg)
+{
+    run_phase(BOOT_PHASE_ANTENNA, init_antenna);
+    run_phase(BOOT_PHASE_FINGERPRINT, init_fingerprint);
+    run_phase(BOOT_PHASE_BATTERY, init_battery);
+    xSemaphoreGive(boot_aux_done);
+    vTaskDelete(NULL);
+}
+#endif
 
+static void init_wifi(void)
+{
+    /*  wifi initialization */
+    wifi_init_config_t config = WIFI_INIT_CONFIG_DEFAULT();
     ESP_ERROR_CHECK(esp_wifi_init(&config));
     ESP_ERROR_CHECK(esp_event_handler_register(IP_EVENT, IP_EVENT_STA_GOT_IP, &ip_event_handler, NULL));
     ESP_ERROR_CHECK(esp_wifi_set_storage(WIFI_STORAGE_FLASH));
+#ifdef CONFIG_BOOT_FAST
+    // The radio waits for the antenna switch, and the mesh OTA for the fingerprint
+    xSemaphoreTake(boot_aux_done, portMAX_DELAY);
+#endif
     ESP_ERROR_CHECK(esp_wifi_start());
+}
+
+static void init_mesh_config(void)
+{
     /*  mesh initialization */
     ESP_ERROR_CHECK(esp_mesh_init());
     ESP_ERROR_CHECK(esp_event_handler_register(MESH_EVENT, ESP_EVENT_ANY_ID, &mesh_event_handler, NULL));
@@ -616,6 +648,20 @@ void app_main(void)
            strlen(CONFIG_MESH_AP_PASSWD));
     ESP_ERROR_CHECK(esp_mesh_set_config(&cfg));
 
+    // Robots receive the base's RTCM corrections through the RTK group
+    if (dcfg.node_type == ROBOT) {
+        rtk_corr_join_group();
+    }
+}
+
+static void init_ota(void)
+{
+    // Every node takes firmware from the root through the OTA group, resuming a saved transfer
+    ESP_ERROR_CHECK(mesh_ota_init(dcfg.fw_md5));
+}
+
+static void init_mesh_start(void)
+{
     // Set vote percentage for root election bias
     if (dcfg.node_type == BASE) {
         ESP_ERROR_CHECK(esp_mesh_set_vote_percentage(1)); // Strongly prefer RTK node as root
@@ -625,6 +671,39 @@ void app_main(void)
 
     /* mesh start */
     ESP_ERROR_CHECK(esp_mesh_start());
+}
+
+static void startup_delay(void)
+{
+    vTaskDelay(pdMS_TO_TICKS(2000)); // Add 2 second delay at startup
+}
+
+void app_main(void)
+{
+#ifdef CONFIG_BOOT_FAST
+    boot_timeline_start(true);
+    run_phase(BOOT_PHASE_CONFIG, init_config);
+    // Antenna, fingerprint and battery overlap the network bring-up below
+    boot_aux_done = xSemaphoreCreateBinary();
+    xTaskCreate(boot_aux_task, "BootAux", 4096, NULL, uxTaskPriorityGet(NULL) + 1, NULL);
+    run_phase(BOOT_PHASE_NETIF, init_netif);
+    run_phase(BOOT_PHASE_MESH_TX, init_mesh_tx);
+    run_phase(BOOT_PHASE_SERIAL, init_serial);
+#else
+    boot_timeline_start(false);
+    run_phase(BOOT_PHASE_DELAY, startup_delay);
+    run_phase(BOOT_PHASE_CONFIG, init_config);
+    run_phase(BOOT_PHASE_FINGERPRINT, init_fingerprint);
+    run_phase(BOOT_PHASE_NETIF, init_netif);
+    run_phase(BOOT_PHASE_BATTERY, init_battery);
+    run_phase(BOOT_PHASE_MESH_TX, init_mesh_tx);
+    run_phase(BOOT_PHASE_SERIAL, init_serial);
+    run_phase(BOOT_PHASE_ANTENNA, init_antenna);
+#endif
+    run_phase(BOOT_PHASE_WIFI, init_wifi);
+    run_phase(BOOT_PHASE_MESH_CONFIG, init_mesh_config);
+    run_phase(BOOT_PHASE_OTA, init_ota);
+    run_phase(BOOT_PHASE_MESH_START, init_mesh_start);
 
 #ifdef CONFIG_MESH_ENABLE_PS
     /* set the device active duty cycle. (default:10, MESH_PS_DEVICE_DUTY_REQUEST) */
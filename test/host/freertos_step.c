@@ -0,0 +1,86 @@
+#include <setjmp.h>
+#include "idf_host.h"
+
+static TaskFunction_t s_task;
+static void *s_task_arg;
+static jmp_buf s_task_exit;
+static int s_delays;
+static bool s_stepping;
+
+TickType_t host_task_wait;
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void) {
+    static int mutex;
+    return &mutex;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t wait) {
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem) {
+    return pdTRUE;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t sem) {
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t len, UBaseType_t item_size) {
+    return NULL;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t wait) {
+    return pdFALSE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t wait) {
+    return pdFALSE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+    return 0;
+}
+
+void vQueueDelete(QueueHandle_t queue) {
+}
+
+BaseType_t xTaskCreate(TaskFunction_t task, const char *name, uint32_t stack, void *arg, UBaseType_t prio,
+                       TaskHandle_t *handle) {
+    s_task = task;
+    s_task_arg = arg;
+    return pdPASS;
+}
+
+// The task's second wait ends the step
+static void task_wait(TickType_t ticks) {
+    if (s_delays++ > 0) {
+        host_task_wait = ticks;
+        longjmp(s_task_exit, 1);
+    }
+}
+
+void vTaskDelay(TickType_t ticks) {
+    if (!s_stepping) {
+        host_now_us += ticks * portTICK_PERIOD_MS * 1000LL;
+        return;
+    }
+    task_wait(ticks);
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t wait) {
+    task_wait(wait);
+    return 1;
+}
+
+void host_task_step(void) {
+    s_delays = 0;
+    s_stepping = true;
+    if (s_task != NULL && setjmp(s_task_exit) == 0) {
+        s_task(s_task_arg);
+    }
+    s_stepping = false;
+}
@@ -0,0 +1,207 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "idf_host.h"
+
+typedef struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t changed;
+    size_t item_size;
+    size_t len;
+    size_t head;
+    size_t count;
+    uint8_t *items;
+} host_queue_t;
+
+typedef struct {
+    TaskFunction_t task;
+    void *arg;
+    pthread_mutex_t mutex;
+    pthread_cond_t notified;
+    uint32_t notify_count;
+} host_task_t;
+
+static _Thread_local host_task_t *s_self;   // NULL on the test's own thread
+static host_task_t s_main_task = {
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+    .notified = PTHREAD_COND_INITIALIZER,
+};
+static int s_tasks_running;
+
+// Blocked for `ticks` that went by: the clock of esp_timer_get_time() moves on as well
+static void advance_clock(TickType_t ticks) {
+    __atomic_add_fetch(&host_now_us, (int64_t)ticks * 1000, __ATOMIC_RELAXED);
+}
+
+// Until `wait` ticks (ms) from now; false once that has passed
+static bool wait_changed(pthread_cond_t *cond, pthread_mutex_t *mutex, TickType_t wait) {
+    if (wait == 0) {
+        return false;
+    }
+    if (wait == portMAX_DELAY) {
+        return pthread_cond_wait(cond, mutex) == 0;
+    }
+    struct timespec until;
+    clock_gettime(CLOCK_REALTIME, &until);
+    long ns = until.tv_nsec + (long)(wait % 1000) * 1000000L;
+    until.tv_sec += wait / 1000 + ns / 1000000000L;
+    until.tv_nsec = ns % 1000000000L;
+    return pthread_cond_timedwait(cond, mutex, &until) != ETIMEDOUT;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void) {
+    pthread_mutex_t *mutex = malloc(sizeof(*mutex));
+    if (mutex != NULL) {
+        pthread_mutex_init(mutex, NULL);
+    }
+    return mutex;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t wait) {
+    return pthread_mutex_lock(sem) == 0 ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem) {
+    return pthread_mutex_unlock(sem) == 0 ? pdTRUE : pdFALSE;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t sem) {
+    pthread_mutex_destroy(sem);
+    free(sem);
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t len, UBaseType_t item_size) {
+    host_queue_t *q = calloc(1, sizeof(*q));
+    if (q == NULL || (q->items = malloc(len * item_size)) == NULL) {
+        free(q);
+        return NULL;
+    }
+    pthread_mutex_init(&q->mutex, NULL);
+    pthread_cond_init(&q->changed, NULL);
+    q->item_size = item_size;
+    q->len = len;
+    return q;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t wait) {
+    host_queue_t *q = queue;
+    pthread_mutex_lock(&q->mutex);
+    while (q->count == q->len) {
+        if (!wait_changed(&q->changed, &q->mutex, wait)) {
+            pthread_mutex_unlock(&q->mutex);
+            return pdFALSE;
+        }
+    }
+    memcpy(q->items + (q->head + q->count) % q->len * q->item_size, item, q->item_size);
+    q->count++;
+    pthread_cond_broadcast(&q->changed);
+    pthread_mutex_unlock(&q->mutex);
+    return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t wait) {
+    host_queue_t *q = queue;
+    pthread_mutex_lock(&q->mutex);
+    while (q->count == 0) {
+        if (!wait_changed(&q->changed, &q->mutex, wait)) {
+            pthread_mutex_unlock(&q->mutex);
+            return pdFALSE;
+        }
+    }
+    memcpy(item, q->items + q->head * q->item_size, q->item_size);
+    q->head = (q->head + 1) % q->len;
+    q->count--;
+    pthread_cond_broadcast(&q->changed);
+    pthread_mutex_unlock(&q->mutex);
+    return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+    host_queue_t *q = queue;
+    pthread_mutex_lock(&q->mutex);
+    UBaseType_t count = q->count;
+    pthread_mutex_unlock(&q->mutex);
+    return count;
+}
+
+void vQueueDelete(QueueHandle_t queue) {
+    host_queue_t *q = queue;
+    free(q->items);
+    free(q);
+}
+
+static void *task_main(void *arg) {
+    s_self = arg;
+    s_self->task(s_self->arg);
+    __atomic_sub_fetch(&s_tasks_running, 1, __ATOMIC_RELAXED);
+    return NULL;
+}
+
+// Never freed: a handle stays valid for notifications sent after its task ended
+BaseType_t xTaskCreate(TaskFunction_t task, const char *name, uint32_t stack, void *arg, UBaseType_t prio,
+                       TaskHandle_t *handle) {
+    host_task_t *t = calloc(1, sizeof(*t));
+    pthread_t thread;
+    if (t == NULL) {
+        return pdFAIL;
+    }
+    t->task = task;
+    t->arg = arg;
+    pthread_mutex_init(&t->mutex, NULL);
+    pthread_cond_init(&t->notified, NULL);
+    if (handle != NULL) {
+        *handle = t;
+    }
+    __atomic_add_fetch(&s_tasks_running, 1, __ATOMIC_RELAXED);
+    if (pthread_create(&thread, NULL, task_main, t) != 0) {
+        __atomic_sub_fetch(&s_tasks_running, 1, __ATOMIC_RELAXED);
+        free(t);
+        return pdFAIL;
+    }
+    pthread_detach(thread);
+    return pdPASS;
+}
+
+// Only a task ending itself
+void vTaskDelete(TaskHandle_t task) {
+    __atomic_sub_fetch(&s_tasks_running, 1, __ATOMIC_RELAXED);
+    pthread_exit(NULL);
+}
+
+int host_tasks_running(void) {
+    return __atomic_load_n(&s_tasks_running, __ATOMIC_RELAXED);
+}
+
+void vTaskDelay(TickType_t ticks) {
+    struct timespec t = { .tv_sec = ticks / 1000, .tv_nsec = (long)(ticks % 1000) * 1000000L };
+    nanosleep(&t, NULL);
+    advance_clock(ticks);
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+    host_task_t *t = task;
+    pthread_mutex_lock(&t->mutex);
+    t->notify_count++;
+    pthread_cond_broadcast(&t->notified);
+    pthread_mutex_unlock(&t->mutex);
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t wait) {
+    host_task_t *t = s_self != NULL ? s_self : &s_main_task;
+    pthread_mutex_lock(&t->mutex);
+    while (t->notify_count == 0) {
+        if (!wait_changed(&t->notified, &t->mutex, wait)) {
+            if (wait != portMAX_DELAY) {
+                advance_clock(wait);
+            }
+            break;
+        }
+    }
+    uint32_t count = t->notify_count;
+    t->notify_count = clear || count == 0 ? 0 : count - 1;
+    pthread_mutex_unlock(&t->mutex);
+    return count;
+}
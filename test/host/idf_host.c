@@ -0,0 +1,64 @@
+#include <string.h>
+#include "idf_host.h"
+
+int64_t host_now_us = 1000000;
+
+uint8_t host_flash[HOST_FLASH_SIZE];
+host_flash_stats_t host_flash_stats;
+
+int64_t esp_timer_get_time(void) {
+    return __atomic_load_n(&host_now_us, __ATOMIC_RELAXED);
+}
+
+vprintf_like_t esp_log_set_vprintf(vprintf_like_t func) {
+    static vprintf_like_t s_vprintf = vprintf;
+    vprintf_like_t previous = s_vprintf;
+    s_vprintf = func;
+    return previous;
+}
+
+uint32_t esp_cpu_get_cycle_count(void) {
+    return (uint32_t)host_now_us;
+}
+
+static bool in_partition(const esp_partition_t *part, size_t offset, size_t len) {
+    return offset <= part->size && len <= part->size - offset && part->address + part->size <= HOST_FLASH_SIZE;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *part, size_t offset, void *dst, size_t len) {
+    if (!in_partition(part, offset, len)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(dst, &host_flash[part->address + offset], len);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *part, size_t offset, const void *src, size_t len) {
+    if (!in_partition(part, offset, len)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    uint8_t *flash = &host_flash[part->address + offset];
+    const uint8_t *data = src;
+    bool dirty = false;
+    for (size_t i = 0; i < len; i++) {
+        dirty |= data[i] != 0xFF && (data[i] & ~flash[i]) != 0;     // 0xFF leaves a byte as it is
+        flash[i] &= data[i];
+    }
+    host_flash_stats.write_calls++;
+    host_flash_stats.bytes_written += len;
+    host_flash_stats.dirty_writes += dirty;
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *part, size_t offset, size_t len) {
+    if (!in_partition(part, offset, len)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if ((part->address + offset) % HOST_FLASH_SECTOR_SIZE != 0 || len % HOST_FLASH_SECTOR_SIZE != 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(&host_flash[part->address + offset], 0xFF, len);
+    host_flash_stats.erase_calls++;
+    host_flash_stats.sectors_erased += len / HOST_FLASH_SECTOR_SIZE;
+    return ESP_OK;
+}
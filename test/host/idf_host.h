@@ -0,0 +1,284 @@
+#ifndef IDF_HOST_H
+#define IDF_HOST_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdarg.h>
+
+/*
+Just enough of the ESP-IDF and FreeRTOS API for the host tests to build modules that use it
+(mesh_dispatch, mesh_frag, ota_writer, mesh_ota, rtk_sink, log_ship, mesh_ptp, cfg_helper). Every
+IDF header those modules include is a one-line header in this directory that includes this one.
+idf_host.c implements the IDF side that behaves the same for every test; the rest (partition table,
+app descriptor, mesh routing and parent, softAP stations, NVS, restart) is up to the test that
+needs it:
+
+- esp_timer_get_time() returns host_now_us, which the test sets and advances.
+- esp_partition_* work on host_flash, a RAM image of a NOR flash: erases set whole sectors to 0xFF
+  and writes only clear bits. Writes of bytes other than 0xFF that would need to set a bit (the
+  sector was not erased first) are counted in host_flash_stats.
+
+FreeRTOS comes in two flavours, one linked into each test:
+
+- freertos_step.c runs everything on the test's thread. Mutexes never block and queues cannot be
+  created (no mesh_dispatch workers). xTaskCreate() only records the task; host_task_step() runs
+  the most recent one through one iteration of its loop: from its start up to its second wait
+  (vTaskDelay() or ulTaskNotifyTake()), where it is abandoned with a longjmp, the ticks it asked
+  for left in host_task_wait. Tasks written as `while (true) { wait; work }` therefore do their
+  work once per step, with their locals fresh each time. vTaskDelay() outside a step advances
+  host_now_us and returns.
+- freertos_thread.c runs each task on a thread of its own, with blocking mutexes, queues and task
+  notifications. vTaskDelay(), and ulTaskNotifyTake() when it times out, sleep for real (ticks are
+  milliseconds) and advance host_now_us by as much, so timeouts measured with esp_timer expire.
+*/
+
+// esp_err.h
+typedef int esp_err_t;
+#define ESP_OK                  0
+#define ESP_FAIL                -1
+#define ESP_ERR_NO_MEM          0x101
+#define ESP_ERR_INVALID_ARG     0x102
+#define ESP_ERR_INVALID_STATE   0x103
+#define ESP_ERR_INVALID_SIZE    0x104
+#define ESP_ERR_NOT_FOUND       0x105
+#define ESP_ERR_NOT_SUPPORTED   0x106
+#define ESP_ERR_INVALID_RESPONSE 0x108
+#define ESP_ERROR_CHECK(x)      do { esp_err_t err_rc_ = (x); (void)err_rc_; } while (0)
+
+// esp_log.h
+typedef enum {
+    ESP_LOG_NONE,
+    ESP_LOG_ERROR,
+    ESP_LOG_WARN,
+    ESP_LOG_INFO,
+    ESP_LOG_DEBUG,
+    ESP_LOG_VERBOSE,
+} esp_log_level_t;
+
+#define HOST_LOG(letter, tag, format, ...)  printf(letter " %s: " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGE(tag, format, ...)          HOST_LOG("E", tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...)          HOST_LOG("W", tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...)          HOST_LOG("I", tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...)          do { } while (0)
+#define ESP_LOGV(tag, format, ...)          do { } while (0)
+#define ESP_LOG_LEVEL(level, tag, format, ...) HOST_LOG("L", tag, format, ##__VA_ARGS__)
+
+// The hook is only recorded: the ESP_LOGx above print directly
+typedef int (*vprintf_like_t)(const char *format, va_list args);
+vprintf_like_t esp_log_set_vprintf(vprintf_like_t func);
+
+// esp_mac.h
+#define MACSTR      "%02x:%02x:%02x:%02x:%02x:%02x"
+#define MAC2STR(a)  (a)[0], (a)[1], (a)[2], (a)[3], (a)[4], (a)[5]
+
+// esp_timer.h, esp_cpu.h
+extern int64_t host_now_us;
+int64_t esp_timer_get_time(void);
+uint32_t esp_cpu_get_cycle_count(void);
+
+// esp_mesh.h
+typedef union {
+    uint8_t addr[6];
+    struct {
+        uint32_t ip4;
+        uint16_t port;
+    } __attribute__((packed)) mip;
+} mesh_addr_t;
+
+#define ESP_ERR_MESH_QUEUE_FULL 0x400c
+
+#define MESH_DATA_P2P       0x02
+#define MESH_DATA_GROUP     0x40
+#define MESH_DATA_NONBLOCK  0x80
+#define MESH_MPS            1472
+#define MESH_ROOT           1
+#define MESH_LEAF           3
+
+typedef enum {
+    MESH_PROTO_BIN,
+} mesh_proto_t;
+
+typedef enum {
+    MESH_TOS_P2P,
+} mesh_tos_t;
+
+typedef struct {
+    uint8_t *data;
+    uint16_t size;
+    mesh_proto_t proto;
+    mesh_tos_t tos;
+} mesh_data_t;
+
+typedef struct {
+    uint8_t type;
+    uint16_t len;
+    uint8_t *val;
+} mesh_opt_t;
+
+esp_err_t esp_mesh_send(const mesh_addr_t *to, const mesh_data_t *data, int flag, const mesh_opt_t opt[],
+                        int opt_count);
+bool esp_mesh_is_root(void);
+esp_err_t esp_mesh_get_parent_bssid(mesh_addr_t *bssid);
+int esp_mesh_get_group_num(void);
+esp_err_t esp_mesh_get_group_list(mesh_addr_t *groups, int num);
+esp_err_t esp_mesh_set_group_id(const mesh_addr_t *groups, int num);
+int esp_mesh_get_routing_table_size(void);
+esp_err_t esp_mesh_get_routing_table(mesh_addr_t *table, int size, int *num);
+
+// esp_wifi.h, esp_system.h
+#define WIFI_IF_STA 0
+#define ESP_WIFI_MAX_CONN_NUM 15
+esp_err_t esp_wifi_get_mac(int ifx, uint8_t *mac);
+
+typedef struct {
+    uint8_t mac[6];
+} wifi_sta_info_t;
+
+typedef struct {
+    wifi_sta_info_t sta[ESP_WIFI_MAX_CONN_NUM];
+    int num;
+} wifi_sta_list_t;
+
+esp_err_t esp_wifi_ap_get_sta_list(wifi_sta_list_t *sta);
+void esp_restart(void);
+
+// freertos/FreeRTOS.h, task.h, queue.h, semphr.h
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned UBaseType_t;
+typedef void *SemaphoreHandle_t;
+typedef void *QueueHandle_t;
+typedef void *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+#define pdTRUE              1
+#define pdFALSE             0
+#define pdPASS              1
+#define pdFAIL              0
+#define portMAX_DELAY       0xFFFFFFFFu
+#define portTICK_PERIOD_MS  1
+#define pdMS_TO_TICKS(ms)   (ms)
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t wait);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem);
+void vSemaphoreDelete(SemaphoreHandle_t sem);
+QueueHandle_t xQueueCreate(UBaseType_t len, UBaseType_t item_size);
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t wait);
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t wait);
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue);
+void vQueueDelete(QueueHandle_t queue);
+BaseType_t xTaskCreate(TaskFunction_t task, const char *name, uint32_t stack, void *arg, UBaseType_t prio,
+                       TaskHandle_t *handle);
+void vTaskDelay(TickType_t ticks);
+void vTaskDelete(TaskHandle_t task);
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t wait);
+
+/**
+ * @brief Run the most recently created task through one iteration of its loop (freertos_step.c).
+ */
+void host_task_step(void);
+
+// Ticks of the wait that ended the last host_task_step()
+extern TickType_t host_task_wait;
+
+/**
+ * @brief Tasks created and not ended yet, by returning or vTaskDelete(NULL) (freertos_thread.c).
+ */
+int host_tasks_running(void);
+
+// esp_partition.h
+typedef struct {
+    uint32_t address;
+    uint32_t size;
+    uint32_t erase_size;
+    char label[17];
+} esp_partition_t;
+
+#define HOST_FLASH_SIZE         (4 * 1024 * 1024)
+#define HOST_FLASH_SECTOR_SIZE  4096
+
+typedef struct {
+    uint32_t erase_calls;
+    uint32_t sectors_erased;
+    uint32_t write_calls;
+    uint32_t bytes_written;
+    uint32_t dirty_writes;      // Writes with bits to set: data lost on real flash
+} host_flash_stats_t;
+
+extern uint8_t host_flash[HOST_FLASH_SIZE];
+extern host_flash_stats_t host_flash_stats;
+
+esp_err_t esp_partition_read(const esp_partition_t *part, size_t offset, void *dst, size_t len);
+esp_err_t esp_partition_write(const esp_partition_t *part, size_t offset, const void *src, size_t len);
+esp_err_t esp_partition_erase_range(const esp_partition_t *part, size_t offset, size_t len);
+
+#define ESP_PARTITION_TYPE_ANY      0xFF
+#define ESP_PARTITION_SUBTYPE_ANY   0xFF
+const esp_partition_t *esp_partition_find_first(int type, int subtype, const char *label);
+esp_err_t esp_partition_get_sha256(const esp_partition_t *part, uint8_t *sha256);
+
+// esp_ota_ops.h, esp_image_format.h
+const esp_partition_t *esp_ota_get_running_partition(void);
+const esp_partition_t *esp_ota_get_next_update_partition(const esp_partition_t *start);
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t *part);
+
+typedef struct {
+    uint32_t offset;
+    uint32_t size;
+} esp_partition_pos_t;
+
+typedef struct {
+    uint32_t image_len;
+} esp_image_metadata_t;
+
+esp_err_t esp_image_get_metadata(const esp_partition_pos_t *part, esp_image_metadata_t *meta);
+
+// esp_app_desc.h
+typedef struct {
+    uint8_t app_elf_sha256[32];
+} esp_app_desc_t;
+
+const esp_app_desc_t *esp_app_get_description(void);
+
+// nvs.h
+typedef uint32_t nvs_handle_t;
+typedef enum {
+    NVS_READONLY,
+    NVS_READWRITE,
+} nvs_open_mode_t;
+#define ESP_ERR_NVS_NOT_FOUND   0x1102
+
+esp_err_t nvs_open(const char *name, nvs_open_mode_t mode, nvs_handle_t *handle);
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *value, size_t *len);
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t len);
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key);
+esp_err_t nvs_commit(nvs_handle_t handle);
+void nvs_close(nvs_handle_t handle);
+
+// driver/gpio.h, esp_adc/adc_oneshot.h: declarations for the inline helpers of cfg_helper.h
+#define GPIO_NUM_3  3
+#define GPIO_NUM_14 14
+esp_err_t gpio_set_level(int gpio, uint32_t level);
+
+typedef int adc_channel_t;
+typedef void *adc_oneshot_unit_handle_t;
+typedef struct {
+    int unit_id;
+} adc_oneshot_unit_init_cfg_t;
+typedef struct {
+    int atten;
+    int bitwidth;
+} adc_oneshot_chan_cfg_t;
+#define ADC_UNIT_1              0
+#define ADC_ATTEN_DB_12         3
+#define ADC_BITWIDTH_DEFAULT    0
+esp_err_t adc_oneshot_new_unit(const adc_oneshot_unit_init_cfg_t *cfg, adc_oneshot_unit_handle_t *handle);
+esp_err_t adc_oneshot_config_channel(adc_oneshot_unit_handle_t handle, adc_channel_t channel,
+                                     const adc_oneshot_chan_cfg_t *cfg);
+esp_err_t adc_oneshot_read(adc_oneshot_unit_handle_t handle, adc_channel_t channel, int *raw);
+
+#endif // IDF_HOST_H
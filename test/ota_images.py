@@ -0,0 +1,95 @@
+"""Encoded OTA images for test_ota_decode, written by python/ota_image.py from made-up firmware.
+
+    python test/ota_images.py <directory>
+
+Writes base.bin (the firmware the nodes run), image.bin (the new firmware), and image.bin encoded as:
+
+  lzss.mota       window 11, lookahead 4, 8 KB chunks (the compress defaults)
+  lzss_w12.mota   window 12, lookahead 5, 16 KB chunks
+  delta.mota      delta against base.bin, window 11, lookahead 4, 32 KB chunks
+  delta_w8.mota   the same with window 8, lookahead 3, 4 KB chunks
+
+The firmware is fixed-seed words from a small instruction set, with calls holding the absolute address of
+other functions, and a block of random bytes in the middle that no chunk covering it can compress. The
+new firmware inserts a function near the start, rewrites a few others and relinks: every function after
+the insertion moves and every call to one of them changes, which is what delta images are for.
+"""
+import os
+import random
+import struct
+import sys
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.dirname(os.path.abspath(__file__))), "python"))
+import ota_image  # noqa: E402
+
+LOAD_ADDRESS = 0x42000000
+FUNCTIONS = 160
+RANDOM_BLOCK = 24 * 1024    # Covers at least two 8 KB chunks whole
+CALL = 0xEF                 # Low byte of a call word, the address follows
+
+
+def make_function(rng, opcodes):
+    """Words of a function, a call as None (filled in by link())."""
+    words = []
+    for _ in range(rng.randrange(16, 512)):
+        if rng.random() < 0.08:
+            words.append(None)
+        else:
+            words.append(rng.choice(opcodes) | rng.randrange(32) << 7)
+    return words, [rng.randrange(FUNCTIONS) for w in words if w is None]
+
+
+def link(functions, random_block):
+    """Image of the functions back to back, the random block after the first half."""
+    addresses, address = [], LOAD_ADDRESS
+    for i, (words, _) in enumerate(functions):
+        if i == len(functions) // 2:
+            address += len(random_block)
+        addresses.append(address)
+        address += 4 * len(words) + 4 * sum(1 for w in words if w is None)
+    out = bytearray()
+    for i, (words, callees) in enumerate(functions):
+        if i == len(functions) // 2:
+            out += random_block
+        callees = iter(callees)
+        for w in words:
+            if w is None:
+                out += struct.pack("<II", CALL, addresses[next(callees) % len(functions)])
+            else:
+                out += struct.pack("<I", w)
+    return bytes(out)
+
+
+def main():
+    out_dir = sys.argv[1]
+    os.makedirs(out_dir, exist_ok=True)
+    rng = random.Random(1)
+    opcodes = [rng.randrange(1 << 32) & ~0xF80 for _ in range(48)]
+    functions = [make_function(rng, opcodes) for _ in range(FUNCTIONS)]
+    random_block = rng.randbytes(RANDOM_BLOCK)
+    base = link(functions, random_block)
+
+    functions.insert(5, make_function(rng, opcodes))
+    for i in rng.sample(range(len(functions)), 4):
+        functions[i] = make_function(rng, opcodes)
+    image = link(functions, random_block)
+
+    md5 = ota_image.image_sha256(base)[:16]
+    files = {
+        "base.bin": base,
+        "image.bin": image,
+        "lzss.mota": ota_image.encode(image, 11, 4, 8192)[0],
+        "lzss_w12.mota": ota_image.encode(image, 12, 5, 16384)[0],
+        "delta.mota": ota_image.encode(image, 11, 4, 32768, base, md5)[0],
+        "delta_w8.mota": ota_image.encode(image, 8, 3, 4096, base, md5)[0],
+    }
+    for name, data in files.items():
+        if name.endswith(".mota") and ota_image.decode(data, base) != image:
+            sys.exit(f"{name}: does not decode back with ota_image.decode()")
+        with open(os.path.join(out_dir, name), "wb") as f:
+            f.write(data)
+        print(f"{name}: {len(data)} bytes")
+
+
+if __name__ == "__main__":
+    main()
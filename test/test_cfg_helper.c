@@ -0,0 +1,271 @@
+#include <string.h>
+#include "test_util.h"
+#include "cfg_helper.h"
+
+/*
+The firmware fingerprint cache of get_running_firmware_fingerprint(), over a RAM NVS of namespaced
+blobs that knows no namespace until something is written to it, like a freshly erased one.
+
+On first boot the image is hashed and the fingerprint cached; on the next boots it comes from NVS
+without hashing, unless asked to rehash. A build of the same size with another ELF SHA-256, an
+image of another size, or the other OTA slot running each hash the image again, once, and a cache
+written by firmware with another record layout is not trusted. The fingerprint is always the first
+16 bytes of the image SHA-256 in hex; without a running partition, image or hash it is "ERROR", and
+nothing is cached then.
+*/
+
+static const esp_partition_t s_slots[2] = {
+    { .address = 0x10000, .size = 0x180000, .label = "ota_0" },
+    { .address = 0x190000, .size = 0x180000, .label = "ota_1" },
+};
+
+// What is flashed in each slot: image length and a build number the image hash derives from
+static struct {
+    uint32_t image_len;
+    uint8_t build;
+} s_images[2];
+static int s_running = 0;                 // -1: no running partition
+static esp_app_desc_t s_app_desc;       // Of the running build
+static int s_hashes;
+static bool s_hash_fails;
+
+const esp_partition_t *esp_ota_get_running_partition(void) {
+    return s_running >= 0 ? &s_slots[s_running] : NULL;
+}
+
+esp_err_t esp_image_get_metadata(const esp_partition_pos_t *pos, esp_image_metadata_t *meta) {
+    int slot = pos->offset == s_slots[1].address;
+    CHECK_EQ(pos->offset, s_slots[slot].address);
+    meta->image_len = s_images[slot].image_len;
+    return meta->image_len > 0 ? ESP_OK : ESP_ERR_INVALID_RESPONSE;
+}
+
+static void image_sha256(int slot, uint8_t *digest) {
+    for (int i = 0; i < 32; i++) {
+        digest[i] = (uint8_t)(i * 37 + s_images[slot].build * 101 + s_images[slot].image_len + slot * 13);
+    }
+}
+
+esp_err_t esp_partition_get_sha256(const esp_partition_t *part, uint8_t *digest) {
+    s_hashes++;
+    if (s_hash_fails) {
+        return ESP_FAIL;
+    }
+    image_sha256(part == &s_slots[1], digest);
+    return ESP_OK;
+}
+
+const esp_app_desc_t *esp_app_get_description(void) {
+    return &s_app_desc;
+}
+
+// NVS: a few namespaced blobs
+#define NVS_ENTRIES 8
+
+static struct {
+    char ns[16];
+    char key[16];
+    size_t len;
+    uint8_t data[128];
+} s_nvs[NVS_ENTRIES];
+static const char *s_open_ns[4];
+static int s_nvs_writes;
+
+static int nvs_find(const char *ns, const char *key) {
+    for (int i = 0; i < NVS_ENTRIES; i++) {
+        if (s_nvs[i].ns[0] && strcmp(s_nvs[i].ns, ns) == 0 && (key == NULL || strcmp(s_nvs[i].key, key) == 0)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+esp_err_t nvs_open(const char *name, nvs_open_mode_t mode, nvs_handle_t *handle) {
+    if (mode == NVS_READONLY && nvs_find(name, NULL) < 0) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    for (int h = 0; h < 4; h++) {
+        if (s_open_ns[h] == NULL) {
+            s_open_ns[h] = name;
+            *handle = h + 1;
+            return ESP_OK;
+        }
+    }
+    CHECK(!"NVS handles leaked");
+    return ESP_ERR_NO_MEM;
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *value, size_t *len) {
+    int i = nvs_find(s_open_ns[handle - 1], key);
+    if (i < 0) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    if (*len < s_nvs[i].len) {
+        *len = s_nvs[i].len;
+        return ESP_ERR_INVALID_SIZE;     // ESP_ERR_NVS_INVALID_LENGTH
+    }
+    memcpy(value, s_nvs[i].data, s_nvs[i].len);
+    *len = s_nvs[i].len;
+    return ESP_OK;
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t len) {
+    const char *ns = s_open_ns[handle - 1];
+    int i = nvs_find(ns, key);
+    for (int e = 0; i < 0 && e < NVS_ENTRIES; e++) {
+        if (!s_nvs[e].ns[0]) {
+            i = e;
+        }
+    }
+    CHECK(i >= 0 && len <= sizeof(s_nvs[i].data));
+    strcpy(s_nvs[i].ns, ns);
+    strcpy(s_nvs[i].key, key);
+    memcpy(s_nvs[i].data, value, len);
+    s_nvs[i].len = len;
+    s_nvs_writes++;
+    return ESP_OK;
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key) {
+    int i = nvs_find(s_open_ns[handle - 1], key);
+    if (i < 0) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    s_nvs[i].ns[0] = 0;
+    return ESP_OK;
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle) {
+    return ESP_OK;
+}
+
+void nvs_close(nvs_handle_t handle) {
+    s_open_ns[handle - 1] = NULL;
+}
+
+static bool handles_closed(void) {
+    for (int h = 0; h < 4; h++) {
+        if (s_open_ns[h] != NULL) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Flash a build into a slot; it runs from the next boot()
+static void flash(int slot, uint32_t image_len, uint8_t build) {
+    s_images[slot].image_len = image_len;
+    s_images[slot].build = build;
+}
+
+static void boot(int slot) {
+    s_running = slot;
+    memset(s_app_desc.app_elf_sha256, 0, sizeof(s_app_desc.app_elf_sha256));
+    s_app_desc.app_elf_sha256[0] = s_images[slot].build;
+    s_app_desc.app_elf_sha256[31] = 0xEF;
+}
+
+// The fingerprint as it should be, and whether getting it took `hashes` hashes of the image
+static void expect(bool rehash, int hashes) {
+    uint8_t digest[32];
+    image_sha256(s_running, digest);
+    char want[33];
+    for (int i = 0; i < 16; i++) {
+        sprintf(want + 2 * i, "%02x", digest[i]);
+    }
+    char got[33];
+    memset(got, 'x', sizeof(got));
+    int before = s_hashes;
+    get_running_firmware_fingerprint(got, rehash);
+    CHECK(strcmp(got, want) == 0);
+    CHECK_EQ(s_hashes - before, hashes);
+    CHECK(handles_closed());
+}
+
+static void test_cache(void) {
+    // First boot: nothing in NVS, not even the namespace
+    flash(0, 912345, 1);
+    boot(0);
+    expect(false, 1);
+    CHECK_EQ(s_nvs_writes, 1);
+    expect(false, 0);
+    expect(false, 0);
+    CHECK_EQ(s_nvs_writes, 1);
+
+    // Asked to hash it again
+    expect(true, 1);
+    expect(false, 0);
+
+    // Rebuilt at the same size: only the ELF SHA-256 tells
+    flash(0, 912345, 2);
+    boot(0);
+    expect(false, 1);
+    expect(false, 0);
+
+    // Another size
+    flash(0, 912377, 2);
+    boot(0);
+    expect(false, 1);
+    expect(false, 0);
+
+    // Updated into the other slot, then rolled back: the cache holds the running one only
+    flash(1, 912377, 2);
+    boot(1);
+    expect(false, 1);
+    expect(false, 0);
+    boot(0);
+    expect(false, 1);
+    expect(false, 0);
+}
+
+static void test_other_layout(void) {
+    // A cache record of another size (older firmware): hashed again, and replaced
+    int i = nvs_find("devcfg", "fw_fp");
+    CHECK(i >= 0);
+    s_nvs[i].len -= 32;
+    expect(false, 1);
+    CHECK(s_nvs[i].len > 32);
+    expect(false, 0);
+
+    // Stored by another module in the same namespace: untouched
+    device_config_t config = { .version = 7, .node_type = 2 };
+    strcpy(config.fw_md5, "0123456789abcdef0123456789abcdef");
+    CHECK_EQ(save_device_config(&config), ESP_OK);
+    expect(false, 0);
+    memset(&config, 0, sizeof(config));
+    CHECK_EQ(load_device_config(&config), ESP_OK);
+    CHECK_EQ(config.version, 7);
+    CHECK(strcmp(config.fw_md5, "0123456789abcdef0123456789abcdef") == 0);
+}
+
+static void test_errors(void) {
+    char got[33];
+    int writes = s_nvs_writes;
+
+    // The hash fails: nothing cached, the next call hashes again
+    flash(0, 700000, 3);
+    boot(0);
+    s_hash_fails = true;
+    get_running_firmware_fingerprint(got, false);
+    CHECK(strcmp(got, "ERROR") == 0);
+    CHECK_EQ(s_nvs_writes, writes);
+    s_hash_fails = false;
+    expect(false, 1);
+
+    // No valid image, or no running partition
+    flash(1, 0, 3);
+    boot(1);
+    get_running_firmware_fingerprint(got, false);
+    CHECK(strcmp(got, "ERROR") == 0);
+    s_running = -1;
+    get_running_firmware_fingerprint(got, false);
+    CHECK(strcmp(got, "ERROR") == 0);
+    CHECK(handles_closed());
+}
+
+int main(void) {
+    test_cache();
+    test_other_layout();
+    test_errors();
+    return test_result("test_cfg_helper");
+}
@@ -0,0 +1,137 @@
+#include <math.h>
+#include "test_util.h"
+#include "clock_est.h"
+
+/*
+Host simulation of the GPS clock estimator: a local clock with a constant drift against GPS time,
+NAV-PVT samples every 5 s whose local timestamps arrive late by a random latency, isolated
+outliers, a real time step and a GPS week rollover. The estimated drift, the predicted GPS time
+between samples and the error bound reported with it are checked against the simulated truth.
+*/
+
+#define SAMPLE_US       5000000LL
+#define MAX_DRIFT_PPB   40000
+#define ACC_US          20          // tAcc reported with every sample
+
+typedef struct {
+    double drift;           // Local clock rate error (local runs 1 + drift times as fast)
+    double jitter_us;       // Scale of the half-normal timestamp latency
+    int outlier_every;      // Every n-th sample 20 ms late (0: none)
+    int step_at;            // Sample at which GPS time steps by 1 s (0: none)
+    int samples;
+} scenario_t;
+
+typedef struct {
+    double worst_us;        // Worst prediction error once converged
+    double worst_drift_ppb; // Worst drift error once converged
+    int predictions;
+    int outside_bound;      // Predictions off by more than the reported error bound
+    uint32_t outliers;
+    uint32_t resets;
+} result_t;
+
+static double gauss(void) {
+    double u = (test_rand() + 1.0) / 4294967297.0;
+    double v = (test_rand() + 1.0) / 4294967297.0;
+    return sqrt(-2 * log(u)) * cos(2 * M_PI * v);
+}
+
+// GPS time of week minus truth, folded across the week boundary
+static double tow_error(uint64_t got, double truth) {
+    double d = (double)got - fmod(truth, GPS_WEEK_US);
+    if (d > GPS_WEEK_US / 2) d -= GPS_WEEK_US;
+    if (d < -GPS_WEEK_US / 2) d += GPS_WEEK_US;
+    return d;
+}
+
+static result_t run(const scenario_t *sc) {
+    clock_est_t est;
+    clock_est_init(&est, MAX_DRIFT_PPB);
+    result_t res = { 0 };
+    // Start 5 minutes before the end of a GPS week, so the rollover is crossed
+    const double t0 = GPS_WEEK_US - 300e6;
+    const double true_drift_ppb = -sc->drift / (1 + sc->drift) * 1e9;   // d(GPS - local)/d(local)
+    double step_us = 0;
+    int converged_at = 20;
+
+    for (int k = 0; k < sc->samples; k++) {
+        if (sc->step_at && k == sc->step_at) {
+            step_us = 1e6;
+            converged_at = k + 20;
+        }
+        double gps = t0 + k * SAMPLE_US;
+        double local = 1e6 + (gps - t0) * (1 + sc->drift);
+        double late = fabs(gauss()) * sc->jitter_us;
+        if (sc->outlier_every && k % sc->outlier_every == sc->outlier_every - 1) {
+            late += 20000;
+        }
+        clock_est_update(&est, (int64_t)(local + late), (uint64_t)fmod(gps + step_us, GPS_WEEK_US), ACC_US);
+        if (k < converged_at) {
+            continue;
+        }
+
+        double drift_err = fabs(est.drift_q8 / 256.0 - true_drift_ppb);
+        if (drift_err > res.worst_drift_ppb) res.worst_drift_ppb = drift_err;
+        // Query between this sample and the next
+        for (int q = 1; q < 5; q++) {
+            double gps_q = gps + q * 1e6;
+            double local_q = 1e6 + (gps_q - t0) * (1 + sc->drift);
+            uint64_t predicted;
+            uint32_t err_us;
+            CHECK(clock_est_predict(&est, (int64_t)local_q, &predicted, &err_us));
+            double d = fabs(tow_error(predicted, gps_q + step_us));
+            if (d > res.worst_us) res.worst_us = d;
+            if (d > err_us) res.outside_bound++;
+            res.predictions++;
+        }
+    }
+    res.outliers = est.outliers;
+    res.resets = est.resets;
+    printf("drift %+.0f ppm jitter %.0f us: worst %.1f us, drift err %.1f ppb, outside bound %d/%d, "
+           "outliers %u resets %u\n", sc->drift * 1e6, sc->jitter_us, res.worst_us, res.worst_drift_ppb,
+           res.outside_bound, res.predictions, res.outliers, res.resets);
+    return res;
+}
+
+// Converged prediction error within `us`, drift within `ppb`, and the reported bound holding for 99%
+static void check_bounds(const result_t *res, double us, double ppb) {
+    CHECK(res->predictions > 0);
+    CHECK(res->worst_us <= us);
+    CHECK(res->worst_drift_ppb <= ppb);
+    CHECK(res->outside_bound * 100 <= res->predictions);
+}
+
+int main(void) {
+    uint64_t unused;
+    clock_est_t est;
+    clock_est_init(&est, MAX_DRIFT_PPB);
+    CHECK(!clock_est_predict(&est, 0, &unused, NULL));
+
+    // Clean timestamps: the fit is a straight line through the samples
+    result_t res = run(&(scenario_t){ .drift = 23e-6, .samples = 200 });
+    check_bounds(&res, 2, 5);
+    CHECK_EQ(res.outliers + res.resets, 0);
+    res = run(&(scenario_t){ .drift = -30e-6, .samples = 200 });
+    check_bounds(&res, 2, 5);
+
+    // Timestamp latency: errors scale with the jitter (the mean latency shows up as a bias)
+    res = run(&(scenario_t){ .drift = 23e-6, .jitter_us = 50, .samples = 400 });
+    check_bounds(&res, 150, 1000);
+    CHECK_EQ(res.outliers + res.resets, 0);
+    res = run(&(scenario_t){ .drift = 23e-6, .jitter_us = 200, .samples = 400 });
+    check_bounds(&res, 600, 4000);
+
+    // Isolated 20 ms late samples are skipped without disturbing the fit
+    res = run(&(scenario_t){ .drift = 23e-6, .jitter_us = 50, .outlier_every = 37, .samples = 400 });
+    check_bounds(&res, 150, 1000);
+    CHECK_EQ(res.outliers, 400 / 37);
+    CHECK_EQ(res.resets, 0);
+
+    // A 1 s step in GPS time: one sample skipped, the next restarts the fit, which converges again
+    res = run(&(scenario_t){ .drift = -10e-6, .jitter_us = 50, .step_at = 100, .samples = 400 });
+    check_bounds(&res, 150, 1000);
+    CHECK_EQ(res.outliers, 1);
+    CHECK_EQ(res.resets, 1);
+
+    return test_result("test_clock_est");
+}
@@ -0,0 +1,189 @@
+#include <math.h>
+#include <time.h>
+#include "test_util.h"
+#include "enu_frame.h"
+
+/*
+Host tests for the integer ENU conversions against a long double reference: random references
+and 40k random points up to 70 km from them, through both enu_from_ecef() and
+enu_from_llh(), must stay within 0.1 mm on every axis. A timing loop reports the cost of each
+conversion on the host (no limit asserted; the target is what matters).
+*/
+
+#define MAX_ERROR_M     1e-4
+#define REFERENCES      80
+#define POINTS_PER_REF  500
+
+static const long double WGS84_A = 6378137.0L;
+static const long double WGS84_F = 1.0L / 298.257223563L;
+#define WGS84_E2 (WGS84_F * (2.0L - WGS84_F))
+#define DEG_E9_TO_RAD (3.14159265358979323846264338327950288L / 180e9L)
+
+static void llh_to_ecef(long double lat, long double lon, long double h, long double xyz[3]) {
+    long double s = sinl(lat), c = cosl(lat), n = WGS84_A / sqrtl(1 - WGS84_E2 * s * s);
+    xyz[0] = (n + h) * c * cosl(lon);
+    xyz[1] = (n + h) * c * sinl(lon);
+    xyz[2] = (n * (1 - WGS84_E2) + h) * s;
+}
+
+static void ecef_to_llh(const long double xyz[3], long double *lat, long double *lon, long double *h) {
+    long double p = hypotl(xyz[0], xyz[1]);
+    long double la = atan2l(xyz[2], p * (1 - WGS84_E2));
+    for (int i = 0; i < 20; i++) {
+        long double s = sinl(la), n = WGS84_A / sqrtl(1 - WGS84_E2 * s * s);
+        *h = p * cosl(la) + xyz[2] * s - WGS84_A * WGS84_A / n;
+        la = atan2l(xyz[2], p * (1 - WGS84_E2 * n / (n + *h)));
+    }
+    *lat = la;
+    *lon = atan2l(xyz[1], xyz[0]);
+}
+
+// ENU of `p` around `ref` (both ECEF, m)
+static void reference_enu(const long double ref[3], const long double p[3], long double enu[3]) {
+    long double lat, lon, h;
+    ecef_to_llh(ref, &lat, &lon, &h);
+    long double d[3] = { p[0] - ref[0], p[1] - ref[1], p[2] - ref[2] };
+    long double sl = sinl(lat), cl = cosl(lat), so = sinl(lon), co = cosl(lon);
+    enu[0] = -so * d[0] + co * d[1];
+    enu[1] = -sl * co * d[0] - sl * so * d[1] + cl * d[2];
+    enu[2] = cl * co * d[0] + cl * so * d[1] + sl * d[2];
+}
+
+static double uniform(void) {
+    return test_rand() / 4294967295.0 * 2 - 1;
+}
+
+static double max_error(const enu_pos_t *got, const long double want[3]) {
+    double e = fabs((double)(got->e * 1e-4L - want[0]));
+    double n = fabs((double)(got->n * 1e-4L - want[1]));
+    double u = fabs((double)(got->u * 1e-4L - want[2]));
+    return fmax(e, fmax(n, u));
+}
+
+static void test_accuracy(void) {
+    // 70 km per horizontal axis keeps every ECEF component of the baseline within ENU_FRAME_MAX_RANGE
+    const long double range_m = ENU_FRAME_MAX_RANGE * 1e-4L * 0.7L;
+    double worst_ecef = 0, worst_llh = 0;
+    int points = 0;
+    for (int r = 0; r < REFERENCES; r++) {
+        // Latitudes up to 60 deg keep 70 km east within ENU_FRAME_MAX_DELTA_E9 of longitude
+        long double lat = uniform() * 1.047L, lon = uniform() * 3.14159L, h = uniform() * 500 + 500;
+        long double ref[3];
+        llh_to_ecef(lat, lon, h, ref);
+        int64_t rx = llroundl(ref[0] * 1e4L), ry = llroundl(ref[1] * 1e4L), rz = llroundl(ref[2] * 1e4L);
+        long double ref_q[3] = { rx * 1e-4L, ry * 1e-4L, rz * 1e-4L };
+        enu_frame_t frame;
+        enu_frame_init(&frame, rx, ry, rz);
+        long double rlat, rlon, rh;
+        ecef_to_llh(ref_q, &rlat, &rlon, &rh);
+        long double sl = sinl(rlat), cl = cosl(rlat), so = sinl(rlon), co = cosl(rlon);
+
+        for (int k = 0; k < POINTS_PER_REF; k++) {
+            long double de = uniform() * range_m, dn = uniform() * range_m, du = uniform() * 100;
+            long double p[3] = {
+                ref_q[0] - so * de - sl * co * dn + cl * co * du,
+                ref_q[1] + co * de - sl * so * dn + cl * so * du,
+                ref_q[2] + cl * dn + sl * du,
+            };
+            long double want[3];
+            enu_pos_t got;
+
+            // ECEF on the 0.1 mm grid of NAV-HPPOSECEF
+            int64_t px = llroundl(p[0] * 1e4L), py = llroundl(p[1] * 1e4L), pz = llroundl(p[2] * 1e4L);
+            long double p_q[3] = { px * 1e-4L, py * 1e-4L, pz * 1e-4L };
+            reference_enu(ref_q, p_q, want);
+            if (enu_from_ecef(&frame, px, py, pz, &got)) {
+                worst_ecef = fmax(worst_ecef, max_error(&got, want));
+            } else {
+                CHECK(!"ECEF point out of range");
+            }
+
+            // Latitude/longitude/height on the 1e-9 deg / 0.1 mm grid of NAV-HPPOSLLH
+            long double plat, plon, ph;
+            ecef_to_llh(p, &plat, &plon, &ph);
+            int64_t lat_e9 = llroundl(plat / DEG_E9_TO_RAD), lon_e9 = llroundl(plon / DEG_E9_TO_RAD);
+            int64_t h_mm10 = llroundl(ph * 1e4L);
+            long double q[3];
+            llh_to_ecef(lat_e9 * DEG_E9_TO_RAD, lon_e9 * DEG_E9_TO_RAD, h_mm10 * 1e-4L, q);
+            reference_enu(ref_q, q, want);
+            if (enu_from_llh(&frame, lat_e9, lon_e9, h_mm10, &got)) {
+                worst_llh = fmax(worst_llh, max_error(&got, want));
+            } else {
+                CHECK(!"LLH point out of range");
+            }
+            points++;
+        }
+    }
+    printf("%d points up to %.0f km: worst error ECEF %.4f mm, LLH %.4f mm\n", points, (double)range_m / 1000,
+           worst_ecef * 1e3, worst_llh * 1e3);
+    CHECK(worst_ecef < MAX_ERROR_M);
+    CHECK(worst_llh < MAX_ERROR_M);
+}
+
+static void test_range(void) {
+    enu_frame_t frame;
+    int64_t rx = 38000000000LL, ry = 6000000000LL, rz = 50000000000LL;
+    enu_frame_init(&frame, rx, ry, rz);
+    enu_pos_t pos;
+    CHECK(enu_from_ecef(&frame, rx, ry, rz, &pos));
+    CHECK_EQ(pos.e, 0);
+    CHECK_EQ(pos.n, 0);
+    CHECK_EQ(pos.u, 0);
+    CHECK(!enu_from_ecef(&frame, rx + ENU_FRAME_MAX_RANGE + 1, ry, rz, &pos));
+    CHECK(!enu_from_llh(&frame, frame.lat0_e9 + ENU_FRAME_MAX_DELTA_E9 + 1, frame.lon0_e9, frame.h0_q8 / 256, &pos));
+
+    // The shared frame is only rebuilt when the reference moves
+    CHECK(!enu_frame_get(&frame));
+    CHECK(enu_frame_set_reference(rx, ry, rz));
+    CHECK(!enu_frame_set_reference(rx, ry, rz));
+    enu_frame_t shared;
+    CHECK(enu_frame_get(&shared));
+    CHECK_EQ(shared.ref_x, rx);
+    CHECK_EQ(shared.ref_z, rz);
+}
+
+static double elapsed_ns(const struct timespec *a, const struct timespec *b) {
+    return (b->tv_sec - a->tv_sec) * 1e9 + (b->tv_nsec - a->tv_nsec);
+}
+
+static void time_conversions(void) {
+    enum { N = 1000000 };
+    enu_frame_t frame;
+    enu_frame_init(&frame, 38000000000LL, 6000000000LL, 50000000000LL);
+    enu_pos_t pos;
+    volatile int32_t sink = 0;
+    struct timespec t0, t1;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int i = 0; i < N; i++) {
+        enu_from_ecef(&frame, 38000000000LL + i, 6000000000LL - i, 50000000000LL + i * 3, &pos);
+        sink += pos.e;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double ecef_ns = elapsed_ns(&t0, &t1) / N;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int i = 0; i < N; i++) {
+        enu_from_llh(&frame, frame.lat0_e9 + i * 37, frame.lon0_e9 - i * 11, frame.h0_q8 / 256 + i, &pos);
+        sink += pos.e;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double llh_ns = elapsed_ns(&t0, &t1) / N;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int i = 0; i < N / 100; i++) {
+        enu_frame_init(&frame, 38000000000LL + i, 6000000000LL, 50000000000LL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double init_ns = elapsed_ns(&t0, &t1) / (N / 100);
+
+    printf("host timing: enu_from_ecef %.0f ns, enu_from_llh %.0f ns, enu_frame_init %.0f ns\n", ecef_ns, llh_ns,
+           init_ns);
+}
+
+int main(void) {
+    test_accuracy();
+    test_range();
+    time_conversions();
+    return test_result("test_enu_frame");
+}
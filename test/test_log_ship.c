@@ -0,0 +1,241 @@
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include "test_util.h"
+
+/*
+The log_ship ring (reserve(), enqueue() through the esp_log hook, drain()) with pthread producers and
+one drainer, built with -fsanitize=thread. log_ship.c is included rather than linked so the test
+reaches its static ring; the sender task and sockets are never started. The ring is 2 KB with lines
+cut at 256 bytes (CMakeLists.txt), so it wraps and fills all the time.
+
+First on one thread: a record reserved but not committed holds back the ones after it, a record
+that would wrap goes after a PAD record, a full ring drops and counts lines, long lines are cut and
+counted. Then producers log numbered lines of random length while the drainer empties the ring into
+batches: every line comes out whole, in order per producer, or is counted as dropped; every line too
+long comes out cut to the limit and is counted. Every freed byte is zero once the ring is empty.
+*/
+
+#include "log_ship.c"
+
+#define PRODUCERS       4
+#define LINES           20000
+#define HEADER_LEN      8       // "A012345 "
+
+static uint32_t s_rand_seed[PRODUCERS];
+
+// Payload length of line `i` of producer `p`, so the drainer knows what to expect
+static int payload_len(int p, int i) {
+    return (p * 7919 + i * 104729) % 300;
+}
+
+static void ship(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    log_ship_vprintf(format, args);
+    va_end(args);
+}
+
+static size_t drain_all(char *out, size_t cap) {
+    size_t n = 0, got;
+    while ((got = drain(out + n, cap - n)) > 0) {
+        n += got;
+    }
+    return n;
+}
+
+static bool ring_is_zero(void) {
+    for (size_t i = 0; i < sizeof(s_ring); i++) {
+        if (s_ring[i] != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void test_commit_bit(void) {
+    char out[64];
+    uint32_t off;
+    CHECK(reserve(REC_SPAN(5), &off));
+    ship("%s\n", "after");
+    CHECK_EQ(drain(out, sizeof(out)), 0);
+    memcpy(&s_ring[off + REC_HEADER], "held\n", 5);
+    __atomic_store_n(header_at(off), REC_COMMITTED | 5, __ATOMIC_RELEASE);
+    CHECK_EQ(drain_all(out, sizeof(out)), 11);
+    CHECK(memcmp(out, "held\nafter\n", 11) == 0);
+    CHECK_EQ(s_read, s_reserve);
+    CHECK(ring_is_zero());
+}
+
+static void test_pad_on_wrap(void) {
+    char out[LOG_SHIP_BATCH];
+    char line[101];
+    memset(line, 'w', 99);
+    line[99] = '\n';
+    line[100] = 0;
+    // Lines until the next one would run past the end of the ring
+    while ((s_reserve & RING_MASK) + REC_SPAN(100) <= CONFIG_LOG_SHIP_BUF_SIZE) {
+        ship("%s", line);
+        CHECK_EQ(drain_all(out, sizeof(out)), 100);
+    }
+    uint32_t at = s_reserve & RING_MASK;
+    CHECK(at != 0);
+    ship("%s", line);
+    uint32_t pad = *header_at(at);
+    CHECK_EQ(pad, REC_COMMITTED | REC_PAD | (CONFIG_LOG_SHIP_BUF_SIZE - at - REC_HEADER));
+    CHECK_EQ(*header_at(0), REC_COMMITTED | 100);
+    CHECK_EQ(s_reserve & RING_MASK, REC_SPAN(100));
+    CHECK_EQ(drain_all(out, sizeof(out)), 100);
+    CHECK(memcmp(out, line, 100) == 0);
+    CHECK(ring_is_zero());
+}
+
+static void test_full_and_truncated(void) {
+    char out[CONFIG_LOG_SHIP_BUF_SIZE];
+    log_ship_stats_t before, after;
+    log_ship_get_stats(&before);
+    int queued = 0;
+    for (;;) {
+        ship("%099d\n", queued);
+        log_ship_get_stats(&after);
+        if (after.dropped != before.dropped) {
+            break;
+        }
+        queued++;
+    }
+    CHECK(queued >= CONFIG_LOG_SHIP_BUF_SIZE / REC_SPAN(100) - 1);
+    CHECK_EQ(after.dropped - before.dropped, 1);
+    CHECK_EQ(after.dropped_bytes - before.dropped_bytes, 100);
+    CHECK_EQ(after.lines - before.lines, queued);
+    size_t n = drain_all(out, sizeof(out));
+    CHECK_EQ(n, queued * 100);
+    for (int i = 0; i < queued && (size_t)(i + 1) * 100 <= n; i++) {
+        char want[101];
+        snprintf(want, sizeof(want), "%099d\n", i);
+        CHECK(memcmp(out + i * 100, want, 100) == 0);
+    }
+
+    ship("%0*d\n", CONFIG_LOG_SHIP_LINE_MAX + 100, 7);
+    log_ship_get_stats(&after);
+    CHECK_EQ(after.truncated - before.truncated, 1);
+    CHECK_EQ(drain_all(out, sizeof(out)), CONFIG_LOG_SHIP_LINE_MAX);
+    CHECK_EQ(out[CONFIG_LOG_SHIP_LINE_MAX - 2], '0');
+    CHECK_EQ(out[CONFIG_LOG_SHIP_LINE_MAX - 1], '\n');
+    CHECK(ring_is_zero());
+}
+
+static bool s_producing;
+static uint32_t s_received[PRODUCERS];
+static uint32_t s_received_cut;
+static uint64_t s_received_bytes;
+static uint64_t s_sent_bytes;
+
+static void *producer(void *arg) {
+    int p = (int)(intptr_t)arg;
+    char payload[300];
+    memset(payload, 'a' + p, sizeof(payload));
+    uint64_t bytes = 0;
+    for (int i = 0; i < LINES; i++) {
+        int len = payload_len(p, i);
+        ship("%c%06d %.*s\n", 'A' + p, i, len, payload);
+        int total = HEADER_LEN + len + 1;
+        bytes += total < CONFIG_LOG_SHIP_LINE_MAX ? total : CONFIG_LOG_SHIP_LINE_MAX;
+        s_rand_seed[p] = s_rand_seed[p] * 1103515245 + 12345;
+        if ((s_rand_seed[p] >> 16) % 16 == 0) {
+            sched_yield();
+        }
+    }
+    __atomic_fetch_add(&s_sent_bytes, bytes, __ATOMIC_RELAXED);
+    return NULL;
+}
+
+// One line as the producer wrote it, cut or not; lines numbered in order per producer
+static void check_line(const char *line, size_t len, int *next) {
+    int p = line[0] - 'A';
+    if (len < HEADER_LEN + 1 || p < 0 || p >= PRODUCERS || line[len - 1] != '\n') {
+        CHECK(!"torn line");
+        return;
+    }
+    int i = atoi(line + 1);
+    CHECK(i >= next[p]);
+    next[p] = i + 1;
+    size_t want = HEADER_LEN + payload_len(p, i) + 1;
+    if (want > CONFIG_LOG_SHIP_LINE_MAX) {
+        want = CONFIG_LOG_SHIP_LINE_MAX;
+        s_received_cut++;
+    }
+    CHECK_EQ(len, want);
+    for (size_t k = HEADER_LEN; k + 1 < len; k++) {
+        if (line[k] != 'a' + p) {
+            CHECK(!"torn payload");
+            break;
+        }
+    }
+    s_received[p]++;
+    s_received_bytes += len;
+}
+
+static void *drainer(void *arg) {
+    static char batch[LOG_SHIP_BATCH];
+    int next[PRODUCERS] = { 0 };
+    for (;;) {
+        bool last = !__atomic_load_n(&s_producing, __ATOMIC_ACQUIRE);
+        size_t n = drain(batch, sizeof(batch));
+        size_t start = 0;
+        for (size_t k = 0; k < n; k++) {
+            if (batch[k] == '\n') {
+                check_line(batch + start, k + 1 - start, next);
+                start = k + 1;
+            }
+        }
+        CHECK_EQ(start, n);     // Whole lines only
+        if (n == 0) {
+            if (last && s_read == __atomic_load_n(&s_reserve, __ATOMIC_ACQUIRE)) {
+                break;
+            }
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+static void test_concurrent(void) {
+    memset(&s_stats, 0, sizeof(s_stats));
+    s_producing = true;
+    pthread_t producers[PRODUCERS], drain_thread;
+    pthread_create(&drain_thread, NULL, drainer, NULL);
+    for (int p = 0; p < PRODUCERS; p++) {
+        s_rand_seed[p] = test_rand();
+        pthread_create(&producers[p], NULL, producer, (void *)(intptr_t)p);
+    }
+    for (int p = 0; p < PRODUCERS; p++) {
+        pthread_join(producers[p], NULL);
+    }
+    __atomic_store_n(&s_producing, false, __ATOMIC_RELEASE);
+    pthread_join(drain_thread, NULL);
+
+    log_ship_stats_t st;
+    log_ship_get_stats(&st);
+    uint32_t received = 0;
+    for (int p = 0; p < PRODUCERS; p++) {
+        received += s_received[p];
+    }
+    CHECK_EQ(st.lines, received);
+    CHECK_EQ(st.lines + st.dropped, PRODUCERS * LINES);
+    CHECK_EQ(st.truncated, s_received_cut);
+    CHECK(st.truncated > 0);
+    CHECK(st.dropped > 0);      // A 2 KB ring against four producers
+    CHECK_EQ(s_received_bytes + st.dropped_bytes, s_sent_bytes);
+    CHECK(ring_is_zero());
+    printf("%d producers, %d lines each: %lu shipped (%lu cut), %lu dropped (%lu bytes)\n", PRODUCERS, LINES,
+           (unsigned long)st.lines, (unsigned long)st.truncated, (unsigned long)st.dropped,
+           (unsigned long)st.dropped_bytes);
+}
+
+int main(void) {
+    test_commit_bit();
+    test_pad_on_wrap();
+    test_full_and_truncated();
+    test_concurrent();
+    return test_result("test_log_ship");
+}
@@ -0,0 +1,327 @@
+#include <string.h>
+#include <unistd.h>
+#include "test_util.h"
+#include "mesh_dispatch.h"
+#include "mesh_tx.h"
+
+/*
+mesh_dispatch with FreeRTOS on threads (test/host), so worker queues are real: packets built with
+wire_encode() in pool buffers and handed to mesh_dispatch_packet() by the test, as the RX task does.
+
+Packets whose size does not match their header, or whose payload is outside the registered range,
+are counted as malformed and never reach the handler; ones too short for a header, or of a type
+nobody registered, count as unknown; an unknown header version as a bad header. Handler time lands
+in the right histogram bucket at every 4x boundary (the host cycle counter is the clock, which the
+handler moves on). A worker whose handler is busy takes its queue's worth of packets and drops the
+next one, the buffers held by exactly the queued jobs and all back once the worker is done. AGGREGATE
+frames are unpacked into records checked and dispatched one by one, those for a worker holding the
+frame's buffer, and a truncated or nested record ends the frame as malformed.
+*/
+
+#define WORKER_QUEUE    2
+
+static const mesh_addr_t FROM = { .addr = { 0x02, 0, 0, 0, 0, 0x07 } };
+
+// From modules not built here (protocol.c, gps_ptp_time.c, mesh_tx.c)
+const char *DATATAG = "DATA_TAG";
+
+uint64_t gps_ptp_now_us(void) {
+    return 0;
+}
+
+esp_err_t mesh_tx_send(mesh_tx_class_t cls, const mesh_addr_t *to, int flag, ProtocolType type,
+                       const void *payload, uint16_t len) {
+    return ESP_OK;
+}
+
+// ECHO_DATA on the RX task: payloads seen, and cycles to spend in the handler
+static struct {
+    int calls;
+    uint8_t first;
+    size_t len;
+    uint32_t cycles;
+} s_echo;
+
+static void rx_echo(const mesh_addr_t *from, const void *payload, size_t payload_len, pkt_buf_t *buf, void *arg) {
+    s_echo.calls++;
+    s_echo.first = *(const uint8_t *)payload;
+    s_echo.len = payload_len;
+    CHECK(memcmp(from->addr, FROM.addr, 6) == 0);
+    // NULL for a message
+    CHECK(buf == NULL || ((const uint8_t *)payload >= buf->data && (const uint8_t *)payload < buf->data + buf->len));
+    host_now_us += s_echo.cycles;       // The host cycle counter
+}
+
+// OTA_DATA on the worker: blocks while s_ota.hold is set
+static struct {
+    int entered;
+    int done;
+    bool hold;
+    uint8_t seen[8];
+} s_ota;
+
+static void rx_ota(const mesh_addr_t *from, const void *payload, size_t payload_len, pkt_buf_t *buf, void *arg) {
+    CHECK(buf != NULL && buf->refs >= 1);
+    int n = __atomic_fetch_add(&s_ota.entered, 1, __ATOMIC_ACQ_REL);
+    if (n < 8) {
+        s_ota.seen[n] = *(const uint8_t *)payload;
+    }
+    while (__atomic_load_n(&s_ota.hold, __ATOMIC_ACQUIRE)) {
+        usleep(1000);
+    }
+    __atomic_fetch_add(&s_ota.done, 1, __ATOMIC_RELEASE);
+}
+
+static uint32_t in_use(void) {
+    pkt_pool_stats_t st;
+    pkt_pool_get_stats(&st);
+    return st.in_use;
+}
+
+// Packet of `len` payload bytes, the first one `first`, the rest `len`
+static pkt_buf_t *packet(ProtocolType type, uint16_t len, uint8_t first) {
+    pkt_buf_t *buf = pkt_pool_alloc();
+    memset(buf->data + WIRE_TX_HDR_SIZE, (uint8_t)len, len);
+    if (len > 0) {
+        buf->data[WIRE_TX_HDR_SIZE] = first;
+    }
+    buf->len = wire_encode(buf->data, type, len);
+    return buf;
+}
+
+static void dispatch_and_release(pkt_buf_t *buf) {
+    mesh_dispatch_packet(&FROM, buf);
+    pkt_buf_release(buf);
+}
+
+// Append a record to an AGGREGATE frame under construction (frame->len: records so far)
+static void add_record(pkt_buf_t *frame, ProtocolType type, uint16_t len, uint8_t first) {
+    uint8_t *pkt = frame->data + WIRE_TX_HDR_SIZE + frame->len;
+    memset(pkt + WIRE_TX_HDR_SIZE, (uint8_t)len, len);
+    if (len > 0) {
+        pkt[WIRE_TX_HDR_SIZE] = first;
+    }
+    frame->len += wire_encode(pkt, type, len);
+}
+
+static void close_frame(pkt_buf_t *frame) {
+    frame->len = wire_encode(frame->data, AGGREGATE, frame->len);
+}
+
+static void wait_for(int *counter, int value) {
+    for (int i = 0; i < 5000 && __atomic_load_n(counter, __ATOMIC_ACQUIRE) < value; i++) {
+        usleep(1000);
+    }
+    CHECK_EQ(__atomic_load_n(counter, __ATOMIC_ACQUIRE), value);
+}
+
+static void test_validation(void) {
+    mesh_dispatch_stats_t st;
+    mesh_dispatch_totals_t before, after;
+    mesh_dispatch_get_totals(&before);
+
+    dispatch_and_release(packet(ECHO_DATA, 4, 1));
+    dispatch_and_release(packet(ECHO_DATA, 8, 2));
+    CHECK_EQ(s_echo.calls, 2);
+    CHECK_EQ(s_echo.first, 2);
+    CHECK_EQ(s_echo.len, 8);
+
+    // Payload out of range, or the size not matching the header
+    dispatch_and_release(packet(ECHO_DATA, 3, 3));
+    dispatch_and_release(packet(ECHO_DATA, 9, 4));
+    pkt_buf_t *buf = packet(ECHO_DATA, 6, 5);
+    buf->len++;
+    dispatch_and_release(buf);
+    buf = packet(ECHO_DATA, 6, 6);
+    buf->len--;
+    dispatch_and_release(buf);
+    CHECK_EQ(s_echo.calls, 2);
+    CHECK(mesh_dispatch_get_stats(ECHO_DATA, &st));
+    CHECK_EQ(st.packets, 2);
+    CHECK_EQ(st.bytes, 12);
+    CHECK_EQ(st.malformed, 4);
+
+    // Too short for a header, nobody registered, beyond the table, unknown version
+    buf = packet(ECHO_DATA, 0, 0);
+    buf->len = WIRE_HEADER_V1_SIZE - 1;
+    dispatch_and_release(buf);
+    dispatch_and_release(packet(BOOT_REPORT, 4, 7));
+    dispatch_and_release(packet(200, 4, 8));
+    buf = packet(ECHO_DATA, 4, 9);
+    buf->data[1] = 3 << 5;
+    dispatch_and_release(buf);
+    CHECK_EQ(s_echo.calls, 2);
+    mesh_dispatch_get_totals(&after);
+    CHECK_EQ(after.unknown - before.unknown, 3);
+    CHECK_EQ(after.bad_header - before.bad_header, 1);
+    CHECK_EQ(after.v1_packets - before.v1_packets, 8);
+    CHECK(!mesh_dispatch_get_stats(BOOT_REPORT, &st));
+    CHECK_EQ(in_use(), 0);
+}
+
+static void test_hist_buckets(void) {
+    static const struct {
+        uint32_t cycles;
+        int bucket;
+    } cases[] = {
+        { 0, 0 }, { 1023, 0 }, { 1024, 1 }, { 4095, 1 }, { 4096, 2 }, { 16383, 2 }, { 16384, 3 },
+        { 65535, 3 }, { 65536, 4 }, { 262143, 4 }, { 262144, 5 }, { 1048575, 5 }, { 1048576, 6 },
+        { 4194303, 6 }, { 4194304, 7 }, { 0xFFFFFFFF, 7 },
+    };
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        mesh_dispatch_stats_t before, after;
+        mesh_dispatch_get_stats(ECHO_DATA, &before);
+        s_echo.cycles = cases[i].cycles;
+        dispatch_and_release(packet(ECHO_DATA, 4, 0));
+        mesh_dispatch_get_stats(ECHO_DATA, &after);
+        for (int b = 0; b < MESH_DISPATCH_HIST_BUCKETS; b++) {
+            if (after.hist[b] - before.hist[b] != (b == cases[i].bucket)) {
+                fprintf(stderr, "%u cycles: bucket %d moved by %u\n", cases[i].cycles, b,
+                        after.hist[b] - before.hist[b]);
+                CHECK(!"wrong histogram bucket");
+            }
+        }
+        CHECK_EQ(after.sum_cycles - before.sum_cycles, cases[i].cycles);
+    }
+    mesh_dispatch_stats_t st;
+    mesh_dispatch_get_stats(ECHO_DATA, &st);
+    CHECK_EQ(st.max_cycles, 0xFFFFFFFF);
+    s_echo.cycles = 0;
+}
+
+static void test_worker_queue_full(mesh_worker_t *worker) {
+    mesh_dispatch_stats_t st;
+    mesh_worker_stats_t ws;
+    __atomic_store_n(&s_ota.hold, true, __ATOMIC_RELEASE);
+    dispatch_and_release(packet(OTA_DATA, 16, 1));
+    wait_for(&s_ota.entered, 1);
+    // One in the handler, the queue's worth waiting, then dropped
+    for (int i = 0; i < WORKER_QUEUE + 1; i++) {
+        dispatch_and_release(packet(OTA_DATA, 16, 2 + i));
+    }
+    CHECK(mesh_dispatch_get_stats(OTA_DATA, &st));
+    CHECK_EQ(st.queue_full, 1);
+    CHECK_EQ(in_use(), 1 + WORKER_QUEUE);
+    mesh_worker_get_stats(worker, &ws);
+    CHECK_EQ(ws.max_depth, WORKER_QUEUE);
+
+    __atomic_store_n(&s_ota.hold, false, __ATOMIC_RELEASE);
+    wait_for(&s_ota.done, 1 + WORKER_QUEUE);
+    for (int i = 0; i < 5000 && in_use() != 0; i++) {
+        usleep(1000);
+    }
+    CHECK_EQ(in_use(), 0);
+    CHECK_EQ(s_ota.seen[0], 1);
+    CHECK_EQ(s_ota.seen[1], 2);
+    CHECK_EQ(s_ota.seen[2], 3);
+    mesh_worker_get_stats(worker, &ws);
+    CHECK_EQ(ws.jobs, 1 + WORKER_QUEUE);
+    mesh_dispatch_get_stats(OTA_DATA, &st);
+    CHECK_EQ(st.packets, 1 + WORKER_QUEUE);
+    CHECK_EQ(st.bytes, 16 * (1 + WORKER_QUEUE));
+}
+
+static void test_aggregate(void) {
+    mesh_dispatch_stats_t echo_before, echo_after, agg;
+    mesh_dispatch_totals_t before, after;
+    mesh_dispatch_get_stats(ECHO_DATA, &echo_before);
+    mesh_dispatch_get_totals(&before);
+    int ota_done = s_ota.done;
+
+    // Good, out of range, unknown, for the worker, good
+    pkt_buf_t *frame = pkt_pool_alloc();
+    add_record(frame, ECHO_DATA, 5, 0x51);
+    add_record(frame, ECHO_DATA, 20, 0x52);
+    add_record(frame, BOOT_REPORT, 4, 0x53);
+    add_record(frame, OTA_DATA, 12, 0x54);
+    add_record(frame, ECHO_DATA, 7, 0x55);
+    close_frame(frame);
+    mesh_dispatch_packet(&FROM, frame);
+    CHECK_EQ(s_echo.first, 0x55);
+    mesh_dispatch_get_stats(ECHO_DATA, &echo_after);
+    CHECK_EQ(echo_after.packets - echo_before.packets, 2);
+    CHECK_EQ(echo_after.bytes - echo_before.bytes, 12);
+    CHECK_EQ(echo_after.malformed - echo_before.malformed, 1);
+    mesh_dispatch_get_totals(&after);
+    CHECK_EQ(after.unknown - before.unknown, 1);
+    CHECK_EQ(after.v1_packets - before.v1_packets, 6);     // The frame and its 5 records
+    // The worker's job holds the frame
+    CHECK(frame->refs >= 1);
+    pkt_buf_release(frame);
+    wait_for(&s_ota.done, ota_done + 1);
+    CHECK_EQ(s_ota.seen[ota_done], 0x54);
+    for (int i = 0; i < 5000 && in_use() != 0; i++) {
+        usleep(1000);
+    }
+    CHECK_EQ(in_use(), 0);
+    CHECK(mesh_dispatch_get_stats(AGGREGATE, &agg));
+    CHECK_EQ(agg.malformed, 0);
+
+    // A record cut short by the end of the frame: the ones before it still dispatched
+    int calls = s_echo.calls;
+    frame = pkt_pool_alloc();
+    add_record(frame, ECHO_DATA, 4, 0x61);
+    add_record(frame, ECHO_DATA, 8, 0x62);
+    frame->len -= 2;
+    close_frame(frame);
+    dispatch_and_release(frame);
+    CHECK_EQ(s_echo.calls, calls + 1);
+    CHECK_EQ(s_echo.first, 0x61);
+    mesh_dispatch_get_stats(AGGREGATE, &agg);
+    CHECK_EQ(agg.malformed, 1);
+
+    // A frame inside a frame
+    frame = pkt_pool_alloc();
+    add_record(frame, AGGREGATE, 4, 0x71);
+    add_record(frame, ECHO_DATA, 4, 0x72);
+    close_frame(frame);
+    dispatch_and_release(frame);
+    CHECK_EQ(s_echo.calls, calls + 1);
+    mesh_dispatch_get_stats(AGGREGATE, &agg);
+    CHECK_EQ(agg.malformed, 2);
+
+    // Shorter than one record header
+    frame = pkt_pool_alloc();
+    frame->len = WIRE_HEADER_V1_SIZE - 1;
+    close_frame(frame);
+    dispatch_and_release(frame);
+    mesh_dispatch_get_stats(AGGREGATE, &agg);
+    CHECK_EQ(agg.malformed, 3);
+    CHECK_EQ(agg.packets, 3);
+    CHECK_EQ(in_use(), 0);
+}
+
+static void test_message(void) {
+    mesh_dispatch_stats_t st;
+    uint8_t payload[16] = { 0x81 };
+    mesh_dispatch_message(&FROM, ECHO_DATA, payload, 6);
+    CHECK_EQ(s_echo.first, 0x81);
+    mesh_dispatch_get_stats(OTA_DATA, &st);
+    uint32_t ota_malformed = st.malformed;
+    mesh_dispatch_message(&FROM, OTA_DATA, payload, 16);   // Registered on a worker
+    mesh_dispatch_get_stats(OTA_DATA, &st);
+    CHECK_EQ(st.malformed, ota_malformed + 1);
+    mesh_dispatch_message(&FROM, AGGREGATE, payload, 16);  // Packet only
+    mesh_dispatch_get_stats(AGGREGATE, &st);
+    CHECK_EQ(st.malformed, 4);
+}
+
+int main(void) {
+    CHECK_EQ(mesh_dispatch_init(), ESP_OK);
+    CHECK_EQ(mesh_dispatch_register(ECHO_DATA, "ECHO_DATA", 4, 8, rx_echo, NULL), ESP_OK);
+    CHECK_EQ(mesh_dispatch_register(ROBOT_DATA, "ROBOT_DATA", 8, 4, rx_echo, NULL), ESP_ERR_INVALID_ARG);
+    CHECK_EQ(mesh_dispatch_register(MESH_DISPATCH_MAX_TYPES, "X", 0, 4, rx_echo, NULL), ESP_ERR_INVALID_ARG);
+    mesh_worker_t *worker = mesh_worker_create("OtaWorker", WORKER_QUEUE, 4096, 5);
+    CHECK(worker != NULL);
+    CHECK_EQ(mesh_dispatch_register_worker(worker, OTA_DATA, "OTA_DATA", 1, 64, rx_ota, NULL), ESP_OK);
+
+    test_validation();
+    test_hist_buckets();
+    if (worker != NULL) {
+        test_worker_queue_full(worker);
+    }
+    test_aggregate();
+    test_message();
+    mesh_dispatch_log_stats();
+    return test_result("test_mesh_dispatch");
+}
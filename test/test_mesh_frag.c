@@ -0,0 +1,303 @@
+#include <string.h>
+#include "test_util.h"
+#include "mesh_frag.h"
+#include "mesh_dispatch.h"
+
+/*
+mesh_frag and mesh_dispatch on one host thread (test/host): the sender's packets are captured from
+mesh_tx_send_buf(), handed to the receiver by the test (in any order, or not at all), and the NACKs
+the receiver sends come back through mesh_tx_send() to be delivered to the sender. Both ends are the
+same module instance, which keys its receive slots by sender and its history by msg_id only.
+*/
+
+#define MSG_LEN     4000
+#define STEP_US     ((CONFIG_MESH_FRAG_NACK_MS + 10) * 1000LL)
+
+static const mesh_addr_t SENDER = { .addr = { 0x02, 0, 0, 0, 0, 0x01 } };
+static const mesh_addr_t RECEIVER = { .addr = { 0x02, 0, 0, 0, 0, 0x02 } };
+
+// Fragments queued by the sender; the test holds the reference mesh_tx_send_buf() takes over
+static pkt_buf_t *s_sent[64];
+static int s_num_sent;
+
+// Last packet sent with mesh_tx_send() (NACKs, small messages)
+static struct {
+    int count;
+    ProtocolType type;
+    uint8_t payload[64];
+    size_t len;
+} s_direct;
+
+// Messages reaching the ROBOT_DATA handler
+static struct {
+    int count;
+    bool had_buf;
+    uint8_t data[CONFIG_MESH_FRAG_MAX_MSG];
+    size_t len;
+} s_rx;
+
+// From modules not built here (protocol.c, gps_ptp_time.c)
+const char *DATATAG = "DATA_TAG";
+
+uint64_t gps_ptp_now_us(void) {
+    return 0;
+}
+
+esp_err_t mesh_tx_send_buf(mesh_tx_class_t cls, const mesh_addr_t *to, int flag, pkt_buf_t *buf) {
+    s_sent[s_num_sent++] = buf;
+    return ESP_OK;
+}
+
+esp_err_t mesh_tx_send(mesh_tx_class_t cls, const mesh_addr_t *to, int flag, ProtocolType type,
+                       const void *payload, uint16_t len) {
+    s_direct.count++;
+    s_direct.type = type;
+    s_direct.len = len;
+    memcpy(s_direct.payload, payload, len < sizeof(s_direct.payload) ? len : sizeof(s_direct.payload));
+    return ESP_OK;
+}
+
+static void rx_robot_data(const mesh_addr_t *from, const void *payload, size_t payload_len, pkt_buf_t *buf,
+                          void *arg) {
+    s_rx.count++;
+    s_rx.had_buf = buf != NULL;
+    memcpy(s_rx.data, payload, payload_len);
+    s_rx.len = payload_len;
+}
+
+static void deliver(int i) {
+    mesh_dispatch_packet(&SENDER, s_sent[i]);
+}
+
+static void release_sent(void) {
+    for (int i = 0; i < s_num_sent; i++) {
+        pkt_buf_release(s_sent[i]);
+    }
+    s_num_sent = 0;
+}
+
+static FragHeader_t sent_header(int i) {
+    FragHeader_t h;
+    memcpy(&h, s_sent[i]->data + WIRE_TX_HDR_SIZE, sizeof(h));
+    return h;
+}
+
+// Pass the receiver's last NACK back to the sender, as the mesh would
+static void deliver_nack(void) {
+    pkt_buf_t *buf = pkt_pool_alloc();
+    memcpy(buf->data + WIRE_TX_HDR_SIZE, s_direct.payload, s_direct.len);
+    buf->len = wire_encode(buf->data, FRAG_NACK, s_direct.len);
+    mesh_dispatch_packet(&RECEIVER, buf);
+    pkt_buf_release(buf);
+}
+
+// A FRAGMENT packet built by hand with n message bytes, straight to the receiver
+static void deliver_fragment(FragHeader_t h, size_t n, const uint8_t *msg) {
+    pkt_buf_t *buf = pkt_pool_alloc();
+    memcpy(buf->data + WIRE_TX_HDR_SIZE, &h, sizeof(h));
+    memcpy(buf->data + WIRE_TX_HDR_SIZE + sizeof(h), msg + h.offset, n);
+    buf->len = wire_encode(buf->data, FRAGMENT, sizeof(h) + n);
+    mesh_dispatch_packet(&SENDER, buf);
+    pkt_buf_release(buf);
+}
+
+// Expire every slot and history entry of the previous test
+static void settle(void) {
+    release_sent();
+    host_now_us += 2 * CONFIG_MESH_FRAG_TIMEOUT_MS * 1000LL;
+    host_task_step();
+    memset(&s_rx, 0, sizeof(s_rx));
+    memset(&s_direct, 0, sizeof(s_direct));
+}
+
+static void fill(uint8_t *msg, size_t len, uint8_t seed) {
+    for (size_t i = 0; i < len; i++) {
+        msg[i] = (uint8_t)(i * 7 + seed);
+    }
+}
+
+// 4000 bytes in 3 fragments, the middle one lost: NACKed, resent once, message delivered whole
+static void test_nack_resend(void) {
+    settle();
+    static uint8_t msg[MSG_LEN];
+    fill(msg, sizeof(msg), 1);
+    mesh_frag_stats_t before;
+    mesh_frag_get_stats(&before);
+
+    CHECK_EQ(mesh_frag_send(MESH_TX_TELEMETRY, &RECEIVER, MESH_DATA_P2P, ROBOT_DATA, msg, MSG_LEN), ESP_OK);
+    CHECK_EQ(s_num_sent, 3);
+    for (int i = 0; i < s_num_sent; i++) {
+        FragHeader_t h = sent_header(i);
+        CHECK_EQ(h.index, i);
+        CHECK_EQ(h.count, 3);
+        CHECK_EQ(h.type, ROBOT_DATA);
+        CHECK_EQ(h.total_len, MSG_LEN);
+        CHECK_EQ(h.offset, i * MESH_FRAG_DATA_MAX);
+    }
+
+    deliver(0);
+    deliver(2);
+    CHECK_EQ(s_rx.count, 0);
+
+    // Nothing new for a NACK interval: the receiver asks for fragment 1 only
+    host_now_us += STEP_US;
+    host_task_step();
+    CHECK_EQ(s_direct.count, 1);
+    CHECK_EQ(s_direct.type, FRAG_NACK);
+    FragNack_t nack;
+    memcpy(&nack, s_direct.payload, sizeof(nack));
+    CHECK_EQ(nack.missing, 1u << 1);
+    CHECK_EQ(nack.msg_id, sent_header(0).msg_id);
+
+    // The sender queues the same buffer again, nothing else
+    deliver_nack();
+    CHECK_EQ(s_num_sent, 4);
+    CHECK(s_sent[3] == s_sent[1]);
+
+    // The same NACK again within the interval: the resend is likely still on its way
+    deliver_nack();
+    CHECK_EQ(s_num_sent, 4);
+
+    deliver(3);
+    CHECK_EQ(s_rx.count, 1);
+    CHECK(!s_rx.had_buf);
+    CHECK_EQ(s_rx.len, MSG_LEN);
+    CHECK(memcmp(s_rx.data, msg, MSG_LEN) == 0);
+
+    // Late duplicates do not start the message again
+    deliver(0);
+    deliver(1);
+    CHECK_EQ(s_rx.count, 1);
+
+    mesh_frag_stats_t st;
+    mesh_frag_get_stats(&st);
+    CHECK_EQ(st.messages_sent - before.messages_sent, 1);
+    CHECK_EQ(st.fragments_sent - before.fragments_sent, 3);
+    CHECK_EQ(st.nacks_sent - before.nacks_sent, 1);
+    CHECK_EQ(st.nacks_received - before.nacks_received, 2);
+    CHECK_EQ(st.retransmits - before.retransmits, 1);
+    CHECK_EQ(st.messages_received - before.messages_received, 1);
+    CHECK_EQ(st.duplicates - before.duplicates, 2);
+    CHECK_EQ(st.malformed - before.malformed, 0);
+}
+
+// Up to one packet goes out as a plain packet of its type
+static void test_small_message(void) {
+    settle();
+    static uint8_t msg[MESH_TX_MTU - WIRE_TX_OVERHEAD];
+    fill(msg, sizeof(msg), 2);
+    CHECK_EQ(mesh_frag_send(MESH_TX_TELEMETRY, &RECEIVER, MESH_DATA_P2P, ROBOT_DATA, msg, sizeof(msg)), ESP_OK);
+    CHECK_EQ(s_num_sent, 0);
+    CHECK_EQ(s_direct.count, 1);
+    CHECK_EQ(s_direct.type, ROBOT_DATA);
+    CHECK_EQ(s_direct.len, sizeof(msg));
+
+    CHECK_EQ(mesh_frag_send(MESH_TX_TELEMETRY, &RECEIVER, MESH_DATA_P2P, ROBOT_DATA, msg,
+                            CONFIG_MESH_FRAG_MAX_MSG + 1), ESP_ERR_INVALID_SIZE);
+}
+
+// Only fragment 0 ever arrives: MESH_FRAG_MAX_NACKS NACKs, then the message is dropped, and both
+// ends let go of everything once the timeout has passed
+static void test_timeout(void) {
+    settle();
+    static uint8_t msg[3000];
+    fill(msg, sizeof(msg), 3);
+    mesh_frag_stats_t before;
+    mesh_frag_get_stats(&before);
+
+    CHECK_EQ(mesh_frag_send(MESH_TX_TELEMETRY, &RECEIVER, MESH_DATA_P2P, ROBOT_DATA, msg, sizeof(msg)), ESP_OK);
+    deliver(0);
+    release_sent();
+    for (int64_t t = 0; t < 2 * CONFIG_MESH_FRAG_TIMEOUT_MS * 1000LL; t += STEP_US) {
+        host_now_us += STEP_US;
+        host_task_step();
+    }
+    mesh_frag_stats_t st;
+    mesh_frag_get_stats(&st);
+    CHECK_EQ(st.nacks_sent - before.nacks_sent, MESH_FRAG_MAX_NACKS);
+    CHECK_EQ(st.timeouts - before.timeouts, 1);
+    CHECK_EQ(s_rx.count, 0);
+
+    // A NACK for the expired message finds no history
+    deliver_nack();
+    CHECK_EQ(s_num_sent, 0);
+
+    pkt_pool_stats_t ps;
+    pkt_pool_get_stats(&ps);
+    CHECK_EQ(ps.in_use, 0);
+}
+
+// Fragments whose layout does not follow from index and total_len, or that carry a type only ever
+// sent as a packet, are dropped before they touch a slot
+static void test_malformed(void) {
+    settle();
+    static uint8_t msg[3000];
+    fill(msg, sizeof(msg), 4);
+    const size_t last_len = sizeof(msg) - 2 * MESH_FRAG_DATA_MAX;
+    const FragHeader_t ok = { .msg_id = 900, .total_len = sizeof(msg), .type = ROBOT_DATA, .count = 3 };
+    mesh_frag_stats_t before;
+    mesh_frag_get_stats(&before);
+
+    FragHeader_t h = ok;
+    h.index = 1;
+    h.offset = MESH_FRAG_DATA_MAX - 1;      // Overlaps fragment 0
+    deliver_fragment(h, MESH_FRAG_DATA_MAX, msg);
+
+    h = ok;
+    deliver_fragment(h, 100, msg);          // Short, not the last
+
+    h = ok;
+    h.index = 2;
+    h.offset = 2 * MESH_FRAG_DATA_MAX;
+    deliver_fragment(h, last_len - 1, msg); // Last one ending before total_len
+
+    h = ok;
+    h.count = 4;                            // 3 fragments' worth of message
+    deliver_fragment(h, MESH_FRAG_DATA_MAX, msg);
+
+    h = ok;
+    h.type = AGGREGATE;                     // Would reach handle_aggregate without a packet buffer
+    deliver_fragment(h, MESH_FRAG_DATA_MAX, msg);
+
+    mesh_frag_stats_t st;
+    mesh_frag_get_stats(&st);
+    CHECK_EQ(st.malformed - before.malformed, 5);
+    CHECK_EQ(st.fragments_received - before.fragments_received, 5);
+
+    // The same message laid out properly is taken
+    for (int i = 0; i < 3; i++) {
+        h = ok;
+        h.index = i;
+        h.offset = i * MESH_FRAG_DATA_MAX;
+        deliver_fragment(h, i < 2 ? MESH_FRAG_DATA_MAX : last_len, msg);
+    }
+    CHECK_EQ(s_rx.count, 1);
+    CHECK_EQ(s_rx.len, sizeof(msg));
+    CHECK(memcmp(s_rx.data, msg, sizeof(msg)) == 0);
+    mesh_frag_get_stats(&st);
+    CHECK_EQ(st.malformed - before.malformed, 5);
+
+    // Packet-only types are refused on the way out and by the dispatcher as well
+    CHECK_EQ(mesh_frag_send(MESH_TX_TELEMETRY, &RECEIVER, MESH_DATA_P2P, AGGREGATE, msg, sizeof(msg)),
+             ESP_ERR_INVALID_ARG);
+    CHECK_EQ(s_num_sent, 0);
+    mesh_dispatch_stats_t ds_before, ds;
+    CHECK(mesh_dispatch_get_stats(AGGREGATE, &ds_before));
+    mesh_dispatch_message(&SENDER, AGGREGATE, msg, 100);
+    CHECK(mesh_dispatch_get_stats(AGGREGATE, &ds));
+    CHECK_EQ(ds.malformed - ds_before.malformed, 1);
+    CHECK_EQ(ds.packets, ds_before.packets);
+}
+
+int main(void) {
+    CHECK_EQ(mesh_dispatch_init(), ESP_OK);
+    CHECK_EQ(mesh_frag_init(), ESP_OK);
+    CHECK_EQ(mesh_dispatch_register(ROBOT_DATA, "ROBOT_DATA", 1, ROBOT_DATA_MAX_PAYLOAD, rx_robot_data, NULL),
+             ESP_OK);
+
+    test_nack_resend();
+    test_small_message();
+    test_timeout();
+    test_malformed();
+    return test_result("test_mesh_frag");
+}
@@ -0,0 +1,445 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "test_util.h"
+#include "mesh_ota.h"
+#include "mesh_tx.h"
+
+/*
+A whole rollout, root and one target in this one process (they keep apart statics in mesh_ota.c):
+the rollout task and the ota_writer task run on threads of their own (test/host/freertos_thread.c).
+Every packet the root sends to the OTA group is handed to the target's mesh_ota_handle_packet() at
+once, unless the scenario loses it, and the target's ACKs come straight back to the root's. Flash
+is test/host's NOR emulation holding two app slots and the partition the root sends from; NVS keeps
+one blob in RAM. A reboot of the target is mesh_ota_init() again, from the slot it was told to boot,
+with whatever NVS held.
+
+The LZSS and delta rollouts send images written by python/ota_image.py (the ota_images test, see
+test_ota_decode.c), from the working directory.
+*/
+
+#define SLOT_SIZE   0x80000
+#define RAW_SIZE    50000       // 49 blocks
+#define RAW_BLOCKS  ((RAW_SIZE + MESH_OTA_BLOCK_SIZE - 1) / MESH_OTA_BLOCK_SIZE)
+
+static const mesh_addr_t ROOT = { .addr = { 0x02, 0, 0, 0, 0, 0x01 } };
+static const mesh_addr_t NODE = { .addr = { 0x02, 0, 0, 0, 0, 0x02 } };
+
+static const esp_partition_t s_slots[2] = {
+    { .address = 0x100000, .size = SLOT_SIZE, .label = "ota_0" },
+    { .address = 0x180000, .size = SLOT_SIZE, .label = "ota_1" },
+};
+static const esp_partition_t s_src = { .address = 0x200000, .size = SLOT_SIZE, .label = "src" };
+static uint32_t s_app_len[3];       // Per slot, then s_src: what esp_partition_get_sha256() hashes
+static int s_running;
+static int s_boot;                  // Slot set to boot
+static int s_restarts;
+static char s_fw_md5[33];           // Of the running slot, as the node reports it
+static int s_running_hashes;        // esp_partition_get_sha256() of the running slot
+
+static struct {
+    bool set;
+    size_t len;
+    uint8_t data[8192];
+} s_nvs;
+
+static bool (*s_lose)(const uint8_t *payload, size_t len);     // Root to target packets lost
+static int s_data_sent;             // DATA packets of the rollout
+static int s_data_delivered;
+
+// SHA-256 (FIPS 180-4), for the image hashes ota_image.py writes
+static void sha256(const uint8_t *data, size_t len, uint8_t digest[32]) {
+    static const uint32_t k[64] = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+    };
+    uint32_t h[8] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab,
+                      0x5be0cd19 };
+#define ROR(x, n) ((x) >> (n) | (x) << (32 - (n)))
+    size_t blocks = (len + 9 + 63) / 64;
+    for (size_t b = 0; b < blocks; b++) {
+        uint8_t block[64];
+        for (size_t i = 0; i < 64; i++) {
+            size_t pos = b * 64 + i;
+            block[i] = pos < len ? data[pos] : pos == len ? 0x80 : 0;
+        }
+        if (b == blocks - 1) {
+            for (int i = 0; i < 8; i++) {
+                block[56 + i] = (uint8_t)((uint64_t)len * 8 >> (56 - 8 * i));
+            }
+        }
+        uint32_t w[64];
+        for (int i = 0; i < 16; i++) {
+            w[i] = (uint32_t)block[4 * i] << 24 | block[4 * i + 1] << 16 | block[4 * i + 2] << 8 | block[4 * i + 3];
+        }
+        for (int i = 16; i < 64; i++) {
+            uint32_t s0 = ROR(w[i - 15], 7) ^ ROR(w[i - 15], 18) ^ w[i - 15] >> 3;
+            uint32_t s1 = ROR(w[i - 2], 17) ^ ROR(w[i - 2], 19) ^ w[i - 2] >> 10;
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+        uint32_t v[8];
+        memcpy(v, h, sizeof(v));
+        for (int i = 0; i < 64; i++) {
+            uint32_t t1 = v[7] + (ROR(v[4], 6) ^ ROR(v[4], 11) ^ ROR(v[4], 25)) + ((v[4] & v[5]) ^ (~v[4] & v[6])) +
+                          k[i] + w[i];
+            uint32_t t2 = (ROR(v[0], 2) ^ ROR(v[0], 13) ^ ROR(v[0], 22)) +
+                          ((v[0] & v[1]) ^ (v[0] & v[2]) ^ (v[1] & v[2]));
+            memmove(&v[1], &v[0], 7 * sizeof(v[0]));
+            v[4] += t1;
+            v[0] = t1 + t2;
+        }
+        for (int i = 0; i < 8; i++) {
+            h[i] += v[i];
+        }
+    }
+#undef ROR
+    for (int i = 0; i < 32; i++) {
+        digest[i] = (uint8_t)(h[i / 4] >> (24 - 8 * (i % 4)));
+    }
+}
+
+static uint32_t *app_len(const esp_partition_t *part) {
+    return part == &s_src ? &s_app_len[2] : &s_app_len[part - s_slots];
+}
+
+esp_err_t esp_partition_get_sha256(const esp_partition_t *part, uint8_t *digest) {
+    s_running_hashes += part == &s_slots[s_running];
+    sha256(&host_flash[part->address], *app_len(part), digest);
+    return ESP_OK;
+}
+
+esp_err_t esp_image_get_metadata(const esp_partition_pos_t *pos, esp_image_metadata_t *meta) {
+    meta->image_len = pos->offset == s_src.address ? s_app_len[2] : 0;
+    return meta->image_len > 0 ? ESP_OK : ESP_FAIL;
+}
+
+const esp_partition_t *esp_partition_find_first(int type, int subtype, const char *label) {
+    return strcmp(label, s_src.label) == 0 ? &s_src : NULL;
+}
+
+const esp_partition_t *esp_ota_get_running_partition(void) {
+    return &s_slots[s_running];
+}
+
+const esp_partition_t *esp_ota_get_next_update_partition(const esp_partition_t *start) {
+    return &s_slots[!s_running];
+}
+
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t *part) {
+    s_boot = part - s_slots;
+    return ESP_OK;
+}
+
+void esp_restart(void) {
+    s_restarts++;
+}
+
+esp_err_t nvs_open(const char *name, nvs_open_mode_t mode, nvs_handle_t *handle) {
+    *handle = 1;
+    return ESP_OK;
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *value, size_t *len) {
+    if (!s_nvs.set) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    memcpy(value, s_nvs.data, *len < s_nvs.len ? *len : s_nvs.len);
+    *len = s_nvs.len;
+    return ESP_OK;
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t len) {
+    CHECK(len <= sizeof(s_nvs.data));
+    memcpy(s_nvs.data, value, len);
+    s_nvs.len = len;
+    s_nvs.set = true;
+    return ESP_OK;
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key) {
+    bool was_set = s_nvs.set;
+    s_nvs.set = false;
+    return was_set ? ESP_OK : ESP_ERR_NVS_NOT_FOUND;
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle) {
+    return ESP_OK;
+}
+
+void nvs_close(nvs_handle_t handle) {
+}
+
+bool esp_mesh_is_root(void) {
+    return true;
+}
+
+int esp_mesh_get_group_num(void) {
+    return 0;
+}
+
+esp_err_t esp_mesh_get_group_list(mesh_addr_t *groups, int num) {
+    return ESP_OK;
+}
+
+esp_err_t esp_mesh_set_group_id(const mesh_addr_t *groups, int num) {
+    return ESP_OK;
+}
+
+int esp_mesh_get_routing_table_size(void) {
+    return 2;
+}
+
+esp_err_t esp_mesh_get_routing_table(mesh_addr_t *table, int size, int *num) {
+    table[0] = ROOT;
+    table[1] = NODE;
+    *num = 2;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_get_mac(int ifx, uint8_t *mac) {
+    memcpy(mac, ROOT.addr, sizeof(ROOT.addr));
+    return ESP_OK;
+}
+
+// From a module not built here (gps_ptp_time.c)
+uint64_t gps_ptp_now_us(void) {
+    return 0;
+}
+
+static void to_target(const uint8_t *payload, size_t len) {
+    bool data = payload[0] == MESH_OTA_CMD_DATA;
+    s_data_sent += data;
+    if (s_lose != NULL && s_lose(payload, len)) {
+        return;
+    }
+    s_data_delivered += data;
+    mesh_ota_handle_packet(&ROOT, payload, len);
+}
+
+esp_err_t mesh_tx_send_buf(mesh_tx_class_t cls, const mesh_addr_t *to, int flag, pkt_buf_t *buf) {
+    wire_hdr_t h;
+    CHECK_EQ(wire_decode(buf->data, buf->len, &h), WIRE_OK);
+    CHECK_EQ(h.type, OTA_DATA);
+    CHECK(flag & MESH_DATA_GROUP);
+    to_target(buf->data + h.hdr_size, h.length);
+    pkt_buf_release(buf);
+    return ESP_OK;
+}
+
+esp_err_t mesh_tx_send(mesh_tx_class_t cls, const mesh_addr_t *to, int flag, ProtocolType type,
+                       const void *payload, uint16_t len) {
+    CHECK_EQ(type, OTA_DATA);
+    if (flag & MESH_DATA_GROUP) {
+        to_target(payload, len);
+    } else {
+        CHECK(memcmp(to->addr, ROOT.addr, sizeof(ROOT.addr)) == 0);
+        mesh_ota_handle_packet(&NODE, payload, len);
+    }
+    return ESP_OK;
+}
+
+static void write_partition(const esp_partition_t *part, const uint8_t *data, size_t len) {
+    CHECK_EQ(esp_partition_erase_range(part, 0, part->size), ESP_OK);
+    CHECK_EQ(esp_partition_write(part, 0, data, len), ESP_OK);
+    *app_len(part) = len;
+}
+
+// The target starts (again) from the slot it was told to boot, with its fingerprint as cached at boot
+static void boot(void) {
+    s_running = s_boot;
+    uint8_t sha[32];
+    sha256(&host_flash[s_slots[s_running].address], s_app_len[s_running], sha);
+    for (int i = 0; i < 16; i++) {
+        sprintf(s_fw_md5 + 2 * i, "%02x", sha[i]);
+    }
+    CHECK_EQ(mesh_ota_init(s_fw_md5), ESP_OK);
+}
+
+static int s_idle_tasks;    // The writer task
+
+// One rollout from s_src, to its end; the report of the target
+static mesh_ota_target_report_t rollout(uint32_t image_len) {
+    s_data_sent = 0;
+    s_data_delivered = 0;
+    s_app_len[!s_running] = image_len;
+    CHECK_EQ(mesh_ota_send_firmware(s_src.label), ESP_OK);
+    for (int ms = 0; ms < 60000 && host_tasks_running() > s_idle_tasks; ms++) {
+        nanosleep(&(struct timespec){ .tv_nsec = 1000000 }, NULL);
+    }
+    CHECK_EQ(host_tasks_running(), s_idle_tasks);
+    mesh_ota_target_report_t report;
+    CHECK_EQ(mesh_ota_get_report(&report, 1), 1);
+    return report;
+}
+
+static bool image_in(const esp_partition_t *part, const uint8_t *image, size_t len) {
+    return memcmp(&host_flash[part->address], image, len) == 0;
+}
+
+static uint8_t *random_image(size_t len) {
+    uint8_t *image = malloc(len);
+    for (size_t i = 0; i < len; i++) {
+        image[i] = (uint8_t)test_rand();
+    }
+    image[0] = 0xE9;    // An app image, not an encoded one
+    return image;
+}
+
+// The first pass loses every 7th block: only those are sent again
+static bool lose_sevenths(const uint8_t *payload, size_t len) {
+    const mesh_ota_data_t *data = (const mesh_ota_data_t *)payload;
+    return data->cmd == MESH_OTA_CMD_DATA && s_data_sent <= RAW_BLOCKS && data->block % 7 == 3;
+}
+
+static void test_lossy(void) {
+    uint8_t *image = random_image(RAW_SIZE);
+    write_partition(&s_src, image, RAW_SIZE);
+    memset(&host_flash[s_slots[!s_running].address], 0xA5, SLOT_SIZE);
+    int restarts = s_restarts;
+
+    s_lose = lose_sevenths;
+    mesh_ota_target_report_t r = rollout(RAW_SIZE);
+    s_lose = NULL;
+    CHECK_EQ(s_data_sent, RAW_BLOCKS + 7);
+    CHECK_EQ(r.state, MESH_OTA_STATE_COMPLETE);
+    CHECK_EQ(r.resent, 7);
+    CHECK(r.throughput_bps > 0);
+    CHECK_EQ(s_restarts, restarts + 1);
+    CHECK_EQ(s_boot, !s_running);
+    CHECK(image_in(&s_slots[s_boot], image, RAW_SIZE));
+    CHECK(!s_nvs.set);
+    boot();
+    free(image);
+}
+
+// The target falls silent after 20 blocks, with the first CONFIG_MESH_OTA_WINDOW saved at the
+// STATUS round after them; rebooted, the next rollout of the image sends it only the rest
+static bool lose_after_20(const uint8_t *payload, size_t len) {
+    return s_data_delivered == 20;
+}
+
+static void test_resume(void) {
+    uint8_t *image = random_image(RAW_SIZE);
+    write_partition(&s_src, image, RAW_SIZE);
+    int restarts = s_restarts;
+
+    s_lose = lose_after_20;
+    mesh_ota_target_report_t r = rollout(RAW_SIZE);
+    s_lose = NULL;
+    CHECK_EQ(s_data_delivered, 20);
+    CHECK_EQ(r.state, MESH_OTA_STATE_RECEIVING);
+    CHECK_EQ(r.received, CONFIG_MESH_OTA_WINDOW);
+    CHECK(s_nvs.set);
+    CHECK_EQ(s_restarts, restarts);
+
+    boot();
+    r = rollout(RAW_SIZE);
+    CHECK_EQ(s_data_sent, RAW_BLOCKS - CONFIG_MESH_OTA_WINDOW);
+    CHECK_EQ(r.state, MESH_OTA_STATE_COMPLETE);
+    CHECK_EQ(s_restarts, restarts + 1);
+    CHECK(image_in(&s_slots[s_boot], image, RAW_SIZE));
+    boot();
+
+    // Running it now: nothing to send, known from the fingerprint
+    r = rollout(RAW_SIZE);
+    CHECK_EQ(r.state, MESH_OTA_STATE_CURRENT);
+    CHECK_EQ(s_data_sent, 0);
+    CHECK_EQ(s_restarts, restarts + 1);
+    CHECK_EQ(s_running_hashes, 0);
+
+    // Without a fingerprint the running image is hashed instead
+    CHECK_EQ(mesh_ota_init("ERROR"), ESP_OK);
+    r = rollout(RAW_SIZE);
+    CHECK_EQ(r.state, MESH_OTA_STATE_CURRENT);
+    CHECK_EQ(s_data_sent, 0);
+    CHECK_EQ(s_running_hashes, 1);
+    s_running_hashes = 0;
+    boot();
+    free(image);
+}
+
+static uint8_t *read_file(const char *name, size_t *len) {
+    FILE *f = fopen(name, "rb");
+    if (f == NULL) {
+        printf("%s: cannot open (run by ctest after the ota_images test)\n", name);
+        exit(1);
+    }
+    fseek(f, 0, SEEK_END);
+    *len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *data = malloc(*len);
+    CHECK_EQ(fread(data, 1, *len, f), *len);
+    fclose(f);
+    return data;
+}
+
+static bool lose_tenth(const uint8_t *payload, size_t len) {
+    return payload[0] == MESH_OTA_CMD_DATA && s_data_sent % 10 == 0;
+}
+
+// An encoded image with every tenth block sent lost, after booting `base` (delta images are against it)
+static void test_encoded(const char *name, const uint8_t *base, size_t base_len) {
+    size_t image_len, file_len;
+    uint8_t *image = read_file("image.bin", &image_len);
+    uint8_t *file = read_file(name, &file_len);
+    mesh_ota_image_header_t h;
+    memcpy(&h, file, sizeof(h));
+    uint8_t sha[32];
+    sha256(image, image_len, sha);
+    CHECK(memcmp(h.sha256, sha, sizeof(sha)) == 0);
+
+    write_partition(esp_ota_get_running_partition(), base, base_len);
+    boot();
+    write_partition(&s_src, file, file_len);
+    int restarts = s_restarts;
+    s_lose = lose_tenth;
+    mesh_ota_target_report_t r = rollout(image_len);
+    s_lose = NULL;
+    CHECK_EQ(r.state, MESH_OTA_STATE_COMPLETE);
+    CHECK(r.resent > 0);
+    CHECK_EQ(s_restarts, restarts + 1);
+    CHECK(image_in(&s_slots[s_boot], image, image_len));
+    printf("%s: %d blocks sent for %d at 10%% loss (%lu again)\n", name, s_data_sent, r.received,
+           (unsigned long)r.resent);
+    boot();
+    free(file);
+    free(image);
+}
+
+// A delta image refused by a target running other firmware
+static void test_wrong_base(const uint8_t *other, size_t other_len) {
+    size_t file_len;
+    uint8_t *file = read_file("delta.mota", &file_len);
+    write_partition(esp_ota_get_running_partition(), other, other_len);
+    boot();
+    write_partition(&s_src, file, file_len);
+    mesh_ota_target_report_t r = rollout(0);
+    CHECK_EQ(r.state, MESH_OTA_STATE_WRONG_BASE);
+    CHECK_EQ(s_data_sent, 0);
+    free(file);
+}
+
+int main(void) {
+    uint8_t *factory = random_image(RAW_SIZE / 2);
+    write_partition(&s_slots[0], factory, RAW_SIZE / 2);
+    boot();
+    s_idle_tasks = host_tasks_running();
+    test_lossy();
+    test_resume();
+
+    size_t base_len;
+    uint8_t *base = read_file("base.bin", &base_len);
+    test_wrong_base(factory, RAW_SIZE / 2);
+    test_encoded("lzss.mota", factory, RAW_SIZE / 2);
+    test_encoded("delta.mota", base, base_len);
+    free(base);
+    free(factory);
+    CHECK_EQ(s_running_hashes, 0);
+    return test_result("test_mesh_ota");
+}
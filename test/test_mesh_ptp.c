@@ -0,0 +1,357 @@
+#include <string.h>
+#include "test_util.h"
+#include "mesh_ptp.h"
+#include "gps_ptp_time.h"
+#include "clock_est.h"
+#include "mesh_dispatch.h"
+#include "mesh_tx.h"
+
+/*
+mesh_ptp on a node in the middle of the tree, with gps_ptp_time and mesh_dispatch. The test plays
+its parent, whose clock is GPS time, and the node's own child; host_now_us is the node's esp_timer,
+which runs DRIFT_PPB fast against GPS time.
+
+Child side: an exchange once a second over a link of 1.5 ms each way with 200 us of jitter, one in
+ten after the first few queued for 5 to 20 ms in one direction only. The node steps once, rejects
+exactly the queued exchanges, learns the drift, and keeps GPS time within a fraction of the link's
+jitter and always within the accuracy it reports. Messages out of turn are unmatched. SYNC from
+another node, to the root, or from the parent the node just left (still listing it as a station)
+is ignored without disturbing the exchange in progress; a new parent over a much slower link is
+stepped to at once, its exchanges not held to the old link's minimum delay.
+
+Master side: nothing sent before the node has time; then SYNC and FOLLOW_UP to each station on the
+softAP (one not a mesh node: a send error), and DELAY_RESP to DELAY_REQ, stamped with the node's
+GPS time within its accuracy and one more step from the GNSS clock than the parent.
+*/
+
+#define DRIFT_PPB       30000
+#define GPS0_US         (3 * 86400 * 1000000LL + 123457)   // GPS time of week at esp_timer 0
+#define LINK_US         1500
+#define JITTER_US       200
+#define PARENT_ACC_US   30
+#define EXCHANGES       300
+
+static const mesh_addr_t PARENT = { .addr = { 0x02, 0, 0, 0, 0, 0x01 } };
+static const mesh_addr_t PARENT_BSSID = { .addr = { 0x02, 0, 0, 0, 0, 0x02 } };
+static const mesh_addr_t PARENT2 = { .addr = { 0x02, 0, 0, 0, 0, 0x11 } };
+static const mesh_addr_t PARENT2_BSSID = { .addr = { 0x02, 0, 0, 0, 0, 0x12 } };
+static const mesh_addr_t OTHER = { .addr = { 0x02, 0, 0, 0, 0, 0x21 } };
+static const mesh_addr_t CHILD = { .addr = { 0x02, 0, 0, 0, 0, 0x31 } };
+static const mesh_addr_t STATION = { .addr = { 0x0A, 0, 0, 0, 0, 0x41 } };     // Not a mesh node
+
+// From modules not built here (protocol.c, mesh_tx.c)
+const char *DATATAG = "DATA_TAG";
+
+esp_err_t mesh_tx_send(mesh_tx_class_t cls, const mesh_addr_t *to, int flag, ProtocolType type,
+                       const void *payload, uint16_t len) {
+    return ESP_OK;
+}
+
+// The mesh and the softAP as this node sees them
+static bool s_root;
+static mesh_addr_t s_bssid;
+static wifi_sta_list_t s_stations;
+
+static struct {
+    mesh_addr_t to;
+    PTPData_t msg;
+    int64_t at_us;
+} s_sent[8];
+static int s_num_sent;
+
+bool esp_mesh_is_root(void) {
+    return s_root;
+}
+
+esp_err_t esp_mesh_get_parent_bssid(mesh_addr_t *bssid) {
+    *bssid = s_bssid;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_ap_get_sta_list(wifi_sta_list_t *sta) {
+    *sta = s_stations;
+    return ESP_OK;
+}
+
+esp_err_t esp_mesh_send(const mesh_addr_t *to, const mesh_data_t *data, int flag, const mesh_opt_t opt[],
+                        int opt_count) {
+    wire_hdr_t hdr;
+    CHECK_EQ(wire_decode(data->data, data->size, &hdr), WIRE_OK);
+    CHECK_EQ(hdr.type, PTP_DATA);
+    if (s_num_sent < (int)(sizeof(s_sent) / sizeof(s_sent[0]))) {
+        s_sent[s_num_sent].to = *to;
+        memcpy(&s_sent[s_num_sent].msg, data->data + hdr.hdr_size, sizeof(PTPData_t));
+        s_sent[s_num_sent].at_us = host_now_us;
+        s_num_sent++;
+    }
+    return memcmp(to->addr, STATION.addr, 6) == 0 ? ESP_FAIL : ESP_OK;
+}
+
+static int64_t true_gps_us(int64_t local_us) {
+    return GPS0_US + local_us + local_us * DRIFT_PPB / 1000000000;
+}
+
+static void deliver(const mesh_addr_t *from, const PTPData_t *msg) {
+    pkt_buf_t *buf = pkt_pool_alloc();
+    memcpy(buf->data + WIRE_TX_HDR_SIZE, msg, sizeof(*msg));
+    buf->len = wire_encode(buf->data, PTP_DATA, sizeof(*msg));
+    mesh_dispatch_packet(from, buf);
+    pkt_buf_release(buf);
+}
+
+// One exchange with `parent`, d_ms_us on the way down and d_sm_us on the way up
+static void exchange(const mesh_addr_t *parent, uint16_t seq, int64_t d_ms_us, int64_t d_sm_us, uint8_t steps) {
+    PTPData_t msg = { .msg = PTP_MSG_SYNC, .steps_removed = steps, .seq = seq };
+    int64_t t1_us = true_gps_us(host_now_us) - d_ms_us;
+    deliver(parent, &msg);
+    host_now_us += 300;
+    msg.msg = PTP_MSG_FOLLOW_UP;
+    msg.accuracy_us = PARENT_ACC_US;
+    msg.timestamp_us = t1_us;
+    s_num_sent = 0;
+    deliver(parent, &msg);
+    if (s_num_sent != 1) {
+        return;
+    }
+    CHECK(memcmp(s_sent[0].to.addr, parent->addr, 6) == 0);
+    CHECK_EQ(s_sent[0].msg.msg, PTP_MSG_DELAY_REQ);
+    CHECK_EQ(s_sent[0].msg.seq, seq);
+    int64_t t3_us = s_sent[0].at_us;
+    host_now_us += d_sm_us + 400;
+    msg.msg = PTP_MSG_DELAY_RESP;
+    msg.timestamp_us = true_gps_us(t3_us) + d_sm_us;
+    deliver(parent, &msg);
+    s_num_sent = 0;
+}
+
+// This node's GPS time against the truth, checked against the accuracy it gives
+static int64_t time_error_us(void) {
+    uint64_t gps_us;
+    uint32_t accuracy_us;
+    CHECK_EQ(gps_ptp_from_local(host_now_us, &gps_us, &accuracy_us), GPS_PTP_SOURCE_MESH);
+    int64_t err_us = (int64_t)gps_us - true_gps_us(host_now_us);
+    if (llabs(err_us) > accuracy_us) {
+        fprintf(stderr, "error %lld us beyond accuracy %u us\n", (long long)err_us, accuracy_us);
+        CHECK(!"error within accuracy");
+    }
+    return err_us;
+}
+
+static uint16_t s_seq;
+
+static void test_master_before_time(void) {
+    s_num_sent = 0;
+    host_task_step();
+    CHECK_EQ(host_task_wait, CONFIG_MESH_PTP_INTERVAL_MS);
+    PTPData_t req = { .msg = PTP_MSG_DELAY_REQ, .seq = 1 };
+    deliver(&CHILD, &req);
+    CHECK_EQ(s_num_sent, 0);
+}
+
+static void test_servo(void) {
+    mesh_ptp_stats_t st;
+    uint32_t queued = 0;
+    int64_t max_err_us = 0;
+    for (int i = 0; i < EXCHANGES; i++) {
+        host_now_us += 1000000;
+        int64_t d_ms = LINK_US + test_rand() % JITTER_US;
+        int64_t d_sm = LINK_US + test_rand() % JITTER_US;
+        if (i >= 5 && test_rand() % 10 == 0) {
+            queued++;
+            if (queued % 2) {
+                d_ms += 5000 + test_rand() % 15000;
+            } else {
+                d_sm += 5000 + test_rand() % 15000;
+            }
+        }
+        exchange(&PARENT, ++s_seq, d_ms, d_sm, 0);
+        int64_t err_us = time_error_us();
+        if (i >= 60 && llabs(err_us) > max_err_us) {
+            max_err_us = llabs(err_us);
+        }
+    }
+    mesh_ptp_get_stats(&st);
+    CHECK_EQ(st.exchanges, EXCHANGES);
+    CHECK_EQ(st.rejected, queued);
+    CHECK(queued > 10);
+    CHECK_EQ(st.steps, 1);
+    CHECK_EQ(st.unmatched, 0);
+    CHECK_EQ(st.foreign_syncs, 0);
+    CHECK(st.min_delay_us >= LINK_US && st.min_delay_us < LINK_US + JITTER_US);
+    CHECK(max_err_us < JITTER_US / 2);
+
+    gps_ptp_mesh_clock_t clock;
+    CHECK(gps_ptp_mesh_get(&clock));
+    CHECK_NEAR(clock.drift_ppb, DRIFT_PPB, 5000);     // 1 s apart, JITTER_US is 200 ppm of noise
+    CHECK_EQ(clock.steps_removed, 1);
+    CHECK(clock.accuracy_us >= PARENT_ACC_US && clock.accuracy_us < PARENT_ACC_US + JITTER_US);
+    printf("%d exchanges, %lu queued and rejected: max error %lld us, drift %ld ppb (true %d), accuracy %lu us\n",
+           EXCHANGES, (unsigned long)queued, (long long)max_err_us, (long)clock.drift_ppb, DRIFT_PPB,
+           (unsigned long)clock.accuracy_us);
+}
+
+static void test_unmatched(void) {
+    mesh_ptp_stats_t before, after;
+    mesh_ptp_get_stats(&before);
+    host_now_us += 1000000;
+    PTPData_t msg = { .msg = PTP_MSG_FOLLOW_UP, .seq = ++s_seq, .timestamp_us = true_gps_us(host_now_us) };
+    deliver(&PARENT, &msg);                 // SYNC lost
+    msg.msg = PTP_MSG_DELAY_RESP;
+    deliver(&PARENT, &msg);                 // No DELAY_REQ sent
+    msg = (PTPData_t){ .msg = PTP_MSG_SYNC, .seq = ++s_seq };
+    deliver(&PARENT, &msg);
+    msg.msg = PTP_MSG_FOLLOW_UP;
+    msg.seq = s_seq + 1;                    // Of another exchange
+    deliver(&PARENT, &msg);
+    CHECK_EQ(s_num_sent, 0);
+    mesh_ptp_get_stats(&after);
+    CHECK_EQ(after.unmatched - before.unmatched, 3);
+    CHECK_EQ(after.exchanges, before.exchanges);
+}
+
+static void test_foreign_sync(void) {
+    mesh_ptp_stats_t before, after;
+    mesh_ptp_get_stats(&before);
+
+    // Another node's SYNC in the middle of an exchange with the parent
+    host_now_us += 1000000;
+    PTPData_t msg = { .msg = PTP_MSG_SYNC, .seq = ++s_seq };
+    int64_t t1_us = true_gps_us(host_now_us) - LINK_US;
+    deliver(&PARENT, &msg);
+    PTPData_t other = { .msg = PTP_MSG_SYNC, .seq = 999 };
+    deliver(&OTHER, &other);
+    other.msg = PTP_MSG_FOLLOW_UP;
+    deliver(&OTHER, &other);
+    CHECK_EQ(s_num_sent, 0);
+    host_now_us += 300;
+    msg.msg = PTP_MSG_FOLLOW_UP;
+    msg.accuracy_us = PARENT_ACC_US;
+    msg.timestamp_us = t1_us;
+    deliver(&PARENT, &msg);
+    CHECK_EQ(s_num_sent, 1);
+    host_now_us += LINK_US + 400;
+    msg.msg = PTP_MSG_DELAY_RESP;
+    msg.timestamp_us = true_gps_us(s_sent[0].at_us) + LINK_US;
+    deliver(&PARENT, &msg);
+    s_num_sent = 0;
+    mesh_ptp_get_stats(&after);
+    CHECK_EQ(after.foreign_syncs - before.foreign_syncs, 1);
+    CHECK_EQ(after.unmatched - before.unmatched, 1);
+    CHECK_EQ(after.exchanges - before.exchanges, 1);
+    CHECK_EQ(after.rejected, before.rejected);
+
+    // The root has no parent to take time from
+    s_root = true;
+    host_now_us += 1000000;
+    exchange(&PARENT, ++s_seq, LINK_US, LINK_US, 0);
+    s_root = false;
+    mesh_ptp_get_stats(&after);
+    CHECK_EQ(after.foreign_syncs - before.foreign_syncs, 2);
+    CHECK_EQ(after.exchanges - before.exchanges, 1);
+    CHECK(llabs(time_error_us()) < JITTER_US);
+}
+
+static void test_new_parent(void) {
+    const int64_t slow_us = 8000;
+    mesh_ptp_stats_t before, after;
+    mesh_ptp_get_stats(&before);
+
+    // Moved to PARENT2, while PARENT still lists this node as a station
+    s_bssid = PARENT2_BSSID;
+    host_now_us += 1000000;
+    exchange(&PARENT, ++s_seq, LINK_US, LINK_US, 0);
+    mesh_ptp_get_stats(&after);
+    CHECK_EQ(after.foreign_syncs - before.foreign_syncs, 1);
+    CHECK_EQ(after.exchanges, before.exchanges);
+
+    // Over a link much slower than the old one: taken at once, stepped to
+    for (int i = 0; i < 20; i++) {
+        host_now_us += 1000000;
+        exchange(&PARENT2, ++s_seq, slow_us + test_rand() % JITTER_US, slow_us + test_rand() % JITTER_US, 1);
+        CHECK(llabs(time_error_us()) < JITTER_US);
+        if (i == 10) {
+            exchange(&PARENT, ++s_seq, LINK_US, LINK_US, 0);
+        }
+    }
+    mesh_ptp_get_stats(&after);
+    CHECK_EQ(after.exchanges - before.exchanges, 20);
+    CHECK_EQ(after.rejected, before.rejected);
+    CHECK_EQ(after.steps - before.steps, 1);
+    CHECK_EQ(after.foreign_syncs - before.foreign_syncs, 2);
+    CHECK(after.min_delay_us >= slow_us);
+    gps_ptp_mesh_clock_t clock;
+    CHECK(gps_ptp_mesh_get(&clock));
+    CHECK_EQ(clock.steps_removed, 2);
+
+    // And back: PARENT is the parent again, PARENT2 the one left
+    s_bssid = PARENT_BSSID;
+    host_now_us += 1000000;
+    exchange(&PARENT2, ++s_seq, slow_us, slow_us, 1);
+    exchange(&PARENT, ++s_seq, LINK_US, LINK_US, 0);
+    mesh_ptp_get_stats(&before);
+    CHECK_EQ(before.exchanges - after.exchanges, 1);
+    CHECK_EQ(before.foreign_syncs - after.foreign_syncs, 1);
+    CHECK(gps_ptp_mesh_get(&clock));
+    CHECK_EQ(clock.steps_removed, 1);
+}
+
+static void test_master(void) {
+    mesh_ptp_stats_t before, after;
+    mesh_ptp_get_stats(&before);
+    memset(&s_stations, 0, sizeof(s_stations));
+    memcpy(s_stations.sta[0].mac, CHILD.addr, 6);
+    memcpy(s_stations.sta[1].mac, STATION.addr, 6);
+    s_stations.num = 2;
+
+    host_now_us += 200000;
+    s_num_sent = 0;
+    host_task_step();
+    CHECK_EQ(s_num_sent, 3);
+    CHECK(memcmp(s_sent[0].to.addr, CHILD.addr, 6) == 0);
+    CHECK_EQ(s_sent[0].msg.msg, PTP_MSG_SYNC);
+    CHECK(memcmp(s_sent[1].to.addr, CHILD.addr, 6) == 0);
+    CHECK_EQ(s_sent[1].msg.msg, PTP_MSG_FOLLOW_UP);
+    CHECK_EQ(s_sent[1].msg.seq, s_sent[0].msg.seq);
+    CHECK_EQ(s_sent[1].msg.steps_removed, 1);
+    int64_t err_us = (int64_t)s_sent[1].msg.timestamp_us - true_gps_us(s_sent[0].at_us);
+    CHECK(llabs(err_us) <= s_sent[1].msg.accuracy_us);
+    CHECK(llabs(err_us) < JITTER_US);
+    CHECK(memcmp(s_sent[2].to.addr, STATION.addr, 6) == 0);
+    CHECK_EQ(s_sent[2].msg.msg, PTP_MSG_SYNC);
+
+    host_now_us += LINK_US;
+    s_num_sent = 0;
+    PTPData_t req = { .msg = PTP_MSG_DELAY_REQ, .seq = s_sent[0].msg.seq };
+    deliver(&CHILD, &req);
+    CHECK_EQ(s_num_sent, 1);
+    CHECK(memcmp(s_sent[0].to.addr, CHILD.addr, 6) == 0);
+    CHECK_EQ(s_sent[0].msg.msg, PTP_MSG_DELAY_RESP);
+    CHECK_EQ(s_sent[0].msg.seq, req.seq);
+    CHECK_EQ(s_sent[0].msg.steps_removed, 1);
+    err_us = (int64_t)s_sent[0].msg.timestamp_us - true_gps_us(host_now_us);
+    CHECK(llabs(err_us) <= s_sent[0].msg.accuracy_us);
+
+    mesh_ptp_get_stats(&after);
+    CHECK_EQ(after.syncs_sent - before.syncs_sent, 1);
+    CHECK_EQ(after.delay_resps_sent - before.delay_resps_sent, 1);
+    CHECK_EQ(after.send_errors - before.send_errors, 1);
+    s_num_sent = 0;
+}
+
+int main(void) {
+    host_now_us = 5000000;
+    s_bssid = PARENT_BSSID;
+    memcpy(s_stations.sta[0].mac, CHILD.addr, 6);
+    s_stations.num = 1;
+    CHECK_EQ(mesh_ptp_start(), ESP_OK);
+    CHECK_EQ(mesh_ptp_start(), ESP_OK);
+
+    test_master_before_time();
+    test_servo();
+    test_unmatched();
+    test_foreign_sync();
+    test_new_parent();
+    test_master();
+    mesh_ptp_log_stats();
+    return test_result("test_mesh_ptp");
+}
@@ -0,0 +1,341 @@
+#include <string.h>
+#include "test_util.h"
+#include "mesh_tx.h"
+
+/*
+mesh_tx on one host thread (test/host), built with CONFIG_MESH_TX_AGGREGATE: packets queued by the
+test, the TX task stepped once per drain, and what it hands to esp_mesh_send() captured. Every test
+packet carries a 16-bit id at the start of its payload, so the send order can be read back.
+
+Classes go out highest first, and a packet kept for a full mesh queue is sent after a higher one
+queued meanwhile. Each class' full-queue policy: corrections and telemetry drop their oldest,
+control drops the new packet, bulk makes its sender wait CONFIG_MESH_TX_BULK_WAIT_MS and then drops
+it; corrections older than CONFIG_MESH_TX_CORR_MAX_AGE_MS are dropped unsent. AGGREGATE frames: held
+until CONFIG_MESH_TX_AGGREGATE_FLUSH_MS after their first packet, one per destination and flags, a
+single record sent as itself, closed and sent at once when the next record would not fit the frame
+or it holds 255, and packets over MESH_TX_AGG_RECORD_MAX never packed.
+*/
+
+#define SMALL       16      // Payload that gets packed
+#define LARGE       400     // Over MESH_TX_AGG_RECORD_MAX
+#define SENT_MAX    64
+
+static const mesh_addr_t ROOT = { .addr = { 0x02, 0, 0, 0, 0, 0x01 } };
+static const mesh_addr_t NODE = { .addr = { 0x02, 0, 0, 0, 0, 0x02 } };
+
+// Packets handed to esp_mesh_send()
+static struct {
+    mesh_addr_t to;
+    int flag;
+    uint8_t data[MESH_TX_MTU];
+    size_t size;
+} s_sent[SENT_MAX];
+static int s_num_sent;
+static esp_err_t s_mesh_err;        // What esp_mesh_send() returns next
+
+// From modules not built here (protocol.c, gps_ptp_time.c)
+const char *DATATAG = "DATA_TAG";
+
+uint64_t gps_ptp_now_us(void) {
+    return 0;
+}
+
+esp_err_t esp_mesh_send(const mesh_addr_t *to, const mesh_data_t *data, int flag, const mesh_opt_t opt[],
+                        int opt_count) {
+    CHECK(flag & MESH_DATA_NONBLOCK);
+    if (s_mesh_err != ESP_OK) {
+        esp_err_t err = s_mesh_err;
+        s_mesh_err = ESP_OK;
+        return err;
+    }
+    if (s_num_sent < SENT_MAX) {
+        s_sent[s_num_sent].to = *to;
+        s_sent[s_num_sent].flag = flag & ~MESH_DATA_NONBLOCK;
+        memcpy(s_sent[s_num_sent].data, data->data, data->size);
+        s_sent[s_num_sent].size = data->size;
+    }
+    s_num_sent++;
+    return ESP_OK;
+}
+
+static esp_err_t send(mesh_tx_class_t cls, const mesh_addr_t *to, ProtocolType type, uint16_t id, uint16_t len) {
+    uint8_t payload[LARGE];
+    memset(payload, (uint8_t)id, len);
+    memcpy(payload, &id, sizeof(id));
+    return mesh_tx_send(cls, to, MESH_DATA_P2P, type, payload, len);
+}
+
+// Type and id of the packet at `pkt`
+static void packet_at(const uint8_t *pkt, size_t size, ProtocolType *type, uint16_t *id) {
+    wire_hdr_t hdr;
+    CHECK_EQ(wire_decode(pkt, size, &hdr), WIRE_OK);
+    *type = hdr.type;
+    memcpy(id, pkt + hdr.hdr_size, sizeof(*id));
+}
+
+static uint16_t sent_id(int i) {
+    ProtocolType type;
+    uint16_t id = 0xFFFF;
+    if (i < s_num_sent) {
+        packet_at(s_sent[i].data, s_sent[i].size, &type, &id);
+    }
+    return id;
+}
+
+static void check_sent_ids(const uint16_t *ids, int count) {
+    CHECK_EQ(s_num_sent, count);
+    for (int i = 0; i < count; i++) {
+        CHECK_EQ(sent_id(i), ids[i]);
+    }
+}
+
+// Records of the AGGREGATE frame sent `i`-th, their ids in `ids`
+static int frame_records(int i, uint16_t *ids, int max) {
+    wire_hdr_t hdr;
+    CHECK_EQ(wire_decode(s_sent[i].data, s_sent[i].size, &hdr), WIRE_OK);
+    CHECK_EQ(hdr.type, AGGREGATE);
+    const uint8_t *p = s_sent[i].data + hdr.hdr_size;
+    size_t left = hdr.length;
+    int n = 0;
+    while (left > 0) {
+        size_t size = wire_packet_size(p, left);
+        CHECK(size > 0);
+        if (size == 0) {
+            break;
+        }
+        ProtocolType type;
+        uint16_t id = 0;
+        if (size > WIRE_TX_OVERHEAD) {
+            packet_at(p, size, &type, &id);
+        }
+        if (n < max) {
+            ids[n] = id;
+        }
+        n++;
+        p += size;
+        left -= size;
+    }
+    return n;
+}
+
+static void reset(void) {
+    s_num_sent = 0;
+    host_now_us += 10 * 1000 * 1000;
+}
+
+static void get_stats(mesh_tx_class_t cls, mesh_tx_stats_t *st) {
+    mesh_tx_get_stats(cls, st);
+}
+
+static void test_priority(void) {
+    reset();
+    CHECK_EQ(send(MESH_TX_BULK, &NODE, OTA_DATA, 1, LARGE), ESP_OK);
+    CHECK_EQ(send(MESH_TX_TELEMETRY, &ROOT, ROBOT_DATA, 2, LARGE), ESP_OK);
+    CHECK_EQ(send(MESH_TX_CONTROL, &ROOT, FW_REPORT, 3, LARGE), ESP_OK);
+    CHECK_EQ(send(MESH_TX_CORRECTIONS, &NODE, RTK_DATA, 4, LARGE), ESP_OK);
+    host_task_step();
+    static const uint16_t order[] = { 4, 3, 2, 1 };
+    check_sent_ids(order, 4);
+    CHECK_EQ(host_task_wait, pdMS_TO_TICKS(60 * 1000));     // Nothing left: only the stats interval
+
+    // The mesh queue is full for the telemetry packet; a correction queued meanwhile goes first
+    reset();
+    CHECK_EQ(send(MESH_TX_TELEMETRY, &ROOT, ROBOT_DATA, 5, LARGE), ESP_OK);
+    CHECK_EQ(send(MESH_TX_BULK, &NODE, OTA_DATA, 6, LARGE), ESP_OK);
+    s_mesh_err = ESP_ERR_MESH_QUEUE_FULL;
+    host_task_step();
+    CHECK_EQ(s_num_sent, 0);
+    CHECK_EQ(host_task_wait, CONFIG_MESH_TX_RETRY_MS);
+    CHECK_EQ(send(MESH_TX_CORRECTIONS, &NODE, RTK_DATA, 7, LARGE), ESP_OK);
+    host_task_step();
+    static const uint16_t retried[] = { 7, 5, 6 };
+    check_sent_ids(retried, 3);
+    mesh_tx_stats_t st;
+    get_stats(MESH_TX_TELEMETRY, &st);
+    CHECK_EQ(st.retries, 1);
+}
+
+static void test_full_policies(void) {
+    mesh_tx_stats_t before, after;
+
+    // Corrections: the oldest goes
+    reset();
+    get_stats(MESH_TX_CORRECTIONS, &before);
+    for (int i = 0; i <= CONFIG_MESH_TX_CORR_QUEUE_LEN; i++) {
+        CHECK_EQ(send(MESH_TX_CORRECTIONS, &NODE, RTK_DATA, 10 + i, LARGE), ESP_OK);
+    }
+    host_task_step();
+    CHECK_EQ(s_num_sent, CONFIG_MESH_TX_CORR_QUEUE_LEN);
+    CHECK_EQ(sent_id(0), 11);
+    CHECK_EQ(sent_id(CONFIG_MESH_TX_CORR_QUEUE_LEN - 1), 10 + CONFIG_MESH_TX_CORR_QUEUE_LEN);
+    get_stats(MESH_TX_CORRECTIONS, &after);
+    CHECK_EQ(after.dropped_full - before.dropped_full, 1);
+    CHECK_EQ(after.max_depth, CONFIG_MESH_TX_CORR_QUEUE_LEN);
+
+    // Control: the new one goes
+    reset();
+    get_stats(MESH_TX_CONTROL, &before);
+    for (int i = 0; i < CONFIG_MESH_TX_CONTROL_QUEUE_LEN; i++) {
+        CHECK_EQ(send(MESH_TX_CONTROL, &ROOT, FW_REPORT, 20 + i, LARGE), ESP_OK);
+    }
+    CHECK_EQ(send(MESH_TX_CONTROL, &ROOT, FW_REPORT, 99, LARGE), ESP_ERR_NO_MEM);
+    host_task_step();
+    CHECK_EQ(s_num_sent, CONFIG_MESH_TX_CONTROL_QUEUE_LEN);
+    CHECK_EQ(sent_id(0), 20);
+    CHECK_EQ(sent_id(CONFIG_MESH_TX_CONTROL_QUEUE_LEN - 1), 20 + CONFIG_MESH_TX_CONTROL_QUEUE_LEN - 1);
+    get_stats(MESH_TX_CONTROL, &after);
+    CHECK_EQ(after.dropped_full - before.dropped_full, 1);
+
+    // Telemetry: the oldest go
+    reset();
+    get_stats(MESH_TX_TELEMETRY, &before);
+    for (int i = 0; i < CONFIG_MESH_TX_TELEM_QUEUE_LEN + 2; i++) {
+        CHECK_EQ(send(MESH_TX_TELEMETRY, &ROOT, ROBOT_DATA, 30 + i, LARGE), ESP_OK);
+    }
+    host_task_step();
+    CHECK_EQ(s_num_sent, CONFIG_MESH_TX_TELEM_QUEUE_LEN);
+    CHECK_EQ(sent_id(0), 32);
+    get_stats(MESH_TX_TELEMETRY, &after);
+    CHECK_EQ(after.dropped_full - before.dropped_full, 2);
+
+    // Bulk: the sender waits, then gives up
+    reset();
+    get_stats(MESH_TX_BULK, &before);
+    for (int i = 0; i < CONFIG_MESH_TX_BULK_QUEUE_LEN; i++) {
+        CHECK_EQ(send(MESH_TX_BULK, &NODE, OTA_DATA, 40 + i, LARGE), ESP_OK);
+    }
+    int64_t start_us = host_now_us;
+    CHECK_EQ(send(MESH_TX_BULK, &NODE, OTA_DATA, 99, LARGE), ESP_ERR_NO_MEM);
+    CHECK(host_now_us - start_us >= CONFIG_MESH_TX_BULK_WAIT_MS * 1000LL);
+    CHECK(host_now_us - start_us < (CONFIG_MESH_TX_BULK_WAIT_MS + 2 * CONFIG_MESH_TX_RETRY_MS) * 1000LL);
+    host_task_step();
+    CHECK_EQ(s_num_sent, CONFIG_MESH_TX_BULK_QUEUE_LEN);
+    CHECK_EQ(sent_id(0), 40);
+    get_stats(MESH_TX_BULK, &after);
+    CHECK_EQ(after.dropped_full - before.dropped_full, 1);
+
+    // Corrections past their age are never sent
+    reset();
+    get_stats(MESH_TX_CORRECTIONS, &before);
+    CHECK_EQ(send(MESH_TX_CORRECTIONS, &NODE, RTK_DATA, 50, LARGE), ESP_OK);
+    host_now_us += (CONFIG_MESH_TX_CORR_MAX_AGE_MS + 1) * 1000LL;
+    CHECK_EQ(send(MESH_TX_CORRECTIONS, &NODE, RTK_DATA, 51, LARGE), ESP_OK);
+    host_task_step();
+    static const uint16_t fresh[] = { 51 };
+    check_sent_ids(fresh, 1);
+    get_stats(MESH_TX_CORRECTIONS, &after);
+    CHECK_EQ(after.dropped_stale - before.dropped_stale, 1);
+}
+
+static void test_flush_deadline(void) {
+    mesh_tx_stats_t before, after;
+    reset();
+    get_stats(MESH_TX_TELEMETRY, &before);
+    for (int i = 0; i < 3; i++) {
+        CHECK_EQ(send(MESH_TX_TELEMETRY, &ROOT, ROBOT_DATA, 60 + i, SMALL), ESP_OK);
+    }
+    CHECK_EQ(send(MESH_TX_TELEMETRY, &NODE, ECHO_DATA, 63, SMALL), ESP_OK);    // Other destination
+    CHECK_EQ(send(MESH_TX_CORRECTIONS, &NODE, RTK_DATA, 64, SMALL), ESP_OK);   // Never packed
+    host_task_step();
+    static const uint16_t first[] = { 64 };
+    check_sent_ids(first, 1);
+    CHECK_EQ(host_task_wait, CONFIG_MESH_TX_AGGREGATE_FLUSH_MS);
+
+    host_now_us += (CONFIG_MESH_TX_AGGREGATE_FLUSH_MS - 1) * 1000LL;
+    host_task_step();
+    CHECK_EQ(s_num_sent, 1);
+    CHECK_EQ(host_task_wait, 1);
+    host_now_us += 1000;
+    host_task_step();
+    CHECK_EQ(s_num_sent, 3);
+    uint16_t ids[8];
+    CHECK_EQ(frame_records(1, ids, 8), 3);
+    CHECK_EQ(ids[0], 60);
+    CHECK_EQ(ids[2], 62);
+    CHECK(memcmp(s_sent[1].to.addr, ROOT.addr, 6) == 0);
+    // The frame to NODE held one packet: sent as that packet
+    ProtocolType type;
+    uint16_t id;
+    packet_at(s_sent[2].data, s_sent[2].size, &type, &id);
+    CHECK_EQ(type, ECHO_DATA);
+    CHECK_EQ(id, 63);
+    CHECK_EQ(s_sent[2].size, WIRE_TX_OVERHEAD + SMALL);
+    get_stats(MESH_TX_TELEMETRY, &after);
+    CHECK_EQ(after.aggregated - before.aggregated, 2);
+    CHECK_EQ(after.frames - before.frames, 1);
+    CHECK_EQ(after.sent - before.sent, 4);
+
+    // Other flags, other frame
+    reset();
+    CHECK_EQ(send(MESH_TX_CONTROL, &ROOT, FW_REPORT, 70, SMALL), ESP_OK);
+    uint8_t payload[SMALL] = { 71 };
+    CHECK_EQ(mesh_tx_send(MESH_TX_CONTROL, &ROOT, MESH_DATA_P2P | MESH_DATA_GROUP, FW_REPORT, payload, SMALL),
+             ESP_OK);
+    CHECK_EQ(send(MESH_TX_CONTROL, &ROOT, FW_REPORT, 72, SMALL), ESP_OK);
+    host_now_us += CONFIG_MESH_TX_AGGREGATE_FLUSH_MS * 1000LL;
+    host_task_step();
+    CHECK_EQ(s_num_sent, 2);
+    CHECK_EQ(frame_records(0, ids, 8), 2);
+    CHECK_EQ(ids[1], 72);
+    CHECK_EQ(s_sent[1].flag, MESH_DATA_P2P | MESH_DATA_GROUP);
+    CHECK_EQ(sent_id(1), 71);
+}
+
+static void test_packing_limits(void) {
+    mesh_tx_stats_t before, after;
+    uint16_t ids[256];
+
+    // Up to CONFIG_MESH_TX_AGGREGATE_FRAME bytes: a full frame goes at once, the next one waits
+    reset();
+    const uint16_t len = MESH_TX_AGG_RECORD_MAX - WIRE_TX_OVERHEAD;
+    const int per_frame = (CONFIG_MESH_TX_AGGREGATE_FRAME - WIRE_TX_OVERHEAD) / MESH_TX_AGG_RECORD_MAX;
+    for (int i = 0; i <= per_frame; i++) {
+        CHECK_EQ(send(MESH_TX_TELEMETRY, &ROOT, ROBOT_DATA, 80 + i, len), ESP_OK);
+    }
+    CHECK_EQ(send(MESH_TX_TELEMETRY, &ROOT, ROBOT_DATA, 99, len + 1), ESP_OK);  // Too large to pack
+    host_task_step();
+    CHECK_EQ(s_num_sent, 1);
+    CHECK(s_sent[0].size <= CONFIG_MESH_TX_AGGREGATE_FRAME);
+    CHECK_EQ(frame_records(0, ids, 256), per_frame);
+    CHECK_EQ(ids[per_frame - 1], 80 + per_frame - 1);
+    // The large packet waits behind the open frame, in queue order
+    host_now_us += CONFIG_MESH_TX_AGGREGATE_FLUSH_MS * 1000LL;
+    host_task_step();
+    CHECK_EQ(s_num_sent, 3);
+    CHECK_EQ(sent_id(1), 80 + per_frame);
+    CHECK_EQ(sent_id(2), 99);
+
+    // At most 255 records, however small
+    reset();
+    get_stats(MESH_TX_CONTROL, &before);
+    for (int i = 0; i < 256; i++) {
+        CHECK_EQ(mesh_tx_send(MESH_TX_CONTROL, &ROOT, MESH_DATA_P2P, FW_QUERY, NULL, 0), ESP_OK);
+    }
+    host_task_step();
+    CHECK_EQ(s_num_sent, 1);
+    CHECK_EQ(frame_records(0, ids, 256), 255);
+    CHECK(s_sent[0].size <= CONFIG_MESH_TX_AGGREGATE_FRAME);
+    host_now_us += CONFIG_MESH_TX_AGGREGATE_FLUSH_MS * 1000LL;
+    host_task_step();
+    CHECK_EQ(s_num_sent, 2);
+    CHECK_EQ(s_sent[1].size, WIRE_TX_OVERHEAD);
+    get_stats(MESH_TX_CONTROL, &after);
+    CHECK_EQ(after.sent - before.sent, 256);
+    CHECK_EQ(after.frames - before.frames, 1);
+    CHECK_EQ(after.aggregated - before.aggregated, 254);
+}
+
+int main(void) {
+    CHECK_EQ(send(MESH_TX_CONTROL, &ROOT, FW_REPORT, 0, SMALL), ESP_ERR_INVALID_STATE);
+    CHECK_EQ(mesh_tx_init(), ESP_OK);
+    test_priority();
+    test_full_policies();
+    test_flush_deadline();
+    test_packing_limits();
+
+    pkt_pool_stats_t pool;
+    pkt_pool_get_stats(&pool);
+    CHECK_EQ(pool.in_use, 0);
+    mesh_tx_log_stats();
+    return test_result("test_mesh_tx");
+}
@@ -0,0 +1,208 @@
+#include <stdlib.h>
+#include <string.h>
+#include "test_util.h"
+#include "ota_lzss.h"
+#include "ota_delta.h"
+#include "protocol_gen.h"
+
+/*
+ota_lzss.c and ota_delta.c against images encoded by python/ota_image.py. The ota_images test writes
+them into the working directory first (ota_images.py, which lists them). Each chunk decodes on its
+own, in shuffled chunk order, its bytes fed in random pieces and decoded into random output sizes,
+through the same LZSS-then-ops chain as decode_block() in mesh_ota.c.
+*/
+
+static uint8_t *s_base;
+static size_t s_base_len;
+static uint8_t *s_image;
+static size_t s_image_len;
+
+static uint8_t *read_file(const char *name, size_t *len) {
+    FILE *f = fopen(name, "rb");
+    if (f == NULL) {
+        printf("%s: cannot open (run by ctest after the ota_images test)\n", name);
+        exit(1);
+    }
+    fseek(f, 0, SEEK_END);
+    *len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *data = malloc(*len);
+    CHECK_EQ(fread(data, 1, *len, f), *len);
+    fclose(f);
+    return data;
+}
+
+static bool read_base(void *ctx, uint32_t offset, void *dst, size_t len) {
+    if (offset > s_base_len || len > s_base_len - offset) {
+        return false;
+    }
+    memcpy(dst, s_base + offset, len);
+    return true;
+}
+
+static size_t random_size(size_t max) {
+    return 1 + test_rand() % max;
+}
+
+// Image bytes decoded from one chunk, at most `size`
+static size_t decode_chunk(const mesh_ota_image_header_t *h, int c, const uint8_t *body, size_t body_len,
+                           uint8_t *out, size_t size) {
+    bool delta = h->encoding == MESH_OTA_ENCODING_DELTA;
+    ota_lzss_t lzss;
+    ota_delta_t ops_state;
+    CHECK(ota_lzss_init(&lzss, h->window_bits, h->lookahead_bits));
+    ota_delta_init(&ops_state, read_base, NULL, s_base_len, (uint32_t)c * h->chunk_size);
+    uint8_t ops[256];
+    const uint8_t *op = ops;
+    size_t op_len = 0;
+    size_t done = 0;
+    for (size_t fed = 0; fed < body_len;) {
+        const uint8_t *in = body + fed;
+        size_t len = random_size(700);
+        len = len < body_len - fed ? len : body_len - fed;
+        fed += len;
+        while (done < size) {
+            size_t want = random_size(300);
+            want = want < size - done ? want : size - done;
+            size_t n;
+            if (!delta) {
+                n = ota_lzss_decode(&lzss, &in, &len, out + done, want);
+            } else {
+                n = ota_delta_apply(&ops_state, &op, &op_len, out + done, want);
+                if (ops_state.error) {
+                    return done + n;
+                }
+                if (n < want) {
+                    op = ops;
+                    op_len = ota_lzss_decode(&lzss, &in, &len, ops, random_size(sizeof(ops)));
+                }
+            }
+            done += n;
+            if (n < want && (!delta || (n == 0 && op_len == 0))) {
+                CHECK_EQ(len, 0);       // Short only once the piece is used up
+                break;
+            }
+        }
+    }
+    return done;
+}
+
+static void shuffle(int *order, int n) {
+    for (int i = 0; i < n; i++) {
+        order[i] = i;
+    }
+    for (int i = n - 1; i > 0; i--) {
+        int j = test_rand() % (i + 1);
+        int t = order[i];
+        order[i] = order[j];
+        order[j] = t;
+    }
+}
+
+// Decodes `name` back to image.bin, with at least `min_stored` chunks stored rather than compressed
+static void test_image(const char *name, uint8_t encoding, int min_stored) {
+    size_t file_len;
+    uint8_t *file = read_file(name, &file_len);
+    mesh_ota_image_header_t h;
+    memcpy(&h, file, sizeof(h));
+    CHECK_EQ(h.magic, MESH_OTA_IMAGE_MAGIC);
+    CHECK_EQ(h.encoding, encoding);
+    CHECK_EQ(h.image_size, s_image_len);
+    CHECK_EQ(h.chunk_count, (s_image_len + h.chunk_size - 1) / h.chunk_size);
+
+    uint16_t *chunk_len = malloc(h.chunk_count * sizeof(uint16_t));
+    memcpy(chunk_len, file + sizeof(h), h.chunk_count * sizeof(uint16_t));
+    size_t *chunk_pos = malloc(h.chunk_count * sizeof(size_t));
+    size_t pos = sizeof(h) + h.chunk_count * sizeof(uint16_t);
+    for (int c = 0; c < h.chunk_count; c++) {
+        chunk_pos[c] = pos;
+        pos += chunk_len[c];
+    }
+    CHECK_EQ(pos, file_len);
+
+    uint8_t *out = malloc(s_image_len);
+    memset(out, 0, s_image_len);
+    int *order = malloc(h.chunk_count * sizeof(int));
+    shuffle(order, h.chunk_count);
+    int stored = 0;
+    for (int i = 0; i < h.chunk_count; i++) {
+        int c = order[i];
+        size_t offset = (size_t)c * h.chunk_size;
+        size_t size = s_image_len - offset < h.chunk_size ? s_image_len - offset : h.chunk_size;
+        if (chunk_len[c] == size) {
+            memcpy(out + offset, file + chunk_pos[c], size);
+            stored++;
+        } else {
+            CHECK_EQ(decode_chunk(&h, c, file + chunk_pos[c], chunk_len[c], out + offset, size), size);
+        }
+    }
+    CHECK(memcmp(out, s_image, s_image_len) == 0);
+    CHECK(stored >= min_stored);
+    CHECK(stored < h.chunk_count);
+    printf("%s: %zu -> %zu bytes, %d chunks (%d stored)\n", name, s_image_len, file_len, h.chunk_count, stored);
+
+    // A chunk cut short decodes short, and only its own bytes
+    for (int c = 0; c < h.chunk_count; c++) {
+        size_t offset = (size_t)c * h.chunk_size;
+        size_t size = s_image_len - offset < h.chunk_size ? s_image_len - offset : h.chunk_size;
+        if (chunk_len[c] != size && chunk_len[c] > 1) {
+            size_t n = decode_chunk(&h, c, file + chunk_pos[c], chunk_len[c] / 2, out, size);
+            CHECK(n < size);
+            CHECK(memcmp(out, s_image + offset, n) == 0);
+            break;
+        }
+    }
+    free(order);
+    free(out);
+    free(chunk_pos);
+    free(chunk_len);
+    free(file);
+}
+
+// Ops the encoder never writes: an unknown code, and reads outside the base
+static void test_bad_ops(void) {
+    static const struct {
+        uint8_t ops[8];
+        size_t len;
+        size_t out;     // Bytes output before the error
+    } cases[] = {
+        { { 3, 0, 0 }, 3, 0 },
+        { { OTA_DELTA_INSERT, 2, 0, 'a', 'b', 9 }, 6, 2 },
+        { { OTA_DELTA_COPY, 0x9B, 0xFF, 0xFF, 0xFF, 4, 0 }, 7, 0 },     // Seek to -1
+        { { OTA_DELTA_COPY, 0, 0, 0, 0x10, 4, 0 }, 7, 0 },              // Seek past the end
+    };
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        ota_delta_t d;
+        ota_delta_init(&d, read_base, NULL, s_base_len, 100);
+        const uint8_t *in = cases[i].ops;
+        size_t in_len = cases[i].len;
+        uint8_t out[16];
+        CHECK_EQ(ota_delta_apply(&d, &in, &in_len, out, sizeof(out)), cases[i].out);
+        CHECK(d.error);
+        CHECK_EQ(ota_delta_apply(&d, &in, &in_len, out, sizeof(out)), 0);
+    }
+
+    // COPY up to the last base byte is fine
+    ota_delta_t d;
+    ota_delta_init(&d, read_base, NULL, s_base_len, s_base_len - 4);
+    uint8_t ops[] = { OTA_DELTA_COPY, 0, 0, 0, 0, 4, 0 };
+    const uint8_t *in = ops;
+    size_t in_len = sizeof(ops);
+    uint8_t out[8];
+    CHECK_EQ(ota_delta_apply(&d, &in, &in_len, out, sizeof(out)), 4);
+    CHECK(!d.error);
+    CHECK(memcmp(out, s_base + s_base_len - 4, 4) == 0);
+}
+
+int main(void) {
+    s_base = read_file("base.bin", &s_base_len);
+    s_image = read_file("image.bin", &s_image_len);
+    test_image("lzss.mota", MESH_OTA_ENCODING_LZSS, 2);
+    test_image("lzss_w12.mota", MESH_OTA_ENCODING_LZSS, 1);
+    test_image("delta.mota", MESH_OTA_ENCODING_DELTA, 0);
+    test_image("delta_w8.mota", MESH_OTA_ENCODING_DELTA, 0);
+    test_bad_ops();
+    free(s_image);
+    free(s_base);
+    return test_result("test_ota_decode");
+}
@@ -0,0 +1,179 @@
+#include <string.h>
+#include <time.h>
+#include "test_util.h"
+#include "ota_writer.h"
+
+/*
+ota_writer with its writer task on a thread of its own (test/host/freertos_thread.c), writing a
+RAM flash that behaves like NOR: programming only clears bits, so a sector programmed without an
+erase first, or erased again after its data went in, shows up as a wrong image. The partition
+starts out all zeros for the same reason.
+*/
+
+#define PART_ADDRESS    0x100000
+#define PART_SIZE       0x100000
+#define IMAGE_SIZE      (600 * 1024 + 300)      // Last sector and last block partial
+#define BLOCK_SIZE      1024                    // As mesh_ota sends them
+#define NUM_BLOCKS      ((IMAGE_SIZE + BLOCK_SIZE - 1) / BLOCK_SIZE)
+#define NUM_SECTORS     ((IMAGE_SIZE + OTA_WRITER_SECTOR_SIZE - 1) / OTA_WRITER_SECTOR_SIZE)
+
+static const esp_partition_t s_part = { .address = PART_ADDRESS, .size = PART_SIZE, .label = "ota_1" };
+static uint8_t s_image[IMAGE_SIZE];
+static uint8_t s_readback[IMAGE_SIZE];
+
+static void new_image(void) {
+    for (int i = 0; i < IMAGE_SIZE; i++) {
+        s_image[i] = (uint8_t)test_rand();
+    }
+    memset(&host_flash[PART_ADDRESS], 0x00, PART_SIZE);
+}
+
+static void shuffle(int *order, int n) {
+    for (int i = 0; i < n; i++) {
+        order[i] = i;
+    }
+    for (int i = n - 1; i > 0; i--) {
+        int j = test_rand() % (i + 1);
+        int t = order[i];
+        order[i] = order[j];
+        order[j] = t;
+    }
+}
+
+// One block, in two pieces split anywhere every other time (pages shared between pieces)
+static void write_block(int b) {
+    uint32_t offset = b * BLOCK_SIZE;
+    uint32_t len = IMAGE_SIZE - offset < BLOCK_SIZE ? IMAGE_SIZE - offset : BLOCK_SIZE;
+    uint32_t split = test_rand() % 2 ? test_rand() % len : 0;
+    if (split > 0) {
+        CHECK_EQ(ota_writer_write(offset + split, s_image + offset + split, len - split), ESP_OK);
+    }
+    CHECK_EQ(ota_writer_write(offset, s_image + offset, split > 0 ? split : len), ESP_OK);
+}
+
+static bool image_on_flash(void) {
+    CHECK_EQ(esp_partition_read(&s_part, 0, s_readback, IMAGE_SIZE), ESP_OK);
+    return memcmp(s_readback, s_image, IMAGE_SIZE) == 0;
+}
+
+// Blocks in random order, one in eight sent twice as a lost ACK would have it
+static void test_any_order(void) {
+    new_image();
+    ota_writer_stats_t before, st;
+    ota_writer_get_stats(&before);
+    host_flash_stats_t flash_before = host_flash_stats;
+
+    CHECK_EQ(ota_writer_begin(&s_part, IMAGE_SIZE), ESP_OK);
+    static int order[NUM_BLOCKS];
+    shuffle(order, NUM_BLOCKS);
+    for (int i = 0; i < NUM_BLOCKS; i++) {
+        write_block(order[i]);
+        if (test_rand() % 8 == 0) {
+            write_block(order[test_rand() % (i + 1)]);
+        }
+    }
+    CHECK_EQ(ota_writer_flush(), ESP_OK);
+
+    CHECK(image_on_flash());
+    CHECK_EQ(host_flash_stats.dirty_writes, 0);
+    ota_writer_get_stats(&st);
+    CHECK(st.sectors_written - before.sectors_written >= NUM_SECTORS);
+    CHECK(st.erased_ahead + st.erased_on_write - before.erased_ahead - before.erased_on_write >= NUM_SECTORS);
+    CHECK(host_flash_stats.sectors_erased - flash_before.sectors_erased <= PART_SIZE / OTA_WRITER_SECTOR_SIZE);
+}
+
+// Sectors written so far, waiting up to a second for the writer task to reach `count`
+static uint32_t wait_sectors_written(uint32_t count) {
+    ota_writer_stats_t st;
+    for (int ms = 0; ms < 1000; ms++) {
+        ota_writer_get_stats(&st);
+        if (st.sectors_written >= count) {
+            break;
+        }
+        nanosleep(&(struct timespec){ .tv_nsec = 1000000 }, NULL);
+    }
+    return st.sectors_written;
+}
+
+// A complete sector goes to flash without waiting for a flush, as one write
+static void test_whole_sectors(void) {
+    new_image();
+    ota_writer_stats_t before, st;
+    ota_writer_get_stats(&before);
+
+    CHECK_EQ(ota_writer_begin(&s_part, IMAGE_SIZE), ESP_OK);
+    CHECK_EQ(ota_writer_write(0, s_image, OTA_WRITER_SECTOR_SIZE), ESP_OK);
+    CHECK_EQ(wait_sectors_written(before.sectors_written + 1), before.sectors_written + 1);
+    for (uint32_t off = OTA_WRITER_SECTOR_SIZE; off < IMAGE_SIZE; off += OTA_WRITER_SECTOR_SIZE) {
+        uint32_t n = IMAGE_SIZE - off < OTA_WRITER_SECTOR_SIZE ? IMAGE_SIZE - off : OTA_WRITER_SECTOR_SIZE;
+        CHECK_EQ(ota_writer_write(off, s_image + off, n), ESP_OK);
+    }
+    CHECK_EQ(ota_writer_flush(), ESP_OK);
+
+    CHECK(image_on_flash());
+    ota_writer_get_stats(&st);
+    CHECK_EQ(st.sectors_written - before.sectors_written, NUM_SECTORS);
+    CHECK_EQ(st.flash_writes - before.flash_writes, NUM_SECTORS);
+}
+
+// Half the blocks, flushed and recorded as mesh_ota saves its bitmap, then a reboot: the new
+// writer is told which sectors hold data (any block of theirs received) and gets only the rest
+static void test_resume(void) {
+    new_image();
+    static bool received[NUM_BLOCKS];
+    static int order[NUM_BLOCKS];
+    memset(received, 0, sizeof(received));
+
+    CHECK_EQ(ota_writer_begin(&s_part, IMAGE_SIZE), ESP_OK);
+    shuffle(order, NUM_BLOCKS);
+    for (int i = 0; i < NUM_BLOCKS / 2; i++) {
+        write_block(order[i]);
+        received[order[i]] = true;
+    }
+    CHECK_EQ(ota_writer_flush(), ESP_OK);
+
+    ota_writer_stats_t before, st;
+    ota_writer_get_stats(&before);
+    CHECK_EQ(ota_writer_begin(&s_part, IMAGE_SIZE), ESP_OK);
+    int marked = 0;
+    static bool sector_marked[NUM_SECTORS];
+    memset(sector_marked, 0, sizeof(sector_marked));
+    for (int b = 0; b < NUM_BLOCKS; b++) {
+        if (received[b]) {
+            ota_writer_set_erased(b * BLOCK_SIZE);
+            int s = b * BLOCK_SIZE / OTA_WRITER_SECTOR_SIZE;
+            marked += !sector_marked[s];
+            sector_marked[s] = true;
+        }
+    }
+    for (int i = NUM_BLOCKS / 2; i < NUM_BLOCKS; i++) {
+        write_block(order[i]);
+    }
+    CHECK_EQ(ota_writer_flush(), ESP_OK);
+
+    // A sector erased again would have lost the blocks received before the reboot
+    CHECK(image_on_flash());
+    CHECK_EQ(host_flash_stats.dirty_writes, 0);
+    ota_writer_get_stats(&st);
+    CHECK(marked > 0);
+    CHECK(st.erased_ahead + st.erased_on_write - before.erased_ahead - before.erased_on_write <=
+          PART_SIZE / OTA_WRITER_SECTOR_SIZE - marked);
+}
+
+static void test_bounds(void) {
+    CHECK_EQ(ota_writer_begin(&s_part, PART_SIZE + 1), ESP_ERR_INVALID_SIZE);
+    CHECK_EQ(ota_writer_begin(&s_part, IMAGE_SIZE), ESP_OK);
+    CHECK_EQ(ota_writer_write(IMAGE_SIZE - 10, s_image, 11), ESP_ERR_INVALID_SIZE);
+    CHECK_EQ(ota_writer_write(IMAGE_SIZE + 1, s_image, 0), ESP_ERR_INVALID_SIZE);
+    CHECK_EQ(ota_writer_flush(), ESP_OK);
+}
+
+int main(void) {
+    CHECK_EQ(ota_writer_init(), ESP_OK);
+    test_any_order();
+    test_whole_sectors();
+    test_resume();
+    test_bounds();
+    ota_writer_log_stats();
+    return test_result("test_ota_writer");
+}
@@ -0,0 +1,175 @@
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include "test_util.h"
+#include "pkt_pool.h"
+
+/*
+Multi-threaded stress test of the packet pool (built with a small pool so it runs dry often).
+
+Worker threads allocate, take extra references, pass references to each other through a shared
+mailbox and release them in any order, like the RX, dispatch and TX tasks do. Every buffer carries
+a tag written by its allocator and checked by every holder, so a buffer handed to two owners at
+once is caught. Afterwards no buffer may be leaked and the allocation, exhaustion and high-water
+counters must match what the threads saw.
+*/
+
+#define THREADS     8
+#define ITERATIONS  200000
+#define MAILBOX     4           // Fewer than the pool, so buffers keep circulating
+
+static pkt_buf_t *s_mailbox[MAILBOX];
+static uint32_t s_corrupt;
+
+typedef struct {
+    uint32_t id;
+    uint32_t seed;
+    uint32_t allocated;
+    uint32_t exhausted;
+} worker_t;
+
+static uint32_t next_rand(uint32_t *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+static void stamp(pkt_buf_t *buf, uint32_t tag) {
+    uint32_t inverse = ~tag;
+    memcpy(buf->data, &tag, 4);
+    memcpy(buf->data + PKT_POOL_BUF_SIZE - 4, &inverse, 4);
+}
+
+// The tag and its inverse at the far end only disagree if someone else wrote the buffer
+static bool stamp_ok(const pkt_buf_t *buf, uint32_t *tag) {
+    uint32_t inverse;
+    memcpy(tag, buf->data, 4);
+    memcpy(&inverse, buf->data + PKT_POOL_BUF_SIZE - 4, 4);
+    return inverse == ~*tag;
+}
+
+static void check_held(const pkt_buf_t *buf) {
+    uint32_t tag;
+    if (!stamp_ok(buf, &tag) || __atomic_load_n(&buf->refs, __ATOMIC_RELAXED) == 0) {
+        __atomic_fetch_add(&s_corrupt, 1, __ATOMIC_RELAXED);
+    }
+}
+
+static void *worker(void *arg) {
+    worker_t *w = arg;
+    for (uint32_t i = 0; i < ITERATIONS; i++) {
+        pkt_buf_t *buf = pkt_pool_alloc();
+        if (buf == NULL) {
+            w->exhausted++;
+            continue;
+        }
+        w->allocated++;
+        uint32_t tag = (w->id << 24) | (i & 0xFFFFFF);
+        if (__atomic_load_n(&buf->refs, __ATOMIC_RELAXED) != 1 || buf->len != 0) {
+            __atomic_fetch_add(&s_corrupt, 1, __ATOMIC_RELAXED);
+        }
+        stamp(buf, tag);
+
+        uint32_t r = next_rand(&w->seed);
+        uint32_t extra = r % 3;
+        for (uint32_t k = 0; k < extra; k++) {
+            pkt_buf_ref(buf);
+        }
+        if (r & 0x100) {
+            // Hand one reference to whoever takes the mailbox slot next; release what was there
+            pkt_buf_ref(buf);
+            pkt_buf_t *old = __atomic_exchange_n(&s_mailbox[(r >> 9) % MAILBOX], buf, __ATOMIC_ACQ_REL);
+            if (old != NULL) {
+                check_held(old);
+                pkt_buf_release(old);
+            }
+        }
+        if ((r & 0xF000) == 0) {
+            sched_yield();      // Let another thread in while references are out (matters on one core)
+        }
+        for (uint32_t k = 0; k <= extra; k++) {
+            uint32_t seen;
+            if (!stamp_ok(buf, &seen) || seen != tag) {
+                __atomic_fetch_add(&s_corrupt, 1, __ATOMIC_RELAXED);
+            }
+            pkt_buf_release(buf);
+        }
+    }
+    return NULL;
+}
+
+static void test_stress(void) {
+    pthread_t threads[THREADS];
+    worker_t workers[THREADS];
+    for (uint32_t i = 0; i < THREADS; i++) {
+        workers[i] = (worker_t){ .id = i, .seed = 0x9E3779B9u * (i + 1) };
+        CHECK_EQ(pthread_create(&threads[i], NULL, worker, &workers[i]), 0);
+    }
+    uint32_t allocated = 0, exhausted = 0;
+    for (uint32_t i = 0; i < THREADS; i++) {
+        pthread_join(threads[i], NULL);
+        allocated += workers[i].allocated;
+        exhausted += workers[i].exhausted;
+    }
+    for (int i = 0; i < MAILBOX; i++) {
+        if (s_mailbox[i] != NULL) {
+            check_held(s_mailbox[i]);
+            pkt_buf_release(s_mailbox[i]);
+            s_mailbox[i] = NULL;
+        }
+    }
+
+    pkt_pool_stats_t st;
+    pkt_pool_get_stats(&st);
+    printf("%u allocations, %u found the pool empty, high water %u/%u\n", allocated, exhausted, st.high_water,
+           st.buffers);
+    CHECK_EQ(s_corrupt, 0);
+    CHECK_EQ(st.buffers, CONFIG_PKT_POOL_BUFFERS);
+    CHECK_EQ(st.in_use, 0);
+    CHECK_EQ(st.allocs, allocated);
+    CHECK_EQ(st.exhausted, exhausted);
+    CHECK(exhausted > 0);       // The test is only worth something if the pool ran dry
+    CHECK(st.high_water > MAILBOX && st.high_water <= CONFIG_PKT_POOL_BUFFERS);
+}
+
+// Nothing leaked: every buffer can be taken again, once, and one more allocation fails
+static void test_no_leak(void) {
+    pkt_pool_stats_t before;
+    pkt_pool_get_stats(&before);
+    pkt_buf_t *bufs[CONFIG_PKT_POOL_BUFFERS];
+    uint32_t seen = 0;
+    for (int i = 0; i < CONFIG_PKT_POOL_BUFFERS; i++) {
+        bufs[i] = pkt_pool_alloc();
+        CHECK(bufs[i] != NULL);
+        if (bufs[i] != NULL) {
+            CHECK((seen & (1u << bufs[i]->index)) == 0);
+            seen |= 1u << bufs[i]->index;
+        }
+    }
+    CHECK(pkt_pool_alloc() == NULL);
+
+    pkt_pool_stats_t st;
+    pkt_pool_get_stats(&st);
+    CHECK_EQ(st.in_use, CONFIG_PKT_POOL_BUFFERS);
+    CHECK_EQ(st.high_water, CONFIG_PKT_POOL_BUFFERS);
+    CHECK_EQ(st.allocs, before.allocs + CONFIG_PKT_POOL_BUFFERS);
+    CHECK_EQ(st.exhausted, before.exhausted + 1);
+
+    // A reference keeps a buffer out of the pool until the last release
+    pkt_buf_ref(bufs[0]);
+    pkt_buf_release(bufs[0]);
+    CHECK(pkt_pool_alloc() == NULL);
+    for (int i = 0; i < CONFIG_PKT_POOL_BUFFERS; i++) {
+        pkt_buf_release(bufs[i]);
+    }
+    pkt_buf_release(NULL);
+    pkt_pool_get_stats(&st);
+    CHECK_EQ(st.in_use, 0);
+}
+
+int main(void) {
+    test_stress();
+    test_no_leak();
+    return test_result("test_pkt_pool");
+}
@@ -0,0 +1,357 @@
+#include <string.h>
+#include <time.h>
+#include "test_util.h"
+#include "rtk_framer.h"
+
+/*
+Host tests for the UBX / RTCM3 framer: captures split at every byte, interleaved with line noise,
+pushed in random chunks through a wrapping ring, resync after corrupted frames, and CRC-24Q
+against a known RTCM 1005 frame. A timing loop frames a few MB of mixed RTCM3 / UBX and reports the
+host cost per byte, and what that would be of one CPU at the 92 kB/s of a saturated 921600 baud link.
+*/
+
+#define STREAM_MAX  (1 << 20)
+#define FRAMES_MAX  4096
+
+typedef struct {
+    uint32_t offset;        // In the stream
+    uint16_t len;
+    rtk_frame_type_t type;
+} expected_t;
+
+static uint8_t s_stream[STREAM_MAX];
+static uint32_t s_stream_len;
+static expected_t s_expected[FRAMES_MAX];
+static int s_num_expected;
+
+static rtk_framer_t s_framer;
+
+static uint32_t add_ubx(uint8_t cls, uint8_t id, uint16_t payload_len) {
+    uint8_t *o = &s_stream[s_stream_len];
+    o[0] = UBX_SYNC_CHAR_1;
+    o[1] = UBX_SYNC_CHAR_2;
+    o[2] = cls;
+    o[3] = id;
+    o[4] = payload_len & 0xFF;
+    o[5] = payload_len >> 8;
+    for (int i = 0; i < payload_len; i++) {
+        o[6 + i] = (uint8_t)test_rand();
+    }
+    uint8_t a = 0, b = 0;
+    for (int i = 2; i < 6 + payload_len; i++) {
+        a += o[i];
+        b += a;
+    }
+    o[6 + payload_len] = a;
+    o[7 + payload_len] = b;
+    uint32_t at = s_stream_len;
+    s_expected[s_num_expected++] = (expected_t){ at, payload_len + 8, RTK_FRAME_UBX };
+    s_stream_len += payload_len + 8;
+    return at;
+}
+
+static uint32_t add_rtcm(uint16_t msg_type, uint16_t payload_len) {
+    uint8_t *o = &s_stream[s_stream_len];
+    o[0] = RTCM3_PREAMBLE;
+    o[1] = payload_len >> 8;
+    o[2] = payload_len & 0xFF;
+    for (int i = 0; i < payload_len; i++) {
+        o[3 + i] = (uint8_t)test_rand();
+    }
+    o[3] = msg_type >> 4;
+    o[4] = (uint8_t)((msg_type & 0x0F) << 4) | (o[4] & 0x0F);
+    uint32_t crc = rtk_crc24q(0, o, payload_len + 3);
+    o[3 + payload_len] = crc >> 16;
+    o[4 + payload_len] = crc >> 8;
+    o[5 + payload_len] = crc;
+    uint32_t at = s_stream_len;
+    s_expected[s_num_expected++] = (expected_t){ at, payload_len + 6, RTK_FRAME_RTCM3 };
+    s_stream_len += payload_len + 6;
+    return at;
+}
+
+// Line noise that cannot start a frame, so the expected output stays exact
+static void add_garbage(int n) {
+    for (int i = 0; i < n; i++) {
+        uint8_t b;
+        do {
+            b = (uint8_t)test_rand();
+        } while (b == UBX_SYNC_CHAR_1 || b == RTCM3_PREAMBLE);
+        s_stream[s_stream_len++] = b;
+    }
+}
+
+// Drop the frame just added from the expected list (it is about to be corrupted)
+static void unexpect_last(void) {
+    s_num_expected--;
+}
+
+static void reset_stream(void) {
+    s_stream_len = 0;
+    s_num_expected = 0;
+}
+
+// Drain the framer, checking each frame against the next expected one
+static void drain(int *next) {
+    rtk_frame_t frame;
+    while (rtk_framer_next(&s_framer, &frame)) {
+        if (*next >= s_num_expected) {
+            CHECK(!"more frames than expected");
+            return;
+        }
+        const expected_t *e = &s_expected[(*next)++];
+        CHECK_EQ(frame.type, e->type);
+        CHECK_EQ(frame.len, e->len);
+        CHECK(memcmp(frame.data, &s_stream[e->offset], e->len) == 0);
+    }
+}
+
+static void test_split_at_every_byte(void) {
+    reset_stream();
+    add_ubx(0x01, 0x07, 92);
+    add_rtcm(1074, 300);
+    add_ubx(0x0D, 0x01, 0);
+    add_rtcm(1005, 19);
+
+    for (uint32_t split = 0; split <= s_stream_len; split++) {
+        rtk_framer_init(&s_framer);
+        int next = 0;
+        CHECK_EQ(rtk_framer_push(&s_framer, s_stream, split), split);
+        drain(&next);
+        CHECK_EQ(rtk_framer_push(&s_framer, s_stream + split, s_stream_len - split), s_stream_len - split);
+        drain(&next);
+        CHECK_EQ(next, s_num_expected);
+        CHECK_EQ(s_framer.stats.skipped_bytes, 0);
+    }
+
+    // One byte per read
+    rtk_framer_init(&s_framer);
+    int next = 0;
+    for (uint32_t i = 0; i < s_stream_len; i++) {
+        rtk_framer_push(&s_framer, &s_stream[i], 1);
+        drain(&next);
+    }
+    CHECK_EQ(next, s_num_expected);
+}
+
+static void test_interleaved_garbage_random_chunks(void) {
+    reset_stream();
+    int ubx = 0, rtcm = 0, garbage = 0;
+    while (s_stream_len < STREAM_MAX - 4096 && s_num_expected < FRAMES_MAX) {
+        switch (test_rand() % 3) {
+        case 0:
+            add_ubx(0x01, 0x07, test_rand() % 200);
+            ubx++;
+            break;
+        case 1:
+            add_rtcm(1074, 2 + test_rand() % 1022);
+            rtcm++;
+            break;
+        default: {
+            int n = 1 + test_rand() % 40;
+            add_garbage(n);
+            garbage += n;
+            break;
+        }
+        }
+    }
+
+    rtk_framer_init(&s_framer);
+    int next = 0;
+    uint32_t pos = 0;
+    while (pos < s_stream_len) {
+        uint32_t chunk = 1 + test_rand() % 700;
+        if (chunk > s_stream_len - pos) {
+            chunk = s_stream_len - pos;
+        }
+        // Never more than the ring holds, as the UART reader only fills free space
+        pos += rtk_framer_push(&s_framer, s_stream + pos, chunk);
+        drain(&next);
+    }
+    CHECK_EQ(next, s_num_expected);
+    CHECK_EQ(s_framer.stats.ubx_frames, ubx);
+    CHECK_EQ(s_framer.stats.rtcm_frames, rtcm);
+    CHECK_EQ(s_framer.stats.skipped_bytes, garbage);
+    CHECK_EQ(s_framer.stats.ubx_crc_errors, 0);
+    CHECK_EQ(s_framer.stats.rtcm_crc_errors, 0);
+    CHECK_EQ(s_framer.stats.overflow_bytes, 0);
+    CHECK_EQ(rtk_framer_used(&s_framer), 0);
+}
+
+static void test_resync_after_bad_crc(void) {
+    reset_stream();
+    // RTCM frame with a flipped payload bit
+    uint32_t bad_rtcm = add_rtcm(1074, 120);
+    unexpect_last();
+    s_stream[bad_rtcm + 20] ^= 0x10;
+    add_ubx(0x01, 0x3C, 40);
+    // UBX frame with a wrong checksum
+    uint32_t bad_ubx = add_ubx(0x01, 0x07, 92);
+    unexpect_last();
+    s_stream[bad_ubx + 98] ^= 0xFF;
+    add_rtcm(1005, 19);
+    // RTCM header whose length is corrupted to run over the frames behind it
+    uint32_t long_rtcm = add_rtcm(1084, 50);
+    unexpect_last();
+    s_stream[long_rtcm + 1] = 0x01;
+    add_ubx(0x01, 0x14, 36);
+    add_rtcm(1094, 200);
+    add_ubx(0x0D, 0x01, 20);
+    add_rtcm(1230, 100);
+    add_garbage(300);   // Enough bytes for the corrupted length to be checked
+    add_rtcm(1124, 30);
+
+    rtk_framer_init(&s_framer);
+    int next = 0;
+    CHECK_EQ(rtk_framer_push(&s_framer, s_stream, s_stream_len), s_stream_len);
+    drain(&next);
+    CHECK_EQ(next, s_num_expected);
+    CHECK_EQ(s_framer.stats.ubx_crc_errors, 1);
+    CHECK_EQ(s_framer.stats.rtcm_crc_errors, 2);
+    CHECK_EQ(s_framer.stats.rtcm_types[rtk_rtcm_type_index(1074)].rejected, 1);
+    CHECK_EQ(s_framer.stats.rtcm_types[rtk_rtcm_type_index(1084)].rejected, 1);
+    CHECK_EQ(s_framer.stats.rtcm_types[rtk_rtcm_type_index(1005)].accepted, 1);
+    CHECK_EQ(rtk_framer_used(&s_framer), 0);
+}
+
+// Bit-at-a-time CRC-24Q straight from the polynomial, to check the table against
+static uint32_t crc24q_bitwise(const uint8_t *data, size_t len) {
+    uint32_t crc = 0;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= (uint32_t)data[i] << 16;
+        for (int b = 0; b < 8; b++) {
+            crc <<= 1;
+            if (crc & 0x1000000) {
+                crc ^= 0x1864CFB;
+            }
+        }
+    }
+    return crc & 0xFFFFFF;
+}
+
+static void test_crc24q(void) {
+    // Reference RTCM 1005 (station ARP) frame, CRC 0x360B98
+    uint8_t msg1005[] = {
+        0xD3, 0x00, 0x13, 0x3E, 0xD7, 0xD3, 0x02, 0x02, 0x98, 0x0E, 0xDE, 0xEF, 0x34,
+        0xB4, 0xBD, 0x62, 0xAC, 0x09, 0x41, 0x98, 0x6F, 0x33, 0x36, 0x0B, 0x98,
+    };
+    CHECK_EQ(rtk_crc24q(0, msg1005, sizeof(msg1005) - 3), 0x360B98);
+    // The whole frame, CRC included, leaves a zero remainder
+    CHECK_EQ(rtk_crc24q(0, msg1005, sizeof(msg1005)), 0);
+    // In pieces
+    CHECK_EQ(rtk_crc24q(rtk_crc24q(0, msg1005, 7), msg1005 + 7, sizeof(msg1005) - 10), 0x360B98);
+
+    static uint8_t random[4096];
+    for (size_t i = 0; i < sizeof(random); i++) {
+        random[i] = (uint8_t)test_rand();
+    }
+    for (size_t len = 0; len <= sizeof(random); len += 1 + len / 3) {
+        CHECK_EQ(rtk_crc24q(0, random, len), crc24q_bitwise(random, len));
+    }
+
+    // Accepted and counted against 1005, then rejected with one bit flipped
+    rtk_framer_init(&s_framer);
+    rtk_framer_push(&s_framer, msg1005, sizeof(msg1005));
+    msg1005[10] ^= 0x01;
+    rtk_framer_push(&s_framer, msg1005, sizeof(msg1005));
+    rtk_frame_t frame;
+    int frames = 0;
+    while (rtk_framer_next(&s_framer, &frame)) {
+        CHECK_EQ(frame.type, RTK_FRAME_RTCM3);
+        CHECK_EQ(rtk_frame_rtcm_type(&frame), 1005);
+        frames++;
+    }
+    CHECK_EQ(frames, 1);
+    int slot = rtk_rtcm_type_index(1005);
+    CHECK_EQ(rtk_rtcm_type_at(slot), 1005);
+    CHECK_EQ(s_framer.stats.rtcm_types[slot].accepted, 1);
+    CHECK_EQ(s_framer.stats.rtcm_types[slot].rejected, 1);
+    CHECK_EQ(s_framer.stats.rtcm_types[slot].bytes, sizeof(msg1005));
+    CHECK_EQ(s_framer.stats.rtcm_crc_errors, 1);
+    CHECK_EQ(rtk_rtcm_type_index(1019), RTK_RTCM_OTHER);
+}
+
+static void test_oversized_ubx_is_garbage(void) {
+    reset_stream();
+    // Sync chars with a length over RTK_FRAMER_MAX_UBX_PAYLOAD must not stall the framer
+    static const uint8_t bogus[] = { UBX_SYNC_CHAR_1, UBX_SYNC_CHAR_2, 0x01, 0x07, 0xFF, 0x7F };
+    memcpy(s_stream, bogus, sizeof(bogus));
+    s_stream_len = sizeof(bogus);
+    add_ubx(0x01, 0x07, 92);
+
+    rtk_framer_init(&s_framer);
+    int next = 0;
+    rtk_framer_push(&s_framer, s_stream, s_stream_len);
+    drain(&next);
+    CHECK_EQ(next, s_num_expected);
+    CHECK_EQ(s_framer.stats.skipped_bytes, sizeof(bogus));
+}
+
+static double elapsed_ns(const struct timespec *a, const struct timespec *b) {
+    return (b->tv_sec - a->tv_sec) * 1e9 + (b->tv_nsec - a->tv_nsec);
+}
+
+static void time_framing(void) {
+    enum { REPEAT = 4 };
+    static const uint16_t msm[] = { 1074, 1084, 1094, 1124 };
+    reset_stream();
+    // One base epoch after another: 1005 and 1230 now and then, MSM4-7 of each system, NAV-PVT
+    for (int epoch = 0; s_stream_len < STREAM_MAX - 4 * 1024; epoch++) {
+        if (epoch % 10 == 0) {
+            add_rtcm(1005, 19);
+            add_rtcm(1230, 8);
+        }
+        for (int i = 0; i < 4; i++) {
+            add_rtcm(msm[i], 100 + test_rand() % 500);
+        }
+        add_ubx(0x01, 0x07, 92);
+    }
+
+    rtk_framer_init(&s_framer);
+    uint32_t frames = 0;
+    rtk_frame_t frame;
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int r = 0; r < REPEAT; r++) {
+        // UART-sized reads straight into the ring, as rtk_serial.c does
+        for (uint32_t pos = 0; pos < s_stream_len;) {
+            size_t space;
+            uint8_t *dst = rtk_framer_write_ptr(&s_framer, &space);
+            size_t n = s_stream_len - pos < 512 ? s_stream_len - pos : 512;
+            n = n < space ? n : space;
+            memcpy(dst, &s_stream[pos], n);
+            rtk_framer_commit(&s_framer, n);
+            pos += n;
+            while (rtk_framer_next(&s_framer, &frame)) {
+                frames++;
+            }
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    CHECK_EQ(frames, (uint32_t)s_num_expected * REPEAT);
+    CHECK_EQ(s_framer.stats.rtcm_crc_errors + s_framer.stats.ubx_crc_errors + s_framer.stats.skipped_bytes, 0);
+    double frame_ns = elapsed_ns(&t0, &t1) / ((double)s_stream_len * REPEAT);
+
+    volatile uint32_t sink = 0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int r = 0; r < REPEAT; r++) {
+        sink += rtk_crc24q(0, s_stream, s_stream_len);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double crc_ns = elapsed_ns(&t0, &t1) / ((double)s_stream_len * REPEAT);
+
+    const double link_bytes_per_s = 921600 / 10;     // 8N1
+    printf("host timing: %.1f MB in %d frames, framer %.2f ns/byte (CRC-24Q alone %.2f), "
+           "%.3f%% of a CPU at 921600 baud\n", s_stream_len * REPEAT / 1e6, frames, frame_ns, crc_ns,
+           frame_ns * link_bytes_per_s / 1e9 * 100);
+}
+
+int main(void) {
+    test_split_at_every_byte();
+    test_interleaved_garbage_random_chunks();
+    test_resync_after_bad_crc();
+    test_oversized_ubx_is_garbage();
+    test_crc24q();
+    time_framing();
+    return test_result("test_rtk_framer");
+}
@@ -0,0 +1,103 @@
+#include <string.h>
+#include "test_util.h"
+#include "rtk_sink.h"
+
+/*
+rtk_sink.c on one host thread (test/host): epochs put in by the test, each one RTK_DATA packet of a
+single part holding its sequence number, and the epochs written to the GNSS receiver captured from
+rtk_serial_write(). Age comes from local arrival time, rtk_corr_gps_tow_ms_now() having no GPS time.
+*/
+
+#define STEP_US     (200 * 1000LL)  // One epoch every 200 ms, longer than the reorder window
+
+// Sequence numbers of the epochs injected, in order
+static uint16_t s_injected[64];
+static int s_num_injected;
+
+// From modules not built here (rtk_serial.c, rtk_corrections.c, boot_timeline.c)
+int rtk_serial_write(const uint8_t *data, size_t len) {
+    CHECK_EQ(len, sizeof(uint16_t));
+    if (s_num_injected < 64) {
+        memcpy(&s_injected[s_num_injected++], data, sizeof(uint16_t));
+    }
+    return (int)len;
+}
+
+bool rtk_corr_gps_tow_ms_now(uint32_t *tow_ms) {
+    return false;
+}
+
+void boot_timeline_end(boot_phase_t phase) {
+}
+
+static void put(uint16_t seq) {
+    static RTKData_t rtk;
+    rtk.seq = seq;
+    rtk.part = 0;
+    rtk.flags = RTK_DATA_FLAG_LAST_PART;
+    memcpy(rtk.data, &seq, sizeof(seq));
+    rtk_sink_put(&rtk, sizeof(seq));
+}
+
+// Epochs `seq`... put one step apart and polled in between
+static void put_run(uint16_t seq, int count) {
+    for (int i = 0; i < count; i++) {
+        host_now_us += STEP_US;
+        rtk_sink_poll();
+        put(seq + i);
+    }
+}
+
+static void check_injected(const uint16_t *seqs, int count) {
+    CHECK_EQ(s_num_injected, count);
+    for (int i = 0; i < count && i < s_num_injected; i++) {
+        CHECK_EQ(s_injected[i], seqs[i]);
+    }
+}
+
+int main(void) {
+    rtk_sink_stats_t stats;
+    host_now_us = 1000000;
+    rtk_sink_init();
+
+    // In order, one late duplicate just behind dropped
+    put_run(1000, 3);
+    put(1001);
+    static const uint16_t first[] = { 1000, 1001, 1002 };
+    check_injected(first, 3);
+    rtk_sink_get_stats(&stats);
+    CHECK_EQ(stats.dropped_late, 1);
+
+    // The base reboots and starts again at 0: injected straight away, nothing counted late
+    put_run(0, 3);
+    static const uint16_t restarted[] = { 1000, 1001, 1002, 0, 1, 2 };
+    check_injected(restarted, 6);
+    rtk_sink_get_stats(&stats);
+    CHECK_EQ(stats.dropped_late, 1);
+    CHECK_EQ(stats.epochs_injected, 6);
+
+    // A reboot that lands a few behind: late while epochs flow, taken once none released for the max age
+    put_run(3, 2);
+    host_now_us += (CONFIG_RTK_SINK_MAX_AGE_MS / 2) * 1000LL;
+    put(2);
+    rtk_sink_get_stats(&stats);
+    CHECK_EQ(stats.dropped_late, 2);
+    CHECK_EQ(stats.epochs_injected, 8);
+    host_now_us += (CONFIG_RTK_SINK_MAX_AGE_MS / 2 + 100) * 1000LL;
+    put(1);
+    put_run(2, 2);
+    static const uint16_t stalled[] = { 1000, 1001, 1002, 0, 1, 2, 3, 4, 1, 2, 3 };
+    check_injected(stalled, 11);
+    rtk_sink_get_stats(&stats);
+    CHECK_EQ(stats.dropped_late, 2);
+
+    // Far behind is a restart too, and the wrap after it is not
+    put_run(0xFFF0, 18);
+    CHECK_EQ(s_num_injected, 29);
+    CHECK_EQ(s_injected[28], 1);
+    rtk_sink_get_stats(&stats);
+    CHECK_EQ(stats.dropped_late, 2);
+    CHECK_EQ(stats.missing, 0);
+    rtk_sink_log_stats();
+    return test_result("test_rtk_sink");
+}
@@ -0,0 +1,115 @@
+#include <string.h>
+#include <pthread.h>
+#include "test_util.h"
+#include "seqlock.h"
+
+/*
+One writer thread publishing numbered snapshots as fast as it can, now and then starting one in
+place and aborting it half-filled with garbage, against several reader threads. Every snapshot a
+reader copies must be one complete publish: every word derived from the same number, which never
+goes backwards for that reader. The writer must overtake readers often enough that some reads are
+retried, counted by seqlock_retries(), and those must come back whole too.
+*/
+
+#define READERS     4
+#define PUBLISHES   2000000
+#define WORDS       254     // 1 KB snapshots, so copies get preempted
+
+typedef struct {
+    uint32_t n;
+    uint32_t words[WORDS];
+    uint32_t check;         // ~n, written last
+} snapshot_t;
+
+static seqlock_t s_lock = SEQLOCK_INIT;
+static snapshot_t s_bufs[2];
+static bool s_writing;
+
+typedef struct {
+    uint32_t reads;
+    uint32_t torn;
+    uint32_t backwards;
+} reader_t;
+
+static void fill(snapshot_t *s, uint32_t n) {
+    s->n = n;
+    for (int i = 0; i < WORDS; i++) {
+        s->words[i] = n * 2654435761u + i;
+    }
+    s->check = ~n;
+}
+
+static void *writer(void *arg) {
+    uint32_t state = 0x9E3779B9;
+    snapshot_t snap;
+    for (uint32_t n = 1; n <= PUBLISHES; n++) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        if (state % 64 == 0) {
+            snapshot_t *spare = seqlock_write_begin(&s_lock, s_bufs, sizeof(snapshot_t));
+            memset(spare, 0xA5, sizeof(*spare) / 2);
+            seqlock_write_abort(&s_lock);
+        }
+        fill(&snap, n);
+        seqlock_publish(&s_lock, s_bufs, sizeof(snapshot_t), &snap);
+    }
+    __atomic_store_n(&s_writing, false, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+static void *reader(void *arg) {
+    reader_t *r = arg;
+    uint32_t last = 0;
+    snapshot_t snap;
+    while (__atomic_load_n(&s_writing, __ATOMIC_ACQUIRE)) {
+        if (!seqlock_read(&s_lock, s_bufs, sizeof(snapshot_t), &snap)) {
+            continue;
+        }
+        r->reads++;
+        bool whole = snap.check == ~snap.n;
+        for (int i = 0; i < WORDS; i++) {
+            whole = whole && snap.words[i] == snap.n * 2654435761u + i;
+        }
+        if (!whole) {
+            r->torn++;
+        } else if (snap.n < last) {
+            r->backwards++;
+        } else {
+            last = snap.n;
+        }
+    }
+    return NULL;
+}
+
+int main(void) {
+    snapshot_t snap;
+    CHECK(!seqlock_read(&s_lock, s_bufs, sizeof(snapshot_t), &snap));
+    CHECK_EQ(seqlock_count(&s_lock), 0);
+
+    s_writing = true;
+    pthread_t writer_thread, reader_threads[READERS];
+    reader_t readers[READERS];
+    memset(readers, 0, sizeof(readers));
+    for (int i = 0; i < READERS; i++) {
+        CHECK_EQ(pthread_create(&reader_threads[i], NULL, reader, &readers[i]), 0);
+    }
+    CHECK_EQ(pthread_create(&writer_thread, NULL, writer, NULL), 0);
+    pthread_join(writer_thread, NULL);
+    uint32_t reads = 0;
+    for (int i = 0; i < READERS; i++) {
+        pthread_join(reader_threads[i], NULL);
+        CHECK_EQ(readers[i].torn, 0);
+        CHECK_EQ(readers[i].backwards, 0);
+        CHECK(readers[i].reads > 0);
+        reads += readers[i].reads;
+    }
+    CHECK(seqlock_retries(&s_lock) > 0);
+
+    // The last publish is the latest, whatever was aborted
+    CHECK_EQ(seqlock_count(&s_lock), PUBLISHES);
+    CHECK(seqlock_read(&s_lock, s_bufs, sizeof(snapshot_t), &snap));
+    CHECK_EQ(snap.n, PUBLISHES);
+    printf("%d readers: %u reads, %u retries\n", READERS, reads, seqlock_retries(&s_lock));
+    return test_result("test_seqlock");
+}
@@ -0,0 +1,389 @@
+#include <math.h>
+#include <stdbool.h>
+#include <string.h>
+#include "test_util.h"
+#include "rtk_framer.h"
+#include "ubx_decoder.h"
+
+/*
+Host tests for the table-driven UBX decoder: golden frames, laid out by hand from the F9P interface
+description (UBX-18010854) rather than from ubx_gen.h, go through the framer and the decoder and
+every field is compared. Short payloads, wrong versions and unknown messages must be refused.
+
+Every decoded message is also checked for what holds in anything a receiver reports: the same
+position in NAV-PVT and NAV-HPPOSLLH, the UTC date against the GPS time of week, the baseline
+length and heading against its components, the survey-in mean at the fix, the next pulse just
+after it. A field read from the wrong offset breaks these whoever laid out the frame. The same checks run over receiver captures
+(u-center .ubx logs) given on the command line; see README.
+*/
+
+// Golden frames (sync to checksum) for one base station fix
+static const uint8_t s_nav_pvt[] = {
+    0xB5, 0x62, 0x01, 0x07, 0x5C, 0x00, 0xD0, 0x3B, 0x73, 0x1C, 0xE9, 0x07, 0x03, 0x0E, 0x0C, 0x22,
+    0x38, 0x37, 0x15, 0x00, 0x00, 0x00, 0xC0, 0x1D, 0xFE, 0xFF, 0x03, 0x83, 0xEA, 0x1F, 0xEB, 0x87,
+    0x13, 0xB7, 0x95, 0x60, 0x38, 0x1C, 0x6E, 0xB2, 0x00, 0x00, 0x1B, 0x0A, 0x01, 0x00, 0x0E, 0x00,
+    0x00, 0x00, 0x0A, 0x00, 0x00, 0x00, 0xF4, 0xFF, 0xFF, 0xFF, 0x22, 0x00, 0x00, 0x00, 0xFB, 0xFF,
+    0xFF, 0xFF, 0x24, 0x00, 0x00, 0x00, 0x6A, 0xE0, 0xA0, 0x00, 0x32, 0x00, 0x00, 0x00, 0x87, 0xD6,
+    0x12, 0x00, 0x57, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x60, 0xDA, 0xD9, 0xFF, 0x10, 0xFA,
+    0x7B, 0x00, 0xA5, 0x69,
+};
+static const uint8_t s_nav_svin[] = {
+    0xB5, 0x62, 0x01, 0x3B, 0x28, 0x00, 0x00, 0x00, 0x00, 0x00, 0xD0, 0x3B, 0x73, 0x1C, 0x2C, 0x01,
+    0x00, 0x00, 0x17, 0x6F, 0x31, 0xF2, 0xD8, 0xB9, 0x32, 0xEA, 0x6E, 0xAF, 0xD2, 0x1B, 0xC5, 0xE1,
+    0x5D, 0x00, 0x98, 0x3A, 0x00, 0x00, 0x2D, 0x01, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x8F, 0x73,
+};
+static const uint8_t s_nav_hpposllh[] = {
+    0xB5, 0x62, 0x01, 0x14, 0x24, 0x00, 0x00, 0x00, 0x00, 0x00, 0xD0, 0x3B, 0x73, 0x1C, 0xEB, 0x87,
+    0x13, 0xB7, 0x95, 0x60, 0x38, 0x1C, 0x6E, 0xB2, 0x00, 0x00, 0x1B, 0x0A, 0x01, 0x00, 0xD3, 0x43,
+    0xFD, 0x09, 0x8D, 0x00, 0x00, 0x00, 0xCB, 0x00, 0x00, 0x00, 0x12, 0x77,
+};
+static const uint8_t s_nav_relposned[] = {
+    0xB5, 0x62, 0x01, 0x3C, 0x40, 0x00, 0x01, 0x00, 0xD2, 0x04, 0xD0, 0x3B, 0x73, 0x1C, 0xC7, 0xCF,
+    0xFF, 0xFF, 0x85, 0x1A, 0x00, 0x00, 0x9B, 0xFF, 0xFF, 0xFF, 0x09, 0x37, 0x00, 0x00, 0xF2, 0xB2,
+    0xE6, 0x00, 0x00, 0x00, 0x00, 0x00, 0xF4, 0x22, 0xC8, 0x1B, 0x8C, 0x00, 0x00, 0x00, 0x96, 0x00,
+    0x00, 0x00, 0x2C, 0x01, 0x00, 0x00, 0xA0, 0x00, 0x00, 0x00, 0x20, 0xA1, 0x07, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x17, 0x01, 0x00, 0x00, 0x4B, 0x64,
+};
+static const uint8_t s_tim_tp[] = {
+    0xB5, 0x62, 0x0D, 0x01, 0x10, 0x00, 0x68, 0xF9, 0x72, 0x1C, 0x00, 0x00, 0x00, 0x40, 0xD7, 0xF6,
+    0xFF, 0xFF, 0x35, 0x09, 0x03, 0x01, 0x5A, 0x93,
+};
+
+static const UBXNavPVT s_want_pvt = {
+    .iTOW = 477314000, .year = 2025, .month = 3, .day = 14, .hour = 12, .min = 34, .sec = 56, .valid = 0x37,
+    .tAcc = 21, .nano = -123456, .fixType = 3, .flags = 0x83, .flags2 = 0xEA, .numSV = 31,
+    .lon = -1223456789, .lat = 473456789, .height = 45678, .hMSL = 68123, .hAcc = 14, .vAcc = 10,
+    .velN = -12, .velE = 34, .velD = -5, .gSpeed = 36, .headMot = 10543210, .sAcc = 50, .headAcc = 1234567,
+    .pDOP = 87, .flags3 = 0, .reserved0 = 0, .headVeh = -2500000, .magDec = -1520, .magAcc = 123,
+};
+
+static const UBXNavSVIN s_want_svin = {
+    .version = 0, .iTOW = 477314000, .dur = 300, .meanX = -231641321, .meanY = -365774376, .meanZ = 466792302,
+    .meanXHP = -59, .meanYHP = -31, .meanZHP = 93, .meanAcc = 15000, .obs = 301, .valid = 1, .active = 0,
+};
+
+static const UBXNavHPPOSLLH s_want_hpposllh = {
+    .version = 0, .flags = 0, .iTOW = 477314000, .lon = -1223456789, .lat = 473456789, .height = 45678,
+    .hMSL = 68123, .lonHp = -45, .latHp = 67, .heightHp = -3, .hMSLHp = 9, .hAcc = 141, .vAcc = 203,
+};
+
+static const UBXNavRELPOSNED s_want_relposned = {
+    .version = 1, .refStationId = 1234, .iTOW = 477314000, .relPosN = -12345, .relPosE = 6789, .relPosD = -101,
+    .relPosLength = 14089, .relPosHeading = 15119090, .relPosHPN = -12, .relPosHPE = 34, .relPosHPD = -56,
+    .relPosHPLength = 27, .accN = 140, .accE = 150, .accD = 300, .accLength = 160, .accHeading = 500000,
+    .flags = 0x117,
+};
+
+static const UBXTimTP s_want_tim_tp = {
+    .towMS = 477297000, .towSubMS = 0x40000000, .qErr = -2345, .week = 2357, .flags = 0x03, .refInfo = 0x01,
+};
+
+// Compare every decoded member, using the field lists of ubx_gen.h for the member names only
+#define CHECK_MEMBER(type, member, wire_offset, field_type) CHECK_EQ(got->member, want->member);
+
+static void check_pvt(const UBXNavPVT *got, const UBXNavPVT *want) { UBX_NAV_PVT_FIELDS(CHECK_MEMBER) }
+static void check_svin(const UBXNavSVIN *got, const UBXNavSVIN *want) { UBX_NAV_SVIN_FIELDS(CHECK_MEMBER) }
+static void check_hpposllh(const UBXNavHPPOSLLH *got, const UBXNavHPPOSLLH *want) { UBX_NAV_HPPOSLLH_FIELDS(CHECK_MEMBER) }
+static void check_relposned(const UBXNavRELPOSNED *got, const UBXNavRELPOSNED *want) { UBX_NAV_RELPOSNED_FIELDS(CHECK_MEMBER) }
+static void check_tim_tp(const UBXTimTP *got, const UBXTimTP *want) { UBX_TIM_TP_FIELDS(CHECK_MEMBER) }
+
+// Consistency of what one receiver reports
+
+#define WEEK_MS 604800000u
+#define GPS_EPOCH_DAYS 3657     // 1980-01-06, in days from 1970-01-01
+
+typedef struct {
+    bool have_pvt;
+    UBXNavPVT pvt;              // Latest NAV-PVT
+    int32_t week;               // GPS week of it, from its UTC date, or -1
+    int32_t leap_ms;            // GPS - UTC
+    uint32_t decoded[UBX_MSG_COUNT];
+} receiver_t;
+
+// Days from 1970-01-01 of a Gregorian date
+static int32_t days_from_civil(int32_t y, uint32_t m, uint32_t d) {
+    y -= m <= 2;
+    int32_t era = (y >= 0 ? y : y - 399) / 400;
+    uint32_t yoe = (uint32_t)(y - era * 400);
+    uint32_t doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    uint32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + (int32_t)doe - 719468;
+}
+
+// WGS-84 geodetic (1e-7 deg, mm) to ECEF (m)
+static void llh_to_ecef(int32_t lat, int32_t lon, int32_t height, double *xyz) {
+    const double a = 6378137.0, f = 1 / 298.257223563, e2 = f * (2 - f);
+    double phi = lat * 1e-7 * M_PI / 180, lambda = lon * 1e-7 * M_PI / 180, h = height * 1e-3;
+    double n = a / sqrt(1 - e2 * sin(phi) * sin(phi));
+    xyz[0] = (n + h) * cos(phi) * cos(lambda);
+    xyz[1] = (n + h) * cos(phi) * sin(lambda);
+    xyz[2] = (n * (1 - e2) + h) * sin(phi);
+}
+
+static void check_hp(int8_t hp, int limit) {
+    CHECK(hp >= -limit && hp <= limit);
+}
+
+static void consistent_pvt(receiver_t *rx, const UBXNavPVT *pvt) {
+    CHECK(pvt->iTOW < WEEK_MS);
+    CHECK(pvt->fixType <= 5);
+    CHECK(pvt->lat >= -900000000 && pvt->lat <= 900000000);
+    CHECK(pvt->lon >= -1800000000 && pvt->lon <= 1800000000);
+    rx->week = -1;
+    if ((pvt->valid & 0x03) == 0x03) {  // validDate, validTime
+        CHECK(pvt->month >= 1 && pvt->month <= 12 && pvt->day >= 1 && pvt->day <= 31);
+        CHECK(pvt->hour < 24 && pvt->min < 60 && pvt->sec <= 60);
+        int32_t days = days_from_civil(pvt->year, pvt->month, pvt->day) - GPS_EPOCH_DAYS;
+        double utc_s = days % 7 * 86400.0 + pvt->hour * 3600 + pvt->min * 60 + pvt->sec + pvt->nano * 1e-9;
+        // GPS - UTC: whole leap seconds (18 since 2017), iTOW being rounded to the ms
+        double leap_s = fmod(pvt->iTOW / 1000.0 - utc_s + WEEK_MS / 1000, WEEK_MS / 1000);
+        CHECK(leap_s > 9 && leap_s < 30);
+        CHECK_NEAR(leap_s, round(leap_s), 0.002);
+        rx->leap_ms = 1000 * (int32_t)round(leap_s);
+        rx->week = days / 7 + (utc_s + leap_s >= WEEK_MS / 1000);
+    }
+    if (pvt->fixType >= 2) {
+        CHECK_NEAR(pvt->gSpeed, hypot(pvt->velN, pvt->velE), 2);
+        CHECK(pvt->height - pvt->hMSL > -120000 && pvt->height - pvt->hMSL < 120000);   // Geoid separation
+    }
+    rx->have_pvt = true;
+    rx->pvt = *pvt;
+}
+
+static void consistent_svin(receiver_t *rx, const UBXNavSVIN *svin) {
+    check_hp(svin->meanXHP, 99);
+    check_hp(svin->meanYHP, 99);
+    check_hp(svin->meanZHP, 99);
+    if (!svin->valid) {
+        return;
+    }
+    double mean[3] = {
+        svin->meanX * 1e-2 + svin->meanXHP * 1e-4,
+        svin->meanY * 1e-2 + svin->meanYHP * 1e-4,
+        svin->meanZ * 1e-2 + svin->meanZHP * 1e-4,
+    };
+    double r = sqrt(mean[0] * mean[0] + mean[1] * mean[1] + mean[2] * mean[2]);
+    CHECK(r > 6350e3 && r < 6390e3);
+    if (rx->have_pvt && rx->pvt.fixType >= 3) {
+        // The base reports its fix at the position it surveyed
+        double fix[3];
+        llh_to_ecef(rx->pvt.lat, rx->pvt.lon, rx->pvt.height, fix);
+        CHECK(hypot(hypot(fix[0] - mean[0], fix[1] - mean[1]), fix[2] - mean[2]) < 100);
+    }
+}
+
+static void consistent_hpposllh(receiver_t *rx, const UBXNavHPPOSLLH *hp) {
+    check_hp(hp->lonHp, 99);
+    check_hp(hp->latHp, 99);
+    check_hp(hp->heightHp, 9);
+    check_hp(hp->hMSLHp, 9);
+    if (!(hp->flags & 0x01) && rx->have_pvt && rx->pvt.iTOW == hp->iTOW) {  // Same epoch
+        CHECK_NEAR(hp->lat, rx->pvt.lat, 1);
+        CHECK_NEAR(hp->lon, rx->pvt.lon, 1);
+        CHECK_NEAR(hp->height, rx->pvt.height, 1);
+        CHECK_NEAR(hp->hMSL, rx->pvt.hMSL, 1);
+    }
+}
+
+static void consistent_hpposecef(receiver_t *rx, const UBXNavHPPOSECEF *hp) {
+    check_hp(hp->ecefXHp, 99);
+    check_hp(hp->ecefYHp, 99);
+    check_hp(hp->ecefZHp, 99);
+    if (!(hp->flags & 0x01) && rx->have_pvt && rx->pvt.iTOW == hp->iTOW && rx->pvt.fixType >= 3) {
+        double fix[3];
+        llh_to_ecef(rx->pvt.lat, rx->pvt.lon, rx->pvt.height, fix);
+        CHECK_NEAR(hp->ecefX * 1e-2 + hp->ecefXHp * 1e-4, fix[0], 0.05);
+        CHECK_NEAR(hp->ecefY * 1e-2 + hp->ecefYHp * 1e-4, fix[1], 0.05);
+        CHECK_NEAR(hp->ecefZ * 1e-2 + hp->ecefZHp * 1e-4, fix[2], 0.05);
+    }
+}
+
+static void consistent_relposned(receiver_t *rx, const UBXNavRELPOSNED *rel) {
+    CHECK(rel->iTOW < WEEK_MS);
+    check_hp(rel->relPosHPN, 99);
+    check_hp(rel->relPosHPE, 99);
+    check_hp(rel->relPosHPD, 99);
+    check_hp(rel->relPosHPLength, 99);
+    CHECK((rel->flags & ~0x3FFu) == 0);         // Bits 0-9 defined
+    CHECK(((rel->flags >> 3) & 0x03) != 0x03);  // carrSoln
+    if (!(rel->flags & 0x04)) {                 // relPosValid
+        return;
+    }
+    // mm
+    double n = rel->relPosN * 10.0 + rel->relPosHPN * 0.1;
+    double e = rel->relPosE * 10.0 + rel->relPosHPE * 0.1;
+    double d = rel->relPosD * 10.0 + rel->relPosHPD * 0.1;
+    if (!(rel->flags & 0x200)) {                // relPosNormalized: components scaled
+        CHECK_NEAR(rel->relPosLength * 10.0 + rel->relPosHPLength * 0.1, hypot(hypot(n, e), d), 0.5);
+    }
+    if ((rel->flags & 0x100) && hypot(n, e) > 100) {   // relPosHeadingValid
+        double heading = atan2(e, n) * 180 / M_PI;
+        CHECK_NEAR(fmod(rel->relPosHeading * 1e-5 - heading + 540, 360) - 180, 0, 0.01);
+    }
+}
+
+static void consistent_tim_tp(receiver_t *rx, const UBXTimTP *tp) {
+    CHECK(tp->towMS < WEEK_MS);
+    CHECK(tp->qErr > -1000000 && tp->qErr < 1000000);  // ps
+    // The next pulse, just after the latest fix. Its time is UTC when timeBase (flags bit 0) is set,
+    // else that of the GNSS in refInfo, of which only GPS numbers weeks like NAV-PVT.
+    bool utc = tp->flags & 0x01;
+    if (rx->have_pvt && rx->week >= 0 && (utc || (tp->refInfo & 0x0F) == 0)) {
+        int64_t ahead = ((int64_t)tp->week - rx->week) * WEEK_MS + tp->towMS + (utc ? rx->leap_ms : 0) -
+                        rx->pvt.iTOW;
+        CHECK(ahead > -1000 && ahead <= 2000);
+    }
+}
+
+// Decode a UBX frame into `out`, and check it against what the receiver reported before
+static ubx_msg_t decode(receiver_t *rx, const rtk_frame_t *frame, void *out) {
+    ubx_msg_t msg = ubx_msg_lookup(frame->data[2], frame->data[3]);
+    uint16_t len = frame->data[4] | (frame->data[5] << 8);
+    if (msg == UBX_MSG_COUNT || !ubx_decode(msg, frame->data + 6, len, out)) {
+        return UBX_MSG_COUNT;
+    }
+    rx->decoded[msg]++;
+    switch (msg) {
+    case UBX_MSG_NAV_PVT:       consistent_pvt(rx, out); break;
+    case UBX_MSG_NAV_SVIN:      consistent_svin(rx, out); break;
+    case UBX_MSG_NAV_HPPOSLLH:  consistent_hpposllh(rx, out); break;
+    case UBX_MSG_NAV_HPPOSECEF: consistent_hpposecef(rx, out); break;
+    case UBX_MSG_NAV_RELPOSNED: consistent_relposned(rx, out); break;
+    case UBX_MSG_TIM_TP:        consistent_tim_tp(rx, out); break;
+    default: break;
+    }
+    return msg;
+}
+
+typedef union {
+    UBXNavPVT pvt;
+    UBXNavSVIN svin;
+    UBXNavHPPOSLLH hpposllh;
+    UBXNavHPPOSECEF hpposecef;
+    UBXNavRELPOSNED relposned;
+    UBXTimTP tim_tp;
+} ubx_any_t;
+
+static void test_golden_frames(void) {
+    static rtk_framer_t framer;
+    rtk_framer_init(&framer);
+    // One odd byte first so the payloads sit at odd addresses in the ring
+    static const uint8_t noise = 0x00;
+    rtk_framer_push(&framer, &noise, 1);
+    rtk_framer_push(&framer, s_nav_pvt, sizeof(s_nav_pvt));
+    rtk_framer_push(&framer, s_nav_svin, sizeof(s_nav_svin));
+    rtk_framer_push(&framer, s_nav_hpposllh, sizeof(s_nav_hpposllh));
+    rtk_framer_push(&framer, s_nav_relposned, sizeof(s_nav_relposned));
+    rtk_framer_push(&framer, s_tim_tp, sizeof(s_tim_tp));
+
+    static const ubx_msg_t order[] = {
+        UBX_MSG_NAV_PVT, UBX_MSG_NAV_SVIN, UBX_MSG_NAV_HPPOSLLH, UBX_MSG_NAV_RELPOSNED, UBX_MSG_TIM_TP,
+    };
+    receiver_t rx = { 0 };
+    int n = 0;
+    rtk_frame_t frame;
+    while (rtk_framer_next(&framer, &frame)) {
+        CHECK_EQ(frame.type, RTK_FRAME_UBX);
+        if (n >= (int)(sizeof(order) / sizeof(order[0]))) {
+            CHECK(!"more frames than expected");
+            break;
+        }
+        uint16_t len = frame.data[4] | (frame.data[5] << 8);
+        CHECK_EQ(len, ubx_msg_desc(order[n])->payload_len);
+
+        ubx_any_t out;
+        ubx_msg_t msg = decode(&rx, &frame, &out);
+        CHECK_EQ(msg, order[n]);
+        switch (msg) {
+        case UBX_MSG_NAV_PVT:       check_pvt(&out.pvt, &s_want_pvt); break;
+        case UBX_MSG_NAV_SVIN:      check_svin(&out.svin, &s_want_svin); break;
+        case UBX_MSG_NAV_HPPOSLLH:  check_hpposllh(&out.hpposllh, &s_want_hpposllh); break;
+        case UBX_MSG_NAV_RELPOSNED: check_relposned(&out.relposned, &s_want_relposned); break;
+        case UBX_MSG_TIM_TP:        check_tim_tp(&out.tim_tp, &s_want_tim_tp); break;
+        default: CHECK(!"unexpected message"); break;
+        }
+        n++;
+    }
+    CHECK_EQ(n, 5);
+    CHECK_EQ(rx.week, 2357);
+    CHECK_EQ(rx.leap_ms, 18000);
+    CHECK_EQ(framer.stats.ubx_frames, 5);
+    CHECK_EQ(framer.stats.ubx_crc_errors, 0);
+}
+
+static void test_refused(void) {
+    uint8_t payload[128];
+    UBXNavRELPOSNED out;
+    memset(&out, 0x5A, sizeof(out));
+    UBXNavRELPOSNED untouched = out;
+
+    // Short payload
+    memcpy(payload, s_nav_relposned + 6, 64);
+    CHECK(!ubx_decode(UBX_MSG_NAV_RELPOSNED, payload, 63, &out));
+    // Version 0 is the 40-byte M8 layout
+    payload[0] = 0;
+    CHECK(!ubx_decode(UBX_MSG_NAV_RELPOSNED, payload, 64, &out));
+    CHECK(memcmp(&out, &untouched, sizeof(out)) == 0);
+
+    UBXNavPVT pvt;
+    CHECK(!ubx_decode(UBX_MSG_NAV_PVT, s_nav_pvt + 6, 91, &pvt));
+    // Longer payloads (newer firmware appending fields) still decode
+    memcpy(payload, s_nav_pvt + 6, 92);
+    CHECK(ubx_decode(UBX_MSG_NAV_PVT, payload, 100, &pvt));
+    check_pvt(&pvt, &s_want_pvt);
+
+    CHECK_EQ(ubx_msg_lookup(UBX_NAV_PVT_CLASS, UBX_NAV_PVT_ID), UBX_MSG_NAV_PVT);
+    CHECK_EQ(ubx_msg_lookup(UBX_TIM_TP_CLASS, UBX_TIM_TP_ID), UBX_MSG_TIM_TP);
+    CHECK_EQ(ubx_msg_lookup(0x01, 0x02), UBX_MSG_COUNT);   // NAV-POSLLH: not decoded
+    CHECK_EQ(ubx_msg_lookup(0x0D, 0x07), UBX_MSG_COUNT);
+}
+
+// Every frame of a receiver capture through the framer, the decoder and the consistency checks
+static void replay(const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        fprintf(stderr, "%s: cannot open\n", path);
+        CHECK(!"capture not readable");
+        return;
+    }
+    static rtk_framer_t framer;
+    rtk_framer_init(&framer);
+    receiver_t rx = { 0 };
+    uint8_t chunk[512];
+    size_t got;
+    while ((got = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+        CHECK_EQ(rtk_framer_push(&framer, chunk, got), got);
+        rtk_frame_t frame;
+        while (rtk_framer_next(&framer, &frame)) {
+            ubx_any_t out;
+            if (frame.type == RTK_FRAME_UBX) {
+                decode(&rx, &frame, &out);
+            }
+        }
+    }
+    fclose(file);
+
+    printf("%s:", path);
+    uint32_t decoded = 0;
+    for (int msg = 0; msg < UBX_MSG_COUNT; msg++) {
+        printf(" %s %lu", ubx_msg_desc(msg)->name, (unsigned long)rx.decoded[msg]);
+        decoded += rx.decoded[msg];
+    }
+    printf(", %lu UBX frames, %lu bad\n", (unsigned long)framer.stats.ubx_frames,
+           (unsigned long)framer.stats.ubx_crc_errors);
+    CHECK(decoded > 0);
+    CHECK_EQ(framer.stats.ubx_crc_errors, 0);
+}
+
+// test_ubx_decoder [capture.ubx ...]: the captures are replayed instead of the golden frames
+int main(int argc, char **argv) {
+    if (argc > 1) {
+        for (int i = 1; i < argc; i++) {
+            replay(argv[i]);
+        }
+        return test_result("test_ubx_decoder");
+    }
+    test_golden_frames();
+    test_refused();
+    return test_result("test_ubx_decoder");
+}
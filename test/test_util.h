@@ -0,0 +1,57 @@
+#ifndef TEST_UTIL_H
+#define TEST_UTIL_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+/*
+Minimal check macros for the host tests: a failed check prints where and why, and the test keeps
+going so one run reports every failure. main() returns test_result().
+*/
+
+static int s_test_failures;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+        s_test_failures++; \
+    } \
+} while (0)
+
+#define CHECK_EQ(a, b) do { \
+    long long _a = (long long)(a), _b = (long long)(b); \
+    if (_a != _b) { \
+        fprintf(stderr, "%s:%d: %s == %s failed: %lld != %lld\n", __FILE__, __LINE__, #a, #b, _a, _b); \
+        s_test_failures++; \
+    } \
+} while (0)
+
+#define CHECK_NEAR(a, b, tol) do { \
+    double _a = (double)(a), _b = (double)(b); \
+    if (!(_a - _b <= (tol) && _b - _a <= (tol))) { \
+        fprintf(stderr, "%s:%d: |%s - %s| <= %s failed: %g vs %g\n", __FILE__, __LINE__, #a, #b, #tol, _a, _b); \
+        s_test_failures++; \
+    } \
+} while (0)
+
+static inline int test_result(const char *name) {
+    if (s_test_failures) {
+        fprintf(stderr, "%s: %d check(s) failed\n", name, s_test_failures);
+        return 1;
+    }
+    printf("%s: ok\n", name);
+    return 0;
+}
+
+// Deterministic PRNG (xorshift32) so a failure reproduces
+static uint32_t s_rand_state = 0x12345678;
+
+static inline uint32_t test_rand(void) {
+    s_rand_state ^= s_rand_state << 13;
+    s_rand_state ^= s_rand_state >> 17;
+    s_rand_state ^= s_rand_state << 5;
+    return s_rand_state;
+}
+
+#endif // TEST_UTIL_H
@@ -0,0 +1,374 @@
+#include <string.h>
+#include "test_util.h"
+#include "wire.h"
+#include "mesh_dispatch.h"
+#include "mesh_tx.h"
+
+/*
+Packet headers, built twice (CMakeLists.txt): test_wire with senders on v1, test_wire_v2 with
+CONFIG_MESH_WIRE_V2_TX and CONFIG_MESH_WIRE_CRC. Either way receivers take both versions.
+
+Packets from wire_encode() of every size come back through wire_decode() and wire_packet_size() as
+sent, with the sequence number counting per type and the timestamp the GPS time when there is one;
+packets of the other version, built field by field, decode too. The CRC is CRC-16/CCITT-FALSE, and
+any bit flipped in the payload or CRC of a v2 packet is a CRC error, counted as a bad header by
+mesh_dispatch. A v1 node reads every v2 header as a type of 0x4000 or more, which it drops as
+unknown. Latency is right across the 16-bit timestamp wrap and refused past WIRE_MAX_LATENCY_US.
+Sequence numbers of v2 packets received by mesh_dispatch count gaps and late or repeated packets
+per sender and type, across the wrap, and start over when a sender jumps too far either way.
+*/
+
+#define SEQ_REORDER_WINDOW  256     // mesh_dispatch.c
+#define SEQ_MAX_GAP         4096
+
+static const mesh_addr_t PEER_A = { .addr = { 0x02, 0, 0, 0, 0, 0x0A } };
+static const mesh_addr_t PEER_B = { .addr = { 0x02, 0, 0, 0, 0, 0x0B } };
+
+// From modules not built here (protocol.c, gps_ptp_time.c, mesh_tx.c)
+const char *DATATAG = "DATA_TAG";
+
+static uint64_t s_gps_now_us;
+
+uint64_t gps_ptp_now_us(void) {
+    return s_gps_now_us;
+}
+
+esp_err_t mesh_tx_send(mesh_tx_class_t cls, const mesh_addr_t *to, int flag, ProtocolType type,
+                       const void *payload, uint16_t len) {
+    return ESP_OK;
+}
+
+static int s_handled;
+
+static void rx_count(const mesh_addr_t *from, const void *payload, size_t payload_len, pkt_buf_t *buf, void *arg) {
+    s_handled++;
+}
+
+static void fill_payload(uint8_t *payload, uint16_t len) {
+    for (uint16_t i = 0; i < len; i++) {
+        payload[i] = (uint8_t)(i * 31 + len);
+    }
+}
+
+// v2 packet built field by field, with the CRC if `flags` asks for it
+static size_t v2_packet(uint8_t *pkt, uint8_t type, uint8_t flags, uint16_t len, uint16_t seq, uint16_t timestamp) {
+    wire_header_v2_t h = {
+        .type = type, .flags = flags, .version = WIRE_VERSION_2, .length = len, .seq = seq, .timestamp = timestamp,
+    };
+    wire_header_v2_encode(&h, pkt);
+    fill_payload(pkt + WIRE_HEADER_V2_SIZE, len);
+    size_t size = WIRE_HEADER_V2_SIZE + len;
+    if (flags & WIRE_FLAG_CRC) {
+        uint16_t crc = wire_crc16(pkt, size);
+        pkt[size++] = (uint8_t)crc;
+        pkt[size++] = (uint8_t)(crc >> 8);
+    }
+    return size;
+}
+
+static size_t v1_packet(uint8_t *pkt, uint16_t type, uint16_t len) {
+    wire_header_v1_t h = { .type = type, .length = len };
+    wire_header_v1_encode(&h, pkt);
+    fill_payload(pkt + WIRE_HEADER_V1_SIZE, len);
+    return WIRE_HEADER_V1_SIZE + len;
+}
+
+static void test_crc16(void) {
+    CHECK_EQ(wire_crc16((const uint8_t *)"123456789", 9), 0x29B1);   // CRC-16/CCITT-FALSE check value
+    CHECK_EQ(wire_crc16(NULL, 0), 0xFFFF);
+    // Against a bitwise reference
+    uint8_t data[64];
+    for (int n = 0; n < 200; n++) {
+        size_t len = test_rand() % sizeof(data);
+        for (size_t i = 0; i < len; i++) {
+            data[i] = (uint8_t)test_rand();
+        }
+        uint16_t crc = 0xFFFF;
+        for (size_t i = 0; i < len; i++) {
+            crc ^= (uint16_t)data[i] << 8;
+            for (int b = 0; b < 8; b++) {
+                crc = crc & 0x8000 ? (uint16_t)(crc << 1) ^ 0x1021 : (uint16_t)(crc << 1);
+            }
+        }
+        CHECK_EQ(wire_crc16(data, len), crc);
+    }
+}
+
+static void test_encode_round_trip(void) {
+    static const uint16_t lens[] = { 0, 1, 2, 100, 1024, PKT_POOL_BUF_SIZE - WIRE_MAX_OVERHEAD };
+    static const ProtocolType types[] = { RTK_DATA, OTA_DATA, AGGREGATE, BOOT_REPORT };
+    static uint8_t pkt[PKT_POOL_BUF_SIZE + 8];
+    uint16_t seq[sizeof(types) / sizeof(types[0])] = { 0 };
+
+    for (int with_time = 0; with_time < 2; with_time++) {
+        s_gps_now_us = with_time ? 123456789012ULL : 0;
+        for (size_t t = 0; t < sizeof(types) / sizeof(types[0]); t++) {
+            for (size_t l = 0; l < sizeof(lens) / sizeof(lens[0]); l++) {
+                fill_payload(pkt + WIRE_TX_HDR_SIZE, lens[l]);
+                size_t size = wire_encode(pkt, types[t], lens[l]);
+                CHECK_EQ(size, WIRE_TX_OVERHEAD + lens[l]);
+
+                wire_hdr_t hdr;
+                CHECK_EQ(wire_decode(pkt, size, &hdr), WIRE_OK);
+                CHECK_EQ(hdr.type, types[t]);
+                CHECK_EQ(hdr.length, lens[l]);
+                CHECK_EQ(hdr.hdr_size, WIRE_TX_HDR_SIZE);
+                CHECK_EQ(wire_packet_size(pkt, size), size);
+                CHECK_EQ(wire_packet_size(pkt, size + 100), size);
+                CHECK_EQ(wire_packet_size(pkt, size - 1), 0);
+                CHECK_EQ(wire_decode(pkt, size + 1, &hdr), WIRE_ERR_LENGTH);
+                if (lens[l] > 0) {
+                    CHECK_EQ(wire_decode(pkt, size - 1, &hdr), WIRE_ERR_LENGTH);
+                }
+                uint8_t want[PKT_POOL_BUF_SIZE];
+                fill_payload(want, lens[l]);
+                CHECK(memcmp(pkt + hdr.hdr_size, want, lens[l]) == 0);
+#ifdef CONFIG_MESH_WIRE_V2_TX
+                CHECK_EQ(hdr.version, WIRE_VERSION_2);
+                CHECK_EQ(hdr.seq, seq[t]);
+                CHECK_EQ(hdr.flags & WIRE_FLAG_TIME, with_time ? WIRE_FLAG_TIME : 0);
+                if (with_time) {
+                    CHECK_EQ(hdr.timestamp, (uint16_t)(s_gps_now_us / WIRE_TIME_UNIT_US));
+                }
+#ifdef CONFIG_MESH_WIRE_CRC
+                CHECK_EQ(hdr.flags & WIRE_FLAG_CRC, WIRE_FLAG_CRC);
+#else
+                CHECK_EQ(hdr.flags & WIRE_FLAG_CRC, 0);
+#endif
+#else
+                CHECK_EQ(hdr.version, WIRE_VERSION_1);
+                CHECK_EQ(pkt[1], 0);
+#endif
+                seq[t]++;
+            }
+        }
+    }
+    s_gps_now_us = 0;
+}
+
+// Packets of both versions, whichever one this build sends
+static void test_decode_both(void) {
+    uint8_t pkt[64];
+    wire_hdr_t hdr;
+    size_t size = v1_packet(pkt, FW_REPORT, 20);
+    CHECK_EQ(wire_decode(pkt, size, &hdr), WIRE_OK);
+    CHECK_EQ(hdr.version, WIRE_VERSION_1);
+    CHECK_EQ(hdr.type, FW_REPORT);
+    CHECK_EQ(hdr.hdr_size, WIRE_HEADER_V1_SIZE);
+    CHECK_EQ(hdr.length, 20);
+    CHECK_EQ(wire_packet_size(pkt, size), size);
+
+    for (uint8_t flags = 0; flags < 4; flags++) {
+        size = v2_packet(pkt, PTP_DATA, flags, 20, 0xBEEF, 0x1234);
+        CHECK_EQ(size, WIRE_HEADER_V2_SIZE + 20 + ((flags & WIRE_FLAG_CRC) ? 2 : 0));
+        CHECK_EQ(wire_decode(pkt, size, &hdr), WIRE_OK);
+        CHECK_EQ(hdr.version, WIRE_VERSION_2);
+        CHECK_EQ(hdr.type, PTP_DATA);
+        CHECK_EQ(hdr.flags, flags);
+        CHECK_EQ(hdr.hdr_size, WIRE_HEADER_V2_SIZE);
+        CHECK_EQ(hdr.length, 20);
+        CHECK_EQ(hdr.seq, 0xBEEF);
+        CHECK_EQ(hdr.timestamp, 0x1234);
+        CHECK_EQ(wire_packet_size(pkt, size), size);
+        CHECK_EQ(wire_packet_size(pkt, size - 1), 0);
+    }
+
+    // Too short for either header, and versions nobody sends
+    CHECK_EQ(wire_decode(pkt, WIRE_HEADER_V1_SIZE - 1, &hdr), WIRE_ERR_SHORT);
+    CHECK_EQ(wire_decode(pkt, WIRE_HEADER_V2_SIZE - 1, &hdr), WIRE_ERR_SHORT);
+    CHECK_EQ(wire_packet_size(pkt, WIRE_HEADER_V2_SIZE - 1), 0);
+    for (uint8_t version = 0; version < 8; version++) {
+        if (version == WIRE_VERSION_1 || version == WIRE_VERSION_2) {
+            continue;
+        }
+        size = v2_packet(pkt, PTP_DATA, 0, 20, 0, 0);
+        pkt[1] = version << 5;
+        CHECK_EQ(wire_decode(pkt, size, &hdr), WIRE_ERR_VERSION);
+        CHECK_EQ(wire_packet_size(pkt, size), 0);
+    }
+}
+
+static void test_crc_errors(void) {
+    uint8_t pkt[64];
+    wire_hdr_t hdr;
+    mesh_dispatch_totals_t before, after;
+    size_t size = v2_packet(pkt, ECHO_DATA, WIRE_FLAG_CRC | WIRE_FLAG_TIME, 30, 7, 99);
+    CHECK_EQ(wire_decode(pkt, size, &hdr), WIRE_OK);
+    // Every bit of the payload, CRC, seq and timestamp: the length and flags would change the size
+    for (size_t byte = 4; byte < size; byte++) {
+        for (int bit = 0; bit < 8; bit++) {
+            pkt[byte] ^= 1 << bit;
+            CHECK_EQ(wire_decode(pkt, size, &hdr), WIRE_ERR_CRC);
+            pkt[byte] ^= 1 << bit;
+        }
+    }
+    // The type byte
+    pkt[0] ^= 0x04;
+    CHECK_EQ(wire_decode(pkt, size, &hdr), WIRE_ERR_CRC);
+
+    int handled = s_handled;
+    mesh_dispatch_get_totals(&before);
+    pkt_buf_t *buf = pkt_pool_alloc();
+    memcpy(buf->data, pkt, size);
+    buf->len = size;
+    mesh_dispatch_packet(&PEER_A, buf);
+    pkt[0] ^= 0x04;
+    memcpy(buf->data, pkt, size);
+    mesh_dispatch_packet(&PEER_A, buf);
+    pkt_buf_release(buf);
+    mesh_dispatch_get_totals(&after);
+    CHECK_EQ(after.bad_header - before.bad_header, 1);
+    CHECK_EQ(after.v2_packets - before.v2_packets, 1);
+    CHECK_EQ(s_handled, handled + 1);
+}
+
+// What firmware from before v2 makes of a v2 header: ProtocolHeader_t, type way beyond anything it knows
+static void test_v1_view_of_v2(void) {
+    uint8_t pkt[WIRE_HEADER_V2_SIZE + 2];
+    for (int type = 0; type < 256; type++) {
+        for (uint8_t flags = 0; flags < 32; flags++) {
+            v2_packet(pkt, (uint8_t)type, flags, 0, 0, 0);
+            wire_header_v1_t v1;
+            wire_header_v1_decode(pkt, &v1);
+            CHECK(v1.type >= 0x4000);
+            CHECK(v1.type >= MESH_DISPATCH_MAX_TYPES);
+        }
+    }
+}
+
+static bool latency(uint16_t sent_units, uint64_t now_us, uint32_t *latency_us) {
+    wire_hdr_t hdr = { .version = WIRE_VERSION_2, .flags = WIRE_FLAG_TIME, .timestamp = sent_units };
+    s_gps_now_us = now_us;
+    return wire_latency_us(&hdr, latency_us);
+}
+
+static void test_latency(void) {
+    const uint64_t WRAP_US = 0x10000ULL * WIRE_TIME_UNIT_US;
+    const uint64_t week_us = 20 * WRAP_US;          // Anywhere in the week
+    uint32_t us = 0;
+
+    CHECK(latency(0x1000, week_us + 0x1000 * WIRE_TIME_UNIT_US + 2550, &us));
+    CHECK_EQ(us, 2500);     // Whole units only
+    // Sent before the wrap, received after it
+    CHECK(latency(0xFFF0, week_us + WRAP_US + 0x10 * WIRE_TIME_UNIT_US, &us));
+    CHECK_EQ(us, 0x20 * WIRE_TIME_UNIT_US);
+    CHECK(latency(0xFFFF, week_us + WRAP_US, &us));
+    CHECK_EQ(us, WIRE_TIME_UNIT_US);
+    CHECK(latency(0, week_us, &us));
+    CHECK_EQ(us, 0);
+
+    // The limit, either side of the wrap
+    const uint16_t limit_units = WIRE_MAX_LATENCY_US / WIRE_TIME_UNIT_US;
+    CHECK(latency((uint16_t)(0x10 - limit_units), week_us + WRAP_US + 0x10 * WIRE_TIME_UNIT_US, &us));
+    CHECK_EQ(us, WIRE_MAX_LATENCY_US);
+    us = 1;
+    CHECK(!latency((uint16_t)(0x10 - limit_units - 1), week_us + WRAP_US + 0x10 * WIRE_TIME_UNIT_US, &us));
+    // Sent "after" it was received: clocks disagree, seen as nearly a whole wrap
+    CHECK(!latency(0x0011, week_us + 0x0010 * WIRE_TIME_UNIT_US, &us));
+    CHECK_EQ(us, 1);
+
+    // No GPS time here, none from the sender, or a v1 packet
+    CHECK(!latency(0x1000, 0, &us));
+    wire_hdr_t hdr = { .version = WIRE_VERSION_2, .timestamp = 0x1000 };
+    s_gps_now_us = week_us + 0x1000 * WIRE_TIME_UNIT_US;
+    CHECK(!wire_latency_us(&hdr, &us));
+    hdr = (wire_hdr_t){ .version = WIRE_VERSION_1, .flags = WIRE_FLAG_TIME, .timestamp = 0x1000 };
+    CHECK(!wire_latency_us(&hdr, &us));
+    CHECK_EQ(us, 1);
+    s_gps_now_us = 0;
+}
+
+// v2 packet with sequence number `seq` from `from`, through the dispatcher
+static void receive(const mesh_addr_t *from, ProtocolType type, uint16_t seq) {
+    pkt_buf_t *buf = pkt_pool_alloc();
+    buf->len = v2_packet(buf->data, type, WIRE_FLAG_TIME, 8, seq, (uint16_t)(s_gps_now_us / WIRE_TIME_UNIT_US));
+    mesh_dispatch_packet(from, buf);
+    pkt_buf_release(buf);
+}
+
+static void expect_seq(ProtocolType type, uint32_t gaps, uint32_t out_of_order) {
+    mesh_dispatch_stats_t st;
+    mesh_dispatch_get_stats(type, &st);
+    CHECK_EQ(st.seq_gaps, gaps);
+    CHECK_EQ(st.out_of_order, out_of_order);
+}
+
+static void test_track_seq(void) {
+    mesh_dispatch_stats_t st;
+    mesh_dispatch_stats_t echo_before;
+    mesh_dispatch_get_stats(ECHO_DATA, &echo_before);
+    s_gps_now_us = 1000000000ULL;
+    int handled = s_handled;
+
+    receive(&PEER_A, RTK_DATA, 10);
+    receive(&PEER_A, RTK_DATA, 11);
+    expect_seq(RTK_DATA, 0, 0);
+    receive(&PEER_A, RTK_DATA, 13);         // 12 missing
+    expect_seq(RTK_DATA, 1, 0);
+    receive(&PEER_A, RTK_DATA, 12);         // Late
+    receive(&PEER_A, RTK_DATA, 13);         // Repeated
+    expect_seq(RTK_DATA, 1, 2);
+    receive(&PEER_A, RTK_DATA, 14);
+    receive(&PEER_A, RTK_DATA, 20);         // 15..19 missing
+    expect_seq(RTK_DATA, 6, 2);
+    CHECK_EQ(s_handled, handled + 7);       // Late and repeated packets still dispatched
+
+    // Another sender, and another type of the same sender, counted on their own
+    receive(&PEER_B, RTK_DATA, 500);
+    receive(&PEER_B, RTK_DATA, 502);
+    expect_seq(RTK_DATA, 7, 2);
+    receive(&PEER_A, ECHO_DATA, 8);       // After the one of test_crc_errors()
+    receive(&PEER_A, RTK_DATA, 21);
+    receive(&PEER_A, ECHO_DATA, 9);
+    expect_seq(RTK_DATA, 7, 2);
+    mesh_dispatch_get_stats(ECHO_DATA, &st);
+    CHECK_EQ(st.seq_gaps - echo_before.seq_gaps, 0);
+    CHECK_EQ(st.out_of_order - echo_before.out_of_order, 0);
+
+    // Across the wrap
+    receive(&PEER_B, RTK_DATA, 0xFFFE);     // Far behind: the sender restarted
+    expect_seq(RTK_DATA, 7, 2);
+    receive(&PEER_B, RTK_DATA, 0xFFFF);
+    receive(&PEER_B, RTK_DATA, 0x0001);     // 0 missing
+    expect_seq(RTK_DATA, 8, 2);
+    receive(&PEER_B, RTK_DATA, 0x0000);
+    receive(&PEER_B, RTK_DATA, 0xFFFF);
+    expect_seq(RTK_DATA, 8, 4);
+
+    // Back by the whole reorder window, or further ahead than the largest gap: start over
+    receive(&PEER_A, RTK_DATA, 21 - SEQ_REORDER_WINDOW + 1);
+    expect_seq(RTK_DATA, 8, 5);
+    receive(&PEER_A, RTK_DATA, 21 - SEQ_REORDER_WINDOW);
+    receive(&PEER_A, RTK_DATA, 21 - SEQ_REORDER_WINDOW + 1);
+    expect_seq(RTK_DATA, 8, 5);
+    receive(&PEER_A, RTK_DATA, 21 - SEQ_REORDER_WINDOW + 1 + SEQ_MAX_GAP);      // The largest gap counted
+    expect_seq(RTK_DATA, 8 + SEQ_MAX_GAP - 1, 5);
+    receive(&PEER_A, RTK_DATA, 21 - SEQ_REORDER_WINDOW + 2 + 2 * SEQ_MAX_GAP);
+    receive(&PEER_A, RTK_DATA, 21 - SEQ_REORDER_WINDOW + 3 + 2 * SEQ_MAX_GAP);
+    expect_seq(RTK_DATA, 8 + SEQ_MAX_GAP - 1, 5);
+
+    // Sent and received at the same time
+    mesh_dispatch_get_stats(RTK_DATA, &st);
+    CHECK_EQ(st.latency_samples, 21);
+    CHECK_EQ(st.latency_max_us, 0);
+    s_gps_now_us = 0;
+}
+
+int main(void) {
+    CHECK_EQ(mesh_dispatch_init(), ESP_OK);
+    CHECK_EQ(mesh_dispatch_register(RTK_DATA, "RTK_DATA", 0, 64, rx_count, NULL), ESP_OK);
+    CHECK_EQ(mesh_dispatch_register(ECHO_DATA, "ECHO_DATA", 0, 64, rx_count, NULL), ESP_OK);
+
+    test_crc16();
+    test_encode_round_trip();
+    test_decode_both();
+    test_crc_errors();
+    test_v1_view_of_v2();
+    test_latency();
+    test_track_seq();
+#ifdef CONFIG_MESH_WIRE_V2_TX
+    return test_result("test_wire_v2");
+#else
+    return test_result("test_wire");
+#endif
+}